@@ -31,8 +31,11 @@ extern PVR_STATE pvrState;
 #ifdef __cplusplus
 
 #include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <mutex>
+#include <string>
 #include <thread>
 
 #include "Utils/StrUtils.h"
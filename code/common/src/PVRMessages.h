@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Utils/SharedBuffer.h"
+
+enum PVR_MSG {
+    PAIR_HMD,
+    PAIR_PHONE_CTRL,
+    PAIR_HMD_CTRLS,
+    PAIR_ACCEPT,
+    ADDITIONAL_DATA,
+    HEADER_NALS,
+    DISCONNECT,
+    STREAM_CONFIG,
+    POSE_DATA,     // multiplexed mode only, otherwise poses go over UDP
+    VIDEO_FRAME,   // multiplexed mode only, otherwise frames have their own TCP connection
+    PING,          // answered by TCPTalker itself, never passed to the receive callback
+    PONG,
+    AUDIO_CONFIG,
+    CLIENT_STATS,
+
+    PVR_MSG_COUNT
+};
+
+// Payload types of the TCPTalker messages. Fixed size payloads go on the wire as their memory
+// layout (PC and phones are all little endian), so they must not contain padding.
+namespace PVRMsg {
+    struct Empty {};
+
+    struct AdditionalData {
+        uint16_t renderWidth;   // max render target size of one eye
+        uint16_t renderHeight;
+        float projRect[4];   // left, top, right, bottom
+        float ipd;
+    };
+    static_assert(sizeof(AdditionalData) == 2 * 2 + 4 * 4 + 4, "AdditionalData has padding");
+
+    // sent by the PC before PAIR_ACCEPT, older PCs don't send it
+    struct StreamConfig {
+        uint8_t multiplexed;   // pose and video go through the talker connection
+        uint8_t halfRate;      // frames come at half the display rate, see Utils/Extrapolation.h
+        uint8_t poseCodec;     // the PC decodes Utils/PoseCodec.h packets, else send legacy ones
+        uint8_t multipath;     // the PC accepts video paths from the phone's other interfaces
+        // with multipath, the phone sends pose samples through every path, not just the first
+        uint8_t duplicatePoses;
+    };
+
+    struct Heartbeat {
+        int64_t sentTicks;   // sender's clock, echoed back unchanged in the PONG
+    };
+
+    // sent by the PC before PAIR_ACCEPT when it streams audio (see Utils/AudioCodec.h)
+    struct AudioConfig {
+        uint8_t codec;   // Audio::Codec
+        uint8_t channels;
+        uint16_t packetFrames;   // per datagram
+        uint32_t sampleRate;
+        uint16_t port;   // UDP, the phone receives on it
+        uint16_t reserved;
+    };
+    static_assert(sizeof(AudioConfig) == 12, "AudioConfig has padding");
+
+    // sent by the phone every CLIENT_STATS_MS while streaming, the PC picks its simulcast tier
+    // from it (see Utils/Simulcast.h)
+    const int CLIENT_STATS_MS = 500;
+    struct ClientStats {
+        uint32_t framesReceived;   // in the interval, handed to the decoder
+        uint32_t framesDecoded;
+        uint32_t framesLost;   // UDP video only, frames that never became complete
+        uint32_t decodeUs;     // mean time from decoder input to output
+    };
+
+    // In front of the NALs of every video frame, on the video TCP connections, in UDP frames
+    // (Utils/VideoTransport.h) and in VIDEO_FRAME messages. Probe trains (Utils/BandwidthProbe.h)
+    // start with one too. Senders and receivers work on it as bytes, with these offsets.
+    struct FrameHeader {
+        int64_t pts;
+        float quat[4];       // w, x, y, z of the pose the frame was rendered with
+        uint32_t size;       // of the NALs that follow
+        float fps[5];        // app, encoder, stream writer, streamer, renderer; shown on the phone
+        float delaysMs[2];   // render, encode
+        int64_t sentUs;      // PC system clock
+        int64_t poseId;      // timestamp of the pose sample the frame was rendered with, or 0
+    };
+    static_assert(sizeof(FrameHeader) == 8 + 16 + 4 + 20 + 8 + 8 + 8, "FrameHeader has padding");
+
+    // PAIR_HMD and PAIR_PHONE_CTRL carry the client version, but only in the UDP announcement
+    template <PVR_MSG M> struct Payload { using type = Empty; };
+    template <> struct Payload<ADDITIONAL_DATA> { using type = AdditionalData; };
+    template <> struct Payload<HEADER_NALS> { using type = SharedBuffer; };   // raw NALs
+    template <> struct Payload<STREAM_CONFIG> { using type = StreamConfig; };
+    template <> struct Payload<POSE_DATA> { using type = SharedBuffer; };     // PoseCodec packet
+    template <> struct Payload<VIDEO_FRAME> { using type = SharedBuffer; };   // header + NALs
+    template <> struct Payload<PING> { using type = Heartbeat; };
+    template <> struct Payload<PONG> { using type = Heartbeat; };
+    template <> struct Payload<AUDIO_CONFIG> { using type = AudioConfig; };
+    template <> struct Payload<CLIENT_STATS> { using type = ClientStats; };
+
+    // Bulk messages are always sent in chunks and give way to every other message between chunks.
+    inline bool isBulk(PVR_MSG type) { return type == VIDEO_FRAME; }
+
+    // sent many times per second, not worth a log line each
+    inline bool isFrequent(PVR_MSG type) {
+        return type == POSE_DATA || type == VIDEO_FRAME || type == PING || type == PONG ||
+               type == CLIENT_STATS;
+    }
+
+    template <PVR_MSG M> struct Message {
+        static constexpr PVR_MSG type = M;
+        typename Payload<M>::type data;
+    };
+
+    inline SharedBuffer encode(const Empty &) { return {}; }
+    inline SharedBuffer encode(const SharedBuffer &data) { return data; }
+    template <typename T> SharedBuffer encode(const T &payload) {
+        static_assert(std::is_trivially_copyable<T>::value, "payload needs its own encode()");
+        return SharedBuffer::copyOf(reinterpret_cast<const uint8_t *>(&payload), sizeof(T));
+    }
+
+    inline bool decode(const SharedBuffer &, Empty &) { return true; }
+    inline bool decode(const SharedBuffer &data, SharedBuffer &out) {
+        out = data;
+        return true;
+    }
+    // older PCs send fewer flags, the missing ones are off
+    inline bool decode(const SharedBuffer &data, StreamConfig &out) {
+        if (data.size() < offsetof(StreamConfig, halfRate))
+            return false;
+        out = {};
+        memcpy(&out, data.data(), (std::min)(data.size(), sizeof(out)));
+        return true;
+    }
+    // trailing bytes are ignored, so a payload can grow without breaking older peers
+    template <typename T> bool decode(const SharedBuffer &data, T &out) {
+        static_assert(std::is_trivially_copyable<T>::value, "payload needs its own decode()");
+        if (data.size() < sizeof(T))
+            return false;
+        memcpy(&out, data.data(), sizeof(T));
+        return true;
+    }
+
+    namespace detail {
+        template <PVR_MSG M, typename Handler>
+        bool invoke(Handler &handler, const SharedBuffer &data) {
+            if constexpr (std::is_invocable<Handler &, Message<M> &>::value) {
+                Message<M> msg;
+                if (!decode(data, msg.data))
+                    return false;
+                handler(msg);
+            }
+            return true;
+        }
+
+        template <typename Handler, size_t... I>
+        constexpr auto makeTable(std::index_sequence<I...>) {
+            using Fn = bool (*)(Handler &, const SharedBuffer &);
+            return std::array<Fn, sizeof...(I)>{&invoke<PVR_MSG(I), Handler>...};
+        }
+    }   // namespace detail
+
+    // Decodes data as the payload of `type` and calls the handler overload taking
+    // `Message<type> &` (or a const ref), through a jump table built at compile time for each
+    // handler type. Types the handler has no overload for are skipped. Returns false for unknown
+    // types and payloads that are too short.
+    template <typename Handler>
+    bool dispatch(Handler &handler, PVR_MSG type, const SharedBuffer &data) {
+        static constexpr auto table =
+            detail::makeTable<Handler>(std::make_index_sequence<PVR_MSG_COUNT>());
+        if ((unsigned) type >= PVR_MSG_COUNT)
+            return false;
+        return table[type](handler, data);
+    }
+
+    // Combines one lambda per handled message into a handler:
+    // Handlers{[](const Message<DISCONNECT> &) {...}, [](const Message<HEADER_NALS> &m) {...}}
+    template <typename... Fs> struct Handlers : Fs... { using Fs::operator()...; };
+    template <typename... Fs> Handlers(Fs...) -> Handlers<Fs...>;
+}   // namespace PVRMsg
@@ -9,9 +9,11 @@ using namespace std::chrono;
 
 // packetize TCP stream: "pvr" / msg type byte / data size (2 bytes) / data
 //  prefix -> 6 bytes
+// chunk of a big message: msg type | TALKER_CHUNK_FLAG, data = stream id (2 bytes) / total size
+//  (4 bytes) / chunk data
 
 TCPTalker::TCPTalker(uint16_t port,
-                     function<void(PVR_MSG, vector<uint8_t>)> recCb,
+                     function<void(PVR_MSG, SharedBuffer)> recCb,
                      function<void(std::error_code)> errCb,
                      bool isServer,
                      string ip) {
@@ -24,7 +26,13 @@ TCPTalker::TCPTalker(uint16_t port,
             io_service svc;
             tcp::socket skt(svc);
             _skt = &skt;
-            tcp::acceptor acc(svc, {tcp::v4(), port});
+            tcp::acceptor acc(svc);
+            if (isServer) {   // only the server listens, so both ends can run on one host
+                acc.open(tcp::v4());
+                acc.set_option(tcp::acceptor::reuse_address(true));
+                acc.bind({tcp::v4(), port});
+                acc.listen();
+            }
 
             asio::error_code ec = asio::error::fault;
             auto errHdl = [&](const asio::error_code &err) { ec = err; };
@@ -56,18 +64,20 @@ TCPTalker::TCPTalker(uint16_t port,
 
             if (ec.value() == 0) {
                 IP = skt.remote_endpoint().address().to_string();
+                skt.set_option(tcp::no_delay(true));   // messages are small and latency bound
 
-                const size_t bufsz = 256;
+                const size_t bufsz = 16 * 1024;
                 string prefix = "pvr";
-                uint8_t buf[bufsz];
+                vector<uint8_t> buf(bufsz);
                 vector<uint8_t> stream;
                 size_t msgLen = 0;
+                map<uint16_t, vector<uint8_t>> partials;   // stream id -> chunks so far
 
                 function<void(const asio::error_code &, size_t)> handle = [&](const asio::error_code
                                                                                   & /*err*/,
                                                                               size_t len) {
                     // PVR_DB_I("[TCPTalker::TCPTalker] Revd some data... Interpreting...");
-                    stream.insert(stream.end(), buf, buf + len);
+                    stream.insert(stream.end(), buf.begin(), buf.begin() + len);
                     bool loop = true;
                     while (loop) {
                         auto it = find_first_of(
@@ -78,18 +88,62 @@ TCPTalker::TCPTalker(uint16_t port,
                             if (stream.size() >=
                                 it - stream.begin() +
                                     msgLen) {   // warning! do not increment iterator out of bounds
-                                recCb(PVR_MSG(*(it - 3)), vector<uint8_t>(it, it + msgLen));
+                                uint8_t type = *(it - 3);
+                                heartbeat.onHeard(Clk::now());
+                                if (type == PVR_MSG::PING) {
+                                    // written here on the io thread, other writes are
+                                    // dispatched to it, so this can't interleave with them
+                                    vector<uint8_t> pong(it - 6, it + msgLen);
+                                    pong[3] = PVR_MSG::PONG;
+                                    asio::error_code pongEc;
+                                    write(skt, buffer(pong), pongEc);
+                                } else if (type == PVR_MSG::PONG) {
+                                    PVRMsg::Heartbeat beat;
+                                    if (PVRMsg::decode(vector<uint8_t>(it, it + msgLen), beat)) {
+                                        heartbeat.onPong(
+                                            Clk::time_point(Clk::duration(beat.sentTicks)),
+                                            Clk::now());
+                                        if (rttCb)
+                                            rttCb(heartbeat.srttMs(), heartbeat.rttVarMs());
+                                    }
+                                } else if (!(type & TALKER_CHUNK_FLAG))
+                                    recCb(PVR_MSG(type), vector<uint8_t>(it, it + msgLen));
+                                else if (msgLen >= 6) {
+                                    uint16_t id;
+                                    uint32_t total;
+                                    memcpy(&id, &*it, 2);
+                                    memcpy(&total, &*(it + 2), 4);
+                                    auto &part = partials[id];
+                                    if (part.empty() && total <= TALKER_MAX_MSG_SIZE)
+                                        part.reserve(total);   // single allocation per message
+                                    part.insert(part.end(), it + 6, it + msgLen);
+                                    if (total > TALKER_MAX_MSG_SIZE || part.size() > total) {
+                                        PVR_DB_I("[TCPTalker::TCPTalker] Dropping oversized "
+                                                 "message with ID:" +
+                                                 to_string(type & ~TALKER_CHUNK_FLAG));
+                                        partials.erase(id);
+                                    } else if (part.size() == total) {
+                                        recCb(PVR_MSG(type & ~TALKER_CHUNK_FLAG), move(part));
+                                        partials.erase(id);
+                                    }
+                                }
                                 stream.erase(stream.begin(), it + msgLen);
                             } else
                                 loop = false;
                         } else
                             loop = false;
                     }
-                    skt.async_read_some(buffer(buf, bufsz), handle);
+                    skt.async_read_some(buffer(buf), handle);
                 };
-                skt.async_read_some(buffer(buf, bufsz), handle);
+                skt.async_read_some(buffer(buf), handle);
                 PVR_DB_I("[TCPTalker::TCPTalker] Talker is Connected. Trying to read some data...");
+                svcMtx.lock();
+                _svc = &svc;
+                svcMtx.unlock();
                 svc.run();
+                svcMtx.lock();
+                _svc = nullptr;
+                svcMtx.unlock();
             }
             if (ec.value() != 0)
                 errCb(ec);
@@ -111,12 +165,14 @@ void TCPTalker::safeDispatch(function<void()> hdl) {
         sktMtx.lock();
         if (_skt) {
             bool done = false;
-            _skt->get_io_service().dispatch([&] {
+            asio::dispatch(_skt->get_executor(), [&] {
                 hdl();
+                lock_guard<mutex> lock(dispatchMtx);
                 done = true;
+                dispatchCond.notify_all();
             });
-            while (!done)
-                sleep_for(milliseconds(10));
+            unique_lock<mutex> lock(dispatchMtx);
+            dispatchCond.wait(lock, [&] { return done; });
         }
         sktMtx.unlock();
     } catch (exception &e) {
@@ -124,23 +180,64 @@ void TCPTalker::safeDispatch(function<void()> hdl) {
     }
 }
 
-bool TCPTalker::send(PVR_MSG msgType, vector<uint8_t> data) {
-    vector<uint8_t> buf = {'p', 'v', 'r', (uint8_t) msgType, 0, 0};
-    auto sz = data.size();
-    memcpy(&buf[4], &sz, 2);
-    buf.insert(buf.end(), data.begin(), data.end());
+// Header and payload go out as one gathered write, the payload is never copied.
+bool TCPTalker::send(PVR_MSG msgType, SharedBuffer data) {
+    bool bulk = PVRMsg::isBulk(msgType);
+    if (!bulk && data.size() <= TALKER_CHUNK_SIZE) {
+        vector<uint8_t> header = {'p', 'v', 'r', (uint8_t) msgType, 0, 0};
+        auto sz = data.size();
+        memcpy(&header[4], &sz, 2);
+
+        directPending++;
+        bool success = sendRaw(header, data);
+        directPending--;
+        return success;
+    }
+
+    if (data.size() > TALKER_MAX_MSG_SIZE) {
+        PVR_DB_I("[TCPTalker::send] Msg too big with ID:" + to_string(msgType) +
+                 ", size: " + to_string(data.size()));
+        return false;
+    }
+
+    uint16_t id = nextStreamId++;
+    uint32_t total = (uint32_t) data.size();
+    size_t chunkSize = bulk ? TALKER_BULK_CHUNK_SIZE : TALKER_CHUNK_SIZE;
+    for (size_t offset = 0; offset < data.size(); offset += chunkSize) {
+        // let messages queued meanwhile go first
+        while (directPending > 0)
+            sleep_for(microseconds(100));
+
+        auto chunk = data.slice(offset, chunkSize);
+        vector<uint8_t> header = {'p', 'v', 'r', (uint8_t) (msgType | TALKER_CHUNK_FLAG), 0, 0};
+        auto sz = chunk.size() + 6;
+        memcpy(&header[4], &sz, 2);
+        header.resize(6 + 6);
+        memcpy(&header[6], &id, 2);
+        memcpy(&header[8], &total, 4);
+        if (!sendRaw(header, chunk))
+            return false;
+    }
+    if (!bulk)
+        PVR_DB_I("[TCPTalker::send] Msg Sent with ID:" + to_string(msgType) + " in " +
+                 to_string((data.size() + chunkSize - 1) / chunkSize) + " chunks");
+    return true;
+}
 
+bool TCPTalker::sendRaw(const vector<uint8_t> &header, const SharedBuffer &data) {
     bool success = false;
     safeDispatch([&] {
         if (_skt->is_open()) {
             asio::error_code ec;
-            write(*_skt, buffer(buf), ec);
+            array<const_buffer, 2> bufs = {buffer(header), buffer(data.data(), data.size())};
+            write(*_skt, bufs, ec);
             success = ec.value() == 0;
             if (ec.value()) {
                 PVR_DB_I("[TCPTalker::send] Error Sending EC(" + to_string(ec.value()) +
                          "): " + ec.message());
-            } else {
-                PVR_DB_I("[TCPTalker::send] Msg Sent with ID:" + to_string(buf[3]));
+            } else if (!(header[3] & TALKER_CHUNK_FLAG) &&
+                       !PVRMsg::isFrequent(PVR_MSG(header[3]))) {
+                PVR_DB_I("[TCPTalker::send] Msg Sent with ID:" + to_string(header[3]));
             }
         } else {
             PVR_DB_I("[TCPTalker::send] Error Sending: Socket is not open");
@@ -149,8 +246,61 @@ bool TCPTalker::send(PVR_MSG msgType, vector<uint8_t> data) {
     return success;
 }
 
+// Posted to the io thread without waiting for it, so a send stuck on a full socket can't hold up
+// the liveness check. A ping still queued behind such a send is not queued twice.
+void TCPTalker::postPing() {
+    lock_guard<mutex> lock(svcMtx);
+    if (!_svc || pingQueued)
+        return;
+    pingQueued = true;
+    asio::post(*_svc, [this] {
+        PVRMsg::Heartbeat beat = {Clk::now().time_since_epoch().count()};
+        vector<uint8_t> ping = {'p', 'v', 'r', PVR_MSG::PING, sizeof(beat), 0};
+        ping.resize(6 + sizeof(beat));
+        memcpy(&ping[6], &beat, sizeof(beat));
+        asio::error_code ec;
+        write(*_skt, buffer(ping), ec);
+        pingQueued = false;
+    });
+}
+
+void TCPTalker::startHeartbeat(milliseconds period,
+                               function<void(double, double)> rttCallback,
+                               function<void()> deadCb) {
+    if (beatThr || period.count() <= 0)
+        return;
+    rttCb = rttCallback;
+    heartbeat.reset(period, Clk::now());
+    beating = true;
+    beatThr = new std::thread([=] {
+        auto nextPing = Clk::now();
+        bool dead = false;
+        while (true) {
+            if (Clk::now() >= nextPing) {
+                postPing();
+                nextPing += period;
+            }
+            if (!dead && !heartbeat.alive(Clk::now())) {
+                dead = true;
+                PVR_DB_I("[TCPTalker::heartbeat] Peer stopped answering, srtt " +
+                         to_string(heartbeat.srttMs()) + " ms");
+                deadCb();
+            }
+            // check liveness more often than pinging so a loss is noticed soon after the deadline
+            unique_lock<mutex> lock(beatMtx);
+            if (beatCond.wait_for(lock, period / 4, [&] { return !beating; }))
+                break;
+        }
+    });
+}
+
 TCPTalker::~TCPTalker() {
-    safeDispatch([=] { _skt->get_io_service().stop(); });
+    beatMtx.lock();
+    beating = false;
+    beatMtx.unlock();
+    beatCond.notify_all();
+    EndThread(beatThr);
+    safeDispatch([=] { static_cast<io_context &>(_skt->get_executor().context()).stop(); });
     EndThread(thr);
 }
 
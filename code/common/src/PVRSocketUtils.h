@@ -1,23 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <mutex>
 #include <thread>
 
-#include "PVRGlobals.h"
-
+// before PVRGlobals.h, its crypt() macro breaks the declaration in the Linux unistd.h
 #define WIN32_LEAN_AND_MEAN
 #define ASIO_STANDALONE
 #include "asio.hpp"
 
-enum PVR_MSG {
-    PAIR_HMD,
-    PAIR_PHONE_CTRL,
-    PAIR_HMD_CTRLS,
-    PAIR_ACCEPT,
-    ADDITIONAL_DATA,
-    HEADER_NALS,
-    DISCONNECT,
-};
+#include "PVRGlobals.h"
+#include "PVRMessages.h"
+#include "Utils/Heartbeat.h"
+
+// Messages bigger than TALKER_CHUNK_SIZE are sent as a series of chunks (type byte with
+// TALKER_CHUNK_FLAG set, data prefixed with stream id and total size) and reassembled on the other
+// side, so multi-megabyte payloads neither overflow the 16 bit length field nor hold up small
+// messages, which are written between chunks.
+const uint8_t TALKER_CHUNK_FLAG = 0x80;
+const size_t TALKER_CHUNK_SIZE = 16 * 1024;
+const size_t TALKER_BULK_CHUNK_SIZE = 4 * 1024;   // other messages wait for one of these at most
+const size_t TALKER_MAX_MSG_SIZE = 64 * 1024 * 1024;
 
 class TCPTalker {
     std::thread *thr;
@@ -25,20 +30,49 @@ class TCPTalker {
     asio::ip::tcp::socket *_skt =
         nullptr;   // warning: any call to this must be wrapped in svc->post()
     std::string IP;
+    std::mutex svcMtx;                  // held only to post, never while writing
+    asio::io_context *_svc = nullptr;   // while connected
+
+    std::mutex dispatchMtx;
+    std::condition_variable dispatchCond;
+    std::atomic<int> directPending{0};   // unchunked sends waiting, chunked sends yield to them
+    std::atomic<uint16_t> nextStreamId{0};
+
+    HeartbeatMonitor heartbeat;
+    std::thread *beatThr = nullptr;
+    std::mutex beatMtx;
+    std::condition_variable beatCond;
+    bool beating = false;
+    std::atomic<bool> pingQueued{false};
+    std::function<void(double srttMs, double rttVarMs)> rttCb;
 
     void safeDispatch(std::function<void()> hdl);
+    bool sendRaw(const std::vector<uint8_t> &header, const SharedBuffer &data);
+    void postPing();
 
   public:
     TCPTalker(uint16_t port,
-              std::function<void(PVR_MSG msgType, std::vector<uint8_t> inData)> receiveCallback,
+              std::function<void(PVR_MSG msgType, SharedBuffer inData)> receiveCallback,
               std::function<void(std::error_code err)> errCb,
               bool isServer,
               std::string ip = "");
     ~TCPTalker();
 
-    bool send(PVR_MSG msgType, std::vector<uint8_t> outData = {});
+    bool send(PVR_MSG msgType, SharedBuffer outData = {});
+
+    template <PVR_MSG M> bool send(const typename PVRMsg::Payload<M>::type &payload) {
+        return send(M, PVRMsg::encode(payload));
+    }
 
     std::string getIP() { return IP; }
+
+    // Pings the peer every period (PONGs are sent by any TCPTalker). rttCb gets the smoothed RTT
+    // after every PONG, deadCb is called once when the peer stops answering. Not restartable.
+    void startHeartbeat(std::chrono::milliseconds period,
+                        std::function<void(double srttMs, double rttVarMs)> rttCb,
+                        std::function<void()> deadCb);
+    double rttMs() { return heartbeat.srttMs(); }
+    double rttVarMs() { return heartbeat.rttVarMs(); }
 };
 
 typedef unsigned long uint32;
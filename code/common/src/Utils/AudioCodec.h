@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "AudioSource.h"
+
+#ifdef PVR_OPUS
+#include "opus.h"
+#endif
+
+// Audio goes out in datagrams of one encoded packet each, on its own UDP port:
+// PacketHeader / payload. Sequence numbers tell losses from pauses of the source, positions
+// place the packet on the video pts timeline (in frames rather than microseconds, so packets of
+// one run line up exactly).
+//
+// PCM is the shipped codec, ~1.5 Mbps: the PC project doesn't link libopus, and for that much
+// traffic next to the video audio is off unless the "audio" setting turns it on. Defining
+// PVR_OPUS there and linking it switches the PC to Opus, RESTRICTED_LOWDELAY only adds 2.5 ms of
+// lookahead to the packet length. Phones decode Opus either way, with MediaCodec when PVR_OPUS
+// isn't defined.
+namespace Audio {
+    enum Codec : uint8_t { PCM16, OPUS };
+
+    struct PacketHeader {
+        int64_t position;   // first frame, pts (us) * SAMPLE_RATE / 1'000'000
+        uint32_t seq;       // per datagram, gaps are losses
+        uint16_t frames;
+        uint8_t codec;
+        uint8_t reserved;
+    };
+    static_assert(sizeof(PacketHeader) == 16, "PacketHeader has padding");
+
+    const size_t MAX_PAYLOAD = 1200;     // one datagram below the usual MTU
+    const int MAX_PACKET_FRAMES = 480;   // 10 ms
+
+    inline int64_t ptsToPosition(int64_t ptsUs) { return ptsUs * SAMPLE_RATE / 1'000'000; }
+    inline int64_t positionToPts(int64_t position) { return position * 1'000'000 / SAMPLE_RATE; }
+
+    // Packet sizes Opus can encode, in frames: 2.5, 5 and 10 ms (20 ms is too long to wait for).
+    // PCM stops at 5 ms, longer packets don't fit MAX_PAYLOAD.
+    inline int packetFrames(Codec codec, double packetMs) {
+        int frames = packetMs <= 2.5 ? 120 : packetMs <= 5 ? 240 : MAX_PACKET_FRAMES;
+        return codec == PCM16 ? (std::min)(frames, 240) : frames;
+    }
+
+    class Encoder {
+      public:
+        virtual ~Encoder() = default;
+        virtual Codec codec() const = 0;
+
+        // Encodes one packet, returns the payload size, 0 on failure.
+        virtual size_t encode(const int16_t *pcm, int frames, uint8_t *out, size_t outSize) = 0;
+    };
+
+    class Decoder {
+      public:
+        virtual ~Decoder() = default;
+
+        // Decodes one packet into pcm, returns the number of frames, 0 on failure.
+        virtual int decode(const uint8_t *data, size_t size, int16_t *pcm, int maxFrames) = 0;
+    };
+
+    class PcmEncoder : public Encoder {
+      public:
+        Codec codec() const override { return PCM16; }
+
+        size_t encode(const int16_t *pcm, int frames, uint8_t *out, size_t outSize) override {
+            size_t size = (size_t) frames * CHANNELS * 2;
+            if (size > outSize)
+                return 0;
+            memcpy(out, pcm, size);
+            return size;
+        }
+    };
+
+    class PcmDecoder : public Decoder {
+      public:
+        int decode(const uint8_t *data, size_t size, int16_t *pcm, int maxFrames) override {
+            int frames = (std::min)((int) (size / (CHANNELS * 2)), maxFrames);
+            memcpy(pcm, data, (size_t) frames * CHANNELS * 2);
+            return frames;
+        }
+    };
+
+#ifdef PVR_OPUS
+    class LibOpusEncoder : public Encoder {
+        OpusEncoder *enc = nullptr;
+
+      public:
+        explicit LibOpusEncoder(int kbps) {
+            int err;
+            enc = opus_encoder_create(
+                SAMPLE_RATE, CHANNELS, OPUS_APPLICATION_RESTRICTED_LOWDELAY, &err);
+            if (err != OPUS_OK)
+                throw std::runtime_error(std::string("opus encoder: ") + opus_strerror(err));
+            opus_encoder_ctl(enc, OPUS_SET_BITRATE(kbps * 1000));
+            opus_encoder_ctl(enc, OPUS_SET_COMPLEXITY(5));   // ~1% of a core at 5 ms packets
+        }
+        ~LibOpusEncoder() override { opus_encoder_destroy(enc); }
+
+        Codec codec() const override { return OPUS; }
+
+        size_t encode(const int16_t *pcm, int frames, uint8_t *out, size_t outSize) override {
+            auto size = opus_encode(enc, pcm, frames, out, (opus_int32) outSize);
+            return size > 0 ? (size_t) size : 0;
+        }
+    };
+
+    class LibOpusDecoder : public Decoder {
+        OpusDecoder *dec = nullptr;
+
+      public:
+        LibOpusDecoder() {
+            int err;
+            dec = opus_decoder_create(SAMPLE_RATE, CHANNELS, &err);
+            if (err != OPUS_OK)
+                throw std::runtime_error(std::string("opus decoder: ") + opus_strerror(err));
+        }
+        ~LibOpusDecoder() override { opus_decoder_destroy(dec); }
+
+        int decode(const uint8_t *data, size_t size, int16_t *pcm, int maxFrames) override {
+            auto frames = opus_decode(dec, data, (opus_int32) size, pcm, maxFrames, 0);
+            return (std::max)(frames, 0);
+        }
+    };
+#endif
+
+    // Opus when it's built in, PCM otherwise. kbps is for Opus only.
+    inline std::unique_ptr<Encoder> makeEncoder([[maybe_unused]] Codec codec,
+                                                [[maybe_unused]] int kbps) {
+#ifdef PVR_OPUS
+        if (codec == OPUS)
+            return std::unique_ptr<Encoder>(new LibOpusEncoder(kbps));
+#endif
+        return std::unique_ptr<Encoder>(new PcmEncoder());
+    }
+
+    // nullptr for codecs that aren't built in
+    inline std::unique_ptr<Decoder> makeDecoder(Codec codec) {
+#ifdef PVR_OPUS
+        if (codec == OPUS)
+            return std::unique_ptr<Decoder>(new LibOpusDecoder());
+#endif
+        if (codec == PCM16)
+            return std::unique_ptr<Decoder>(new PcmDecoder());
+        return nullptr;
+    }
+}   // namespace Audio
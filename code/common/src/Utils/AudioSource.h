@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ThreadUtils.h"
+
+// Audio is 16 bit interleaved PCM, SAMPLE_RATE frames (one sample per channel) per second, on
+// both ends. A Source hands it out in blocks as it is captured, each with the time of its first
+// frame on Clk.
+namespace Audio {
+    const int SAMPLE_RATE = 48000;
+    const int CHANNELS = 2;
+
+    inline int64_t framesToNs(int64_t frames) { return frames * 1'000'000'000 / SAMPLE_RATE; }
+    inline int64_t nsToFrames(int64_t ns) { return ns * SAMPLE_RATE / 1'000'000'000; }
+
+    class Source {
+      public:
+        virtual ~Source() = default;
+
+        // Blocks until `frames` frames are captured and writes them to pcm, false when the
+        // source failed or ended.
+        virtual bool read(int16_t *pcm, int frames, Clk::time_point &captureTime) = 0;
+    };
+
+    // Generated audio handed out in real time, as if it was captured.
+    class PacedSource : public Source {
+        Clk::time_point start;
+        int64_t position = -1;   // frames handed out
+
+      protected:
+        virtual void generate(int16_t *pcm, int frames, int64_t position) = 0;
+
+      public:
+        bool read(int16_t *pcm, int frames, Clk::time_point &captureTime) override {
+            if (position < 0) {
+                start = Clk::now();
+                position = 0;
+            }
+            captureTime = start + std::chrono::nanoseconds(framesToNs(position));
+            // a block is captured once its last frame is
+            std::this_thread::sleep_until(start +
+                                          std::chrono::nanoseconds(framesToNs(position + frames)));
+            generate(pcm, frames, position);
+            position += frames;
+            return true;
+        }
+    };
+
+    // Sine tone with a full scale click of CLICK_FRAMES every clickPeriod frames (0: none), the
+    // clicks mark known capture times at the output.
+    class SyntheticSource : public PacedSource {
+        double frequency;
+        int64_t clickPeriod;
+
+      protected:
+        void generate(int16_t *pcm, int frames, int64_t position) override {
+            const double twoPi = 6.283185307179586;
+            for (int i = 0; i < frames; i++) {
+                int64_t pos = position + i;
+                int16_t v = (int16_t) (8000 * std::sin(twoPi * frequency * pos / SAMPLE_RATE));
+                if (clickPeriod > 0 && pos % clickPeriod < CLICK_FRAMES)
+                    v = 32000;
+                for (int c = 0; c < CHANNELS; c++)
+                    pcm[i * CHANNELS + c] = v;
+            }
+        }
+
+      public:
+        static const int CLICK_FRAMES = 48;   // 1 ms
+
+        SyntheticSource(double frequency = 440, int64_t clickPeriod = 0)
+            : frequency(frequency), clickPeriod(clickPeriod) {}
+    };
+
+    // A 16 bit PCM WAV file played in a loop. Other rates are resampled linearly, mono is
+    // copied to both channels and channels past CHANNELS are dropped.
+    class WavSource : public PacedSource {
+        std::vector<int16_t> samples;   // converted, CHANNELS interleaved
+
+      protected:
+        void generate(int16_t *pcm, int frames, int64_t position) override {
+            auto total = (int64_t) (samples.size() / CHANNELS);
+            for (int i = 0; i < frames; i++)
+                memcpy(&pcm[i * CHANNELS],
+                       &samples[((position + i) % total) * CHANNELS],
+                       CHANNELS * sizeof(int16_t));
+        }
+
+      public:
+        explicit WavSource(const std::string &path) {
+            std::ifstream file(path, std::ios::binary);
+            char riff[12];
+            if (!file.read(riff, 12) || memcmp(riff, "RIFF", 4) != 0 ||
+                memcmp(riff + 8, "WAVE", 4) != 0)
+                throw std::runtime_error("not a WAV file: " + path);
+
+            uint16_t format = 0, channels = 0, bits = 0;
+            uint32_t rate = 0;
+            std::vector<int16_t> data;
+            char id[4];
+            uint32_t size;
+            while (file.read(id, 4) && file.read(reinterpret_cast<char *>(&size), 4)) {
+                if (memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+                    std::vector<char> fmt(size);
+                    file.read(fmt.data(), size);
+                    memcpy(&format, &fmt[0], 2);
+                    memcpy(&channels, &fmt[2], 2);
+                    memcpy(&rate, &fmt[4], 4);
+                    memcpy(&bits, &fmt[14], 2);
+                } else if (memcmp(id, "data", 4) == 0) {
+                    data.resize(size / 2);
+                    file.read(reinterpret_cast<char *>(data.data()), data.size() * 2);
+                    break;
+                } else
+                    file.seekg(size + (size & 1), std::ios::cur);   // chunks are word aligned
+            }
+            // WAVE_FORMAT_EXTENSIBLE (0xFFFE) files are usually plain PCM too
+            if ((format != 1 && format != 0xFFFE) || bits != 16 || channels == 0 || rate == 0)
+                throw std::runtime_error("only 16 bit PCM WAV files are supported: " + path);
+            size_t inFrames = data.size() / channels;
+            if (inFrames == 0)
+                throw std::runtime_error("empty WAV file: " + path);
+
+            auto outFrames = (size_t) ((double) inFrames * SAMPLE_RATE / rate);
+            samples.resize((std::max<size_t>)(outFrames, 1) * CHANNELS);
+            for (size_t i = 0; i * CHANNELS < samples.size(); i++) {
+                double src = (double) i * rate / SAMPLE_RATE;
+                auto i0 = (std::min)((size_t) src, inFrames - 1);
+                auto i1 = (std::min)(i0 + 1, inFrames - 1);
+                double frac = src - (double) i0;
+                for (int c = 0; c < CHANNELS; c++) {
+                    int ch = (std::min)(c, channels - 1);
+                    samples[i * CHANNELS + c] =
+                        (int16_t) (data[i0 * channels + ch] * (1 - frac) +
+                                   data[i1 * channels + ch] * frac);
+                }
+            }
+        }
+    };
+}   // namespace Audio
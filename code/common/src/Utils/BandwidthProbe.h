@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Startup link probe, run on the video TCP channel right after the client connects and before the
+// first frame. The server sends packet trains of growing size, each with a regular frame header
+// whose pts is PROBE_PTS and whose size field is the train size. The client reads the train and
+// answers with a ProbeReply on the same socket. Trains stop once one takes long enough to give a
+// stable throughput figure.
+namespace BandwidthProbe {
+    const int64_t PROBE_PTS = -1;   // never a valid frame pts
+
+    const size_t MAX_TRAIN_SIZE = 1 << 20;
+    const size_t TRAIN_SIZES[] = {
+        0, 32 << 10, 64 << 10, 128 << 10, 256 << 10, 512 << 10, MAX_TRAIN_SIZE};
+    const int64_t ENOUGH_US = 200'000;   // a train this long is a good enough measurement
+
+    struct ProbeReply {
+        uint32_t bytes;       // train size as received
+        uint32_t receiveUs;   // client time from end of header to end of train
+    };
+
+    struct Result {
+        double throughputBps = 0;   // bytes per second
+        double baseRttMs = 0;
+        double queuingDelayMs = 0;   // latency added under load, on top of base RTT and transfer
+        bool valid() const { return throughputBps > 0; }
+    };
+
+    class Estimator {
+        struct Sample {
+            size_t bytes;
+            int64_t receiveUs;
+            int64_t rttUs;   // server time from first byte written to reply received
+        };
+        std::vector<Sample> samples;
+
+      public:
+        void add(size_t bytes, int64_t receiveUs, int64_t rttUs) {
+            samples.push_back({bytes, receiveUs, rttUs});
+        }
+
+        bool done() const { return !samples.empty() && samples.back().receiveUs >= ENOUGH_US; }
+
+        // The largest train gives the throughput (short trains are dominated by timer resolution
+        // and TCP slow start), the empty one the base RTT.
+        Result result() const {
+            Result res;
+            const Sample *base = nullptr, *largest = nullptr;
+            for (auto &s : samples) {
+                if (s.bytes == 0)
+                    base = &s;
+                else if (s.receiveUs > 0 && (!largest || s.bytes > largest->bytes))
+                    largest = &s;
+            }
+            if (!largest)
+                return res;
+            res.throughputBps = largest->bytes * 1e6 / largest->receiveUs;
+            res.baseRttMs = base ? base->rttUs / 1000.0 : 0;
+            res.queuingDelayMs =
+                (std::max)(0.0, (largest->rttUs - largest->receiveUs) / 1000.0 - res.baseRttMs);
+            return res;
+        }
+    };
+}   // namespace BandwidthProbe
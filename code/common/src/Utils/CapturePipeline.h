@@ -0,0 +1,206 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ThreadUtils.h"
+
+// Capture of the app's frames for the encoder, pipelined over a few staging slots: Present only
+// waits until the copy of its shared texture is queued, the color conversion and the readback of
+// a frame run while the app renders and the encoder encodes the next ones.
+//
+// A frame holds a staging slot from begin() until its readback is complete, and writes one of
+// the output buffers the encoder reads. A completion thread waits on the backend's fences in
+// submit order and hands finished buffers to the encoder, which always takes the newest one.
+namespace CapturePipeline {
+    // the GPU work, D3D11 and C++ AMP on the PC
+    class Backend {
+      public:
+        virtual ~Backend() = default;
+
+        // Queues the copy of the shared texture into the staging slot, the app may render into it
+        // again once this returns. False if it could not be locked in time, the slot keeps the
+        // last frame it had.
+        virtual bool copy(uint64_t handle, int slot) = 0;
+
+        // queues the conversion of the slot into output buffer `out` and its readback, fenced
+        virtual void convert(int slot, int out) = 0;
+
+        // blocks until the readback of the slot's last conversion is complete
+        virtual void wait(int slot) = 0;
+    };
+
+    class Pipeline {
+      public:
+        struct Ticket {
+            int slot = -1, out = -1;   // -1: stopped
+        };
+
+      private:
+        enum State : uint8_t { FREE, WRITING, READY, READING };
+
+        std::unique_ptr<Backend> backend;
+        std::function<void(int)> onReady;   // on the completion thread, before acquire() sees it
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<int> freeSlots;
+        std::vector<State> outputs;
+        std::vector<uint64_t> readyOrder;   // of the READY outputs
+        std::deque<Ticket> inFlight;        // committed, in submit order
+        uint64_t completed = 0;
+        int pending = 0;       // tickets between begin() and the end of commit()
+        int overwritten = 0;   // READY frames begin() reused, the encoder never saw them
+        uint32_t failedCopies = 0;
+        bool running = true;
+        std::thread completer;
+
+        // a free output, else the oldest frame the encoder didn't take yet, -1 if neither
+        int pickOutput() const {
+            int pick = -1;
+            for (int i = 0; i < (int) outputs.size(); i++) {
+                if (outputs[i] == FREE)
+                    return i;
+                if (outputs[i] == READY && (pick < 0 || readyOrder[i] < readyOrder[pick]))
+                    pick = i;
+            }
+            return pick;
+        }
+
+        void complete() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true) {
+                cv.wait(lock, [&] { return !inFlight.empty() || (!running && pending == 0); });
+                if (inFlight.empty())
+                    return;
+                auto t = inFlight.front();
+                lock.unlock();
+                backend->wait(t.slot);
+                if (onReady)
+                    onReady(t.out);
+                lock.lock();
+                inFlight.pop_front();
+                freeSlots.push_back(t.slot);
+                outputs[t.out] = READY;
+                readyOrder[t.out] = ++completed;
+                cv.notify_all();
+            }
+        }
+
+      public:
+        // buffers > slots + 1: the encoder reads one while every slot writes another
+        Pipeline(std::unique_ptr<Backend> backend,
+                 int slots,
+                 int buffers,
+                 std::function<void(int)> onReady = nullptr)
+            : backend(std::move(backend)), onReady(std::move(onReady)), outputs(buffers, FREE),
+              readyOrder(buffers) {
+            for (int i = slots - 1; i >= 0; i--)
+                freeSlots.push_back(i);
+            completer = std::thread([this] { complete(); });
+        }
+
+        ~Pipeline() { stop(); }
+
+        // Reserves a staging slot and an output buffer for a frame, blocks while all slots are in
+        // flight. The caller fills in what goes with the buffer and then commits the ticket.
+        Ticket begin() {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return (!freeSlots.empty() && pickOutput() >= 0) || !running; });
+            if (!running)
+                return {};
+            Ticket t;
+            t.slot = freeSlots.back();
+            freeSlots.pop_back();
+            t.out = pickOutput();
+            overwritten += outputs[t.out] == READY ? 1 : 0;
+            outputs[t.out] = WRITING;
+            pending++;
+            return t;
+        }
+
+        // Queues the copy of the frame, then calls prepare with its output buffer and queues the
+        // conversion. Returns once the texture can be reused. A frame that could not be copied
+        // gives its slot and buffer back without prepare or conversion: false, nothing of it
+        // reaches the encoder.
+        bool commit(const Ticket &t,
+                    uint64_t handle,
+                    const std::function<void(int)> &prepare = nullptr) {
+            if (!backend->copy(handle, t.slot)) {
+                std::lock_guard<std::mutex> lock(mtx);
+                failedCopies++;
+                freeSlots.push_back(t.slot);
+                outputs[t.out] = FREE;
+                pending--;
+                cv.notify_all();
+                return false;
+            }
+            if (prepare)
+                prepare(t.out);
+            backend->convert(t.slot, t.out);
+            std::lock_guard<std::mutex> lock(mtx);
+            inFlight.push_back(t);
+            pending--;
+            cv.notify_all();
+            return true;
+        }
+
+        // The newest converted frame, older ones nobody took are dropped and counted in skipped.
+        // -1 after the timeout or once stopped.
+        int acquire(int &skipped, Clk::duration timeout) {
+            std::unique_lock<std::mutex> lock(mtx);
+            int newest = -1;
+            auto findNewest = [&] {
+                newest = -1;
+                for (int i = 0; i < (int) outputs.size(); i++)
+                    if (outputs[i] == READY && (newest < 0 || readyOrder[i] > readyOrder[newest]))
+                        newest = i;
+                return newest >= 0 || !running;
+            };
+            skipped = 0;
+            if (!cv.wait_for(lock, timeout, findNewest) || !running)
+                return -1;
+            skipped = overwritten;
+            overwritten = 0;
+            for (int i = 0; i < (int) outputs.size(); i++)
+                if (outputs[i] == READY && i != newest) {
+                    outputs[i] = FREE;
+                    skipped++;
+                }
+            outputs[newest] = READING;
+            cv.notify_all();
+            return newest;
+        }
+
+        // the encoder is done with the buffer
+        void release(int out) {
+            std::lock_guard<std::mutex> lock(mtx);
+            outputs[out] = FREE;
+            cv.notify_all();
+        }
+
+        uint32_t copyFailures() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return failedCopies;
+        }
+
+        // Unblocks begin() and acquire() for good and waits for the committed frames, whose
+        // readback may still write into the output buffers.
+        void stop() {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                running = false;
+                cv.notify_all();
+                cv.wait(lock, [&] { return pending == 0; });
+            }
+            if (completer.joinable())
+                completer.join();
+        }
+    };
+}   // namespace CapturePipeline
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "LensMask.h"
+#include "PoseIngest.h"
+
+// Half rate streaming: the PC renders, encodes and sends every other display refresh, the phone
+// synthesizes the refreshes in between by rotating the last decoded frame to the freshest head
+// orientation (rotational reprojection, the same warp a late frame gets).
+//
+// Orientations are head to world rotations. A view direction is given by its tangents like the
+// eye rectangles of LensMask (x right, y down, the eye looks down -z), the delta rotation takes a
+// direction of the displayed view into the head space the frame was rendered in. A rotation maps
+// straight lines in tangent space (great circles) to straight lines, so the display rectangle
+// stays a quadrilateral in the frame and its corners tell whether the frame covers it.
+namespace Extrapolation {
+    using PoseIngest::Quat;
+
+    // display head space -> head space of the frame
+    inline Quat delta(const Quat &rendered, const Quat &shown) {
+        return PoseIngest::mul(PoseIngest::conj(rendered), shown);
+    }
+
+    inline void rotate(const Quat &q, const double v[3], double out[3]) {
+        // v + 2w (u x v) + 2 u x (u x v), u the vector part
+        double c[3] = {q.y * v[2] - q.z * v[1], q.z * v[0] - q.x * v[2], q.x * v[1] - q.y * v[0]};
+        out[0] = v[0] + 2 * (q.w * c[0] + q.y * c[2] - q.z * c[1]);
+        out[1] = v[1] + 2 * (q.w * c[1] + q.z * c[0] - q.x * c[2]);
+        out[2] = v[2] + 2 * (q.w * c[2] + q.x * c[1] - q.y * c[0]);
+    }
+
+    // Where the frame shows the direction (tx, ty) of the displayed view, as tangents of the
+    // frame's eye. False if it is behind the frame's eye.
+    inline bool toFrame(const Quat &delta, float tx, float ty, float &fx, float &fy) {
+        double d[3] = {tx, -ty, -1}, r[3];
+        rotate(delta, d, r);
+        if (r[2] > -1e-6)
+            return false;
+        fx = (float) (r[0] / -r[2]);
+        fy = (float) (-r[1] / -r[2]);
+        return true;
+    }
+
+    // whether the frame (rendered with a margin around the display FOV) still fills the whole
+    // displayed eye after the rotation, or the background shows at an edge
+    inline bool covers(const Quat &delta,
+                       const LensMask::EyeTangents &frame,
+                       const LensMask::EyeTangents &display) {
+        const float corners[4][2] = {{display.left, display.top},
+                                     {display.right, display.top},
+                                     {display.left, display.bottom},
+                                     {display.right, display.bottom}};
+        for (auto &c : corners) {
+            float fx, fy;
+            if (!toFrame(delta, c[0], c[1], fx, fy) || fx < frame.left || fx > frame.right ||
+                fy < frame.top || fy > frame.bottom)
+                return false;
+        }
+        return true;
+    }
+
+    // What the phone displayed: frames it decoded and ones it synthesized from the last of them.
+    struct FrameStats {
+        uint32_t real = 0;
+        uint32_t synthesized = 0;
+        uint32_t uncovered = 0;   // synthesized with the background showing at an edge
+        double maxDeltaDeg = 0;   // largest rotation a synthesized frame needed
+
+        uint32_t displayed() const { return real + synthesized; }
+
+        void addReal() { real++; }
+
+        void addSynthesized(const Quat &delta, bool covered) {
+            synthesized++;
+            uncovered += covered ? 0 : 1;
+            double deg = PoseIngest::angleBetween(delta, Quat()) * 180 / 3.14159265358979;
+            maxDeltaDeg = deg > maxDeltaDeg ? deg : maxDeltaDeg;
+        }
+
+        std::string summary() const {
+            double share = displayed() ? 100.0 * synthesized / displayed() : 0;
+            return std::to_string(displayed()) + " displayed, " + std::to_string(real) +
+                   " real, " + std::to_string(synthesized) + " synthesized (" +
+                   std::to_string((int) (share + 0.5)) + "%), " + std::to_string(uncovered) +
+                   " uncovered, max rotation " + std::to_string((int) (maxDeltaDeg + 0.5)) +
+                   " deg";
+        }
+    };
+}   // namespace Extrapolation
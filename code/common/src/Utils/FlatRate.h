@@ -0,0 +1,20 @@
+#pragma once
+
+#include <algorithm>
+
+// Constant frame size mode of the encoder. A keyframe sized frame takes several frame intervals
+// to send, and every frame behind it waits: a latency spike. In flat mode a column of intra
+// macroblocks sweeps the picture once per refresh period instead of IDRs, the VBV holds one frame
+// interval at the target rate and never fills above it, and slices are capped at about a datagram
+// so a lost one takes a single slice with it.
+namespace FlatRate {
+    // kbit, no frame takes longer than a frame interval to send at kbps
+    inline int vbvBufferKbit(int kbps, int fpsNum, int fpsDen) {
+        return (std::max)(kbps * fpsDen / (std::max)(fpsNum, 1), 1);
+    }
+
+    // frames per intra refresh sweep, half a second unless the keyint setting (> 0) says otherwise
+    inline int refreshPeriod(int fps, int keyintSetting) {
+        return keyintSetting > 0 ? keyintSetting : (std::max)(fps / 2, 1);
+    }
+}   // namespace FlatRate
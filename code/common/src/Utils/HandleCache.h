@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// The shared textures an app presents, opened once per handle instead of once per frame.
+//
+// SteamVR cycles through the few textures of each swap chain, so the handles repeat: an entry
+// keeps what opening the handle gave (the texture and its keyed mutex on the PC) and each frame
+// only locks, copies and unlocks. The least recently used entry is closed when a new handle
+// doesn't fit. Entries belong to a device and a frame size, binding another one closes them all.
+namespace HandleCache {
+    // what the resources were opened for
+    struct Context {
+        uint64_t device = 0;
+        uint32_t width = 0, height = 0;
+
+        bool operator==(const Context &o) const {
+            return device == o.device && width == o.width && height == o.height;
+        }
+        bool operator!=(const Context &o) const { return !(*this == o); }
+    };
+
+    // opens and closes the resources of a handle, D3D11 on the PC
+    template <typename Resource>
+    class Backend {
+      public:
+        virtual ~Backend() = default;
+
+        // false if the handle can't be opened or doesn't fit the context, nothing to close then
+        virtual bool open(uint64_t handle, const Context &context, Resource &res) = 0;
+        virtual void close(Resource &res) = 0;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;        // opened, or tried to
+        uint64_t evictions = 0;     // closed to make room
+        uint64_t invalidated = 0;   // closed by invalidate(), bind() or erase()
+
+        std::string summary() const {
+            return std::to_string(hits) + " hits, " + std::to_string(misses) + " misses, " +
+                   std::to_string(evictions) + " evicted, " + std::to_string(invalidated) +
+                   " invalidated";
+        }
+    };
+
+    template <typename Resource>
+    class Cache {
+        using Entry = std::pair<uint64_t, Resource>;
+
+        std::unique_ptr<Backend<Resource>> backend;
+        const size_t capacity;
+        std::list<Entry> entries;   // most recently used first
+        std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index;
+        Context context;
+        Stats counts;
+        std::mutex mtx;
+
+        void closeAll() {
+            for (auto &entry : entries)
+                backend->close(entry.second);
+            counts.invalidated += entries.size();
+            entries.clear();
+            index.clear();
+        }
+
+      public:
+        Cache(std::unique_ptr<Backend<Resource>> backend, size_t capacity)
+            : backend(std::move(backend)), capacity(capacity > 0 ? capacity : 1) {}
+
+        ~Cache() { invalidate(); }
+
+        // the device or the frame size changed: what was opened for the old one is closed
+        void bind(const Context &ctx) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (ctx != context)
+                closeAll();
+            context = ctx;
+        }
+
+        // closes everything, before the device is released
+        void invalidate() {
+            std::lock_guard<std::mutex> lock(mtx);
+            closeAll();
+        }
+
+        // a handle whose resources stopped working
+        void erase(uint64_t handle) {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = index.find(handle);
+            if (it == index.end())
+                return;
+            backend->close(it->second->second);
+            entries.erase(it->second);
+            index.erase(it);
+            counts.invalidated++;
+        }
+
+        // Calls use(Resource &) with the handle's resources, opening them on a miss, and returns
+        // its result. False if they can't be opened. The cache is locked meanwhile, invalidate()
+        // can't close them under it.
+        template <typename Use>
+        bool use(uint64_t handle, Use &&use) {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = index.find(handle);
+            if (it != index.end()) {
+                counts.hits++;
+                entries.splice(entries.begin(), entries, it->second);
+            } else {
+                counts.misses++;
+                Resource res{};
+                if (!backend->open(handle, context, res))
+                    return false;
+                if (entries.size() >= capacity) {
+                    backend->close(entries.back().second);
+                    index.erase(entries.back().first);
+                    entries.pop_back();
+                    counts.evictions++;
+                }
+                entries.emplace_front(handle, res);
+                index[handle] = entries.begin();
+            }
+            return use(entries.front().second);
+        }
+
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return entries.size();
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return counts;
+        }
+    };
+}   // namespace HandleCache
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+
+#include "ThreadUtils.h"
+
+// Liveness and round-trip time of the control connection. One side sends a PING with its send
+// time every period, the other echoes it back in a PONG, so every PONG is an RTT sample without
+// a shared clock. Samples are smoothed like TCP does (RFC 6298, gains 1/8 and 1/4).
+//
+// The peer is dead when nothing at all was heard for missLimit periods plus the retransmit margin
+// srtt + 4 * rttvar, at least one minimum TCP retransmit timeout: a single lost segment stalls
+// the connection that long. ~500 ms on a LAN with 100 ms pings. Until the first PONG the peer may
+// be an older version that ignores pings, so it can't be declared dead before that.
+class HeartbeatMonitor {
+    static constexpr double MIN_RTO_MS = 200;   // Linux, Windows uses 300
+
+    std::mutex mtx;
+    double periodMs;
+    int missLimit;
+    double srtt = 0, rttvar = 0;
+    bool hasSample = false;
+    Clk::time_point lastHeard;
+
+  public:
+    HeartbeatMonitor(std::chrono::milliseconds period = std::chrono::milliseconds(100),
+                     int missLimit = 3,
+                     Clk::time_point now = Clk::now())
+        : periodMs((double) period.count()), missLimit(missLimit), lastHeard(now) {}
+
+    void reset(std::chrono::milliseconds period, Clk::time_point now) {
+        std::lock_guard<std::mutex> lock(mtx);
+        periodMs = (double) period.count();
+        srtt = rttvar = 0;
+        hasSample = false;
+        lastHeard = now;
+    }
+
+    // any message counts, not only PONGs
+    void onHeard(Clk::time_point now) {
+        std::lock_guard<std::mutex> lock(mtx);
+        lastHeard = (std::max)(lastHeard, now);
+    }
+
+    // returns the RTT sample in ms
+    double onPong(Clk::time_point sentAt, Clk::time_point now) {
+        std::lock_guard<std::mutex> lock(mtx);
+        double sample =
+            (std::max)(0.0, std::chrono::duration<double, std::milli>(now - sentAt).count());
+        if (!hasSample) {
+            srtt = sample;
+            rttvar = sample / 2;
+            hasSample = true;
+        } else {
+            rttvar = 0.75 * rttvar + 0.25 * std::abs(srtt - sample);
+            srtt = 0.875 * srtt + 0.125 * sample;
+        }
+        lastHeard = (std::max)(lastHeard, now);
+        return sample;
+    }
+
+    double deadlineMs() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return missLimit * periodMs + (std::max)(MIN_RTO_MS, srtt + 4 * rttvar);
+    }
+
+    bool alive(Clk::time_point now) {
+        double deadline = deadlineMs();
+        std::lock_guard<std::mutex> lock(mtx);
+        return !hasSample ||
+               std::chrono::duration<double, std::milli>(now - lastHeard).count() < deadline;
+    }
+
+    bool measured() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return hasSample;
+    }
+
+    double srttMs() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return srtt;
+    }
+
+    double rttVarMs() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return rttvar;
+    }
+};
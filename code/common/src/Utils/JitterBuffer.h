@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "AudioCodec.h"
+
+// Client side of the audio channel: holds decoded packets until they are due and hands the output
+// device exactly the frames it asks for.
+//
+// The frame at position p plays at local time framesToNs(p) + offset. While video is shown the
+// offset is the one its frames are presented with, so sound stays in sync with the picture.
+// Otherwise, or when audio arrives later than that, it is the network offset: the
+// (1 - LATE_FRACTION) quantile of arrival time - position over the last WINDOW_MS (raised at
+// once, lowered slowly), plus how far ahead of playout the device asks for a block.
+//
+// Playout follows the wanted position by dropping or repeating up to 0.5% of the frames, which
+// can't be heard. Running ahead of it makes packets late, so that jumps back at once (a short
+// gap), running behind only by more than RESYNC_MS. Losses and underruns fade out the last
+// packet, pauses of the source play as silence.
+namespace Audio {
+    class JitterBuffer {
+      public:
+        static constexpr double WINDOW_MS = 2000;
+        static constexpr double LATE_FRACTION = 0.02;
+        static constexpr double RESYNC_MS = 40;
+        static constexpr double DEADBAND_MS = 1;
+        static constexpr double VIDEO_TIMEOUT_MS = 1000;   // no frames: sync to the network alone
+
+        struct Stats {
+            uint64_t received = 0;
+            uint64_t late = 0;   // arrived after their playout time
+            uint64_t lost = 0;   // never played, late ones included
+            uint64_t underruns = 0;
+            uint64_t resyncs = 0;
+            double bufferedMs = 0;
+            double jitterMs = 0;     // arrival spread waited for
+            double avOffsetMs = 0;   // audio behind video, 0 without video
+        };
+
+      private:
+        struct Packet {
+            int64_t position;
+            std::vector<int16_t> pcm;
+        };
+
+        mutable std::mutex mtx;
+        std::map<uint32_t, Packet> packets;   // by seq
+        std::deque<std::pair<int64_t, int64_t>> transits;   // arrival, arrival - position (ns)
+        std::vector<int64_t> sorted;
+        std::vector<int16_t> scratch, lastPcm;
+        Stats st;
+
+        int64_t netOffset = 0, minTransit = 0;
+        bool hasNet = false;
+        int64_t videoOffset = 0, videoSeenNs = 0;
+        bool hasVideo = false;
+
+        bool playing = false, inGap = false;
+        int64_t cursor = 0;   // next position to play
+        int64_t lastLead = 0;
+        uint32_t lastSeq = 0;
+        bool hasLastSeq = false;
+        int64_t concealPos = 0;
+
+        bool videoActive(int64_t nowNs) const {
+            return hasVideo && nowNs - videoSeenNs < (int64_t) (VIDEO_TIMEOUT_MS * 1e6);
+        }
+
+        // leadNs: the block is taken that long before it plays
+        int64_t offset(int64_t nowNs, int64_t leadNs) const {
+            int64_t net = netOffset + leadNs;
+            return videoActive(nowNs) ? (std::max)(videoOffset, net) : net;
+        }
+
+        // fills out with `count` frames from position `from` on
+        void render(int64_t from, int count, int16_t *out) {
+            int done = 0;
+            while (done < count) {
+                int64_t pos = from + done;
+                while (!packets.empty()) {
+                    auto &first = packets.begin()->second;
+                    if (first.position + (int64_t) (first.pcm.size() / CHANNELS) > pos)
+                        break;
+                    packets.erase(packets.begin());   // passed over by a resync
+                }
+
+                auto it = packets.begin();
+                if (it != packets.end() && it->second.position <= pos) {
+                    auto &pkt = it->second;
+                    auto frames = (int64_t) (pkt.pcm.size() / CHANNELS);
+                    int n = (int) (std::min)((int64_t) (count - done), pkt.position + frames - pos);
+                    std::copy_n(&pkt.pcm[(pos - pkt.position) * CHANNELS],
+                                n * CHANNELS,
+                                &out[done * CHANNELS]);
+                    done += n;
+                    if (hasLastSeq && it->first > lastSeq + 1)
+                        st.lost += it->first - lastSeq - 1;
+                    lastSeq = it->first;
+                    hasLastSeq = true;
+                    inGap = false;
+                    concealPos = 0;
+                    if (pos + n == pkt.position + frames) {
+                        lastPcm.swap(pkt.pcm);
+                        packets.erase(it);
+                    }
+                    continue;
+                }
+
+                // nothing to play until the next packet, if any
+                int64_t gapEnd = it != packets.end() ? it->second.position : pos + count - done;
+                int n = (int) (std::min)((int64_t) (count - done), gapEnd - pos);
+                if (it == packets.end() && !inGap)
+                    st.underruns++;
+                inGap = true;
+                auto lastFrames = (int64_t) (lastPcm.size() / CHANNELS);
+                for (int i = 0; i < n; i++, concealPos++) {
+                    for (int c = 0; c < CHANNELS; c++) {
+                        int16_t v = 0;
+                        if (concealPos < lastFrames)
+                            v = (int16_t) (lastPcm[concealPos * CHANNELS + c] *
+                                           (lastFrames - concealPos) / lastFrames);
+                        out[(done + i) * CHANNELS + c] = v;
+                    }
+                }
+                done += n;
+            }
+        }
+
+      public:
+        void reset() {
+            std::lock_guard<std::mutex> lock(mtx);
+            packets.clear();
+            transits.clear();
+            lastPcm.clear();
+            st = Stats();
+            hasNet = hasVideo = playing = inGap = hasLastSeq = false;
+        }
+
+        // video frame pts (us) reaches the screen at photonNs on the local clock
+        void onVideoPresented(int64_t ptsUs, int64_t photonNs) {
+            std::lock_guard<std::mutex> lock(mtx);
+            int64_t sample = photonNs - ptsUs * 1000;
+            // frames land on a vsync, the average is what the picture lags by
+            videoOffset = hasVideo ? videoOffset + (sample - videoOffset) / 16 : sample;
+            videoSeenNs = photonNs;
+            hasVideo = true;
+        }
+
+        void push(const PacketHeader &hdr, const int16_t *pcm, int frames, int64_t arrivalNs) {
+            std::lock_guard<std::mutex> lock(mtx);
+            st.received++;
+
+            int64_t transit = arrivalNs - framesToNs(hdr.position);
+            transits.push_back({arrivalNs, transit});
+            while (arrivalNs - transits.front().first > (int64_t) (WINDOW_MS * 1e6))
+                transits.pop_front();
+            sorted.clear();
+            for (auto &t : transits)
+                sorted.push_back(t.second);
+            auto q = sorted.begin() + (ptrdiff_t) ((sorted.size() - 1) * (1 - LATE_FRACTION));
+            std::nth_element(sorted.begin(), q, sorted.end());
+            int64_t wanted = *q;
+            minTransit = *std::min_element(sorted.begin(), sorted.end());
+            if (!hasNet) {
+                netOffset = wanted;
+                hasNet = true;
+            } else if (wanted > netOffset)
+                netOffset = wanted;
+            else
+                netOffset += (wanted - netOffset) / 128;
+
+            if ((playing && hdr.position + frames <= cursor) ||
+                (hasLastSeq && hdr.seq <= lastSeq)) {
+                st.late++;
+                return;
+            }
+            if (frames <= 0 || packets.count(hdr.seq))
+                return;
+            packets[hdr.seq] = {hdr.position, std::vector<int16_t>(pcm, pcm + frames * CHANNELS)};
+        }
+
+        // Fills pcm with `frames` frames, the first of which leaves the speaker at playNs.
+        void pull(int16_t *pcm, int frames, int64_t playNs, int64_t nowNs) {
+            std::lock_guard<std::mutex> lock(mtx);
+            // all of the block has to be there now
+            int64_t lead = playNs - nowNs + framesToNs(frames);
+            lastLead = lead;
+            int64_t wanted = nsToFrames(playNs - offset(nowNs, lead));
+            if (!playing) {
+                if (packets.empty()) {
+                    std::fill_n(pcm, frames * CHANNELS, (int16_t) 0);
+                    return;
+                }
+                cursor = wanted;
+                playing = true;
+            }
+
+            int64_t error = cursor - wanted;   // > 0: ahead of time
+            auto deadband = nsToFrames((int64_t) (DEADBAND_MS * 1e6));
+            if (error > deadband || -error > nsToFrames((int64_t) (RESYNC_MS * 1e6))) {
+                cursor = wanted;
+                st.resyncs++;
+                error = 0;
+            }
+            int adjust = 0;
+            if (-error > deadband) {
+                int maxAdjust = (std::max)(1, frames / 200);
+                adjust = (int) (std::min)(-error, (int64_t) maxAdjust);
+            }
+
+            int consume = frames + adjust;
+            scratch.resize((size_t) consume * CHANNELS);
+            render(cursor, consume, scratch.data());
+            cursor += consume;
+            for (int i = 0; i < frames; i++) {
+                int src = (int) ((int64_t) i * consume / frames);
+                std::copy_n(&scratch[src * CHANNELS], CHANNELS, &pcm[i * CHANNELS]);
+            }
+        }
+
+        Stats stats(int64_t nowNs) const {
+            std::lock_guard<std::mutex> lock(mtx);
+            Stats s = st;
+            if (!packets.empty()) {
+                auto &last = packets.rbegin()->second;
+                s.bufferedMs =
+                    framesToNs(last.position + (int64_t) (last.pcm.size() / CHANNELS) - cursor) /
+                    1e6;
+            }
+            s.jitterMs = (netOffset - minTransit) / 1e6;
+            if (videoActive(nowNs))
+                s.avOffsetMs = (offset(nowNs, lastLead) - videoOffset) / 1e6;
+            return s;
+        }
+    };
+}   // namespace Audio
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Latency distribution with 1 ms bins up to MAX_MS and one overflow bin, cheap enough to update
+// every frame. Percentiles are the upper edge of the bin they fall in.
+class LatencyHistogram {
+  public:
+    static const int MAX_MS = 250;
+
+  private:
+    std::array<uint32_t, MAX_MS + 1> bins{};   // last one: MAX_MS and above
+    uint64_t count = 0;
+    double sumMs = 0;
+    double maxMs = 0;
+
+  public:
+    void add(double ms) {
+        ms = (std::max)(ms, 0.0);
+        bins[(std::min)((int) ms, MAX_MS)]++;
+        count++;
+        sumMs += ms;
+        maxMs = (std::max)(maxMs, ms);
+    }
+
+    void clear() { *this = LatencyHistogram(); }
+
+    uint64_t size() const { return count; }
+    double mean() const { return count ? sumMs / count : 0; }
+    double max() const { return maxMs; }
+    uint32_t bin(int ms) const { return bins[(std::min)((std::max)(ms, 0), MAX_MS)]; }
+
+    // p in [0, 1]
+    double percentile(double p) const {
+        if (count == 0)
+            return 0;
+        auto rank = (uint64_t) (p * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < MAX_MS; i++) {
+            seen += bins[i];
+            if (seen >= rank)
+                return i + 1;
+        }
+        return maxMs;
+    }
+
+    std::string summary() const {
+        char buf[128];
+        snprintf(buf,
+                 sizeof(buf),
+                 "n %llu, mean %.1f ms, p50 %.0f ms, p90 %.0f ms, p99 %.0f ms, max %.1f ms",
+                 (unsigned long long) count,
+                 mean(),
+                 percentile(0.5),
+                 percentile(0.9),
+                 percentile(0.99),
+                 maxMs);
+        return buf;
+    }
+};
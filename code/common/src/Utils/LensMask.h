@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// The part of each eye's render target the lens can't show.
+//
+// The phone's FOV rectangle (the lens FOV extended by offFov for reprojection) bounds what the
+// lens shows on each axis, but through the round lens the visible area is closer to an ellipse
+// in angle space that touches the rectangle's edges: the corners are never seen, not even after
+// reprojection moved the picture by offFov. Each quadrant around the view direction gets its own
+// semi-axes, so the asymmetric FOV of each eye (less towards the nose) keeps its shape.
+//
+// Hidden macroblocks get the highest QP from the encoder and, past a ring of them around the
+// visible ones, are painted a flat color by the color conversion: they cost next to no bits or
+// encode time. The ring keeps the picture there as a reference, motion compensation of visible
+// macroblocks finds what moves in from the edge.
+//
+// Off by default: it makes keyframes a quarter cheaper, but with ultrafast under head motion the
+// P frames cost more than without it (see LensMaskX264Tests). What moves in from the hidden edge
+// has no usable reference and gets coded anew. Also, x264 clamps the offsets to qp_max, so with a
+// low qp_max the hidden macroblocks only get cheaper by being painted.
+namespace LensMask {
+    const int MB_SIZE = 16;          // x264 macroblock, the mask's granularity
+    const float MASKED_QP = 51;      // quant offset, x264 clamps it to its highest QP
+    const uint8_t MASKED_Y = 0;      // black like the phone's background
+    const uint8_t MASKED_UV = 128;
+
+    enum Macroblock : uint8_t {
+        VISIBLE,
+        HIDDEN,    // highest QP, converted as usual
+        PAINTED,   // highest QP and a flat color
+    };
+
+    // one eye like IVRDisplayComponent::GetProjectionRaw: tangents of the edges, top < bottom
+    struct EyeTangents {
+        float left, right, top, bottom;
+    };
+
+    // the side by side frame: left eye in the left half, right eye mirrored
+    inline void eyesFromProjRect(const float projRect[4], EyeTangents eyes[2]) {
+        eyes[0] = {projRect[0], projRect[2], projRect[3], projRect[1]};
+        eyes[1] = {-projRect[2], -projRect[0], projRect[3], projRect[1]};
+    }
+
+    // tangents (tx, ty) of a view direction
+    inline bool visible(const EyeTangents &eye, float tx, float ty) {
+        float ex = std::atan(tx < 0 ? -eye.left : eye.right);
+        float ey = std::atan(ty < 0 ? -eye.top : eye.bottom);
+        if (ex <= 0 || ey <= 0)
+            return true;   // the view direction is outside the FOV, nothing to go by
+        float ax = std::atan(std::abs(tx)) / ex, ay = std::atan(std::abs(ty)) / ey;
+        return ax * ax + ay * ay <= 1;
+    }
+
+    namespace detail {
+        // the pixel centers x0 to x1 - 1 of a row eyeSize pixels wide, the one nearest to the view
+        // direction: inside a quadrant visibility only shrinks going outwards
+        inline float nearestTangent(float from, float to, int eyeSize, int x0, int x1) {
+            float t0 = from + (to - from) * (x0 + 0.5f) / eyeSize;
+            float t1 = from + (to - from) * (x1 - 0.5f) / eyeSize;
+            return std::clamp(0.f, (std::min)(t0, t1), (std::max)(t0, t1));
+        }
+    }   // namespace detail
+
+    // A Macroblock for each one of the width x height side by side frame, raster order. Hidden
+    // where no pixel of it is visible.
+    inline std::vector<uint8_t> macroblocks(int width, int height, const EyeTangents eyes[2]) {
+        int mbW = (width + MB_SIZE - 1) / MB_SIZE, mbH = (height + MB_SIZE - 1) / MB_SIZE;
+        int eyeW = width / 2;
+        std::vector<uint8_t> mask((size_t) mbW * mbH);
+        for (int my = 0; my < mbH; my++) {
+            int y0 = my * MB_SIZE, y1 = (std::min)(y0 + MB_SIZE, height);
+            for (int mx = 0; mx < mbW; mx++) {
+                int x0 = mx * MB_SIZE, x1 = (std::min)(x0 + MB_SIZE, width);
+                bool masked = true;
+                // a macroblock can straddle the eyes when the eye width isn't a multiple of 16
+                for (int e = 0; e < 2 && masked; e++) {
+                    int from = (std::max)(x0, e * eyeW), to = (std::min)(x1, (e + 1) * eyeW);
+                    if (from >= to)
+                        continue;
+                    auto &eye = eyes[e];
+                    float tx = detail::nearestTangent(
+                        eye.left, eye.right, eyeW, from - e * eyeW, to - e * eyeW);
+                    float ty = detail::nearestTangent(eye.top, eye.bottom, height, y0, y1);
+                    masked = !visible(eye, tx, ty);
+                }
+                mask[(size_t) my * mbW + mx] = masked ? HIDDEN : VISIBLE;
+            }
+        }
+        // painted: no visible neighbour, diagonals included
+        auto hidden = mask;
+        for (int my = 0; my < mbH; my++)
+            for (int mx = 0; mx < mbW; mx++) {
+                bool inner = hidden[(size_t) my * mbW + mx] == HIDDEN;
+                for (int y = (std::max)(my - 1, 0); y <= (std::min)(my + 1, mbH - 1) && inner; y++)
+                    for (int x = (std::max)(mx - 1, 0); x <= (std::min)(mx + 1, mbW - 1); x++)
+                        inner &= hidden[(size_t) y * mbW + x] == HIDDEN;
+                if (inner)
+                    mask[(size_t) my * mbW + mx] = PAINTED;
+            }
+        return mask;
+    }
+
+    // x264_picture_t::prop.quant_offsets for a mask
+    inline std::vector<float> quantOffsets(const std::vector<uint8_t> &mask) {
+        std::vector<float> offsets(mask.size());
+        for (size_t i = 0; i < mask.size(); i++)
+            offsets[i] = mask[i] != VISIBLE ? MASKED_QP : 0;
+        return offsets;
+    }
+}   // namespace LensMask
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+// How the encoder gets the client back to a clean picture after a lost frame.
+//
+// An IDR is the simple way, but it is several times the size of a P frame and arrives when the
+// link is already in trouble. Instead the encoder keeps the last frames in its DPB (x264's
+// i_dpb_size, no motion search cost) and the recovery frame predicts from the newest one the
+// client acknowledged (reference picture selection, x264_encoder_invalidate_reference). Only
+// when that frame has left the DPB, or nothing was acknowledged since the last IDR, is an IDR
+// needed.
+//
+// A loss taints every frame not acknowledged yet: each one is lost or predicts from one that is.
+namespace LossRecovery {
+    enum Action {
+        NONE,
+        REFERENCE,   // invalidate references from invalidateFrom() on
+        IDR,
+    };
+
+    class ReferenceTracker {
+        static const size_t MAX_FRAMES = 256;   // unacknowledged ones are tracked past the DPB
+
+        enum State { IN_FLIGHT, ACKED, TAINTED };
+        struct Frame {
+            int64_t pts;   // as acknowledged by the client
+            int64_t encoderPts;
+            State state;
+        };
+
+        int dpbFrames;
+        std::deque<Frame> frames;   // oldest first, the last dpbFrames are in the encoder's DPB
+        bool lossPending = false;
+        int64_t taintFrom = 0;   // encoder pts
+
+      public:
+        explicit ReferenceTracker(int dpbFrames) : dpbFrames((std::max)(dpbFrames, 1)) {}
+
+        void reset() {
+            frames.clear();
+            lossPending = false;
+        }
+
+        // every encoded frame, in order, whether it was sent or not
+        void onEncoded(int64_t pts, int64_t encoderPts, bool keyframe) {
+            if (keyframe)
+                frames.clear();   // nothing before an IDR is referenced anymore
+            frames.push_back({pts, encoderPts, IN_FLIGHT});
+            while (frames.size() > MAX_FRAMES ||
+                   ((int) frames.size() > dpbFrames && frames.front().state != IN_FLIGHT))
+                frames.pop_front();
+        }
+
+        // the client decoded the frame, cumulative: and every one before it
+        void onAck(int64_t pts, bool cumulative) {
+            for (auto &f : frames) {
+                if (f.pts > pts)
+                    break;
+                if (f.state == IN_FLIGHT && (f.pts == pts || cumulative))
+                    f.state = ACKED;
+            }
+        }
+
+        // some frame that isn't acknowledged yet is lost
+        void onLoss() {
+            auto first = std::find_if(
+                frames.begin(), frames.end(), [](const Frame &f) { return f.state == IN_FLIGHT; });
+            if (first == frames.end())
+                return;   // reported twice
+            if (!lossPending || first->encoderPts < taintFrom)
+                taintFrom = first->encoderPts;
+            lossPending = true;
+            // acknowledged frames after the lost one predict from it
+            for (auto it = first; it != frames.end(); ++it)
+                it->state = TAINTED;
+        }
+
+        // what the next frame has to be, called once before encoding it
+        Action next() {
+            if (!lossPending)
+                return NONE;
+            lossPending = false;
+            auto dpb = frames.end() - (std::min)((int) frames.size(), dpbFrames);
+            bool haveRef = std::any_of(dpb, frames.end(), [&](const Frame &f) {
+                return f.state == ACKED && f.encoderPts < taintFrom;
+            });
+            return haveRef ? REFERENCE : IDR;
+        }
+
+        int64_t invalidateFrom() const { return taintFrom; }
+    };
+}   // namespace LossRecovery
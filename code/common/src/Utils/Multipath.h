@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+// Picks the network path (e.g. WiFi and USB tethering) each video frame goes out on.
+// Paths are scored by expected delivery delay, srtt + 4 * rttvar as for a TCP RTO, so a lossy
+// path (retransmissions show up as RTT spikes) scores worse than its mean RTT suggests.
+// Frames of one stream must arrive in order for the decoder, so the scheduler only moves to a
+// better path once everything sent on the current one has been acknowledged.
+class MultipathScheduler {
+    struct Path {
+        bool alive = true;
+        bool measured = false;
+        double srttMs = 0;
+        double rttvarMs = 0;
+        int inFlight = 0;
+    };
+
+    std::vector<Path> paths;
+    int current = -1;
+    std::mutex mtx;
+
+    double score(const Path &p) {
+        // unmeasured paths get a chance once the current one is idle
+        return p.measured ? p.srttMs + 4 * p.rttvarMs : 0;
+    }
+
+  public:
+    int addPath() {
+        std::lock_guard<std::mutex> lock(mtx);
+        paths.push_back({});
+        if (current < 0)
+            current = (int) paths.size() - 1;
+        return (int) paths.size() - 1;
+    }
+
+    // frames sent on the path and not acknowledged yet
+    void setInFlight(int path, int frames) {
+        std::lock_guard<std::mutex> lock(mtx);
+        paths[path].inFlight = frames;
+    }
+
+    // RFC 6298 smoothing
+    void onAck(int path, double rttMs) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto &p = paths[path];
+        if (!p.measured) {
+            p.srttMs = rttMs;
+            p.rttvarMs = rttMs / 2;
+            p.measured = true;
+        } else {
+            p.rttvarMs = 0.75 * p.rttvarMs + 0.25 * std::abs(p.srttMs - rttMs);
+            p.srttMs = 0.875 * p.srttMs + 0.125 * rttMs;
+        }
+    }
+
+    void onDown(int path) {
+        std::lock_guard<std::mutex> lock(mtx);
+        paths[path].alive = false;
+        paths[path].inFlight = 0;
+        if (current == path)
+            current = -1;
+    }
+
+    // Path for the next frame, -1 if every path is down.
+    int pick() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (current >= 0 && paths[current].inFlight > 0)
+            return current;
+
+        int best = current;
+        for (int i = 0; i < (int) paths.size(); i++) {
+            if (!paths[i].alive)
+                continue;
+            if (best < 0 || score(paths[i]) < score(paths[best]))
+                best = i;
+        }
+        current = best;
+        return current;
+    }
+
+    std::vector<int> alivePaths() {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<int> res;
+        for (int i = 0; i < (int) paths.size(); i++)
+            if (paths[i].alive)
+                res.push_back(i);
+        return res;
+    }
+
+    double srttMs(int path) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return paths[path].srttMs;
+    }
+};
+
+// Receiver side: the same frame or pose sample can come in over several paths, keep only the
+// first copy and anything newer than what was already delivered.
+class MonotonicFilter {
+    int64_t last = (std::numeric_limits<int64_t>::min)();
+    std::mutex mtx;
+
+  public:
+    bool accept(int64_t stamp) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (stamp <= last)
+            return false;
+        last = stamp;
+        return true;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mtx);
+        last = (std::numeric_limits<int64_t>::min)();
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "ThreadUtils.h"
+
+// Spreads each video frame over part of the frame interval instead of writing it in one burst.
+// A burst fills the WiFi AP and driver queues and delays the small pose and control packets that
+// share the link. Works as a user-space token bucket (one chunk of burst) so it behaves the same
+// on every platform and socket type.
+class FramePacer {
+    double fraction;    // part of the frame interval a frame is spread over, <= 0 disables pacing
+    size_t chunkSize;   // bytes released at once
+    double linkRate;    // estimated link rate in bytes/s, 0 if unknown
+
+    static void waitUntil(Clk::time_point tp) {
+        // sleep granularity is coarse on some platforms, spin for the last bit
+        while (true) {
+            auto left = tp - Clk::now();
+            if (left <= Clk::duration::zero())
+                return;
+            if (left > std::chrono::milliseconds(2))
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            else
+                std::this_thread::yield();
+        }
+    }
+
+  public:
+    FramePacer(double windowFraction = 0.5, size_t chunkSize = 16 * 1024, double linkRate = 0)
+        : fraction(windowFraction), chunkSize((std::max<size_t>)(chunkSize, 1)),
+          linkRate(linkRate) {}
+
+    bool enabled() { return fraction > 0; }
+
+    void setLinkRate(double bytesPerSec) { linkRate = (std::max)(bytesPerSec, 0.0); }
+    double getLinkRate() { return linkRate; }
+
+    // Even spread over the pacing window, but never faster than the link can drain: anything
+    // above that would only end up queued again.
+    double pacingRate(size_t frameBytes, std::chrono::microseconds frameInterval) {
+        double windowS = fraction * frameInterval.count() / 1'000'000.0;
+        double rate = windowS > 0 ? frameBytes / windowS : 0;
+        if (linkRate > 0 && (rate <= 0 || rate > linkRate))
+            rate = linkRate;
+        return rate;
+    }
+
+    // Writes data through send(ptr, len) in paced chunks. Returns false as soon as send fails.
+    // With pacing disabled the whole buffer is handed to send at once.
+    bool send(const uint8_t *data,
+              size_t size,
+              std::chrono::microseconds frameInterval,
+              const std::function<bool(const uint8_t *, size_t)> &send) {
+        double rate = enabled() ? pacingRate(size, frameInterval) : 0;
+        if (rate <= 0)
+            return send(data, size);
+
+        auto start = Clk::now();
+        for (size_t sent = 0; sent < size;) {
+            // release time of this chunk: bytes already sent at the pacing rate
+            waitUntil(start + std::chrono::duration_cast<Clk::duration>(
+                                  std::chrono::duration<double>(sent / rate)));
+            auto n = (std::min)(chunkSize, size - sent);
+            if (!send(data + sent, n))
+                return false;
+            sent += n;
+        }
+        return true;
+    }
+};
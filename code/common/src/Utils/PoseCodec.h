@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Compact encoding of the phone's sensor samples (orientation, acceleration, timestamp) for the
+// pose datagrams, 24 bytes for a single sample instead of 36.
+//
+// packet: magic (1) / sample count (1) / timestamp of the newest sample (8)
+// sample: age relative to the newest in us (2) / quaternion (6) / acceleration (6)
+//
+// Quaternions use "smallest three": the largest component is dropped (its sign is folded into the
+// others, q and -q are the same rotation) and rebuilt from the unit norm, the other three lie in
+// [-1/sqrt2, 1/sqrt2] and get 15 bits each. The rotation error is below 0.01 degrees.
+// Acceleration is stored as IEEE half floats, relative error below 2^-11 (~0.005 m/s^2 at 1 g).
+// Samples are fixed-size records and only the age refers to another sample, so batch loops have
+// no dependency between iterations and can be vectorized.
+//
+// PCs from before the codec only take the legacy 36 byte datagram of a single sample, plain
+// floats and the timestamp. The PC announces the codec in STREAM_CONFIG.
+namespace PoseCodec {
+    struct Sample {
+        float quat[4];   // any component order, decoded in the same order
+        float acc[3];
+        int64_t timestamp;   // clock ticks in ns
+    };
+
+    const uint8_t PACKET_MAGIC = 0xb5;
+    const size_t HEADER_SIZE = 1 + 1 + 8;
+    const size_t SAMPLE_SIZE = 2 + 6 + 6;
+    const size_t MAX_BATCH = 16;
+    const int QUAT_BITS = 15;
+    const size_t LEGACY_SIZE = 4 * 4 + 3 * 4 + 8;   // quat / acc / timestamp
+
+    constexpr size_t packetSize(size_t count) { return HEADER_SIZE + count * SAMPLE_SIZE; }
+
+    // round to nearest even, overflow goes to infinity, small values to subnormals or zero
+    inline uint16_t toHalf(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        uint16_t sign = (bits >> 16) & 0x8000;
+        int32_t exp = (int32_t) ((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mant = bits & 0x7fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff)   // inf, nan
+            return sign | 0x7c00 | (mant ? 0x200 : 0);
+        if (exp >= 31)
+            return sign | 0x7c00;
+        if (exp <= 0) {
+            if (exp < -10)
+                return sign;
+            mant |= 0x800000;
+            uint32_t shift = 14 - exp;
+            uint32_t half = mant >> shift;
+            uint32_t rest = mant & ((1u << shift) - 1);
+            uint32_t midpoint = 1u << (shift - 1);
+            if (rest > midpoint || (rest == midpoint && (half & 1)))
+                half++;
+            return sign | (uint16_t) half;
+        }
+        uint32_t half = ((uint32_t) exp << 10) | (mant >> 13);
+        uint32_t rest = mant & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            half++;   // may carry into the exponent, which is still correct
+        return sign | (uint16_t) half;
+    }
+
+    inline float fromHalf(uint16_t half) {
+        uint32_t sign = (uint32_t) (half & 0x8000) << 16;
+        uint32_t exp = (half >> 10) & 0x1f;
+        uint32_t mant = half & 0x3ff;
+        uint32_t bits;
+        if (exp == 0x1f)
+            bits = sign | 0x7f800000 | (mant << 13);
+        else if (exp != 0)
+            bits = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+        else {
+            float value = std::ldexp((float) mant, -24);
+            return sign ? -value : value;
+        }
+        float value;
+        memcpy(&value, &bits, 4);
+        return value;
+    }
+
+    // 2 bits index of the dropped component, then 3 x QUAT_BITS
+    inline uint64_t packQuat(const float quat[4]) {
+        const float range = 0.70710678f;
+        const float steps = (float) ((1 << QUAT_BITS) - 1);
+
+        int largest = 0;
+        for (int i = 1; i < 4; i++)
+            if (std::abs(quat[i]) > std::abs(quat[largest]))
+                largest = i;
+        float sign = quat[largest] < 0 ? -1.f : 1.f;
+        float norm = std::sqrt(quat[0] * quat[0] + quat[1] * quat[1] + quat[2] * quat[2] +
+                               quat[3] * quat[3]);
+        float scale = norm > 0 ? sign / norm : 0;
+
+        uint64_t packed = (uint64_t) largest;
+        for (int i = 0, slot = 0; i < 4; i++) {
+            if (i == largest)
+                continue;
+            float value = std::clamp(quat[i] * scale, -range, range);
+            auto q = (uint64_t) std::lround((value + range) / (2 * range) * steps);
+            packed |= q << (2 + slot * QUAT_BITS);
+            slot++;
+        }
+        return packed;
+    }
+
+    inline void unpackQuat(uint64_t packed, float quat[4]) {
+        const float range = 0.70710678f;
+        const float steps = (float) ((1 << QUAT_BITS) - 1);
+        const uint64_t mask = (1 << QUAT_BITS) - 1;
+
+        int largest = (int) (packed & 3);
+        float sumSq = 0;
+        for (int i = 0, slot = 0; i < 4; i++) {
+            if (i == largest)
+                continue;
+            auto q = (packed >> (2 + slot * QUAT_BITS)) & mask;
+            quat[i] = q / steps * 2 * range - range;
+            sumSq += quat[i] * quat[i];
+            slot++;
+        }
+        quat[largest] = std::sqrt((std::max)(0.f, 1 - sumSq));
+    }
+
+    // Writes count samples (oldest first) to out. Returns the packet size, 0 if the batch is empty,
+    // too big or does not fit.
+    inline size_t encode(const Sample *samples, size_t count, uint8_t *out, size_t outSize) {
+        if (count == 0 || count > MAX_BATCH || outSize < packetSize(count))
+            return 0;
+        int64_t newest = samples[count - 1].timestamp;
+        out[0] = PACKET_MAGIC;
+        out[1] = (uint8_t) count;
+        memcpy(&out[2], &newest, 8);
+
+        for (size_t i = 0; i < count; i++) {
+            auto &s = samples[i];
+            uint8_t *rec = out + HEADER_SIZE + i * SAMPLE_SIZE;
+            auto ageUs = (newest - s.timestamp) / 1000;
+            auto age = (uint16_t) std::clamp<int64_t>(ageUs, 0, UINT16_MAX);
+            uint64_t quat = packQuat(s.quat);
+            uint16_t acc[3] = {toHalf(s.acc[0]), toHalf(s.acc[1]), toHalf(s.acc[2])};
+            memcpy(rec, &age, 2);
+            memcpy(rec + 2, &quat, 6);   // little endian, low 48 bits
+            memcpy(rec + 8, acc, 6);
+        }
+        return packetSize(count);
+    }
+
+    inline size_t encodeLegacy(const Sample &sample, uint8_t *out, size_t outSize) {
+        if (outSize < LEGACY_SIZE)
+            return 0;
+        memcpy(out, sample.quat, 4 * 4);
+        memcpy(out + 4 * 4, sample.acc, 3 * 4);
+        memcpy(out + 4 * 4 + 3 * 4, &sample.timestamp, 8);
+        return LEGACY_SIZE;
+    }
+
+    // Returns the number of samples read, 0 if data is not a valid pose packet.
+    inline size_t decode(const uint8_t *data, size_t size, Sample *samples, size_t maxCount) {
+        if (size < HEADER_SIZE || data[0] != PACKET_MAGIC)
+            return 0;
+        size_t count = data[1];
+        if (count == 0 || count > maxCount || size < packetSize(count))
+            return 0;
+        int64_t newest;
+        memcpy(&newest, &data[2], 8);
+
+        for (size_t i = 0; i < count; i++) {
+            auto &s = samples[i];
+            const uint8_t *rec = data + HEADER_SIZE + i * SAMPLE_SIZE;
+            uint16_t age;
+            uint64_t quat = 0;
+            uint16_t acc[3];
+            memcpy(&age, rec, 2);
+            memcpy(&quat, rec + 2, 6);
+            memcpy(acc, rec + 8, 6);
+            s.timestamp = newest - (int64_t) age * 1000;
+            unpackQuat(quat, s.quat);
+            for (int j = 0; j < 3; j++)
+                s.acc[j] = fromHalf(acc[j]);
+        }
+        return count;
+    }
+
+    // a packet of either layout, no codec packet is LEGACY_SIZE long (they are 10 + 14n)
+    inline size_t decodeAny(const uint8_t *data, size_t size, Sample *samples, size_t maxCount) {
+        if (size != LEGACY_SIZE)
+            return decode(data, size, samples, maxCount);
+        if (maxCount == 0)
+            return 0;
+        memcpy(samples[0].quat, data, 4 * 4);
+        memcpy(samples[0].acc, data + 4 * 4, 3 * 4);
+        memcpy(&samples[0].timestamp, data + 4 * 4 + 3 * 4, 8);
+        return 1;
+    }
+}   // namespace PoseCodec
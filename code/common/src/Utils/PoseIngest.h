@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+// Turns the phone's orientation samples into what SteamVR's own prediction needs: angular
+// velocity, angular acceleration and the time of the pose on the PC clock (poseTimeOffset).
+//
+// Clocks: arrival - sample time = clock offset + one way delay + queuing. The minimum over a
+// sliding window is the sample that didn't queue, and its one way delay is taken as half the
+// smallest RTT seen, so the offset is minDelta - minRtt / 2 (the symmetric path assumption NTP
+// makes too). Without an RTT it degrades to age since arrival of the best sample.
+//
+// Velocity is a finite difference over ~VELOCITY_SPAN_MS of samples (one step is mostly sensor
+// noise), which estimates it at the middle of the span; the acceleration brings it forward to the
+// newest sample. Vectors are in the same (world) frame as the orientations, like SteamVR wants.
+namespace PoseIngest {
+    struct Quat {
+        double w = 1, x = 0, y = 0, z = 0;
+    };
+
+    inline Quat mul(const Quat &a, const Quat &b) {
+        return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+                a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+    }
+
+    inline Quat conj(const Quat &q) { return {q.w, -q.x, -q.y, -q.z}; }
+
+    inline Quat normalized(const Quat &q) {
+        double n = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+        return n > 0 ? Quat{q.w / n, q.x / n, q.y / n, q.z / n} : Quat{};
+    }
+
+    // axis * angle of the shorter rotation
+    inline void toRotVec(Quat q, double v[3]) {
+        if (q.w < 0)
+            q = {-q.w, -q.x, -q.y, -q.z};
+        double s = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z);
+        double k = s > 1e-12 ? 2 * std::atan2(s, q.w) / s : 2;
+        v[0] = q.x * k;
+        v[1] = q.y * k;
+        v[2] = q.z * k;
+    }
+
+    inline Quat fromRotVec(const double v[3]) {
+        double angle = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (angle < 1e-12)
+            return {1, v[0] / 2, v[1] / 2, v[2] / 2};
+        double s = std::sin(angle / 2) / angle;
+        return {std::cos(angle / 2), v[0] * s, v[1] * s, v[2] * s};
+    }
+
+    // what SteamVR does with a pose dt seconds after its time
+    inline Quat predict(const Quat &q, const double vel[3], const double acc[3], double dt) {
+        double v[3];
+        for (int i = 0; i < 3; i++)
+            v[i] = vel[i] * dt + acc[i] * dt * dt / 2;
+        return normalized(mul(fromRotVec(v), q));
+    }
+
+    // angle between two orientations in radians
+    inline double angleBetween(const Quat &a, const Quat &b) {
+        double v[3];
+        toRotVec(mul(a, conj(b)), v);
+        return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+
+    struct State {
+        Quat quat;
+        double angularVelocity[3] = {};       // rad/s
+        double angularAcceleration[3] = {};   // rad/s^2
+        double poseTimeOffsetS = 0;           // pose time - now, negative
+    };
+
+    class Ingest {
+      public:
+        static constexpr double VELOCITY_SPAN_MS = 25;
+        static constexpr double ACC_SMOOTHING = 0.25;   // EMA weight of a new sample
+        static constexpr double MAX_ACC = 100;          // rad/s^2, faster is noise
+        static constexpr double CLOCK_WINDOW_S = 10;
+
+      private:
+        struct Sample {
+            Quat quat;
+            int64_t phoneNs;
+        };
+        std::deque<Sample> history;                      // VELOCITY_SPAN_MS and one more
+        std::deque<std::pair<int64_t, int64_t>> deltas;   // (arrival, arrival - sample), rising
+        double minRttMs = 0;
+        double velMid[3] = {}, vel[3] = {}, acc[3] = {};
+        int64_t velMidNs = 0;
+        bool hasVel = false;
+
+      public:
+        void reset() { *this = Ingest(); }
+
+        // quat is w x y z, sampleNs on the phone clock, arrivalNs on the PC clock. rttMs is the
+        // current RTT estimate, 0 if unknown. Samples not newer than the last one are ignored.
+        void add(const float quat[4], int64_t sampleNs, int64_t arrivalNs, double rttMs) {
+            if (!history.empty() && sampleNs <= history.back().phoneNs)
+                return;
+            if (rttMs > 0)
+                minRttMs = minRttMs > 0 ? (std::min)(minRttMs, rttMs) : rttMs;
+
+            int64_t delta = arrivalNs - sampleNs;
+            while (!deltas.empty() && deltas.back().second >= delta)
+                deltas.pop_back();
+            deltas.push_back({arrivalNs, delta});
+            while (arrivalNs - deltas.front().first > (int64_t) (CLOCK_WINDOW_S * 1e9))
+                deltas.pop_front();
+
+            history.push_back({normalized({quat[0], quat[1], quat[2], quat[3]}), sampleNs});
+            auto spanNs = (int64_t) (VELOCITY_SPAN_MS * 1e6);
+            while (history.size() > 2 && sampleNs - history[1].phoneNs >= spanNs)
+                history.pop_front();
+            if (history.size() < 2)
+                return;
+
+            auto &oldest = history.front();
+            double dt = (sampleNs - oldest.phoneNs) / 1e9;
+            if (dt <= 0)
+                return;
+            double step[3];
+            toRotVec(mul(history.back().quat, conj(oldest.quat)), step);
+            int64_t midNs = oldest.phoneNs + (sampleNs - oldest.phoneNs) / 2;
+            double newMid[3] = {step[0] / dt, step[1] / dt, step[2] / dt};
+
+            if (hasVel && midNs > velMidNs) {
+                double dtMid = (midNs - velMidNs) / 1e9;
+                for (int i = 0; i < 3; i++) {
+                    double a = std::clamp((newMid[i] - velMid[i]) / dtMid, -MAX_ACC, MAX_ACC);
+                    acc[i] += ACC_SMOOTHING * (a - acc[i]);
+                }
+            }
+            double lead = (sampleNs - midNs) / 1e9;
+            for (int i = 0; i < 3; i++) {
+                velMid[i] = newMid[i];
+                vel[i] = newMid[i] + acc[i] * lead;
+            }
+            velMidNs = midNs;
+            hasVel = true;
+        }
+
+        bool empty() const { return history.empty(); }
+
+        // phone clock + offset = PC clock
+        int64_t clockOffsetNs() const {
+            if (deltas.empty())
+                return 0;
+            return deltas.front().second - (int64_t) (minRttMs / 2 * 1e6);
+        }
+
+        // the newest sample as of nowNs on the PC clock
+        State state(int64_t nowNs) const {
+            State s;
+            if (history.empty())
+                return s;
+            s.quat = history.back().quat;
+            for (int i = 0; i < 3; i++) {
+                s.angularVelocity[i] = vel[i];
+                s.angularAcceleration[i] = acc[i];
+            }
+            s.poseTimeOffsetS = (history.back().phoneNs + clockOffsetNs() - nowNs) / 1e9;
+            return s;
+        }
+    };
+}   // namespace PoseIngest
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Immutable refcounted byte buffer. Copies and slices share the storage, so a payload is written
+// once and then handed around (talker, encoder output, decoder config) without copying. The
+// storage is released when the last copy or slice goes away.
+class SharedBuffer {
+    std::shared_ptr<const std::vector<uint8_t>> storage;
+    size_t offset = 0;
+    size_t length = 0;
+
+  public:
+    SharedBuffer() = default;
+
+    // takes over the vector's memory, no copy
+    SharedBuffer(std::vector<uint8_t> &&data)
+        : storage(std::make_shared<const std::vector<uint8_t>>(std::move(data))),
+          length(storage->size()) {}
+
+    static SharedBuffer copyOf(const uint8_t *data, size_t size) {
+        return std::vector<uint8_t>(data, data + size);
+    }
+
+    const uint8_t *data() const { return storage ? storage->data() + offset : nullptr; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    const uint8_t *begin() const { return data(); }
+    const uint8_t *end() const { return data() + length; }
+    const uint8_t &operator[](size_t i) const { return data()[i]; }
+
+    // view of [start, start + size) of this buffer, clamped to its end
+    SharedBuffer slice(size_t start, size_t size = SIZE_MAX) const {
+        SharedBuffer res = *this;
+        res.offset = offset + (std::min)(start, length);
+        res.length = (std::min)(size, length - (res.offset - offset));
+        return res;
+    }
+
+    std::vector<uint8_t> toVector() const { return std::vector<uint8_t>(begin(), end()); }
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "ThreadUtils.h"
+
+// Simulcast: the streamer encodes the same frame at a few quality tiers and every client gets
+// the one its decoder and link keep up with.
+//
+// The expensive shared work (rendering, RGB -> YUV conversion) happens once at full size, each
+// lower tier scales the converted frame down and has its own encoder. Only the tiers a client is
+// on are encoded. Tier 0 is the full size stream, every next one is smaller in both directions
+// and gets less bitrate. Switching tiers needs an IDR of the new tier, the SPS in it tells the
+// client's decoder the new size.
+namespace Simulcast {
+    const int MAX_TIERS = 3;
+
+    struct Tier {
+        int width, height;
+        double rateShare;   // of tier 0's bitrate
+    };
+
+    // Tier sizes keep the aspect ratio and stay multiples of 8 like the render target, the
+    // bitrate goes with pixels^0.75 (smaller pictures need more bits per pixel).
+    inline std::vector<Tier> makeTiers(int width, int height, int count) {
+        static const double scales[MAX_TIERS] = {1, 0.75, 0.5};
+        std::vector<Tier> tiers;
+        for (int i = 0; i < std::clamp(count, 1, MAX_TIERS); i++) {
+            int w = (int) (width * scales[i]) / 8 * 8, h = (int) (height * scales[i]) / 8 * 8;
+            tiers.push_back({(std::max)(w, 8), (std::max)(h, 8), std::pow(scales[i], 1.5)});
+        }
+        return tiers;
+    }
+
+    // Bilinear scaling of one 8 bit plane, 8 bits of subpixel precision. Used for both the luma
+    // and the chroma planes of an I420 picture. Each output row blends two source rows first, then
+    // samples that row. The blend is most of the work: it's written 16 pixels at a time in 16 bit
+    // math (the weights add up to 256, so nothing overflows), which compilers turn into vector
+    // code at -O2 as well.
+    inline void scalePlane(const uint8_t *src,
+                           int srcStride,
+                           int srcW,
+                           int srcH,
+                           uint8_t *dst,
+                           int dstStride,
+                           int dstW,
+                           int dstH) {
+        // left source pixel and weight of the right one for each destination pixel center
+        std::vector<int> x0s(dstW), fxs(dstW);
+        for (int x = 0; x < dstW; x++) {
+            int sx = (std::max)(0, (int) (((x + 0.5) * srcW / dstW - 0.5) * 256));
+            x0s[x] = (std::min)(sx >> 8, srcW - 1);
+            fxs[x] = sx & 255;
+        }
+        std::vector<uint16_t> row(srcW + 1);   // the last pixel repeated, the right neighbour
+        for (int y = 0; y < dstH; y++) {
+            int sy = (std::max)(0, (int) (((y + 0.5) * srcH / dstH - 0.5) * 256));
+            int y0 = (std::min)(sy >> 8, srcH - 1), y1 = (std::min)(y0 + 1, srcH - 1);
+            int fy = sy & 255;
+            const uint8_t *r0 = src + (size_t) y0 * srcStride, *r1 = src + (size_t) y1 * srcStride;
+            uint16_t w0 = (uint16_t) (256 - fy), w1 = (uint16_t) fy;
+            auto blend = [w0, w1](uint8_t a, uint8_t b) {
+                return (uint16_t) ((uint16_t) (a * w0 + b * w1 + 128) >> 8);
+            };
+            int x = 0;
+            for (; x + 16 <= srcW; x += 16)
+                for (int i = 0; i < 16; i++)
+                    row[x + i] = blend(r0[x + i], r1[x + i]);
+            for (; x < srcW; x++)
+                row[x] = blend(r0[x], r1[x]);
+            row[srcW] = row[srcW - 1];
+            uint8_t *out = dst + (size_t) y * dstStride;
+            for (int x = 0; x < dstW; x++) {
+                int x0 = x0s[x], fx = fxs[x];
+                out[x] = (uint8_t) ((row[x0] * (256 - fx) + row[x0 + 1] * fx + 128) >> 8);
+            }
+        }
+    }
+
+    // What a client reported for the last interval (PVRMsg::ClientStats) plus what the PC knows
+    // about the link to it.
+    struct Report {
+        int framesReceived = 0;
+        int framesDecoded = 0;
+        int framesLost = 0;
+        double decodeMs = 0;    // mean time a frame spent in the decoder
+        double queuingMs = 0;   // RTT above the lowest one seen
+    };
+
+    // Picks a client's tier. Down right away when the decoder can't keep up (mean decode time above
+    // decodeBudget of the frame interval, or a growing backlog of frames) or the link drops or
+    // queues frames. Up one tier after upReports reports in a row whose decode time, scaled to the
+    // bigger picture, fits upBudget. A tier that was just left for being too much is not tried
+    // again for holdS, doubled each time it fails again soon after (up to MAX_HOLD_S).
+    class TierSelector {
+      public:
+        struct Config {
+            double decodeBudget = 0.8;   // of the frame interval
+            double upBudget = 0.6;
+            int maxBacklog = 3;      // frames received but not decoded over one report
+            double maxLoss = 0.02;   // of the frames sent in the interval
+            double maxQueuingMs = 30;
+            int upReports = 6;   // 3 s at the phone's two reports a second
+            double holdS = 10;
+        };
+
+      private:
+        static constexpr double MAX_HOLD_S = 120;
+
+        std::vector<Tier> tiers;
+        Config cfg;
+        double frameIntervalMs;
+        int tier = 0;
+        int goodReports = 0;
+        double holdS;
+        Clk::time_point upHoldUntil;   // no switching up to tier - 1 before this
+        Clk::time_point lastUp;
+
+        static double seconds(Clk::duration d) { return std::chrono::duration<double>(d).count(); }
+
+        double pixels(int t) const { return (double) tiers[t].width * tiers[t].height; }
+
+        bool overloaded(const Report &r) const {
+            int sent = r.framesReceived + r.framesLost;
+            return r.decodeMs > cfg.decodeBudget * frameIntervalMs ||
+                   r.framesReceived - r.framesDecoded > cfg.maxBacklog ||
+                   (sent > 0 && (double) r.framesLost / sent > cfg.maxLoss) ||
+                   r.queuingMs > cfg.maxQueuingMs;
+        }
+
+      public:
+        TierSelector(std::vector<Tier> tiers, double frameIntervalMs, Config cfg)
+            : tiers(std::move(tiers)), cfg(cfg), frameIntervalMs(frameIntervalMs),
+              holdS(cfg.holdS) {}
+        TierSelector(std::vector<Tier> tiers, double frameIntervalMs)
+            : TierSelector(std::move(tiers), frameIntervalMs, Config()) {}
+
+        int current() const { return tier; }
+
+        // the tier the client should get from now on
+        int onReport(const Report &r, Clk::time_point now) {
+            if (overloaded(r)) {
+                goodReports = 0;
+                if (tier + 1 < (int) tiers.size()) {
+                    // the last step up did not hold
+                    if (seconds(now - lastUp) < 2 * holdS)
+                        holdS = (std::min)(holdS * 2, MAX_HOLD_S);
+                    else
+                        holdS = cfg.holdS;
+                    tier++;
+                    upHoldUntil = now + std::chrono::duration_cast<Clk::duration>(
+                                            std::chrono::duration<double>(holdS));
+                }
+                return tier;
+            }
+            if (r.framesDecoded == 0)
+                return tier;   // nothing to judge the decoder by
+            // would the decoder keep up with the bigger picture
+            if (tier == 0 ||
+                r.decodeMs * pixels(tier - 1) / pixels(tier) >= cfg.upBudget * frameIntervalMs) {
+                goodReports = 0;
+                return tier;
+            }
+            if (++goodReports >= cfg.upReports && now >= upHoldUntil) {
+                tier--;
+                goodReports = 0;
+                lastUp = now;
+            }
+            return tier;
+        }
+    };
+}   // namespace Simulcast
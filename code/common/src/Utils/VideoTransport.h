@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "ThreadUtils.h"
+
+// The video channel runs over TCP or over UDP with forward error correction.
+//
+// In UDP mode a frame (the same frame header + NALs as on TCP) is cut into FRAGMENT_SIZE pieces,
+// every group of groupSize data fragments is followed by one XOR parity fragment, so one lost
+// datagram per group is repaired without a round trip. Frames that still miss fragments are
+// dropped. Every datagram is padded to DATAGRAM_SIZE.
+// The client answers each completed frame with a Feedback datagram carrying the frame pts and
+// its cumulative datagram counters, the PC derives RTT and loss from it.
+namespace VideoTransport {
+    enum Mode { TCP, UDP };
+
+    struct FragmentHeader {
+        int64_t pts;
+        uint32_t seq;         // per datagram, gaps are losses
+        uint32_t frameSize;   // bytes of the whole frame
+        uint16_t index;       // data fragments first, then parity fragments
+        uint16_t dataCount;
+        uint8_t groupSize;   // data fragments per parity fragment, 0 without FEC
+        uint8_t reserved[3];
+    };
+    static_assert(sizeof(FragmentHeader) == 24, "FragmentHeader has padding");
+
+    struct Feedback {
+        int64_t ackPts;        // last completed frame, -1 before the first one
+        uint32_t received;     // datagrams received so far
+        uint32_t expected;     // datagrams sent so far as seen from the sequence numbers
+        uint32_t framesLost;   // frames given up on, or never seen at all
+        uint32_t reserved;
+    };
+
+    const size_t FRAGMENT_SIZE = 1200;   // stays below the usual 1500 MTU with IP/UDP headers
+    const size_t DATAGRAM_SIZE = sizeof(FragmentHeader) + FRAGMENT_SIZE;
+
+    inline size_t parityCount(size_t dataCount, int groupSize) {
+        return groupSize > 0 ? (dataCount + groupSize - 1) / groupSize : 0;
+    }
+
+    // Appends the datagrams of one frame to wire, DATAGRAM_SIZE bytes each, and returns how many.
+    inline size_t packetize(int64_t pts,
+                            const uint8_t *frame,
+                            size_t size,
+                            int groupSize,
+                            uint32_t &seq,
+                            std::vector<uint8_t> &wire) {
+        groupSize = std::clamp(groupSize, 0, 255);
+        size_t dataCount = (std::max<size_t>)((size + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE, 1);
+        size_t total = dataCount + parityCount(dataCount, groupSize);
+        size_t start = wire.size();
+        wire.resize(start + total * DATAGRAM_SIZE);   // zero filled, pads the last fragment
+
+        for (size_t i = 0; i < total; i++) {
+            uint8_t *dgram = &wire[start + i * DATAGRAM_SIZE];
+            FragmentHeader hdr = {pts,
+                                  seq++,
+                                  (uint32_t) size,
+                                  (uint16_t) i,
+                                  (uint16_t) dataCount,
+                                  (uint8_t) groupSize,
+                                  {}};
+            memcpy(dgram, &hdr, sizeof(hdr));
+
+            uint8_t *payload = dgram + sizeof(hdr);
+            if (i < dataCount) {
+                size_t offset = i * FRAGMENT_SIZE;
+                memcpy(payload, frame + offset, (std::min)(FRAGMENT_SIZE, size - offset));
+            } else {
+                size_t first = (i - dataCount) * groupSize;
+                size_t last = (std::min)(first + groupSize, dataCount);
+                for (size_t d = first; d < last; d++) {
+                    const uint8_t *src = &wire[start + d * DATAGRAM_SIZE] + sizeof(hdr);
+                    for (size_t b = 0; b < FRAGMENT_SIZE; b++)
+                        payload[b] ^= src[b];
+                }
+            }
+        }
+        return total;
+    }
+
+    // Client side: collects fragments, repairs what the parity allows and hands out frames in
+    // pts order. Frames older than a completed one are given up on.
+    class FrameAssembler {
+        struct Partial {
+            uint32_t frameSize = 0;
+            size_t dataCount = 0;
+            int groupSize = 0;
+            size_t missing = 0;
+            std::vector<uint8_t> data;
+            std::vector<uint8_t> parity;
+            std::vector<bool> have;   // data fragments, then parity fragments
+        };
+
+        static const size_t MAX_PARTIALS = 8;
+
+        std::map<int64_t, Partial> partials;
+        int64_t lastDone = (std::numeric_limits<int64_t>::min)();
+
+        bool seqStarted = false;
+        uint32_t firstSeq = 0, highestSeq = 0;
+        uint32_t receivedCount = 0;
+        uint32_t lostFrames = 0;
+        bool hasDone = false;
+        uint32_t doneEndSeq = 0;   // last datagram of the last completed frame
+
+        void repair(Partial &p, size_t group) {
+            if (p.groupSize == 0 || !p.have[p.dataCount + group])
+                return;
+            size_t first = group * p.groupSize;
+            size_t last = (std::min)(first + p.groupSize, p.dataCount);
+            size_t lost = 0, lostIdx = 0;
+            for (size_t d = first; d < last; d++)
+                if (!p.have[d]) {
+                    lost++;
+                    lostIdx = d;
+                }
+            if (lost != 1)
+                return;
+            uint8_t *dst = &p.data[lostIdx * FRAGMENT_SIZE];
+            memcpy(dst, &p.parity[group * FRAGMENT_SIZE], FRAGMENT_SIZE);
+            for (size_t d = first; d < last; d++)
+                if (d != lostIdx)
+                    for (size_t b = 0; b < FRAGMENT_SIZE; b++)
+                        dst[b] ^= p.data[d * FRAGMENT_SIZE + b];
+            p.have[lostIdx] = true;
+            p.missing--;
+        }
+
+      public:
+        // Returns true and fills frame when the datagram completes a frame.
+        bool add(const uint8_t *dgram, size_t size, std::vector<uint8_t> &frame) {
+            FragmentHeader hdr;
+            if (size != DATAGRAM_SIZE)
+                return false;
+            memcpy(&hdr, dgram, sizeof(hdr));
+            size_t total = hdr.dataCount + parityCount(hdr.dataCount, hdr.groupSize);
+            if (hdr.dataCount == 0 || hdr.index >= total ||
+                hdr.frameSize > hdr.dataCount * FRAGMENT_SIZE)
+                return false;
+
+            receivedCount++;
+            if (!seqStarted) {
+                seqStarted = true;
+                firstSeq = highestSeq = hdr.seq;
+            } else if ((int32_t) (hdr.seq - highestSeq) > 0)
+                highestSeq = hdr.seq;
+
+            if (hdr.pts <= lastDone)
+                return false;   // late fragment or parity of a finished frame
+
+            auto &p = partials[hdr.pts];
+            if (p.have.empty()) {
+                p.frameSize = hdr.frameSize;
+                p.dataCount = hdr.dataCount;
+                p.groupSize = hdr.groupSize;
+                p.missing = hdr.dataCount;
+                p.data.resize(hdr.dataCount * FRAGMENT_SIZE);
+                p.parity.resize((total - hdr.dataCount) * FRAGMENT_SIZE);
+                p.have.resize(total);
+            }
+            if (p.dataCount != hdr.dataCount || p.have[hdr.index])
+                return false;
+
+            p.have[hdr.index] = true;
+            const uint8_t *payload = dgram + sizeof(hdr);
+            if (hdr.index < p.dataCount) {
+                memcpy(&p.data[hdr.index * FRAGMENT_SIZE], payload, FRAGMENT_SIZE);
+                p.missing--;
+                if (p.groupSize > 0)
+                    repair(p, hdr.index / p.groupSize);
+            } else {
+                size_t group = hdr.index - p.dataCount;
+                memcpy(&p.parity[group * FRAGMENT_SIZE], payload, FRAGMENT_SIZE);
+                repair(p, group);
+            }
+
+            if (p.missing == 0) {
+                frame.assign(p.data.begin(), p.data.begin() + p.frameSize);
+                lastDone = hdr.pts;
+                // older incomplete frames can't be used anymore
+                auto end = partials.upper_bound(hdr.pts);
+                auto dropped = (uint32_t) std::distance(partials.begin(), end) - 1;
+                // a frame none of whose datagrams arrived leaves no partial, only a seq gap
+                uint32_t startSeq = hdr.seq - hdr.index;
+                if (dropped == 0 && hasDone && startSeq != doneEndSeq + 1)
+                    dropped = 1;
+                lostFrames += dropped;
+                partials.erase(partials.begin(), end);
+                hasDone = true;
+                doneEndSeq = startSeq + (uint32_t) total - 1;
+                return true;
+            }
+            if (partials.size() > MAX_PARTIALS) {
+                partials.erase(partials.begin());
+                lostFrames++;
+            }
+            return false;
+        }
+
+        Feedback feedback(int64_t ackPts) const {
+            return {
+                ackPts, receivedCount, seqStarted ? highestSeq - firstSeq + 1 : 0, lostFrames, 0};
+        }
+    };
+
+    // Picks the transport of the video channel. TCP is preferred, on a clean link it delivers
+    // everything at the same latency. Loss makes TCP stall the whole stream behind
+    // retransmissions (head-of-line blocking), then UDP with FEC is better: a lost frame costs a
+    // glitch instead of a freeze.
+    // TCP -> UDP when frames arrive late for more than stallFraction of the window, UDP -> TCP
+    // when datagram loss stays below cleanLoss for the whole window. The two use different
+    // signals and thresholds, and a switch is held for at least holdS, doubled each time the
+    // previous switch is undone soon after (up to MAX_HOLD_S).
+    // UDP without any feedback for a window (a firewall drops the client's datagrams) means the
+    // switch failed: back to TCP right away, with the hold doubled as for flapping.
+    class TransportSelector {
+      public:
+        struct Config {
+            double stallFraction = 0.05;
+            double cleanLoss = 0.005;
+            double windowS = 2;
+            double holdS = 5;
+        };
+
+      private:
+        static constexpr double MAX_HOLD_S = 60;
+        static const uint32_t MIN_DATAGRAMS = 200;   // loss is meaningless below this
+
+        Config cfg;
+        double frameIntervalMs;
+        Mode mode;
+        double holdS;
+        Clk::time_point modeStart;
+        Clk::time_point lastFeedback;   // or the switch to UDP
+        bool feedbackLost = false;      // the switch back to TCP is for that
+
+        std::deque<std::pair<Clk::time_point, double>> latencies;   // TCP ack latency samples
+        double baseLatencyMs = (std::numeric_limits<double>::max)();
+        double srttMs = 0;
+
+        struct LossSample {
+            Clk::time_point tp;
+            uint32_t received, expected;
+        };
+        std::deque<LossSample> lossReports;   // cumulative counters as reported
+
+        static double seconds(Clk::duration d) { return std::chrono::duration<double>(d).count(); }
+
+        template <typename T> void trim(std::deque<T> &samples, Clk::time_point now) {
+            while (!samples.empty() && seconds(now - samples.front().first) > cfg.windowS)
+                samples.pop_front();
+        }
+
+      public:
+        TransportSelector(Mode initial, Config cfg, double frameIntervalMs)
+            : cfg(cfg), frameIntervalMs(frameIntervalMs), mode(initial), holdS(cfg.holdS),
+              modeStart(Clk::now()), lastFeedback(modeStart) {}
+
+        Mode current() const { return mode; }
+        double rttMs() const { return srttMs; }
+
+        // round trip of a frame, acked over TCP or with a feedback datagram
+        void onAck(Mode via, double latencyMs, Clk::time_point now) {
+            srttMs = srttMs > 0 ? 0.875 * srttMs + 0.125 * latencyMs : latencyMs;
+            if (via != TCP)
+                return;
+            baseLatencyMs = (std::min)(baseLatencyMs, latencyMs);
+            latencies.push_back({now, latencyMs});
+            trim(latencies, now);
+        }
+
+        void onFeedback(const Feedback &fb, Clk::time_point now) {
+            lastFeedback = now;
+            lossReports.push_back({now, fb.received, fb.expected});
+            while (lossReports.size() > 1 && seconds(now - lossReports[1].tp) > cfg.windowS)
+                lossReports.pop_front();
+        }
+
+        // part of the window in which frames were late: a frame is late by how much its
+        // round trip exceeds the best one plus a frame interval, at most one frame interval
+        double stallFraction(Clk::time_point now) {
+            trim(latencies, now);
+            double stalledMs = 0;
+            for (auto &s : latencies)
+                stalledMs +=
+                    std::clamp(s.second - baseLatencyMs - frameIntervalMs, 0.0, frameIntervalMs);
+            return stalledMs / (cfg.windowS * 1000);
+        }
+
+        // datagram loss over the window, negative if there is not enough data yet
+        double lossRate() const {
+            if (lossReports.size() < 2)
+                return -1;
+            uint32_t expected = lossReports.back().expected - lossReports.front().expected;
+            uint32_t received = lossReports.back().received - lossReports.front().received;
+            if (expected < MIN_DATAGRAMS)
+                return -1;
+            return 1 - (double) (std::min)(received, expected) / expected;
+        }
+
+        // Mode the channel should be in. The caller switches at the next IDR and then calls
+        // switched().
+        Mode wanted(Clk::time_point now) {
+            feedbackLost = mode == UDP && seconds(now - lastFeedback) > cfg.windowS;
+            if (feedbackLost)
+                return TCP;
+            if (seconds(now - modeStart) < (std::max)(holdS, cfg.windowS))
+                return mode;
+            if (mode == TCP)
+                return stallFraction(now) > cfg.stallFraction ? UDP : TCP;
+            double loss = lossRate();
+            return loss >= 0 && loss < cfg.cleanLoss ? TCP : UDP;
+        }
+
+        void switched(Mode newMode, Clk::time_point now) {
+            if (newMode == mode)
+                return;
+            // flapping: the last switch did not hold
+            if (feedbackLost || seconds(now - modeStart) < 2 * holdS)
+                holdS = (std::min)(holdS * 2, MAX_HOLD_S);
+            else
+                holdS = cfg.holdS;
+            mode = newMode;
+            modeStart = now;
+            lastFeedback = now;
+            feedbackLost = false;
+            latencies.clear();
+            lossReports.clear();
+        }
+    };
+}   // namespace VideoTransport
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#define ASIO_STANDALONE
+#include "asio.hpp"
+
+#include "Check.h"
+#include "Utils/JitterBuffer.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace Audio;
+using asio::ip::udp;
+
+// The audio path of PVRStartAudioStreamer and the phone's PVRAudio over real UDP on loopback, in
+// real time: a SyntheticSource with a click every half second, the PCM codec, one datagram per
+// 5 ms packet, the jitter buffer and a device thread pulling 5 ms blocks. The clicks give the
+// latency from capture to the speaker.
+namespace {
+    const int PACKET_FRAMES = 240;
+    const int64_t CLICK_PERIOD = SAMPLE_RATE / 2;
+    const int64_t OUTPUT_LATENCY_NS = 10'000'000;
+    const auto WARMUP = 2s;   // the jitter buffer learns the link
+
+    struct Result {
+        uint64_t sent = 0;
+        JitterBuffer::Stats stats, warmedUp;
+        vector<double> latenciesMs;   // of each click heard after WARMUP
+    };
+
+    Result stream(seconds length) {
+        asio::io_context svc;
+        udp::socket rx(svc, {asio::ip::address_v4::loopback(), 0}), tx(svc);
+        tx.open(udp::v4());
+        auto ep = rx.local_endpoint();
+
+        JitterBuffer jitter;
+        Result res;
+        atomic<bool> running{true};
+        atomic<int64_t> sourceStartNs{-1};
+
+        // PC
+        thread sender([&] {
+            SyntheticSource source(440, CLICK_PERIOD);
+            auto encoder = makeEncoder(PCM16, 0);
+            vector<int16_t> pcm(PACKET_FRAMES * CHANNELS);
+            uint8_t dgram[sizeof(PacketHeader) + MAX_PAYLOAD];
+            PacketHeader hdr = {0, 0, PACKET_FRAMES, PCM16, 0};
+            Clk::time_point captureTime;
+            while (running && source.read(pcm.data(), PACKET_FRAMES, captureTime)) {
+                if (sourceStartNs < 0)
+                    sourceStartNs = captureTime.time_since_epoch().count();
+                hdr.position = nsToFrames(captureTime.time_since_epoch().count());
+                auto size = encoder->encode(pcm.data(), PACKET_FRAMES, &dgram[sizeof(hdr)],
+                                            MAX_PAYLOAD);
+                memcpy(dgram, &hdr, sizeof(hdr));
+                hdr.seq++;
+                asio::error_code ec;
+                tx.send_to(asio::buffer(dgram, sizeof(hdr) + size), ep, 0, ec);
+                res.sent++;
+            }
+            uint8_t stop = 0;   // wakes the receiver
+            tx.send_to(asio::buffer(&stop, 1), ep);
+        });
+
+        // phone, network thread
+        thread receiver([&] {
+            auto decoder = makeDecoder(PCM16);
+            uint8_t dgram[sizeof(PacketHeader) + MAX_PAYLOAD];
+            int16_t pcm[MAX_PACKET_FRAMES * CHANNELS];
+            while (true) {
+                size_t len = rx.receive(asio::buffer(dgram));
+                auto arrivalNs = Clk::now().time_since_epoch().count();
+                if (len < sizeof(PacketHeader))
+                    break;
+                PacketHeader hdr;
+                memcpy(&hdr, dgram, sizeof(hdr));
+                int frames =
+                    decoder->decode(&dgram[sizeof(hdr)], len - sizeof(hdr), pcm, MAX_PACKET_FRAMES);
+                jitter.push(hdr, pcm, frames, arrivalNs);
+            }
+        });
+
+        // phone, output device
+        vector<int16_t> block(PACKET_FRAMES * CHANNELS);
+        auto start = Clk::now();
+        bool wasHigh = false;
+        auto blockTime = nanoseconds(framesToNs(PACKET_FRAMES));
+        for (auto next = start; next < start + length; next += blockTime) {
+            this_thread::sleep_until(next);
+            auto now = Clk::now().time_since_epoch().count();
+            auto playNs = now + framesToNs(PACKET_FRAMES) + OUTPUT_LATENCY_NS;
+            jitter.pull(block.data(), PACKET_FRAMES, playNs, now);
+            bool warm = Clk::now() - start > WARMUP;
+            for (int i = 0; i < PACKET_FRAMES; i++) {
+                bool high = block[i * CHANNELS] >= 32000;
+                if (high && !wasHigh && warm) {
+                    // the click captured last before it played
+                    auto sinceStart = playNs + framesToNs(i) - sourceStartNs;
+                    auto click = sinceStart / framesToNs(CLICK_PERIOD);
+                    res.latenciesMs.push_back((sinceStart - framesToNs(click * CLICK_PERIOD)) /
+                                              1e6);
+                }
+                wasHigh = high;
+            }
+            if (!warm)
+                res.warmedUp = jitter.stats(now);
+        }
+        running = false;
+        sender.join();
+        receiver.join();
+        res.stats = jitter.stats(Clk::now().time_since_epoch().count());
+        sort(res.latenciesMs.begin(), res.latenciesMs.end());
+        return res;
+    }
+}   // namespace
+
+TEST(AudioLoopback, EveryClickArrivesAtALowSteadyLatency) {
+    auto res = stream(6s);
+    printf("sent %llu, received %llu, late %llu, lost %llu, underruns %llu, jitter %.1f ms\n",
+           (unsigned long long) res.sent,
+           (unsigned long long) res.stats.received,
+           (unsigned long long) res.stats.late,
+           (unsigned long long) res.stats.lost,
+           (unsigned long long) res.stats.underruns,
+           res.stats.jitterMs);
+    printf("clicks after %.1f to %.1f ms\n", res.latenciesMs.front(), res.latenciesMs.back());
+
+    // nothing is lost on loopback, but threads that wake up late make packets late on a busy
+    // machine: a few, and the buffer grows to cover them
+    CHECK_EQ(res.stats.received, res.sent);
+    CHECK(res.stats.lost <= res.sent / 100);
+    CHECK(res.stats.underruns - res.warmedUp.underruns <= res.sent / 100);
+    REQUIRE(res.latenciesMs.size() >= 7);   // one every 0.5 s for 4 s
+    // a packet, a block and the output latency at least
+    CHECK(res.latenciesMs.front() > 15);
+    CHECK(res.latenciesMs.back() < 60);
+    CHECK(res.latenciesMs.back() - res.latenciesMs.front() < 15);
+}
@@ -0,0 +1,107 @@
+#include <cmath>
+
+#include "Check.h"
+#include "Utils/BandwidthProbe.h"
+
+using namespace std;
+using namespace BandwidthProbe;
+
+namespace {
+    // A TCP path with a bottleneck of capacity bytes/s behind baseRttMs. A train starts in slow
+    // start (10 segments, doubling every round trip) until the window covers the bandwidth-delay
+    // product, then arrives at line rate. A standing queue at the bottleneck adds queueMs to the
+    // round trip of every train that isn't empty.
+    struct Link {
+        double capacity;
+        double baseRttMs;
+        double queueMs = 0;
+
+        int64_t receiveUs(size_t bytes) const {
+            double us = 0, left = (double) bytes, cwnd = 10 * 1460;
+            // a round trip per window while the window is below the bandwidth-delay product
+            while (left > cwnd && cwnd < capacity * baseRttMs / 1000) {
+                left -= cwnd;
+                us += baseRttMs * 1000;
+                cwnd *= 2;
+            }
+            return (int64_t) (us + left / capacity * 1e6);
+        }
+
+        int64_t rttUs(size_t bytes) const {
+            return (int64_t) (baseRttMs * 1000 + (bytes ? queueMs * 1000 : 0)) + receiveUs(bytes);
+        }
+    };
+
+    // what ProbeLink does, with the link answering
+    Result probe(const Link &link, int *trains = nullptr) {
+        Estimator est;
+        int count = 0;
+        for (auto size : TRAIN_SIZES) {
+            est.add(size, link.receiveUs(size), link.rttUs(size));
+            count++;
+            if (est.done())
+                break;
+        }
+        if (trains)
+            *trains = count;
+        return est.result();
+    }
+
+    const double MBPS = 1'000'000 / 8.0;
+}   // namespace
+
+// up to a few tens of Mbps on WiFi or USB round trips, a train that fills ENOUGH_US fits in the
+// largest one and slow start is over within a few ms, so the figure is close to the cap
+TEST(BandwidthProbe, MeasuresSlowLinksCloseToTheirCap) {
+    for (double mbps : {2, 5, 10, 20, 40}) {
+        for (double rtt : {2, 10}) {
+            auto res = probe({mbps * MBPS, rtt});
+            REQUIRE(res.valid());
+            CHECK(res.throughputBps < 1.001 * mbps * MBPS);   // receive times are whole us
+            CHECK(res.throughputBps > 0.9 * mbps * MBPS);
+            CHECK_NEAR(res.baseRttMs, rtt, 0.01);
+            CHECK(res.queuingDelayMs < 1);
+        }
+    }
+}
+
+// slower links stop as soon as a train is long enough, faster ones need the bigger trains
+TEST(BandwidthProbe, StopsOnceATrainIsLongEnough) {
+    int slow, fast;
+    probe({2 * MBPS, 5}, &slow);
+    probe({40 * MBPS, 5}, &fast);
+    CHECK(slow < fast);
+    CHECK_EQ(slow, 3);   // 64 KiB at 2 Mbps takes 262 ms
+    CHECK_EQ(fast, (int) (sizeof(TRAIN_SIZES) / sizeof(TRAIN_SIZES[0])));
+}
+
+// A 1 MiB train on a fast link, or any train on a long round trip, is mostly slow start: the
+// figure is low, which only costs quality, and never over the cap.
+TEST(BandwidthProbe, UnderestimatesFastOrDistantLinks) {
+    for (double mbps : {100, 200, 400}) {
+        auto res = probe({mbps * MBPS, 5});
+        CHECK(res.throughputBps < 1.001 * mbps * MBPS);
+        CHECK(res.throughputBps > 0.3 * mbps * MBPS);
+    }
+    auto distant = probe({40 * MBPS, 40});
+    CHECK(distant.throughputBps < 0.6 * 40 * MBPS);
+    CHECK(distant.throughputBps > 0.4 * 40 * MBPS);
+}
+
+TEST(BandwidthProbe, SeesStandingQueues) {
+    auto res = probe({10 * MBPS, 5, 30});
+    CHECK_NEAR(res.baseRttMs, 5, 0.01);
+    CHECK_NEAR(res.queuingDelayMs, 30, 0.01);
+    CHECK(res.throughputBps > 0.85 * 10 * MBPS);
+}
+
+// a client that couldn't time the trains answers 0, that's no measurement
+TEST(BandwidthProbe, NothingReceivedIsNoResult) {
+    Estimator est;
+    CHECK(!est.done());
+    CHECK(!est.result().valid());
+    for (auto size : TRAIN_SIZES)
+        est.add(size, 0, 1000);
+    CHECK(!est.done());
+    CHECK(!est.result().valid());
+}
@@ -0,0 +1,217 @@
+#include <atomic>
+#include <future>
+#include <set>
+
+#include "Check.h"
+#include "Utils/CapturePipeline.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace CapturePipeline;
+
+namespace {
+    // a GPU queue: jobs run one after the other on its own thread
+    class Gpu {
+        mutex mtx;
+        condition_variable cv;
+        deque<function<void()>> jobs;
+        bool running = true;
+        thread worker;
+
+      public:
+        Gpu() {
+            worker = thread([this] {
+                unique_lock<mutex> lock(mtx);
+                while (true) {
+                    cv.wait(lock, [&] { return !jobs.empty() || !running; });
+                    if (jobs.empty())
+                        return;
+                    auto job = move(jobs.front());
+                    jobs.pop_front();
+                    lock.unlock();
+                    job();
+                    lock.lock();
+                }
+            });
+        }
+
+        ~Gpu() {
+            {
+                lock_guard<mutex> lock(mtx);
+                running = false;
+            }
+            cv.notify_all();
+            worker.join();
+        }
+
+        shared_future<void> push(function<void()> job) {
+            auto done = make_shared<promise<void>>();
+            shared_future<void> fence = done->get_future();
+            {
+                lock_guard<mutex> lock(mtx);
+                jobs.push_back([job, done] {
+                    job();
+                    done->set_value();
+                });
+            }
+            cv.notify_all();
+            return fence;
+        }
+    };
+
+    // The PC's copy, conversion and readback as sleeps on the GPU queue. The handle stands for the
+    // frame: it ends up in outFrames[out] once the frame is converted.
+    class MockBackend : public Backend {
+        Gpu gpu;
+        microseconds copyTime, convertTime;
+        vector<shared_future<void>> fences;
+        vector<uint64_t> slotFrames;
+
+      public:
+        vector<uint64_t> outFrames;
+        set<uint64_t> failing;   // handles that can't be locked
+        atomic<int> busySlots{0}, maxBusySlots{0};
+
+        MockBackend(int slots, int buffers, microseconds copyTime, microseconds convertTime)
+            : copyTime(copyTime), convertTime(convertTime), fences(slots), slotFrames(slots),
+              outFrames(buffers) {}
+
+        bool copy(uint64_t handle, int slot) override {
+            if (failing.count(handle))
+                return false;
+            int busy = ++busySlots, max = maxBusySlots;
+            while (busy > max && !maxBusySlots.compare_exchange_weak(max, busy)) {
+            }
+            gpu.push([=] {
+                this_thread::sleep_for(copyTime);
+                slotFrames[slot] = handle;
+            });
+            return true;
+        }
+
+        void convert(int slot, int out) override {
+            fences[slot] = gpu.push([=] {
+                this_thread::sleep_for(convertTime);
+                outFrames[out] = slotFrames[slot];
+            });
+        }
+
+        void wait(int slot) override {
+            fences[slot].wait();
+            busySlots--;
+        }
+    };
+
+    struct Fixture {
+        MockBackend *backend;
+        mutex readyMtx;
+        vector<uint64_t> readyFrames;   // as the completion thread hands them over
+        unique_ptr<Pipeline> pipeline;
+
+        Fixture(int slots, int buffers, microseconds copyTime, microseconds convertTime)
+            : backend(new MockBackend(slots, buffers, copyTime, convertTime)) {
+            pipeline.reset(new Pipeline(unique_ptr<Backend>(backend), slots, buffers, [&](int out) {
+                lock_guard<mutex> lock(readyMtx);
+                readyFrames.push_back(backend->outFrames[out]);
+            }));
+        }
+
+        bool submit(uint64_t frame) {
+            auto t = pipeline->begin();
+            return t.out >= 0 && pipeline->commit(t, frame);
+        }
+
+        size_t ready() {
+            lock_guard<mutex> lock(readyMtx);
+            return readyFrames.size();
+        }
+
+        bool waitReady(size_t count) {
+            auto deadline = Clk::now() + seconds(5);
+            while (ready() < count && Clk::now() < deadline)
+                this_thread::sleep_for(milliseconds(1));
+            return ready() >= count;
+        }
+    };
+}   // namespace
+
+TEST(CapturePipeline, FramesCompleteInSubmitOrder) {
+    Fixture f(2, 4, microseconds(200), microseconds(1500));
+    for (uint64_t frame = 1; frame <= 6; frame++)
+        REQUIRE(f.submit(frame));
+    REQUIRE(f.waitReady(6));
+    for (size_t i = 0; i < f.readyFrames.size(); i++)
+        CHECK_EQ(f.readyFrames[i], i + 1);
+    CHECK(f.backend->maxBusySlots <= 2);
+
+    // the newest one, the others were overwritten or dropped
+    int skipped;
+    int out = f.pipeline->acquire(skipped, milliseconds(100));
+    REQUIRE(out >= 0);
+    CHECK_EQ(f.backend->outFrames[out], 6u);
+    CHECK_EQ(skipped, 5);
+    CHECK_EQ(f.pipeline->acquire(skipped, milliseconds(10)), -1);   // nothing new
+    f.pipeline->release(out);
+}
+
+TEST(CapturePipeline, TheBufferBeingEncodedIsLeftAlone) {
+    Fixture f(2, 4, microseconds(100), microseconds(400));
+    REQUIRE(f.submit(1));
+    int skipped;
+    int reading = f.pipeline->acquire(skipped, milliseconds(100));
+    REQUIRE(reading >= 0);
+    for (uint64_t frame = 2; frame <= 20; frame++) {
+        auto t = f.pipeline->begin();
+        CHECK(t.out != reading);
+        f.pipeline->commit(t, frame);
+    }
+    REQUIRE(f.waitReady(20));
+    CHECK_EQ(f.backend->outFrames[reading], 1u);
+    f.pipeline->release(reading);
+    int newest = f.pipeline->acquire(skipped, milliseconds(100));
+    REQUIRE(newest >= 0);
+    CHECK_EQ(f.backend->outFrames[newest], 20u);
+}
+
+TEST(CapturePipeline, StopWaitsForCommittedFramesAndUnblocks) {
+    Fixture f(2, 4, microseconds(100), milliseconds(5));
+    REQUIRE(f.submit(1));
+    REQUIRE(f.submit(2));
+    thread blocked([&] { f.submit(3); });   // both slots are in flight
+    this_thread::sleep_for(milliseconds(1));
+    f.pipeline->stop();
+    blocked.join();
+    CHECK(f.ready() >= 2);   // their readback wrote the buffers before stop() returned
+    int skipped;
+    CHECK_EQ(f.pipeline->acquire(skipped, milliseconds(10)), -1);
+    CHECK_EQ(f.pipeline->begin().out, -1);
+}
+
+// nothing of a frame whose texture couldn't be copied reaches the encoder, its slot and buffer
+// are free again
+TEST(CapturePipeline, FailedCopyReachesNothing) {
+    Fixture f(1, 2, microseconds(100), microseconds(300));
+    f.backend->failing.insert(7);
+    auto t = f.pipeline->begin();
+    bool prepared = false;
+    CHECK(!f.pipeline->commit(t, 7, [&](int) { prepared = true; }));
+    CHECK(!prepared);
+    CHECK_EQ(f.pipeline->copyFailures(), 1u);
+    int skipped;
+    CHECK_EQ(f.pipeline->acquire(skipped, milliseconds(20)), -1);
+    CHECK_EQ(f.ready(), 0u);
+
+    // the only slot is free again, and both buffers: two frames go through
+    for (uint64_t frame = 8; frame <= 9; frame++) {
+        auto next = f.pipeline->begin();
+        REQUIRE(next.out >= 0);
+        int preparedOut = -1;
+        CHECK(f.pipeline->commit(next, frame, [&](int out) { preparedOut = out; }));
+        CHECK_EQ(preparedOut, next.out);
+    }
+    REQUIRE(f.waitReady(2));
+    int out = f.pipeline->acquire(skipped, milliseconds(100));
+    REQUIRE(out >= 0);
+    CHECK_EQ(f.backend->outFrames[out], 9u);
+    CHECK_EQ(skipped, 1);
+}
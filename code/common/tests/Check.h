@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Just enough of a test framework for these tests, they build with nothing but the compiler:
+//   TEST(Suite, Name) { CHECK(...); REQUIRE(...); }
+// CHECK records a failure and goes on, REQUIRE ends the test. Every test of an executable runs,
+// its name given on the command line runs only that one.
+namespace Tests {
+    struct Test {
+        std::string name;
+        std::function<void()> body;
+    };
+
+    inline std::vector<Test> &all() {
+        static std::vector<Test> tests;
+        return tests;
+    }
+
+    inline int &failures() {
+        static int count = 0;
+        return count;
+    }
+
+    struct Abort {};
+
+    struct Registrar {
+        Registrar(const char *name, std::function<void()> body) { all().push_back({name, body}); }
+    };
+
+    inline bool fail(const char *file, int line, const std::string &what) {
+        std::cerr << file << ":" << line << ": failed: " << what << std::endl;
+        failures()++;
+        return false;
+    }
+
+    template <typename T, typename = void> struct Printable : std::false_type {};
+    template <typename T>
+    struct Printable<T, std::void_t<decltype(std::declval<std::ostream &>() << std::declval<T>())>>
+        : std::true_type {};
+
+    template <typename T> void print(std::ostream &os, const T &value) {
+        if constexpr (std::is_arithmetic<T>::value)
+            os << +value;   // uint8_t as a number
+        else if constexpr (Printable<const T &>::value)
+            os << value;
+        else
+            os << "?";
+    }
+
+    template <typename A, typename B>
+    bool checkEq(const A &a, const B &b, const char *expr, const char *file, int line) {
+        if (a == b)
+            return true;
+        std::ostringstream ss;
+        ss << expr << " (";
+        print(ss, a);
+        ss << " vs ";
+        print(ss, b);
+        ss << ")";
+        return fail(file, line, ss.str());
+    }
+
+    inline bool
+    checkNear(double a, double b, double tolerance, const char *expr, const char *file, int line) {
+        if (std::abs(a - b) <= tolerance)
+            return true;
+        std::ostringstream ss;
+        ss << expr << " (" << a << " vs " << b << ", tolerance " << tolerance << ")";
+        return fail(file, line, ss.str());
+    }
+}   // namespace Tests
+
+#define TEST(suite, name)                                                                          \
+    static void suite##_##name();                                                                  \
+    static Tests::Registrar suite##_##name##_registrar(#suite "." #name, suite##_##name);          \
+    static void suite##_##name()
+
+#define CHECK(cond) ((cond) || Tests::fail(__FILE__, __LINE__, #cond))
+#define CHECK_EQ(a, b) Tests::checkEq((a), (b), #a " == " #b, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, tolerance)                                                                \
+    Tests::checkNear((a), (b), (tolerance), #a " ~ " #b, __FILE__, __LINE__)
+#define REQUIRE(cond)                                                                              \
+    do {                                                                                           \
+        if (!CHECK(cond))                                                                          \
+            throw Tests::Abort();                                                                  \
+    } while (0)
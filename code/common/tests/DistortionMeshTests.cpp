@@ -0,0 +1,141 @@
+#include <cmath>
+#include <filesystem>
+
+#include "Check.h"
+#include "distortion_mesh.h"
+
+using namespace std;
+
+namespace {
+    // radial lens model with the first Cardboard viewer's coefficients, eye center in the middle
+    void lens(float u, float v, float *screenU, float *screenV) {
+        float x = (u - 0.5f) * 0.8f, y = (v - 0.5f) * 0.8f;
+        float r2 = x * x + y * y;
+        float scale = 1 + 0.34f * r2 + 0.55f * r2 * r2;
+        *screenU = 0.5f + x * scale;
+        *screenV = 0.5f + y * scale;
+    }
+
+    // Largest distance between the mesh as the GPU draws it, linear over each triangle of the
+    // strip, and the lens model, in pixels of a w x h eye viewport. Every sample point has to be
+    // covered by a triangle.
+    double maxErrorPx(const DistortionMeshData &mesh, int w, int h) {
+        const int SAMPLES = 301;
+        vector<bool> covered(SAMPLES * SAMPLES);
+        double worst = 0;
+        auto uv = [&](int i) { return make_pair(mesh.uvs[i * 2], mesh.uvs[i * 2 + 1]); };
+        for (size_t t = 2; t < mesh.indices.size(); t++) {
+            int a = mesh.indices[t - 2], b = mesh.indices[t - 1], c = mesh.indices[t];
+            auto [ua, va] = uv(a);
+            auto [ub, vb] = uv(b);
+            auto [uc, vc] = uv(c);
+            double det = (vb - vc) * (ua - uc) + (uc - ub) * (va - vc);
+            if (abs(det) < 1e-12)   // the degenerate ones joining rows
+                continue;
+            int s0 = (int) floor((min)({ua, ub, uc}) * (SAMPLES - 1));
+            int s1 = (int) ceil((max)({ua, ub, uc}) * (SAMPLES - 1));
+            int r0 = (int) floor((min)({va, vb, vc}) * (SAMPLES - 1));
+            int r1 = (int) ceil((max)({va, vb, vc}) * (SAMPLES - 1));
+            for (int r = r0; r <= r1; r++) {
+                for (int s = s0; s <= s1; s++) {
+                    double u = (double) s / (SAMPLES - 1), v = (double) r / (SAMPLES - 1);
+                    double la = ((vb - vc) * (u - uc) + (uc - ub) * (v - vc)) / det;
+                    double lb = ((vc - va) * (u - uc) + (ua - uc) * (v - vc)) / det;
+                    double lc = 1 - la - lb;
+                    if (la < -1e-6 || lb < -1e-6 || lc < -1e-6)
+                        continue;
+                    covered[r * SAMPLES + s] = true;
+                    double x = la * mesh.vertices[a * 2] + lb * mesh.vertices[b * 2] +
+                               lc * mesh.vertices[c * 2];
+                    double y = la * mesh.vertices[a * 2 + 1] + lb * mesh.vertices[b * 2 + 1] +
+                               lc * mesh.vertices[c * 2 + 1];
+                    float screenU, screenV;
+                    lens((float) u, (float) v, &screenU, &screenV);
+                    double dx = ((x + 1) / 2 - screenU) * w, dy = ((y + 1) / 2 - screenV) * h;
+                    worst = (max)(worst, sqrt(dx * dx + dy * dy));
+                }
+            }
+        }
+        CHECK(all_of(covered.begin(), covered.end(), [](bool c) { return c; }));
+        return worst;
+    }
+
+    struct TempFile {
+        string path;
+        explicit TempFile(const char *name)
+            : path((filesystem::temp_directory_path() / name).string()) {
+            remove(path.c_str());
+        }
+        ~TempFile() { remove(path.c_str()); }
+    };
+
+    const DistortionMeshKey KEY = {0x1234, 2400, 1080, 20};
+}   // namespace
+
+TEST(DistortionMesh, StripCoversTheGrid) {
+    auto mesh = buildDistortionMesh(4, lens);
+    CHECK_EQ(mesh.vertices.size(), 32u);
+    CHECK_EQ(mesh.uvs.size(), 32u);
+    // two indices per column and row pair, one more joining each row to the next
+    CHECK_EQ(mesh.indices.size(), 3u * 4 * 2 + 2);
+    CHECK_NEAR(mesh.uvs[2 * 5], 1 / 3.0, 1e-6);
+    CHECK_NEAR(mesh.uvs[2 * 5 + 1], 1 / 3.0, 1e-6);
+    CHECK_NEAR(mesh.vertices[0], -0.4 * (1 + 0.34 * 0.32 + 0.55 * 0.32 * 0.32) * 2, 1e-5);
+    CHECK_EQ(buildDistortionMesh(1, lens).density, 2);
+}
+
+// what the density setting trades: the error falls with the square of the grid spacing
+TEST(DistortionMesh, DenseMeshesFollowTheLens) {
+    const int W = 1200, H = 1080;   // one eye of a 2400x1080 screen
+    double coarse = maxErrorPx(buildDistortionMesh(10, lens), W, H);
+    double standard = maxErrorPx(buildDistortionMesh(40, lens), W, H);
+    printf("max error: density 10 %.2f px, density 40 %.3f px\n", coarse, standard);
+    CHECK(standard < 0.5);
+    CHECK(coarse > standard * 10);
+}
+
+TEST(DistortionMesh, CacheRoundTrips) {
+    TempFile file("pvr_distortion_mesh_test.bin");
+    DistortionMeshData saved[2] = {buildDistortionMesh(20, lens), buildDistortionMesh(20, lens)};
+    for (auto &x : saved[1].vertices)
+        x = -x;
+    REQUIRE(saveDistortionMeshes(file.path, KEY, saved));
+    CHECK(!filesystem::exists(file.path + ".tmp"));
+
+    DistortionMeshData loaded[2];
+    REQUIRE(loadDistortionMeshes(file.path, KEY, loaded));
+    for (int eye = 0; eye < 2; eye++) {
+        CHECK_EQ(loaded[eye].density, 20);
+        CHECK(loaded[eye].vertices == saved[eye].vertices);
+        CHECK(loaded[eye].uvs == saved[eye].uvs);
+        CHECK(loaded[eye].indices == saved[eye].indices);
+    }
+}
+
+TEST(DistortionMesh, CacheRejectsOtherKeysAndBadFiles) {
+    TempFile file("pvr_distortion_mesh_test.bin");
+    DistortionMeshData meshes[2] = {buildDistortionMesh(20, lens), buildDistortionMesh(20, lens)},
+                       loaded[2];
+    CHECK(!loadDistortionMeshes(file.path, KEY, loaded));   // missing
+    REQUIRE(saveDistortionMeshes(file.path, KEY, meshes));
+    for (auto key : {DistortionMeshKey{0x1235, 2400, 1080, 20},
+                     DistortionMeshKey{0x1234, 2340, 1080, 20},
+                     DistortionMeshKey{0x1234, 2400, 1080, 40}})
+        CHECK(!loadDistortionMeshes(file.path, key, loaded));
+
+    auto size = filesystem::file_size(file.path);
+    filesystem::resize_file(file.path, size - 4);
+    CHECK(!loadDistortionMeshes(file.path, KEY, loaded));
+
+    // an index out of the vertex range
+    meshes[1].indices.back() = 20 * 20;
+    REQUIRE(saveDistortionMeshes(file.path, KEY, meshes));
+    CHECK(!loadDistortionMeshes(file.path, KEY, loaded));
+}
+
+TEST(DistortionMesh, CacheNamesDifferPerKey) {
+    CHECK_EQ(distortionMeshCacheName(KEY),
+             string("distortion_mesh_0000000000001234_2400x1080_20.bin"));
+    CHECK(distortionMeshCacheName({0x1234, 1080, 2400, 20}) != distortionMeshCacheName(KEY));
+    CHECK(distortionMeshCacheName({~0ULL, 2400, 1080, 20}).size() < 80);
+}
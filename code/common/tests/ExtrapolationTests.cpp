@@ -0,0 +1,118 @@
+#include <random>
+
+#include "Check.h"
+#include "Utils/Extrapolation.h"
+
+using namespace std;
+using namespace Extrapolation;
+
+namespace {
+    const double DEG = 3.14159265358979 / 180;
+
+    Quat axisAngle(double x, double y, double z, double deg) {
+        double n = sqrt(x * x + y * y + z * z), s = sin(deg * DEG / 2) / n;
+        return {cos(deg * DEG / 2), x * s, y * s, z * s};
+    }
+
+    // yaw (about +y, positive turns left) then pitch (about +x, positive looks up), head to world
+    Quat headAt(double yawDeg, double pitchDeg) {
+        return PoseIngest::mul(axisAngle(0, 1, 0, yawDeg), axisAngle(1, 0, 0, pitchDeg));
+    }
+
+    // 45 degrees each side shown, 55 rendered: the phone's offFov of 10
+    const float T55 = (float) tan(55 * DEG);
+    const LensMask::EyeTangents DISPLAY = {-1, 1, -1, 1}, FRAME = {-T55, T55, -T55, T55};
+}   // namespace
+
+TEST(Extrapolation, NoRotationNoChange) {
+    float fx, fy;
+    REQUIRE(toFrame(Quat(), 0.3f, -0.2f, fx, fy));
+    CHECK_NEAR(fx, 0.3f, 1e-6);
+    CHECK_NEAR(fy, -0.2f, 1e-6);
+}
+
+TEST(Extrapolation, TurnsMoveTheViewAcrossTheFrame) {
+    float fx, fy;
+    // the head turned 5 degrees left since the frame: the center of view is left of the frame's
+    REQUIRE(toFrame(delta(Quat(), headAt(5, 0)), 0, 0, fx, fy));
+    CHECK_NEAR(fx, -tan(5 * DEG), 1e-6);
+    CHECK_NEAR(fy, 0, 1e-6);
+    // looking up: the center is above, y is down
+    REQUIRE(toFrame(delta(headAt(0, 0), headAt(0, 4)), 0, 0, fx, fy));
+    CHECK_NEAR(fx, 0, 1e-6);
+    CHECK_NEAR(fy, -tan(4 * DEG), 1e-6);
+    // only the difference counts
+    REQUIRE(toFrame(delta(headAt(30, 0), headAt(35, 0)), 0, 0, fx, fy));
+    CHECK_NEAR(fx, -tan(5 * DEG), 1e-5);
+    // a yaw moves a point off the center by the angle
+    REQUIRE(toFrame(delta(Quat(), headAt(-7, 0)), 0.5f, 0, fx, fy));
+    CHECK_NEAR(fx, tan(atan(0.5) + 7 * DEG), 1e-5);
+}
+
+TEST(Extrapolation, BehindTheFramesEye) {
+    float fx, fy;
+    CHECK(!toFrame(delta(Quat(), headAt(120, 0)), 0, 0, fx, fy));
+}
+
+// to the frame and back is the identity, and it is the warp PVRRenderer draws: the frame's quad
+// point at z = -1 times headMat * rotInv, rotInv the rendered pose and headMat the inverse of the
+// shown one
+TEST(Extrapolation, RoundTripsAndMatchesTheRenderer) {
+    mt19937 rng(7);
+    uniform_real_distribution<double> u(-1, 1);
+    for (int i = 0; i < 1000; i++) {
+        auto rendered = PoseIngest::normalized({u(rng), u(rng), u(rng), u(rng)});
+        auto step = axisAngle(u(rng), u(rng), u(rng) + 0.001, 20 * u(rng));
+        auto shown = PoseIngest::normalized(PoseIngest::mul(rendered, step));
+        auto d = delta(rendered, shown);
+        float tx = (float) u(rng), ty = (float) u(rng), fx, fy, bx, by;
+        REQUIRE(toFrame(d, tx, ty, fx, fy));
+        REQUIRE(toFrame(PoseIngest::conj(d), fx, fy, bx, by));
+        CHECK_NEAR(bx, tx, 1e-4);
+        CHECK_NEAR(by, ty, 1e-4);
+
+        double quad[3] = {fx, -fy, -1}, world[3], p[3];
+        rotate(rendered, quad, world);
+        rotate(PoseIngest::conj(shown), world, p);
+        CHECK_NEAR(p[0] / -p[2], tx, 1e-4);
+        CHECK_NEAR(-p[1] / -p[2], ty, 1e-4);
+    }
+}
+
+TEST(Extrapolation, CoversWithinTheMargin) {
+    CHECK(covers(Quat(), FRAME, DISPLAY));
+    CHECK(covers(delta(Quat(), headAt(9, 0)), FRAME, DISPLAY));
+    CHECK(!covers(delta(Quat(), headAt(11, 0)), FRAME, DISPLAY));
+    CHECK(covers(delta(Quat(), headAt(0, -9)), FRAME, DISPLAY));
+    CHECK(!covers(delta(Quat(), headAt(0, -11)), FRAME, DISPLAY));
+    // roll keeps the corners on a circle of radius sqrt(2), less than tan(55 degrees)
+    CHECK(covers(delta(Quat(), axisAngle(0, 0, 1, 30)), FRAME, DISPLAY));
+    // a diagonal turn pushes a corner out first
+    CHECK(!covers(delta(Quat(), headAt(8, -8)), FRAME, DISPLAY));
+    // nothing to show when the display is behind the frame
+    CHECK(!covers(delta(Quat(), headAt(180, 0)), FRAME, DISPLAY));
+}
+
+// the largest yaw covers() accepts is where the display edge reaches the frame edge: 10 degrees
+TEST(Extrapolation, CoverLimitOfAYaw) {
+    double lo = 0, hi = 30;
+    for (int i = 0; i < 40; i++) {
+        double mid = (lo + hi) / 2;
+        (covers(delta(Quat(), headAt(mid, 0)), FRAME, DISPLAY) ? lo : hi) = mid;
+    }
+    CHECK_NEAR(lo, 10, 1e-3);
+}
+
+TEST(Extrapolation, FrameStats) {
+    FrameStats stats;
+    stats.addReal();
+    stats.addSynthesized(delta(Quat(), headAt(2, 0)), true);
+    stats.addSynthesized(delta(Quat(), headAt(12, 0)), false);
+    CHECK_EQ(stats.displayed(), 3u);
+    CHECK_EQ(stats.real, 1u);
+    CHECK_EQ(stats.synthesized, 2u);
+    CHECK_EQ(stats.uncovered, 1u);
+    CHECK_NEAR(stats.maxDeltaDeg, 12, 1e-6);
+    CHECK_EQ(stats.summary(), string("3 displayed, 1 real, 2 synthesized (67%), 1 uncovered, "
+                                     "max rotation 12 deg"));
+}
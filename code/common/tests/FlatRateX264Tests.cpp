@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "Check.h"
+#include "Utils/FlatRate.h"
+#include "X264Scene.h"
+
+using namespace std;
+
+// Per-frame sizes and send times of the streamer's default rate control against flat mode, on a
+// game-like scene with a cut every 5 s. Frames go out back to back on a link twice the target
+// rate.
+namespace {
+    const int W = 640, H = 360, FPS = 60, FRAMES = 900, KBPS = 2000;
+    const double LINK_MBPS = 2 * KBPS / 1000.0;
+    const double FRAME_MS = 1000.0 / FPS;
+
+    struct Distribution {
+        vector<double> sizesKB, sendMs;
+        int idrs = 0, largestSlice = 0;
+
+        static double percentile(vector<double> v, double p) {
+            sort(v.begin(), v.end());
+            return v[(min)(v.size() - 1, (size_t) (p * v.size()))];
+        }
+
+        static double stddev(const vector<double> &v) {
+            double mean = 0, sq = 0;
+            for (double x : v)
+                mean += x;
+            mean /= v.size();
+            for (double x : v)
+                sq += (x - mean) * (x - mean);
+            return sqrt(sq / v.size());
+        }
+
+        void print(const char *name) const {
+            printf("%-8s size KB p50 %5.1f p99 %5.1f max %5.1f | send ms sd %.2f max %5.2f | "
+                   "%d IDRs, largest slice %d B\n",
+                   name, percentile(sizesKB, 0.5), percentile(sizesKB, 0.99),
+                   percentile(sizesKB, 1), stddev(sendMs), percentile(sendMs, 1), idrs,
+                   largestSlice);
+        }
+    };
+
+    Distribution stream(bool flat) {
+        x264_param_t par;
+        REQUIRE(x264_param_default_preset(&par, "ultrafast", "zerolatency") == 0);
+        par.i_log_level = X264_LOG_ERROR;
+        par.i_width = W;
+        par.i_height = H;
+        par.i_fps_num = FPS;
+        par.i_fps_den = 1;
+        par.i_threads = 1;
+        par.b_vfr_input = 0;
+        par.b_repeat_headers = 1;
+        par.b_annexb = 1;
+        REQUIRE(x264_param_apply_profile(&par, "baseline") == 0);
+
+        // as PVRStartStreamer sets rate control
+        par.rc.i_rc_method = X264_RC_CRF;
+        par.rc.i_bitrate = KBPS;
+        par.rc.f_vbv_buffer_init = 0.9f;
+        if (flat) {
+            par.b_intra_refresh = 1;
+            par.i_keyint_max = FlatRate::refreshPeriod(FPS, 0);
+            par.i_slice_max_size = 1200;
+            par.rc.i_vbv_max_bitrate = KBPS;
+            par.rc.i_vbv_buffer_size = FlatRate::vbvBufferKbit(KBPS, FPS, 1);
+        } else {
+            par.rc.i_vbv_max_bitrate = KBPS * 6 / 5;
+            par.rc.i_vbv_buffer_size = 20000;
+        }
+
+        x264_t *enc = x264_encoder_open(&par);
+        REQUIRE(enc);
+        x264_picture_t pic, out;
+        REQUIRE(x264_picture_alloc(&pic, X264_CSP_I420, W, H) == 0);
+        X264Scene scene(W, H, 300);
+
+        Distribution dist;
+        for (int n = 0; n < FRAMES; n++) {
+            scene.render(n, pic);
+            pic.i_pts = n;
+            x264_nal_t *nals;
+            int nalCount;
+            int size = x264_encoder_encode(enc, &nals, &nalCount, &pic, &out);
+            REQUIRE(size > 0);
+            for (int i = 0; i < nalCount; i++) {
+                if (nals[i].i_type == NAL_SLICE || nals[i].i_type == NAL_SLICE_IDR)
+                    dist.largestSlice = (max)(dist.largestSlice, nals[i].i_payload);
+                dist.idrs += nals[i].i_type == NAL_SLICE_IDR && nals[i].i_first_mb == 0;
+            }
+            dist.sizesKB.push_back(size / 1024.0);
+            dist.sendMs.push_back(size * 8 / (LINK_MBPS * 1000));
+        }
+        x264_picture_clean(&pic);
+        x264_encoder_close(enc);
+        return dist;
+    }
+}   // namespace
+
+TEST(FlatRate, EveryFrameSendsWithinTheFrameInterval) {
+    auto normal = stream(false);
+    auto flat = stream(true);
+    normal.print("default");
+    flat.print("flat");
+
+    CHECK_EQ(flat.idrs, 1);   // the first frame, refresh waves after that
+    CHECK(flat.largestSlice <= 1200);
+    // the VBV holds half a frame interval of the link, x264 overshoots it a little at times
+    CHECK(Distribution::percentile(flat.sendMs, 1) < FRAME_MS);
+    CHECK(Distribution::percentile(flat.sizesKB, 1) <
+          2 * Distribution::percentile(flat.sizesKB, 0.5));
+    // keyframes and scene cuts make the default mode spike
+    CHECK(Distribution::percentile(normal.sendMs, 1) > FRAME_MS);
+    CHECK(Distribution::stddev(flat.sendMs) < Distribution::stddev(normal.sendMs) / 2);
+}
@@ -0,0 +1,52 @@
+#include "Check.h"
+#include "foveation_config.h"
+
+using namespace std;
+
+namespace {
+    const string ENABLED = R"({"video": {"foveated_encoding": {"Enabled": {
+        "center_size_x": 0.45, "center_size_y": 0.4, "center_shift_x": 0.4,
+        "center_shift_y": 0.1, "edge_ratio_x": 4.0, "edge_ratio_y": 5.0}}}})";
+}   // namespace
+
+TEST(FoveationConfig, Enabled) {
+    auto config = parseFoveationConfig(ENABLED);
+    CHECK(config.enabled);
+    CHECK(config.missingKey == nullptr);
+    CHECK_NEAR(config.centerSizeX, 0.45, 1e-6);
+    CHECK_NEAR(config.centerSizeY, 0.4, 1e-6);
+    CHECK_NEAR(config.centerShiftX, 0.4, 1e-6);
+    CHECK_NEAR(config.centerShiftY, 0.1, 1e-6);
+    CHECK_NEAR(config.edgeRatioX, 4, 1e-6);
+    CHECK_NEAR(config.edgeRatioY, 5, 1e-6);
+    CHECK(config.encoding.find("center_size_x") != string::npos);
+}
+
+TEST(FoveationConfig, DisabledOrMissing) {
+    auto disabled = parseFoveationConfig(R"({"video": {"foveated_encoding": "Disabled"}})");
+    CHECK(!disabled.enabled);
+    CHECK(disabled.missingKey == nullptr);
+    CHECK_EQ(disabled.encoding, string("\"Disabled\""));
+
+    auto noEncoding = parseFoveationConfig(R"({"video": {}})");
+    CHECK(!noEncoding.enabled);
+    CHECK_EQ(string(noEncoding.missingKey), string("video.foveated_encoding"));
+
+    auto noVideo = parseFoveationConfig(R"({"audio": {}})");
+    CHECK(!noVideo.enabled);
+    CHECK_EQ(string(noVideo.missingKey), string("video"));
+}
+
+TEST(FoveationConfig, CacheParsesOnlyChangedSettings) {
+    FoveationConfigCache cache;
+    bool parsed = false;
+    CHECK(cache.get(ENABLED, &parsed).enabled);
+    CHECK(parsed);
+    CHECK(cache.get(ENABLED, &parsed).enabled);
+    CHECK(!parsed);
+    CHECK(!cache.get(R"({"video": {}})", &parsed).enabled);
+    CHECK(parsed);
+    CHECK_EQ(string(cache.get(R"({"video": {}})", &parsed).missingKey),
+             string("video.foveated_encoding"));
+    CHECK(!parsed);
+}
@@ -0,0 +1,193 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "Check.h"
+#include "Utils/Extrapolation.h"
+#include "x264.h"
+
+using namespace std;
+using namespace Extrapolation;
+
+// Headless half rate streaming: the same 60 Hz display fed once by a 60 fps and once by a 30 fps
+// stream encoded as PVRStartStreamer does, the phone rotating the last frame to the head on the
+// refreshes without one. Quality is measured against the view the head really had.
+namespace {
+    const double DEG = 3.14159265358979 / 180;
+    const int DISPLAY_HZ = 60, SECONDS = 4;
+    const int FRAME_PX = 400, DISPLAY_PX = 280;   // both 140 px per unit of tangent
+    const double FRAME_T = tan(55 * DEG), DISPLAY_T = 1;
+    const LensMask::EyeTangents FRAME = {(float) -FRAME_T, (float) FRAME_T, (float) -FRAME_T,
+                                         (float) FRAME_T},
+                                DISPLAY = {-1, 1, -1, 1};
+
+    Quat axisAngle(double x, double y, double z, double deg) {
+        double n = sqrt(x * x + y * y + z * z), s = sin(deg * DEG / 2) / n;
+        return {cos(deg * DEG / 2), x * s, y * s, z * s};
+    }
+
+    // a head looking around at up to 160 deg/s
+    Quat headAt(double t) {
+        double yaw = 25 * sin(360 * DEG * 0.5 * t) + 10 * sin(360 * DEG * 1.3 * t);
+        double pitch = 8 * sin(360 * DEG * 0.7 * t);
+        return PoseIngest::mul(axisAngle(0, 1, 0, yaw), axisAngle(1, 0, 0, pitch));
+    }
+
+    // a static panorama and an object circling the viewer at 40 deg/s, which rotation can't
+    // bring to its new place
+    uint8_t scene(const double d[3], double t) {
+        double lon = atan2(d[0], -d[2]);
+        double lat = asin(d[1] / sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+        double v = 128 + 40 * sin(lon * 23) * cos(lat * 17) + 25 * sin(lon * 71 + lat * 53);
+        v += ((int) floor(lon / (6 * DEG)) + (int) floor(lat / (6 * DEG))) & 1 ? 30 : -30;
+        double dLon = lon - (-20 + 40 * t) * DEG, dLat = lat - 5 * DEG;
+        if (dLon * dLon + dLat * dLat < (6 * DEG) * (6 * DEG))
+            v = 235;
+        return (uint8_t) (v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+
+    // the view of an eye with the head at q, tangents -half..half over px x px
+    void render(const Quat &q, double t, double half, int px, vector<uint8_t> &out) {
+        out.resize((size_t) px * px);
+        for (int y = 0; y < px; y++)
+            for (int x = 0; x < px; x++) {
+                double v[3] = {
+                    (2 * (x + 0.5) / px - 1) * half, -(2 * (y + 0.5) / px - 1) * half, -1};
+                double w[3];
+                rotate(q, v, w);
+                out[(size_t) y * px + x] = scene(w, t);
+            }
+    }
+
+    // what the phone shows of a frame rendered at delta from the head, bilinearly sampled
+    void display(const vector<uint8_t> &frame, const Quat &delta, vector<uint8_t> &out) {
+        out.assign((size_t) DISPLAY_PX * DISPLAY_PX, 0);
+        for (int y = 0; y < DISPLAY_PX; y++)
+            for (int x = 0; x < DISPLAY_PX; x++) {
+                float fx, fy;
+                if (!toFrame(delta,
+                             (float) ((2 * (x + 0.5) / DISPLAY_PX - 1) * DISPLAY_T),
+                             (float) ((2 * (y + 0.5) / DISPLAY_PX - 1) * DISPLAY_T),
+                             fx,
+                             fy))
+                    continue;
+                double sx = (fx / FRAME_T + 1) / 2 * FRAME_PX - 0.5;
+                double sy = (fy / FRAME_T + 1) / 2 * FRAME_PX - 0.5;
+                int x0 = (int) floor(sx), y0 = (int) floor(sy);
+                if (x0 < 0 || y0 < 0 || x0 + 1 >= FRAME_PX || y0 + 1 >= FRAME_PX)
+                    continue;
+                double ax = sx - x0, ay = sy - y0;
+                auto at = [&](int xx, int yy) { return frame[(size_t) yy * FRAME_PX + xx]; };
+                double v = (at(x0, y0) * (1 - ax) + at(x0 + 1, y0) * ax) * (1 - ay) +
+                           (at(x0, y0 + 1) * (1 - ax) + at(x0 + 1, y0 + 1) * ax) * ay;
+                out[(size_t) y * DISPLAY_PX + x] = (uint8_t) (v + 0.5);
+            }
+    }
+
+    double psnr(const vector<uint8_t> &a, const vector<uint8_t> &b) {
+        double se = 0;
+        for (size_t i = 0; i < a.size(); i++)
+            se += (a[i] - b[i]) * (a[i] - b[i]);
+        se /= a.size();
+        return se == 0 ? 99 : 10 * log10(255.0 * 255 / se);
+    }
+
+    struct Run {
+        int frames = 0;
+        size_t bytes = 0;
+        double realPsnr = 0, synthesizedPsnr = 0, heldPsnr = 0;   // means
+        FrameStats stats;
+    };
+
+    // the PC sends every divisor-th refresh, rendered with the exact pose of that refresh
+    Run stream(int divisor) {
+        x264_param_t par;
+        REQUIRE(x264_param_default_preset(&par, "ultrafast", "zerolatency") == 0);
+        par.i_log_level = X264_LOG_ERROR;
+        par.i_width = FRAME_PX;
+        par.i_height = FRAME_PX;
+        par.i_fps_num = DISPLAY_HZ / divisor;
+        par.i_fps_den = 1;
+        par.i_threads = 1;
+        par.b_vfr_input = 0;
+        REQUIRE(x264_param_apply_profile(&par, "baseline") == 0);
+        par.rc.i_rc_method = X264_RC_CRF;
+        par.rc.f_rf_constant = 24;
+        par.rc.f_rf_constant_max = 26;
+        par.rc.i_qp_constant = 20;   // the qp and qcomp settings
+        par.rc.i_qp_min = 15;
+        par.rc.i_qp_max = 25;
+        par.rc.f_qcompress = 0;
+        x264_t *enc = x264_encoder_open(&par);
+        REQUIRE(enc);
+        x264_picture_t pic, out;
+        REQUIRE(x264_picture_alloc(&pic, X264_CSP_I420, FRAME_PX, FRAME_PX) == 0);
+        memset(pic.img.plane[1], 128, FRAME_PX * FRAME_PX / 4);
+        memset(pic.img.plane[2], 128, FRAME_PX * FRAME_PX / 4);
+
+        Run run;
+        vector<uint8_t> frame, truth, shown, held;
+        Quat frameQuat;
+        for (int i = 0; i < DISPLAY_HZ * SECONDS; i++) {
+            double t = (double) i / DISPLAY_HZ;
+            Quat head = headAt(t);
+            bool real = i % divisor == 0;
+            if (real) {
+                render(head, t, FRAME_T, FRAME_PX, frame);
+                frameQuat = head;
+                for (int y = 0; y < FRAME_PX; y++)
+                    memcpy(&pic.img.plane[0][y * pic.img.i_stride[0]],
+                           &frame[(size_t) y * FRAME_PX],
+                           FRAME_PX);
+                pic.i_pts = run.frames++;
+                x264_nal_t *nals;
+                int nalCount;
+                int size = x264_encoder_encode(enc, &nals, &nalCount, &pic, &out);
+                REQUIRE(size >= 0);
+                run.bytes += size;
+            }
+
+            auto d = delta(frameQuat, head);
+            render(head, t, DISPLAY_T, DISPLAY_PX, truth);
+            display(frame, d, shown);
+            if (real) {
+                run.stats.addReal();
+                run.realPsnr += psnr(shown, truth);
+            } else {
+                run.stats.addSynthesized(d, covers(d, FRAME, DISPLAY));
+                run.synthesizedPsnr += psnr(shown, truth);
+                display(frame, Quat(), held);   // without the rotation: locked to the head
+                run.heldPsnr += psnr(held, truth);
+            }
+        }
+        run.realPsnr /= (max)(run.stats.real, 1u);
+        run.synthesizedPsnr /= (max)(run.stats.synthesized, 1u);
+        run.heldPsnr /= (max)(run.stats.synthesized, 1u);
+        x264_picture_clean(&pic);
+        x264_encoder_close(enc);
+        return run;
+    }
+}   // namespace
+
+TEST(HalfRateX264, HalfTheBandwidthAtTheSameDisplayRate) {
+    Run full = stream(1), half = stream(2);
+    for (auto *run : {&full, &half}) {
+        printf("%s: %3d frames, %5.2f Mbps, %s\n",
+               run == &full ? "full rate" : "half rate",
+               run->frames,
+               run->bytes * 8.0 / SECONDS / 1e6,
+               run->stats.summary().c_str());
+    }
+    printf("half rate PSNR: real %.1f dB, synthesized %.1f dB, not rotated %.1f dB\n",
+           half.realPsnr,
+           half.synthesizedPsnr,
+           half.heldPsnr);
+
+    CHECK_EQ(full.stats.displayed(), (uint32_t) (DISPLAY_HZ * SECONDS));
+    CHECK_EQ(half.stats.displayed(), full.stats.displayed());
+    CHECK_EQ(half.stats.synthesized, half.stats.displayed() / 2);
+    CHECK_EQ(half.stats.uncovered, 0u);
+    CHECK((double) half.bytes / full.bytes < 0.6);
+    // the rotation is what makes the synthesized refreshes worth showing
+    CHECK(half.synthesizedPsnr > half.heldPsnr + 3);
+}
@@ -0,0 +1,197 @@
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include "Check.h"
+#include "Utils/HandleCache.h"
+
+using namespace std;
+using namespace HandleCache;
+
+namespace {
+    struct Texture {
+        uint64_t handle = 0, device = 0;
+        bool open = false;
+    };
+
+    // what the mock did, outlives the cache that owns it
+    struct Device {
+        int opens = 0, closes = 0, closedTwice = 0;
+        set<uint64_t> live, broken;
+        uint32_t width = 2048, height = 1024;   // of the app's textures
+    };
+
+    // OpenSharedResource on the PC: fails for broken handles and other frame sizes
+    class MockBackend : public Backend<Texture> {
+        Device &dev;
+
+      public:
+        explicit MockBackend(Device &dev) : dev(dev) {}
+
+        bool open(uint64_t handle, const Context &context, Texture &tex) override {
+            dev.opens++;
+            if (dev.broken.count(handle) || context.width != dev.width ||
+                context.height != dev.height)
+                return false;
+            tex = {handle, context.device, true};
+            dev.live.insert(handle);
+            return true;
+        }
+
+        void close(Texture &tex) override {
+            dev.closes++;
+            dev.closedTwice += tex.open ? 0 : 1;
+            dev.live.erase(tex.handle);
+            tex.open = false;
+        }
+    };
+
+    struct Fixture {
+        Device dev;
+        Cache<Texture> cache;
+
+        explicit Fixture(size_t capacity)
+            : cache(unique_ptr<Backend<Texture>>(new MockBackend(dev)), capacity) {
+            cache.bind({1, 2048, 1024});
+        }
+
+        // a frame of the handle, false if it couldn't be opened
+        bool present(uint64_t handle) {
+            uint64_t seen = 0;
+            bool ok = cache.use(handle, [&](Texture &tex) {
+                seen = tex.handle;
+                return tex.open;
+            });
+            return ok && seen == handle;
+        }
+    };
+}   // namespace
+
+// SteamVR cycles through three textures: each is opened once
+TEST(HandleCache, SwapChainOpensEachTextureOnce) {
+    Fixture f(3);
+    for (int frame = 0; frame < 300; frame++)
+        REQUIRE(f.present(10 + frame % 3));
+    auto stats = f.cache.stats();
+    CHECK_EQ(stats.misses, 3u);
+    CHECK_EQ(stats.hits, 297u);
+    CHECK_EQ(f.dev.opens, 3);
+    CHECK_EQ(f.dev.closes, 0);
+}
+
+TEST(HandleCache, EvictsTheLeastRecentlyUsed) {
+    Fixture f(3);
+    for (uint64_t handle : {10, 11, 12, 10, 13})   // 11 is the least recently used one
+        REQUIRE(f.present(handle));
+    CHECK_EQ(f.dev.live, (set<uint64_t>{10, 12, 13}));
+    CHECK_EQ(f.cache.stats().evictions, 1u);
+    CHECK_EQ(f.cache.size(), 3u);
+    REQUIRE(f.present(11));   // now 12 is
+    CHECK_EQ(f.dev.live, (set<uint64_t>{10, 11, 13}));
+}
+
+TEST(HandleCache, PassesTheResultOfUseThrough) {
+    Fixture f(3);
+    CHECK(!f.cache.use(10, [](Texture &) { return false; }));
+    CHECK_EQ(f.cache.size(), 1u);   // opened all the same
+    CHECK(f.cache.use(10, [](Texture &) { return true; }));
+    CHECK_EQ(f.cache.stats().hits, 1u);
+}
+
+TEST(HandleCache, FailedOpensAreNotCached) {
+    Fixture f(3);
+    f.dev.broken.insert(99);
+    CHECK(!f.present(99));
+    CHECK(!f.present(99));   // tried again
+    CHECK_EQ(f.dev.opens, 2);
+    CHECK_EQ(f.cache.stats().misses, 2u);
+    CHECK_EQ(f.cache.size(), 0u);
+}
+
+TEST(HandleCache, BindingAnotherContextClosesEverything) {
+    Fixture f(3);
+    REQUIRE(f.present(10));
+    REQUIRE(f.present(11));
+    f.cache.bind({1, 2048, 1024});   // the same one
+    CHECK_EQ(f.cache.size(), 2u);
+
+    // the resolution changed, the app's textures did too
+    f.dev.width = 1920;
+    f.dev.height = 1080;
+    f.cache.bind({1, 1920, 1080});
+    CHECK_EQ(f.cache.size(), 0u);
+    CHECK(f.dev.live.empty());
+    CHECK_EQ(f.cache.stats().invalidated, 2u);
+    REQUIRE(f.present(10));
+
+    // a new device
+    f.cache.bind({2, 1920, 1080});
+    CHECK(f.dev.live.empty());
+    uint64_t device = 0;
+    f.cache.use(10, [&](Texture &tex) { return (device = tex.device) != 0; });
+    CHECK_EQ(device, 2u);
+
+    // a texture of another size doesn't open
+    f.cache.bind({2, 1280, 720});
+    CHECK(!f.present(10));
+    CHECK_EQ(f.cache.size(), 0u);
+}
+
+TEST(HandleCache, EraseAndInvalidate) {
+    Fixture f(3);
+    REQUIRE(f.present(10));
+    REQUIRE(f.present(11));
+    f.cache.erase(10);
+    CHECK_EQ(f.dev.live, set<uint64_t>{11});
+    f.cache.erase(10);   // not there anymore
+    CHECK_EQ(f.cache.stats().invalidated, 1u);
+
+    f.cache.invalidate();
+    CHECK(f.dev.live.empty());
+    CHECK_EQ(f.cache.size(), 0u);
+    CHECK_EQ(f.dev.closes, 2);
+    CHECK_EQ(f.dev.closedTwice, 0);
+}
+
+TEST(HandleCache, DestructionClosesWhatIsOpen) {
+    Device dev;
+    {
+        Cache<Texture> cache(unique_ptr<Backend<Texture>>(new MockBackend(dev)), 2);
+        cache.bind({1, 2048, 1024});
+        for (uint64_t handle : {1, 2, 3})
+            cache.use(handle, [](Texture &) { return true; });
+    }
+    CHECK(dev.live.empty());
+    CHECK_EQ(dev.closes, dev.opens);
+}
+
+// the encoder thread presents while the device thread rebinds and invalidates: a texture is never
+// used once closed
+TEST(HandleCache, NeverUsedAfterClose) {
+    Fixture f(3);
+    f.dev.width = 1920;
+    f.dev.height = 1080;
+    f.cache.bind({2, 1920, 1080});
+    atomic<bool> running{true};
+    atomic<int> closedUses{0}, uses{0};
+    thread presenter([&] {
+        for (uint64_t n = 0; running; n++)
+            f.cache.use(20 + n % 4, [&](Texture &tex) {
+                closedUses += tex.open ? 0 : 1;
+                uses++;
+                return true;
+            });
+    });
+    for (int i = 0; i < 2000; i++) {
+        if (i % 2)
+            f.cache.invalidate();
+        else
+            f.cache.bind({(uint64_t) 3 + i % 4 / 2, 1920, 1080});
+        this_thread::yield();
+    }
+    running = false;
+    presenter.join();
+    CHECK(uses > 0);
+    CHECK_EQ(closedUses, 0);
+    CHECK_EQ(f.dev.closedTwice, 0);
+}
@@ -0,0 +1,150 @@
+#include <set>
+#include <vector>
+
+#include "Check.h"
+#include "hardware_buffer_importer.h"
+
+using namespace std;
+
+namespace {
+    // stands in for EGL: images are numbered, the live ones and every bind are recorded
+    class MockBackend : public ExternalImageBackend {
+      public:
+        bool extensions = true;
+        set<void *> failing;   // buffers createImage rejects
+        uint32_t textures = 0;
+        uintptr_t nextImage = 0x100;
+        set<void *> alive;
+        vector<pair<uint32_t, void *>> binds;
+        int created = 0, destroyed = 0;
+
+        bool load() override { return extensions; }
+
+        uint32_t createExternalTexture() override { return ++textures; }
+
+        void *createImage(void *hardwareBuffer) override {
+            if (failing.count(hardwareBuffer))
+                return nullptr;
+            created++;
+            auto image = (void *) nextImage++;
+            alive.insert(image);
+            return image;
+        }
+
+        void destroyImage(void *image) override {
+            destroyed++;
+            CHECK_EQ(alive.erase(image), 1u);
+        }
+
+        void bindImage(uint32_t externalTexture, void *image) override {
+            CHECK(alive.count(image) == 1);
+            binds.push_back({externalTexture, image});
+        }
+    };
+
+    void *buffer(int i) { return (void *) (uintptr_t) (0x1000 * i); }
+}   // namespace
+
+// the decoder cycles through its output buffers: one image each, made once
+TEST(HardwareBufferImporter, CachedBuffersAreNotImportedAgain) {
+    MockBackend egl;
+    HardwareBufferImporter importer(&egl, 8);
+    CHECK(importer.available());
+    CHECK_EQ(importer.texture(), 0u);
+    for (int frame = 0; frame < 100; frame++)
+        CHECK(importer.import(buffer(1 + frame % 4)));
+    CHECK_EQ(egl.created, 4);
+    CHECK_EQ(egl.destroyed, 0);
+    CHECK_EQ(egl.textures, 1u);
+    CHECK_EQ(importer.texture(), 1u);
+    CHECK_EQ(importer.cachedImages(), 4u);
+    CHECK_EQ(egl.binds.size(), 100u);
+    for (auto &bind : egl.binds)
+        CHECK_EQ(bind.first, 1u);
+
+    // the same buffer twice in a row is not bound again
+    CHECK(importer.import(buffer(4)));
+    CHECK_EQ(egl.binds.size(), 100u);
+}
+
+TEST(HardwareBufferImporter, EvictsTheLeastRecentlyUsed) {
+    MockBackend egl;
+    HardwareBufferImporter importer(&egl, 3);
+    for (int i : {1, 2, 3, 1})
+        CHECK(importer.import(buffer(i)));
+    auto image2 = egl.binds[1].second;
+    // 2 is the least recently used now
+    CHECK(importer.import(buffer(4)));
+    CHECK_EQ(egl.created, 4);
+    CHECK_EQ(egl.destroyed, 1);
+    CHECK(egl.alive.count(image2) == 0);
+    CHECK_EQ(importer.cachedImages(), 3u);
+    for (int i : {1, 3, 4})
+        CHECK(importer.import(buffer(i)));
+    CHECK_EQ(egl.created, 4);
+    CHECK(importer.import(buffer(2)));
+    CHECK_EQ(egl.created, 5);
+    CHECK_EQ(egl.destroyed, 2);
+    CHECK_EQ(importer.createdImages(), 5u);
+}
+
+TEST(HardwareBufferImporter, EvictingTheBoundImageBindsAgain) {
+    MockBackend egl;
+    HardwareBufferImporter importer(&egl, 1);
+    CHECK(importer.import(buffer(1)));
+    CHECK(importer.import(buffer(2)));
+    CHECK(importer.import(buffer(1)));
+    CHECK_EQ(egl.binds.size(), 3u);
+    CHECK_EQ(egl.destroyed, 2);
+    CHECK_EQ(egl.alive.size(), 1u);
+}
+
+TEST(HardwareBufferImporter, FailuresFallBackToTheCopyPath) {
+    MockBackend egl;
+    egl.extensions = false;
+    HardwareBufferImporter importer(&egl);
+    CHECK(!importer.available());
+
+    egl.extensions = true;
+    egl.failing.insert(buffer(2));
+    CHECK(!importer.import(nullptr));
+    CHECK(importer.import(buffer(1)));
+    CHECK(!importer.import(buffer(2)));
+    CHECK_EQ(importer.cachedImages(), 1u);
+    CHECK_EQ(egl.binds.size(), 1u);
+}
+
+TEST(HardwareBufferImporter, StreamStopDestroysEverything) {
+    MockBackend egl;
+    {
+        HardwareBufferImporter importer(&egl);
+        for (int i = 1; i <= 3; i++)
+            importer.import(buffer(i));
+        importer.clear();
+        CHECK_EQ(egl.destroyed, 3);
+        CHECK(egl.alive.empty());
+        // the next decoder may hand out the same addresses: imported anew
+        CHECK(importer.import(buffer(1)));
+        CHECK_EQ(egl.created, 4);
+        CHECK_EQ(importer.texture(), 1u);
+    }
+    CHECK(egl.alive.empty());
+}
+
+TEST(HardwareBufferImporter, ContextLossDestroysNothing) {
+    MockBackend egl;
+    HardwareBufferImporter importer(&egl);
+    for (int i = 1; i <= 3; i++)
+        importer.import(buffer(i));
+    importer.onContextLost();
+    CHECK_EQ(egl.destroyed, 0);
+    CHECK_EQ(importer.cachedImages(), 0u);
+    CHECK_EQ(importer.texture(), 0u);
+
+    // a new texture and new images in the new context
+    CHECK(importer.import(buffer(1)));
+    CHECK_EQ(egl.textures, 2u);
+    CHECK_EQ(importer.texture(), 2u);
+    CHECK_EQ(egl.created, 4);
+    CHECK_EQ(egl.binds.back().first, 2u);
+}
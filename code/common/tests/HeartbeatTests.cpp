@@ -0,0 +1,130 @@
+#include <random>
+
+#include "Check.h"
+#include "Utils/Heartbeat.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+    const auto T0 = Clk::now();
+
+    Clk::time_point at(double ms) {
+        return T0 + duration_cast<Clk::duration>(duration<double, milli>(ms));
+    }
+
+    // first moment the monitor reports the peer dead, checking every millisecond from `from`
+    double detectedAtMs(HeartbeatMonitor &monitor, double from) {
+        for (double ms = from; ms < from + 10'000; ms++)
+            if (!monitor.alive(at(ms)))
+                return ms;
+        return -1;
+    }
+}   // namespace
+
+TEST(Heartbeat, SmoothsLikeTcp) {
+    HeartbeatMonitor monitor(100ms, 3, at(0));
+    CHECK(!monitor.measured());
+    CHECK_NEAR(monitor.onPong(at(0), at(4)), 4, 1e-6);
+    CHECK(monitor.measured());
+    CHECK_NEAR(monitor.srttMs(), 4, 1e-6);
+    CHECK_NEAR(monitor.rttVarMs(), 2, 1e-6);
+
+    // rttvar first, against the old srtt
+    monitor.onPong(at(100), at(112));
+    CHECK_NEAR(monitor.rttVarMs(), 0.75 * 2 + 0.25 * 8, 1e-6);
+    CHECK_NEAR(monitor.srttMs(), 0.875 * 4 + 0.125 * 12, 1e-6);
+
+    // a pong stamped after it arrived (clocks of other threads) counts as no delay
+    CHECK_NEAR(monitor.onPong(at(300), at(200)), 0, 1e-6);
+}
+
+// one pong held up 200 ms behind a retransmission among 2 ms ones
+TEST(Heartbeat, ADelayedSampleWidensTheDeadline) {
+    HeartbeatMonitor monitor(100ms, 3, at(0));
+    double t = 0;
+    for (int i = 0; i < 20; i++, t += 100)
+        monitor.onPong(at(t), at(t + 2));
+    CHECK_NEAR(monitor.srttMs(), 2, 1e-6);
+    CHECK(monitor.rttVarMs() < 0.01);
+    CHECK_NEAR(monitor.deadlineMs(), 300 + 200, 1e-6);   // the minimum RTO
+
+    monitor.onPong(at(t), at(t + 200));
+    double srtt = 0.875 * 2 + 0.125 * 200;
+    double rttvar = 0.25 * 198;   // from ~0 by a quarter of the deviation
+    CHECK_NEAR(monitor.srttMs(), srtt, 1e-6);
+    CHECK_NEAR(monitor.rttVarMs(), rttvar, 0.01);
+    CHECK_NEAR(monitor.deadlineMs(), 300 + srtt + 4 * rttvar, 0.05);
+
+    // and narrows again as normal samples come back
+    for (int i = 0; i < 60; i++, t += 100)
+        monitor.onPong(at(t + 100), at(t + 102));
+    CHECK(monitor.srttMs() < 2.1);
+    CHECK_NEAR(monitor.deadlineMs(), 500, 1e-6);
+}
+
+TEST(Heartbeat, DeadOnlyAfterTheDeadline) {
+    HeartbeatMonitor monitor(100ms, 3, at(0));
+    monitor.onPong(at(0), at(5));
+    // srtt 5, rttvar 2.5: the minimum RTO applies
+    CHECK_NEAR(monitor.deadlineMs(), 500, 1e-6);
+    CHECK(monitor.alive(at(504)));
+    CHECK_NEAR(detectedAtMs(monitor, 5), 505, 1e-6);
+}
+
+TEST(Heartbeat, NeverDeadBeforeTheFirstPong) {
+    // an older peer that doesn't answer pings
+    HeartbeatMonitor monitor(100ms, 3, at(0));
+    CHECK(monitor.alive(at(60'000)));
+    monitor.onHeard(at(100));
+    CHECK(monitor.alive(at(60'000)));
+}
+
+TEST(Heartbeat, OtherMessagesKeepThePeerAlive) {
+    HeartbeatMonitor monitor(100ms, 3, at(0));
+    monitor.onPong(at(0), at(3));
+    // pongs stuck behind a video frame, the frame's chunks still arrive
+    for (double t = 100; t <= 2000; t += 100)
+        monitor.onHeard(at(t));
+    CHECK(monitor.alive(at(2400)));
+    // a late sample doesn't move the last time heard back
+    monitor.onPong(at(0), at(1500));
+    CHECK(monitor.alive(at(2400)));
+    CHECK(!monitor.alive(at(2000 + monitor.deadlineMs())));
+}
+
+// 100 ms pings over a jittery link losing a tenth of the pongs: never a false alarm, and the peer
+// going away is noticed within the deadline
+TEST(Heartbeat, DroppedPongsAndAVanishingPeer) {
+    mt19937 rng(3);
+    uniform_real_distribution<double> rtt(2, 8);
+    bernoulli_distribution dropped(0.1);
+    HeartbeatMonitor monitor(100ms, 3, at(0));
+    double lastHeard = 0;
+    for (double t = 0; t < 30'000; t += 100) {
+        double arrival = t + rtt(rng);
+        if (!dropped(rng)) {
+            monitor.onPong(at(t), at(arrival));
+            lastHeard = arrival;
+        }
+        for (double check = t; check < t + 100; check += 10)
+            CHECK(monitor.alive(at(check)));
+    }
+    CHECK(monitor.srttMs() > 2 && monitor.srttMs() < 8);
+    CHECK(monitor.rttVarMs() < 4);
+    CHECK_NEAR(monitor.deadlineMs(), 500, 1e-6);
+
+    double detected = detectedAtMs(monitor, lastHeard);
+    CHECK(detected >= lastHeard + 499 && detected <= lastHeard + 501);
+}
+
+TEST(Heartbeat, ResetForgetsTheSamples) {
+    HeartbeatMonitor monitor(100ms, 3, at(0));
+    monitor.onPong(at(0), at(300));
+    monitor.reset(50ms, at(1000));
+    CHECK(!monitor.measured());
+    CHECK_EQ(monitor.srttMs(), 0.0);
+    CHECK(monitor.alive(at(100'000)));
+    monitor.onPong(at(1000), at(1002));
+    CHECK_NEAR(monitor.deadlineMs(), 3 * 50 + 200, 1e-6);
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include "Check.h"
+#include "Utils/JitterBuffer.h"
+
+using namespace std;
+using namespace Audio;
+
+namespace {
+    const int PACKET_FRAMES = 240;           // 5 ms
+    const int DEVICE_FRAMES = 240;           // the output device asks for 5 ms blocks
+    const int64_t DEVICE_LATENCY_NS = 10000000;
+    const int64_t CLICK_PERIOD = SAMPLE_RATE / 2;
+    const int CLICK_FRAMES = 48;
+    const int16_t CLICK = 30000, TONE = 1000;
+
+    struct Link {
+        double baseMs;
+        double jitterMs;   // mean of the exponential queuing delay
+        double spikeChance, spikeMs;
+        double loss;
+    };
+
+    struct Result {
+        JitterBuffer::Stats stats, warmedUp;   // at the end, and after 3 s
+        vector<double> latenciesMs;   // capture to speaker, of each click
+        int packets = 0;
+    };
+
+    // The PC encodes 5 ms packets as they are captured (position = capture time, like the video
+    // pts clock), the link delays or drops them, the phone decodes them into the jitter buffer and
+    // a device pulls 5 ms blocks. Time is simulated, 20 s of it. Clicks at known capture times
+    // give the latency at the speaker. videoLatencyMs > 0 shows video that long after capture.
+    Result loopback(const Link &link, double videoLatencyMs = 0, unsigned seed = 1) {
+        mt19937 rng(seed);
+        exponential_distribution<double> queuing(1 / (max)(link.jitterMs, 1e-3));
+        uniform_real_distribution<double> uniform(0, 1);
+        auto encoder = makeEncoder(PCM16, 0);
+        auto decoder = makeDecoder(PCM16);
+        JitterBuffer jitter;
+        Result res;
+
+        multimap<int64_t, vector<uint8_t>> inFlight;   // by arrival
+        vector<int16_t> pcm(PACKET_FRAMES * CHANNELS), out(DEVICE_FRAMES * CHANNELS);
+        uint32_t seq = 0;
+        int64_t position = 0;
+        int64_t nextVideo = 0;
+        map<int64_t, bool> heard;
+        bool wasHigh = false;
+
+        const int64_t stepNs = framesToNs(DEVICE_FRAMES);
+        for (int64_t now = stepNs; now < 20'000'000'000; now += stepNs) {
+            // captured up to now: one packet per device block, both are 5 ms
+            for (; framesToNs(position + PACKET_FRAMES) <= now; position += PACKET_FRAMES) {
+                for (int i = 0; i < PACKET_FRAMES; i++) {
+                    bool click = (position + i) % CLICK_PERIOD < CLICK_FRAMES;
+                    for (int c = 0; c < CHANNELS; c++)
+                        pcm[i * CHANNELS + c] = click ? CLICK : TONE;
+                }
+                PacketHeader hdr = {position, seq++, PACKET_FRAMES, PCM16, 0};
+                vector<uint8_t> dgram(sizeof(hdr) + MAX_PAYLOAD);
+                memcpy(dgram.data(), &hdr, sizeof(hdr));
+                auto size = encoder->encode(pcm.data(), PACKET_FRAMES, &dgram[sizeof(hdr)],
+                                            MAX_PAYLOAD);
+                dgram.resize(sizeof(hdr) + size);
+                res.packets++;
+                if (uniform(rng) < link.loss)
+                    continue;
+                double delayMs = link.baseMs + (link.jitterMs > 0 ? queuing(rng) : 0) +
+                                 (uniform(rng) < link.spikeChance ? link.spikeMs : 0);
+                inFlight.emplace(now + (int64_t) (delayMs * 1e6), move(dgram));
+            }
+
+            while (!inFlight.empty() && inFlight.begin()->first <= now) {
+                auto &dgram = inFlight.begin()->second;
+                PacketHeader hdr;
+                memcpy(&hdr, dgram.data(), sizeof(hdr));
+                int frames = decoder->decode(
+                    &dgram[sizeof(hdr)], dgram.size() - sizeof(hdr), pcm.data(), MAX_PACKET_FRAMES);
+                jitter.push(hdr, pcm.data(), frames, inFlight.begin()->first);
+                inFlight.erase(inFlight.begin());
+            }
+
+            // 60 Hz video rendered at its pts, on screen videoLatencyMs later
+            for (; videoLatencyMs > 0 && nextVideo <= now; nextVideo += 16666667)
+                jitter.onVideoPresented(nextVideo / 1000,
+                                        nextVideo + (int64_t) (videoLatencyMs * 1e6));
+
+            int64_t playNs = now + stepNs + DEVICE_LATENCY_NS;
+            jitter.pull(out.data(), DEVICE_FRAMES, playNs, now);
+            for (int i = 0; i < DEVICE_FRAMES; i++) {
+                bool high = out[i * CHANNELS] >= CLICK;
+                int64_t playedNs = playNs + framesToNs(i);
+                int64_t click = playedNs / framesToNs(CLICK_PERIOD);
+                if (high && !wasHigh && now > 3'000'000'000 && !heard[click]) {
+                    heard[click] = true;
+                    res.latenciesMs.push_back(
+                        (playedNs - framesToNs(click * CLICK_PERIOD)) / 1e6);
+                }
+                wasHigh = high;
+            }
+            if (now <= 3'000'000'000)
+                res.warmedUp = jitter.stats(now);
+        }
+        res.stats = jitter.stats(20'000'000'000);
+        sort(res.latenciesMs.begin(), res.latenciesMs.end());
+        return res;
+    }
+}   // namespace
+
+TEST(JitterBuffer, CleanLinkPlaysEverythingAtAFixedLatency) {
+    auto res = loopback({2, 0, 0, 0, 0});
+    CHECK_EQ(res.stats.late, 0u);
+    CHECK_EQ(res.stats.lost, 0u);
+    CHECK_EQ(res.stats.resyncs, 0u);
+    CHECK_EQ(res.stats.underruns, res.warmedUp.underruns);   // only while the first ones arrive
+    REQUIRE(res.latenciesMs.size() >= 30);
+    CHECK(res.latenciesMs.back() < 30);
+    CHECK(res.latenciesMs.back() - res.latenciesMs.front() < 1);
+}
+
+TEST(JitterBuffer, WifiJitterAndLoss) {
+    auto res = loopback({3, 2, 0.01, 40, 0.01});
+    double lost = (double) res.stats.lost / res.packets;
+    CHECK(lost > 0.005 && lost < 0.05);   // the dropped ones and the spikes, little else
+    CHECK(res.stats.late <= res.stats.received * 3 / 100);
+    REQUIRE(res.latenciesMs.size() >= 25);
+    CHECK(res.latenciesMs[res.latenciesMs.size() / 2] < 45);
+    CHECK(res.stats.jitterMs > 2 && res.stats.jitterMs < 20);
+}
+
+// sound follows the picture when the picture is later than the network
+TEST(JitterBuffer, FollowsVideoShownLate) {
+    auto res = loopback({3, 2, 0.01, 40, 0.01}, 80);
+    REQUIRE(!res.latenciesMs.empty());
+    CHECK_EQ(res.stats.late, 0u);   // 80 ms is more than the spikes take
+    CHECK_NEAR(res.stats.avOffsetMs, 0, 1);
+    CHECK_NEAR(res.latenciesMs[res.latenciesMs.size() / 2], 80, 3);
+}
+
+// video shown sooner than audio can get there: audio stays behind by the difference
+TEST(JitterBuffer, NetworkBoundWhenVideoIsEarly) {
+    auto res = loopback({3, 2, 0.01, 40, 0.01}, 5);
+    REQUIRE(!res.latenciesMs.empty());
+    CHECK(res.stats.avOffsetMs > 5);
+    CHECK_NEAR(res.latenciesMs[res.latenciesMs.size() / 2], 5 + res.stats.avOffsetMs, 3);
+}
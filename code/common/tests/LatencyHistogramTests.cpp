@@ -0,0 +1,67 @@
+#include <random>
+
+#include "Check.h"
+#include "Utils/LatencyHistogram.h"
+
+using namespace std;
+
+TEST(LatencyHistogram, OneMillisecondBins) {
+    LatencyHistogram hist;
+    for (double ms : {0.0, 0.2, 0.999, 1.0, 1.5, 7.9, 249.9})
+        hist.add(ms);
+    CHECK_EQ(hist.bin(0), 3u);
+    CHECK_EQ(hist.bin(1), 2u);
+    CHECK_EQ(hist.bin(7), 1u);
+    CHECK_EQ(hist.bin(249), 1u);
+    CHECK_EQ(hist.bin(2), 0u);
+    CHECK_EQ(hist.size(), 7u);
+}
+
+// late frames land in the last bin but keep their value for mean and max
+TEST(LatencyHistogram, OverflowAndNegativeSamples) {
+    LatencyHistogram hist;
+    hist.add(250);
+    hist.add(4000);
+    hist.add(-3);   // clocks a bit apart, counts as 0
+    CHECK_EQ(hist.bin(LatencyHistogram::MAX_MS), 2u);
+    CHECK_EQ(hist.bin(10000), 2u);   // any index past the end is the overflow bin
+    CHECK_EQ(hist.bin(0), 1u);
+    CHECK_EQ(hist.bin(-1), 1u);
+    CHECK_NEAR(hist.max(), 4000, 1e-9);
+    CHECK_NEAR(hist.mean(), 4250 / 3.0, 1e-9);
+    // percentiles in the overflow bin are the largest sample
+    CHECK_NEAR(hist.percentile(0.99), 4000, 1e-9);
+}
+
+TEST(LatencyHistogram, PercentilesAreUpperBinEdges) {
+    LatencyHistogram hist;
+    CHECK_EQ(hist.percentile(0.5), 0);   // nothing yet
+    for (int i = 0; i < 100; i++)
+        hist.add(i + 0.5);   // one sample in each of the bins 0 to 99
+    CHECK_NEAR(hist.percentile(0), 1, 1e-9);
+    CHECK_NEAR(hist.percentile(0.5), 50, 1e-9);
+    CHECK_NEAR(hist.percentile(0.9), 90, 1e-9);
+    CHECK_NEAR(hist.percentile(0.99), 99, 1e-9);
+    CHECK_NEAR(hist.percentile(1), 100, 1e-9);
+}
+
+// motion to photon of a minute at 60 fps: 30 to 50 ms with every 100th frame stuck for 300 ms
+TEST(LatencyHistogram, SummaryOfAStream) {
+    LatencyHistogram hist;
+    mt19937 rng(1);
+    uniform_real_distribution<double> ms(30, 50);
+    for (int i = 0; i < 3600; i++)
+        hist.add(i % 100 == 99 ? 300 : ms(rng));
+    CHECK(hist.percentile(0.5) > 38 && hist.percentile(0.5) <= 42);
+    CHECK(hist.percentile(0.9) > 47 && hist.percentile(0.9) <= 50);
+    CHECK_NEAR(hist.percentile(0.995), 300, 1e-9);
+    CHECK_NEAR(hist.max(), 300, 1e-9);
+    auto summary = hist.summary();
+    CHECK(summary.rfind("n 3600, mean ", 0) == 0);
+    CHECK(summary.find(", max 300.0 ms") != string::npos);
+
+    hist.clear();
+    CHECK_EQ(hist.size(), 0u);
+    CHECK_EQ(hist.bin(LatencyHistogram::MAX_MS), 0u);
+    CHECK_EQ(hist.summary(), string("n 0, mean 0.0 ms, p50 0 ms, p90 0 ms, p99 0 ms, max 0.0 ms"));
+}
@@ -0,0 +1,142 @@
+#include <cmath>
+
+#include "Check.h"
+#include "Utils/LensMask.h"
+
+using namespace std;
+using namespace LensMask;
+
+namespace {
+    const float DEG = 3.14159265f / 180;
+    const int W = 1920, H = 1080;
+    const int MB_W = W / MB_SIZE, MB_H = (H + MB_SIZE - 1) / MB_SIZE;
+
+    // the phone's left eye: a Cardboard-like lens FOV plus offFov, as PVRRenderer.cpp sends it
+    void projRectFor(float l, float t, float r, float b, float off, float rect[4]) {
+        rect[0] = -tan((l + off) * DEG);
+        rect[1] = tan((t + off * 2 / 3) * DEG);
+        rect[2] = tan((r + off) * DEG);
+        rect[3] = -tan((b + off * 2 / 3) * DEG);
+    }
+
+    struct Cardboard {
+        EyeTangents eyes[2];
+        vector<uint8_t> mask;
+
+        Cardboard(int width = W, int height = H) {
+            float rect[4];
+            projRectFor(50, 52, 44, 52, 10, rect);
+            eyesFromProjRect(rect, eyes);
+            mask = macroblocks(width, height, eyes);
+        }
+
+        uint8_t at(int mx, int my) const { return mask[(size_t) my * MB_W + mx]; }
+    };
+}   // namespace
+
+TEST(LensMask, CornersHiddenCentersAndEdgesVisible) {
+    Cardboard c;
+    REQUIRE(c.mask.size() == (size_t) MB_W * MB_H);
+    for (int e = 0; e < 2; e++) {
+        int x0 = e * MB_W / 2, x1 = x0 + MB_W / 2 - 1;
+        CHECK(c.at(x0, 0) != VISIBLE && c.at(x1, 0) != VISIBLE);
+        CHECK(c.at(x0, MB_H - 1) != VISIBLE && c.at(x1, MB_H - 1) != VISIBLE);
+        CHECK_EQ(c.at(x0, MB_H / 2), VISIBLE);
+        CHECK_EQ(c.at(x1, MB_H / 2), VISIBLE);
+        // top and bottom edge in the column of the view direction
+        auto &eye = c.eyes[e];
+        int cx = (int) (W / 2 * -eye.left / (eye.right - eye.left)) / MB_SIZE + x0;
+        CHECK_EQ(c.at(cx, 0), VISIBLE);
+        CHECK_EQ(c.at(cx, MB_H - 1), VISIBLE);
+    }
+}
+
+TEST(LensMask, RightEyeMirrorsTheLeft) {
+    Cardboard c;
+    for (int my = 0; my < MB_H; my++)
+        for (int mx = 0; mx < MB_W / 2; mx++)
+            CHECK_EQ(c.at(mx, my), c.at(MB_W - 1 - mx, my));
+}
+
+TEST(LensMask, HiddenMacroblocksHaveNoVisiblePixel) {
+    Cardboard c;
+    int eyeW = W / 2;
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++) {
+            if (c.at(x / MB_SIZE, y / MB_SIZE) == VISIBLE)
+                continue;
+            int e = x / eyeW;
+            auto &eye = c.eyes[e];
+            float tx = eye.left + (eye.right - eye.left) * (x - e * eyeW + 0.5f) / eyeW;
+            float ty = eye.top + (eye.bottom - eye.top) * (y + 0.5f) / H;
+            CHECK(!visible(eye, tx, ty));
+        }
+}
+
+// the lens FOV itself, without offFov, all the way round
+TEST(LensMask, LensFovStaysVisible) {
+    Cardboard c;
+    for (float a = 0; a < 360; a += 5) {
+        float ex = cos(a * DEG) < 0 ? 50 : 44, ey = 52;
+        float ax = ex * cos(a * DEG), ay = ey * sin(a * DEG);
+        CHECK(visible(c.eyes[0], tan(ax * DEG), tan(-ay * DEG)));
+    }
+}
+
+// a ring of hidden ones around the visible ones keeps the picture for motion compensation
+TEST(LensMask, PaintedOnesNeverTouchAVisibleOne) {
+    Cardboard c;
+    int painted = 0;
+    for (int my = 0; my < MB_H; my++)
+        for (int mx = 0; mx < MB_W; mx++) {
+            bool nearVisible = false;
+            for (int y = (max)(my - 1, 0); y <= (min)(my + 1, MB_H - 1); y++)
+                for (int x = (max)(mx - 1, 0); x <= (min)(mx + 1, MB_W - 1); x++)
+                    nearVisible |= c.at(x, y) == VISIBLE;
+            auto m = c.at(mx, my);
+            if (m == PAINTED)
+                CHECK(!nearVisible);
+            if (m == HIDDEN)
+                CHECK(nearVisible);
+            painted += m == PAINTED;
+        }
+    CHECK(painted > 0);
+}
+
+TEST(LensMask, NothingHiddenWithoutAFov) {
+    EyeTangents none[2] = {{0, 0, 0, 0}, {0, 0, 0, 0}};
+    for (auto m : macroblocks(W, H, none))
+        CHECK_EQ(m, VISIBLE);
+}
+
+// 1000 wide: a macroblock straddles the eyes, it is visible if a pixel of either eye's part is
+TEST(LensMask, MacroblockStraddlingTheEyes) {
+    const int width = 1000, height = 600, eyeW = width / 2;
+    Cardboard c(width, height);
+    int mbW = (width + MB_SIZE - 1) / MB_SIZE, mbH = (height + MB_SIZE - 1) / MB_SIZE;
+    REQUIRE(c.mask.size() == (size_t) mbW * mbH);
+    int mx = eyeW / MB_SIZE;
+    int straddlingHidden = 0;
+    for (int my = 0; my < mbH; my++) {
+        bool anyVisible = false;
+        for (int y = my * MB_SIZE; y < (min)((my + 1) * MB_SIZE, height); y++)
+            for (int x = mx * MB_SIZE; x < (mx + 1) * MB_SIZE; x++) {
+                int e = x / eyeW;
+                auto &eye = c.eyes[e];
+                float tx = eye.left + (eye.right - eye.left) * (x - e * eyeW + 0.5f) / eyeW;
+                float ty = eye.top + (eye.bottom - eye.top) * (y + 0.5f) / height;
+                anyVisible |= visible(eye, tx, ty);
+            }
+        CHECK_EQ(c.mask[(size_t) my * mbW + mx] == VISIBLE, anyVisible);
+        straddlingHidden += !anyVisible;
+    }
+    CHECK(straddlingHidden > 0);   // the nose side corners
+}
+
+TEST(LensMask, QuantOffsetsOfHiddenMacroblocks) {
+    Cardboard c;
+    auto offsets = quantOffsets(c.mask);
+    REQUIRE(offsets.size() == c.mask.size());
+    for (size_t i = 0; i < offsets.size(); i++)
+        CHECK_EQ(offsets[i], c.mask[i] == VISIBLE ? 0 : MASKED_QP);
+}
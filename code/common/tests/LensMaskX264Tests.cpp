@@ -0,0 +1,155 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "Check.h"
+#include "Utils/LensMask.h"
+#include "X264Scene.h"
+
+using namespace std;
+using namespace LensMask;
+
+// The side by side frame encoded as PVRStartStreamer does with the default settings, with and
+// without the lens mask: the bits it saves against the quality of what the lens shows, measured on
+// x264's reconstruction.
+namespace {
+    const int W = 960, H = 540, FPS = 60, FRAMES = 120;
+    const float DEG = 3.14159265f / 180;
+
+    struct Run {
+        int idrBytes = 0;
+        double pKbps = 0;
+        double visiblePsnr = 0;   // luma, of the visible macroblocks against the unpainted frame
+        double encodeMs = 0;      // mean of the P frames
+    };
+
+    // what the color conversion does to the painted macroblocks
+    void paint(x264_picture_t &pic, const vector<uint8_t> &mask) {
+        int mbW = (W + MB_SIZE - 1) / MB_SIZE;
+        for (int y = 0; y < H; y++)
+            for (int x = 0; x < W; x++) {
+                if (mask[(size_t) (y / MB_SIZE) * mbW + x / MB_SIZE] != PAINTED)
+                    continue;
+                pic.img.plane[0][y * pic.img.i_stride[0] + x] = MASKED_Y;
+                if (x % 2 == 0 && y % 2 == 0) {
+                    pic.img.plane[1][y / 2 * pic.img.i_stride[1] + x / 2] = MASKED_UV;
+                    pic.img.plane[2][y / 2 * pic.img.i_stride[2] + x / 2] = MASKED_UV;
+                }
+            }
+    }
+
+    Run stream(const vector<uint8_t> &mask, bool masked) {
+        x264_param_t par;
+        REQUIRE(x264_param_default_preset(&par, "ultrafast", "zerolatency") == 0);
+        par.i_log_level = X264_LOG_ERROR;
+        par.i_width = W;
+        par.i_height = H;
+        par.i_fps_num = FPS;
+        par.i_fps_den = 1;
+        par.i_threads = 1;
+        par.b_vfr_input = 0;
+        par.b_full_recon = 1;
+        REQUIRE(x264_param_apply_profile(&par, "baseline") == 0);
+        par.rc.i_rc_method = X264_RC_CRF;
+        par.rc.f_rf_constant = 24;
+        par.rc.f_rf_constant_max = 26;
+        par.rc.i_qp_constant = 20;   // the qp and qcomp settings
+        par.rc.i_qp_min = 15;
+        par.rc.i_qp_max = 25;
+        par.rc.f_qcompress = 0;
+        auto offsets = quantOffsets(mask);
+        if (masked) {
+            par.rc.i_aq_mode = X264_AQ_VARIANCE;
+            par.rc.f_aq_strength = 0.01f;
+        }
+
+        x264_t *enc = x264_encoder_open(&par);
+        REQUIRE(enc);
+        x264_picture_t pic, out;
+        REQUIRE(x264_picture_alloc(&pic, X264_CSP_I420, W, H) == 0);
+        vector<uint8_t> source((size_t) W * H);
+        X264Scene scene(W, H);
+
+        Run run;
+        double pBytes = 0, sqErr = 0, encodeNs = 0;
+        size_t pixels = 0;
+        int mbW = (W + MB_SIZE - 1) / MB_SIZE;
+        for (int n = 0; n < FRAMES; n++) {
+            scene.render(n, pic);
+            for (int y = 0; y < H; y++)
+                memcpy(&source[(size_t) y * W], &pic.img.plane[0][y * pic.img.i_stride[0]], W);
+            if (masked) {
+                paint(pic, mask);
+                pic.prop.quant_offsets = offsets.data();
+            }
+            pic.i_pts = n;
+            x264_nal_t *nals;
+            int nalCount;
+            auto start = chrono::steady_clock::now();
+            int size = x264_encoder_encode(enc, &nals, &nalCount, &pic, &out);
+            auto encodeTime = chrono::steady_clock::now() - start;
+            REQUIRE(size > 0);
+            if (n == 0) {
+                run.idrBytes = size;
+            } else {
+                pBytes += size;
+                encodeNs += (double) chrono::duration_cast<chrono::nanoseconds>(encodeTime).count();
+            }
+            for (int y = 0; y < H; y++)
+                for (int x = 0; x < W; x++) {
+                    if (mask[(size_t) (y / MB_SIZE) * mbW + x / MB_SIZE] != VISIBLE)
+                        continue;
+                    double d = out.img.plane[0][y * out.img.i_stride[0] + x] -
+                               source[(size_t) y * W + x];
+                    sqErr += d * d;
+                    pixels++;
+                }
+        }
+        x264_picture_clean(&pic);
+        x264_encoder_close(enc);
+
+        run.pKbps = pBytes * 8 / 1000 / ((double) (FRAMES - 1) / FPS);
+        run.visiblePsnr = 10 * log10(255.0 * 255.0 / (sqErr / pixels));
+        run.encodeMs = encodeNs / 1e6 / (FRAMES - 1);
+        return run;
+    }
+}   // namespace
+
+// What the mask buys with the tree's encoder settings, and why lens_mask is off by default:
+// keyframes get much cheaper at the same visible quality, but the P frames of a panning scene cost
+// more and take no less time to encode. If either of the last two checks fails, the mask got
+// better than this and the default can be revisited.
+TEST(LensMaskX264, CheaperKeyframesButNotPFrames) {
+    // Cardboard-like lens FOV plus 10 degrees offFov, as the phone sends it
+    float rect[4] = {-tan(60 * DEG), tan(58.67f * DEG), tan(54 * DEG), -tan(58.67f * DEG)};
+    EyeTangents eyes[2];
+    eyesFromProjRect(rect, eyes);
+    auto mask = macroblocks(W, H, eyes);
+    size_t hidden = 0;
+    for (auto m : mask)
+        hidden += m != VISIBLE;
+
+    auto plain = stream(mask, false);
+    auto masked = stream(mask, true);
+    printf("plain    IDR %6d B, P frames %5.0f kbps %.2f ms, visible PSNR %.2f dB\n",
+           plain.idrBytes,
+           plain.pKbps,
+           plain.encodeMs,
+           plain.visiblePsnr);
+    printf("masked   IDR %6d B, P frames %5.0f kbps %.2f ms, visible PSNR %.2f dB, %zu of %zu "
+           "hidden\n",
+           masked.idrBytes,
+           masked.pKbps,
+           masked.encodeMs,
+           masked.visiblePsnr,
+           hidden,
+           mask.size());
+
+    CHECK(hidden > mask.size() / 5);
+    CHECK(masked.idrBytes < plain.idrBytes * 3 / 4);
+    CHECK(masked.visiblePsnr > plain.visiblePsnr - 0.5);
+    // The painted macroblocks are skipped with zero vectors, and ultrafast's diamond search of
+    // the visible ones next to them starts from those. What pans in from there is coded anew.
+    CHECK(masked.pKbps > plain.pKbps);
+    CHECK(masked.encodeMs > plain.encodeMs * 0.8);
+}
@@ -0,0 +1,120 @@
+#include "Check.h"
+#include "Utils/LossRecovery.h"
+
+using namespace std;
+using namespace LossRecovery;
+
+namespace {
+    // frames first..last encoded as P frames, pts == encoder pts
+    void encode(ReferenceTracker &tracker, int64_t first, int64_t last) {
+        for (int64_t pts = first; pts <= last; pts++)
+            tracker.onEncoded(pts, pts, false);
+    }
+}   // namespace
+
+TEST(LossRecovery, NothingToDoWithoutLoss) {
+    ReferenceTracker tracker(8);
+    tracker.onEncoded(0, 0, true);
+    encode(tracker, 1, 20);
+    tracker.onAck(18, true);
+    CHECK_EQ(tracker.next(), NONE);
+}
+
+TEST(LossRecovery, PredictsFromTheNewestAcknowledgedFrame) {
+    ReferenceTracker tracker(8);
+    tracker.onEncoded(0, 0, true);
+    encode(tracker, 1, 10);
+    tracker.onAck(7, true);
+    tracker.onLoss();   // 8 is the first one not acknowledged
+    CHECK_EQ(tracker.next(), REFERENCE);
+    CHECK_EQ(tracker.invalidateFrom(), 8);
+    CHECK_EQ(tracker.next(), NONE);   // handled
+}
+
+TEST(LossRecovery, IdrWhenNothingWasAcknowledgedSinceTheLastOne) {
+    ReferenceTracker tracker(8);
+    tracker.onEncoded(0, 0, true);
+    encode(tracker, 1, 5);
+    tracker.onLoss();
+    CHECK_EQ(tracker.next(), IDR);
+}
+
+TEST(LossRecovery, IdrWhenTheAcknowledgedFrameLeftTheDpb) {
+    ReferenceTracker tracker(4);
+    tracker.onEncoded(0, 0, true);
+    encode(tracker, 1, 10);
+    tracker.onAck(5, true);
+    encode(tracker, 11, 14);   // 5 is 9 frames back, the DPB holds 4
+    tracker.onLoss();
+    CHECK_EQ(tracker.next(), IDR);
+}
+
+TEST(LossRecovery, FramesAcknowledgedAfterTheLossAreTainted) {
+    ReferenceTracker tracker(8);
+    tracker.onEncoded(0, 0, true);
+    encode(tracker, 1, 10);
+    tracker.onAck(3, true);
+    tracker.onLoss();          // 4 lost, 5 to 10 predict from it
+    tracker.onAck(9, false);   // decoded, but from a broken picture
+    tracker.onLoss();          // the same loss reported again
+    CHECK_EQ(tracker.next(), REFERENCE);
+    CHECK_EQ(tracker.invalidateFrom(), 4);
+
+    // the recovery frame is acknowledged, the next loss predicts from it
+    encode(tracker, 11, 12);
+    tracker.onAck(11, false);
+    tracker.onLoss();
+    CHECK_EQ(tracker.next(), REFERENCE);
+    CHECK_EQ(tracker.invalidateFrom(), 12);
+}
+
+TEST(LossRecovery, KeyframesStartOver) {
+    ReferenceTracker tracker(8);
+    tracker.onEncoded(0, 0, true);
+    encode(tracker, 1, 5);
+    tracker.onAck(5, true);
+    tracker.onEncoded(6, 6, true);
+    tracker.onLoss();   // 6 is in flight, nothing after the IDR is acknowledged
+    CHECK_EQ(tracker.next(), IDR);
+}
+
+TEST(LossRecovery, ReportsWithNothingInFlightAreIgnored) {
+    ReferenceTracker tracker(8);
+    tracker.onEncoded(0, 0, true);
+    encode(tracker, 1, 3);
+    tracker.onAck(3, true);
+    tracker.onLoss();
+    CHECK_EQ(tracker.next(), NONE);
+}
+
+// The client acknowledges every completed frame two frames later and reports losses with the next
+// completed one, every 97th frame is lost. Every loss gets exactly one recovery frame, and each is
+// predicted from a reference.
+TEST(LossRecovery, LossScenario) {
+    const int frames = 900, ackDelay = 2;
+    ReferenceTracker tracker(8);
+    vector<bool> lost(frames);
+    vector<uint32_t> lostSoFar(frames);   // as the client reports with each frame
+    uint32_t clientLost = 0, reported = 0;
+    int references = 0, idrs = 0;
+    for (int n = 0; n < frames; n++) {
+        int k = n - ackDelay;
+        if (k >= 0 && !lost[k]) {
+            if (lostSoFar[k] > reported) {
+                reported = lostSoFar[k];
+                tracker.onLoss();
+            }
+            tracker.onAck(k, true);
+        }
+        auto action = tracker.next();
+        references += action == REFERENCE;
+        idrs += action == IDR;
+        tracker.onEncoded(n, n, n == 0 || action == IDR);
+
+        lost[n] = n >= 120 && n % 97 == 120 % 97;
+        clientLost += lost[n];
+        lostSoFar[n] = clientLost;
+    }
+    CHECK_EQ(references, (int) clientLost);
+    CHECK_EQ(idrs, 0);
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+
+#include "Check.h"
+#include "Utils/LossRecovery.h"
+#include "X264Scene.h"
+
+using namespace std;
+using namespace LossRecovery;
+
+// IDR against prediction from the acknowledged frame with the real encoder, at low latency
+// settings like the streamer's. The client acknowledges each frame ACK_DELAY frames later and
+// reports a loss with the next frame it completes.
+namespace {
+    const int W = 640, H = 360, FPS = 60, FRAMES = 600, ACK_DELAY = 2;
+    const double LINK_MBPS = 20;
+
+    struct Run {
+        double medianPBytes = 0;
+        vector<int> recoveryBytes;
+        int idrs = 0;
+    };
+
+    Run stream(bool reference, const vector<int> &lossAt) {
+        x264_param_t par;
+        REQUIRE(x264_param_default_preset(&par, "ultrafast", "zerolatency") == 0);
+        par.i_log_level = X264_LOG_ERROR;
+        par.i_width = W;
+        par.i_height = H;
+        par.i_fps_num = FPS;
+        par.i_fps_den = 1;
+        par.i_threads = 1;
+        par.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+        par.rc.i_rc_method = X264_RC_CRF;
+        par.rc.f_rf_constant = 24;
+        par.rc.i_vbv_max_bitrate = 8000;
+        par.rc.i_vbv_buffer_size = 8000 / FPS * 4;
+        par.b_repeat_headers = 1;
+        par.b_annexb = 1;
+        REQUIRE(x264_param_apply_profile(&par, "baseline") == 0);
+        if (reference)
+            par.i_dpb_size = 8;
+        ReferenceTracker tracker(reference ? 8 : 1);
+
+        x264_t *enc = x264_encoder_open(&par);
+        REQUIRE(enc);
+        x264_picture_t pic, out;
+        REQUIRE(x264_picture_alloc(&pic, X264_CSP_I420, W, H) == 0);
+
+        X264Scene scene(W, H);
+        Run run;
+        vector<int> pSizes;
+        vector<bool> lost(FRAMES);
+        vector<uint32_t> lostSoFar(FRAMES);
+        uint32_t clientLost = 0, reported = 0;
+        for (int n = 0; n < FRAMES; n++) {
+            int k = n - ACK_DELAY;
+            if (k >= 0 && !lost[k]) {
+                if (lostSoFar[k] > reported) {
+                    reported = lostSoFar[k];
+                    tracker.onLoss();
+                }
+                tracker.onAck(k, true);
+            }
+            auto action = tracker.next();
+            bool recovery = action != NONE;
+            if (action == REFERENCE &&
+                x264_encoder_invalidate_reference(enc, tracker.invalidateFrom()) < 0)
+                action = IDR;
+
+            scene.render(n, pic);
+            pic.i_pts = n;
+            pic.i_type = action == IDR ? X264_TYPE_IDR : X264_TYPE_AUTO;
+            x264_nal_t *nals;
+            int nalCount;
+            int size = x264_encoder_encode(enc, &nals, &nalCount, &pic, &out);
+            REQUIRE(size > 0 && out.i_pts == n);
+            tracker.onEncoded(n, out.i_pts, out.b_keyframe);
+
+            if (recovery) {
+                run.recoveryBytes.push_back(size);
+                run.idrs += out.b_keyframe;
+            } else if (n > 0)
+                pSizes.push_back(size);
+
+            lost[n] = find(lossAt.begin(), lossAt.end(), n) != lossAt.end();
+            clientLost += lost[n];
+            lostSoFar[n] = clientLost;
+        }
+        x264_picture_clean(&pic);
+        x264_encoder_close(enc);
+
+        sort(pSizes.begin(), pSizes.end());
+        run.medianPBytes = pSizes[pSizes.size() / 2];
+        return run;
+    }
+
+    double mean(const vector<int> &v) {
+        double sum = 0;
+        for (int x : v)
+            sum += x;
+        return v.empty() ? 0 : sum / v.size();
+    }
+
+    // from the loss until the recovery frame is on the client: the feedback, then sending it
+    double msToCleanPicture(double recoveryBytes) {
+        return (ACK_DELAY + 1) * 1000.0 / FPS + recoveryBytes * 8 / (LINK_MBPS * 1000);
+    }
+}   // namespace
+
+TEST(LossRecoveryX264, ReferenceRecoveryIsSmallerAndCleanSooner) {
+    vector<int> lossAt;
+    for (int n = 100; n < FRAMES - 10; n += 97)
+        lossAt.push_back(n);
+
+    auto idr = stream(false, lossAt);
+    auto ref = stream(true, lossAt);
+    REQUIRE(idr.recoveryBytes.size() == lossAt.size());
+    REQUIRE(ref.recoveryBytes.size() == lossAt.size());
+    CHECK_EQ(idr.idrs, (int) lossAt.size());
+    CHECK_EQ(ref.idrs, 0);
+
+    // predicting from a few frames back costs a few P frames, an IDR tens of them
+    CHECK(mean(idr.recoveryBytes) > 10 * idr.medianPBytes);
+    CHECK(mean(ref.recoveryBytes) < mean(idr.recoveryBytes) / 3);
+    CHECK(msToCleanPicture(mean(ref.recoveryBytes)) < msToCleanPicture(mean(idr.recoveryBytes)));
+}
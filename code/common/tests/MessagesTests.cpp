@@ -0,0 +1,216 @@
+#include <chrono>
+#include <functional>
+#include <random>
+
+#include "Check.h"
+#include "PVRMessages.h"
+
+using namespace std;
+
+namespace {
+    struct Seen {
+        int disconnects = 0;
+        float ipd = 0;
+        size_t nalsSize = 0;
+    };
+
+    auto handlers(Seen &seen) {
+        return PVRMsg::Handlers{
+            [&](const PVRMsg::Message<DISCONNECT> &) { seen.disconnects++; },
+            [&](const PVRMsg::Message<ADDITIONAL_DATA> &msg) { seen.ipd = msg.data.ipd; },
+            [&](PVRMsg::Message<HEADER_NALS> &msg) { seen.nalsSize = msg.data.size(); }};
+    }
+}   // namespace
+
+TEST(Messages, DispatchesToTheOverloadOfTheType) {
+    Seen seen;
+    auto h = handlers(seen);
+    PVRMsg::AdditionalData data = {1920, 1080, {-1, -1, 1, 1}, 0.063f};
+    CHECK(PVRMsg::dispatch(h, ADDITIONAL_DATA, PVRMsg::encode(data)));
+    CHECK(PVRMsg::dispatch(h, DISCONNECT, {}));
+    CHECK(PVRMsg::dispatch(h, HEADER_NALS, vector<uint8_t>(10)));
+    CHECK_EQ(seen.disconnects, 1);
+    CHECK_EQ(seen.ipd, 0.063f);
+    CHECK_EQ(seen.nalsSize, 10u);
+}
+
+TEST(Messages, TypesWithoutAnOverloadAreSkipped) {
+    Seen seen;
+    auto h = handlers(seen);
+    CHECK(PVRMsg::dispatch(h, PAIR_ACCEPT, {}));
+    CHECK(PVRMsg::dispatch(h, CLIENT_STATS, vector<uint8_t>(3)));   // not decoded either
+    CHECK_EQ(seen.disconnects, 0);
+}
+
+TEST(Messages, ShortPayloadsAndUnknownTypesAreRejected) {
+    Seen seen;
+    auto h = handlers(seen);
+    CHECK(!PVRMsg::dispatch(h, ADDITIONAL_DATA, vector<uint8_t>(3)));
+    CHECK(!PVRMsg::dispatch(h, PVR_MSG(PVR_MSG_COUNT), {}));
+    CHECK(!PVRMsg::dispatch(h, PVR_MSG(200), {}));
+    CHECK_EQ(seen.ipd, 0.f);
+}
+
+TEST(Messages, FixedSizePayloadsRoundTrip) {
+    PVRMsg::AudioConfig sent = {1, 2, 480, 48000, 15244, 0}, got = {};
+    auto data = PVRMsg::encode(sent);
+    CHECK_EQ(data.size(), sizeof(sent));
+    REQUIRE(PVRMsg::decode(data, got));
+    CHECK_EQ(got.packetFrames, 480);
+    CHECK_EQ(got.sampleRate, 48000u);
+    CHECK_EQ(got.port, 15244);
+
+    // trailing bytes of a newer peer are ignored
+    auto longer = data.toVector();
+    longer.push_back(0xff);
+    CHECK(PVRMsg::decode(SharedBuffer(move(longer)), got));
+}
+
+TEST(Messages, StreamConfigOfOlderPCs) {
+    PVRMsg::StreamConfig config;
+    CHECK(!PVRMsg::decode(SharedBuffer(), config));
+    REQUIRE(PVRMsg::decode(vector<uint8_t>{1}, config));   // only the multiplexed flag
+    CHECK_EQ(config.multiplexed, 1);
+    CHECK_EQ(config.halfRate, 0);
+    CHECK_EQ(config.poseCodec, 0);   // legacy pose packets
+    CHECK_EQ(config.multipath, 0);   // a single video path
+    CHECK_EQ(config.duplicatePoses, 0);
+}
+
+// the phone reads frame headers of older PCs, the layout must not move
+TEST(Messages, FrameHeaderLayout) {
+    CHECK_EQ(offsetof(PVRMsg::FrameHeader, pts), 0u);
+    CHECK_EQ(offsetof(PVRMsg::FrameHeader, quat), 8u);
+    CHECK_EQ(offsetof(PVRMsg::FrameHeader, size), 24u);
+    CHECK_EQ(offsetof(PVRMsg::FrameHeader, fps), 28u);
+    CHECK_EQ(offsetof(PVRMsg::FrameHeader, delaysMs), 48u);
+    CHECK_EQ(offsetof(PVRMsg::FrameHeader, sentUs), 56u);
+    CHECK_EQ(offsetof(PVRMsg::FrameHeader, poseId), 64u);
+    CHECK_EQ(sizeof(PVRMsg::FrameHeader), 72u);
+}
+
+namespace {
+    template <typename T> T randomPayload(mt19937 &rng) {
+        uint8_t bytes[sizeof(T)];
+        for (auto &b : bytes)
+            b = (uint8_t) rng();
+        T payload;
+        memcpy(&payload, bytes, sizeof(T));
+        return payload;
+    }
+    template <> PVRMsg::Empty randomPayload(mt19937 &) { return {}; }
+    template <> SharedBuffer randomPayload(mt19937 &rng) {
+        vector<uint8_t> bytes(1 + rng() % 2000);
+        for (auto &b : bytes)
+            b = (uint8_t) rng();
+        return SharedBuffer(move(bytes));
+    }
+
+    template <typename T> bool samePayload(const T &a, const T &b) {
+        return memcmp(&a, &b, sizeof(T)) == 0;
+    }
+    bool samePayload(const PVRMsg::Empty &, const PVRMsg::Empty &) { return true; }
+    bool samePayload(const SharedBuffer &a, const SharedBuffer &b) {
+        return a.toVector() == b.toVector();
+    }
+
+    // encodes a random payload of M and dispatches it as M and as every other type, only the
+    // first reaches the handler
+    template <PVR_MSG M> void roundTrip(mt19937 &rng) {
+        using Payload = typename PVRMsg::Payload<M>::type;
+        auto sent = randomPayload<Payload>(rng);
+        auto data = PVRMsg::encode(sent);
+        int calls = 0;
+        auto handler = [&](PVRMsg::Message<M> &msg) {
+            calls++;
+            if (!samePayload(msg.data, sent))
+                Tests::fail(__FILE__, __LINE__, "payload of type " + to_string(M));
+        };
+        CHECK(PVRMsg::dispatch(handler, M, data));
+        CHECK_EQ(calls, 1);
+        for (int type = 0; type < PVR_MSG_COUNT; type++)
+            if (type != M)
+                PVRMsg::dispatch(handler, PVR_MSG(type), data);
+        CHECK_EQ(calls, 1);
+    }
+
+    template <size_t... I> void roundTripAll(mt19937 &rng, index_sequence<I...>) {
+        (roundTrip<PVR_MSG(I)>(rng), ...);
+    }
+}   // namespace
+
+TEST(Messages, EveryTypeRoundTrips) {
+    mt19937 rng(1);
+    for (int i = 0; i < 20; i++)
+        roundTripAll(rng, make_index_sequence<PVR_MSG_COUNT>());
+}
+
+// The talker's receive loop for a stream of small messages: the jump table against what it
+// replaced, a std::function per type and a memcpy of the payload. Each takes the best of 5 runs.
+TEST(Messages, DispatchCost) {
+    const int COUNT = 1'000'000;
+    mt19937 rng(2);
+    const PVR_MSG mix[] = {POSE_DATA, PING, PONG, CLIENT_STATS, POSE_DATA, POSE_DATA};
+    vector<pair<PVR_MSG, SharedBuffer>> stream;
+    for (auto type : mix) {
+        vector<uint8_t> bytes(type == POSE_DATA ? 24 : 16);
+        for (auto &b : bytes)
+            b = (uint8_t) rng();
+        stream.push_back({type, SharedBuffer(move(bytes))});
+    }
+
+    int64_t sum = 0;
+    auto handlers = PVRMsg::Handlers{
+        [&](const PVRMsg::Message<POSE_DATA> &msg) { sum += msg.data.size(); },
+        [&](const PVRMsg::Message<PING> &msg) { sum += msg.data.sentTicks; },
+        [&](const PVRMsg::Message<PONG> &msg) { sum -= msg.data.sentTicks; },
+        [&](const PVRMsg::Message<CLIENT_STATS> &msg) { sum += msg.data.framesLost; }};
+
+    function<void(const SharedBuffer &)> functions[PVR_MSG_COUNT];
+    functions[POSE_DATA] = [&](const SharedBuffer &data) { sum += data.size(); };
+    functions[PING] = [&](const SharedBuffer &data) {
+        PVRMsg::Heartbeat hb;
+        memcpy(&hb, data.data(), sizeof(hb));
+        sum += hb.sentTicks;
+    };
+    functions[PONG] = [&](const SharedBuffer &data) {
+        PVRMsg::Heartbeat hb;
+        memcpy(&hb, data.data(), sizeof(hb));
+        sum -= hb.sentTicks;
+    };
+    functions[CLIENT_STATS] = [&](const SharedBuffer &data) {
+        PVRMsg::ClientStats stats;
+        memcpy(&stats, data.data(), sizeof(stats));
+        sum += stats.framesLost;
+    };
+
+    auto bestNs = [&](auto &&receive) {
+        double best = 1e9;
+        for (int run = 0; run < 5; run++) {
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < COUNT; i++) {
+                auto &msg = stream[i % stream.size()];
+                receive(msg.first, msg.second);
+            }
+            auto elapsed = chrono::steady_clock::now() - start;
+            best = (min)(best, chrono::duration<double, nano>(elapsed).count() / COUNT);
+        }
+        return best;
+    };
+    double table = bestNs([&](PVR_MSG type, const SharedBuffer &data) {
+        PVRMsg::dispatch(handlers, type, data);
+    });
+    double baseline = bestNs([&](PVR_MSG type, const SharedBuffer &data) {
+        if (functions[type])
+            functions[type](data);
+    });
+    printf("dispatch %.1f ns per message, std::function per type %.1f ns (checksum %lld)\n",
+           table,
+           baseline,
+           (long long) sum);
+
+    // Well below a microsecond. The few ns over the std::function table are the copy of the
+    // SharedBuffer payloads into the message, a reference count the raw handlers don't take.
+    CHECK(table < 200);
+    CHECK(table < baseline * 3);
+}
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "Check.h"
+#include "Utils/Multipath.h"
+
+using namespace std;
+
+TEST(Multipath, FirstPathIsUsedUntilMeasured) {
+    MultipathScheduler sched;
+    CHECK_EQ(sched.pick(), -1);
+    int wifi = sched.addPath();
+    int usb = sched.addPath();
+    CHECK_EQ(wifi, 0);
+    CHECK_EQ(usb, 1);
+    CHECK_EQ(sched.pick(), wifi);
+
+    // once wifi has a score, the unmeasured path gets its turn
+    sched.onAck(wifi, 10);
+    CHECK_EQ(sched.pick(), usb);
+    sched.onAck(usb, 2);
+    CHECK_EQ(sched.pick(), usb);
+}
+
+TEST(Multipath, SmoothsLikeRfc6298) {
+    MultipathScheduler sched;
+    int p = sched.addPath();
+    sched.onAck(p, 20);
+    CHECK_NEAR(sched.srttMs(p), 20, 1e-9);   // rttvar 10
+    sched.onAck(p, 36);
+    // rttvar 0.75 * 10 + 0.25 * 16 = 11.5, srtt 0.875 * 20 + 0.125 * 36 = 22
+    CHECK_NEAR(sched.srttMs(p), 22, 1e-9);
+    sched.onAck(p, 22);
+    CHECK_NEAR(sched.srttMs(p), 22, 1e-9);
+}
+
+// a jittery path loses to a steadier one with the same mean
+TEST(Multipath, ScoresRttVariance) {
+    MultipathScheduler sched;
+    int steady = sched.addPath(), jittery = sched.addPath();
+    for (int i = 0; i < 50; i++) {
+        sched.onAck(steady, 10);
+        sched.onAck(jittery, i % 2 ? 4 : 16);
+    }
+    CHECK_NEAR(sched.srttMs(jittery), 10, 1);
+    CHECK_EQ(sched.pick(), steady);
+}
+
+// frames must not overtake each other: the current path is kept while it has frames in flight
+TEST(Multipath, StaysWhileFramesAreInFlight) {
+    MultipathScheduler sched;
+    int wifi = sched.addPath(), usb = sched.addPath();
+    sched.onAck(wifi, 5);
+    sched.onAck(usb, 5);
+    CHECK_EQ(sched.pick(), wifi);
+
+    for (int i = 0; i < 20; i++)
+        sched.onAck(wifi, 40);   // wifi degrades
+    sched.setInFlight(wifi, 2);
+    CHECK_EQ(sched.pick(), wifi);
+    sched.setInFlight(wifi, 1);
+    CHECK_EQ(sched.pick(), wifi);
+    sched.setInFlight(wifi, 0);
+    CHECK_EQ(sched.pick(), usb);
+
+    // and back once usb is worse and idle
+    for (int i = 0; i < 40; i++)
+        sched.onAck(usb, 200);
+    sched.setInFlight(usb, 3);
+    CHECK_EQ(sched.pick(), usb);
+    sched.setInFlight(usb, 0);
+    CHECK_EQ(sched.pick(), wifi);
+}
+
+TEST(Multipath, DownPathsAreSkipped) {
+    MultipathScheduler sched;
+    int wifi = sched.addPath(), usb = sched.addPath();
+    sched.onAck(wifi, 5);
+    sched.onAck(usb, 50);
+    sched.setInFlight(wifi, 4);
+    CHECK_EQ(sched.pick(), wifi);
+
+    // whatever was in flight on it is gone, no need to wait for it
+    sched.onDown(wifi);
+    CHECK_EQ(sched.pick(), usb);
+    CHECK(sched.alivePaths() == vector<int>{usb});
+
+    sched.onDown(usb);
+    CHECK_EQ(sched.pick(), -1);
+    CHECK(sched.alivePaths().empty());
+}
+
+TEST(Multipath, FilterKeepsFirstCopy) {
+    MonotonicFilter filter;
+    CHECK(filter.accept(10));
+    CHECK(!filter.accept(10));   // the same frame over the second path
+    CHECK(!filter.accept(9));    // a late one
+    CHECK(filter.accept(12));
+    CHECK(!filter.accept(11));   // 12 overtook it on a faster path
+
+    // a new stream starts its pts over
+    filter.reset();
+    CHECK(filter.accept(0));
+}
+
+// two path readers get every frame, each pts is delivered exactly once and in order
+TEST(Multipath, FilterDeliversEachStampOnceAcrossThreads) {
+    const int COUNT = 100000;
+    MonotonicFilter filter;
+    atomic<int> accepted{0};
+    vector<int64_t> delivered[2];
+    auto reader = [&](int i) {
+        for (int64_t pts = 0; pts < COUNT; pts++)
+            if (filter.accept(pts)) {
+                accepted++;
+                delivered[i].push_back(pts);
+            }
+    };
+    thread a(reader, 0), b(reader, 1);
+    a.join();
+    b.join();
+
+    CHECK_EQ(accepted.load(), COUNT);
+    for (auto &d : delivered)
+        CHECK(is_sorted(d.begin(), d.end()));
+    vector<int64_t> all(delivered[0]);
+    all.insert(all.end(), delivered[1].begin(), delivered[1].end());
+    sort(all.begin(), all.end());
+    CHECK(adjacent_find(all.begin(), all.end()) == all.end());
+}
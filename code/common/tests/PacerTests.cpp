@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Check.h"
+#include "Utils/Pacer.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+    struct Write {
+        size_t offset, size;
+        Clk::time_point at;
+    };
+
+    vector<Write> pace(FramePacer &pacer, size_t size, microseconds interval) {
+        vector<uint8_t> frame(size);
+        vector<Write> writes;
+        CHECK(pacer.send(frame.data(), size, interval, [&](const uint8_t *data, size_t n) {
+            writes.push_back({(size_t) (data - frame.data()), n, Clk::now()});
+            return true;
+        }));
+        return writes;
+    }
+
+    double ms(Clk::duration d) { return duration<double, milli>(d).count(); }
+}   // namespace
+
+TEST(Pacer, DisabledSendsAtOnce) {
+    FramePacer pacer(0, 1000, 1e6);
+    CHECK(!pacer.enabled());
+    auto writes = pace(pacer, 100'000, microseconds(16667));
+    REQUIRE(writes.size() == 1);
+    CHECK_EQ(writes[0].size, 100'000u);
+}
+
+TEST(Pacer, RateSpreadsTheFrameOverTheWindow) {
+    FramePacer pacer(0.5);
+    CHECK_NEAR(pacer.pacingRate(100'000, microseconds(20'000)), 10e6, 1);
+    // never faster than the link drains
+    pacer.setLinkRate(5e6);
+    CHECK_NEAR(pacer.pacingRate(100'000, microseconds(20'000)), 5e6, 1);
+    CHECK_NEAR(pacer.pacingRate(10'000, microseconds(20'000)), 1e6, 1);
+    pacer.setLinkRate(-1);
+    CHECK_EQ(pacer.getLinkRate(), 0);
+}
+
+// chunks in order, back to back, released at the pacing rate: the last one goes out at
+// 1 - 1 / chunks of the window
+TEST(Pacer, ChunksGoOutAtThePacingRate) {
+    FramePacer pacer(0.5, 10'000);
+    auto writes = pace(pacer, 95'000, microseconds(40'000));
+    REQUIRE(writes.size() == 10);
+    for (size_t i = 0; i < writes.size(); i++) {
+        CHECK_EQ(writes[i].offset, i * 10'000);
+        CHECK_EQ(writes[i].size, i < 9 ? 10'000u : 5'000u);
+        // 95 KB over 20 ms, a chunk every 2.1 ms
+        CHECK(ms(writes[i].at - writes[0].at) >= i * 2.105 - 0.01);
+    }
+    CHECK(ms(writes.back().at - writes[0].at) < 19 + 3);   // what sleeping overshoots by
+}
+
+TEST(Pacer, StopsAtTheFirstFailedWrite) {
+    FramePacer pacer(0.5, 1000);
+    vector<uint8_t> frame(10'000);
+    int writes = 0;
+    CHECK(!pacer.send(frame.data(), frame.size(), microseconds(1000), [&](const uint8_t *, size_t) {
+        return ++writes < 3;
+    }));
+    CHECK_EQ(writes, 3);
+}
+
+// Why pacing is off by default. A 60 fps stream at 20 Mbps of 40 KB frames (an IDR every second
+// 4x that) through a 100 Mbps WiFi bottleneck, with a 100 byte pose packet every 2 ms from the
+// same PC. The bottleneck queue drains at the link rate; a pose waits for the bytes in front of
+// it. Pacing over half the interval keeps the queue empty, so poses stop waiting, but each frame
+// finishes arriving that much later.
+TEST(Pacer, PosesWaitLessButFramesArriveLater) {
+    const double LINK = 100e6 / 8;
+    const auto INTERVAL = microseconds(16667);
+    struct Outcome {
+        double poseWaitMaxMs = 0;
+        double frameDoneMeanMs = 0;   // last byte out of the bottleneck, after the frame is sent
+    };
+    auto run = [&](double fraction) {
+        FramePacer pacer(fraction, 16 * 1024, LINK);   // the streamer knows the link from probing
+        Outcome res;
+        const int FRAMES = 120;
+        for (int f = 0; f < FRAMES; f++) {
+            size_t size = f % 60 == 0 ? 160'000 : 40'000;
+            double t0 = f * INTERVAL.count() / 1e6;
+            // the writes of the frame, as the pacer releases them
+            vector<pair<double, size_t>> arrivals;
+            double rate = pacer.enabled() ? pacer.pacingRate(size, INTERVAL) : 0;
+            for (size_t sent = 0; sent < size; sent += 16 * 1024)
+                arrivals.push_back({t0 + (rate > 0 ? sent / rate : 0),
+                                    (min)((size_t) 16 * 1024, size - sent)});
+            // the queue drains in arrival order, frame chunks and poses alike
+            double busyUntil = t0, frameDone = t0;
+            size_t next = 0;
+            auto drainUntil = [&](double t) {
+                for (; next < arrivals.size() && arrivals[next].first <= t; next++) {
+                    busyUntil = (max)(busyUntil, arrivals[next].first);
+                    frameDone = busyUntil += arrivals[next].second / LINK;
+                }
+            };
+            for (double pose = t0; pose < t0 + INTERVAL.count() / 1e6; pose += 0.002) {
+                drainUntil(pose);
+                res.poseWaitMaxMs = (max)(res.poseWaitMaxMs, (max)(0.0, busyUntil - pose) * 1000);
+                busyUntil = (max)(busyUntil, pose) + 100 / LINK;
+            }
+            drainUntil(HUGE_VAL);
+            res.frameDoneMeanMs += (frameDone - t0) * 1000 / FRAMES;
+        }
+        return res;
+    };
+    auto burst = run(0), paced = run(0.5);
+    printf("burst: poses wait up to %.1f ms, frames through after %.1f ms\n",
+           burst.poseWaitMaxMs,
+           burst.frameDoneMeanMs);
+    printf("paced: poses wait up to %.1f ms, frames through after %.1f ms\n",
+           paced.poseWaitMaxMs,
+           paced.frameDoneMeanMs);
+    CHECK(burst.poseWaitMaxMs > 10);     // behind an IDR
+    CHECK(paced.poseWaitMaxMs < 1.5);    // one chunk at most
+    CHECK(paced.frameDoneMeanMs > burst.frameDoneMeanMs + 4);
+}
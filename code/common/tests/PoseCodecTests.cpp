@@ -0,0 +1,167 @@
+#include <chrono>
+#include <random>
+
+#include "Check.h"
+#include "Utils/PoseCodec.h"
+
+using namespace std;
+using namespace PoseCodec;
+
+namespace {
+    Sample randomSample(mt19937 &rng, int64_t timestamp) {
+        normal_distribution<float> normal;
+        Sample s;
+        float norm = 0;
+        for (auto &q : s.quat) {
+            q = normal(rng);
+            norm += q * q;
+        }
+        for (auto &q : s.quat)
+            q /= sqrt(norm);
+        for (auto &a : s.acc)
+            a = normal(rng) * 9.8f;
+        s.timestamp = timestamp;
+        return s;
+    }
+
+    // |a - b| = 2 sin(angle / 4) for unit quaternions, unlike acos(a . b) exact for tiny angles
+    double rotationErrorDeg(const float a[4], const float b[4]) {
+        double minus = 0, plus = 0;   // q and -q are the same rotation
+        for (int i = 0; i < 4; i++) {
+            minus += (a[i] - b[i]) * (a[i] - b[i]);
+            plus += (a[i] + b[i]) * (a[i] + b[i]);
+        }
+        return 4 * asin(sqrt((min)(minus, plus)) / 2) * 180 / 3.14159265358979;
+    }
+}   // namespace
+
+TEST(PoseCodec, QuaternionsWithinAHundredthOfADegree) {
+    mt19937 rng(1);
+    double worst = 0;
+    for (int i = 0; i < 200000; i++) {
+        auto s = randomSample(rng, 0);
+        float back[4];
+        unpackQuat(packQuat(s.quat), back);
+        worst = (max)(worst, rotationErrorDeg(s.quat, back));
+    }
+    CHECK(worst < 0.01);
+}
+
+TEST(PoseCodec, HalfFloats) {
+    CHECK_EQ(toHalf(1.f), 0x3c00);
+    CHECK_EQ(toHalf(-2.f), 0xc000);
+    CHECK_EQ(toHalf(65504.f), 0x7bff);
+    CHECK_EQ(toHalf(1e6f), 0x7c00);                // overflow to infinity
+    CHECK_EQ(toHalf(1e-10f), 0x0000);              // underflow to zero
+    CHECK_EQ(fromHalf(0x0001), ldexp(1.f, -24));   // smallest subnormal
+    for (float g : {9.81f, -0.5f, 3.3f, 20.f})
+        CHECK_NEAR(fromHalf(toHalf(g)), g, abs(g) / 2048);
+}
+
+TEST(PoseCodec, BatchRoundTrip) {
+    mt19937 rng(2);
+    Sample in[MAX_BATCH], out[MAX_BATCH];
+    for (size_t i = 0; i < MAX_BATCH; i++)
+        in[i] = randomSample(rng, 1000000000LL + (int64_t) i * 2000000);   // 500 Hz sensor
+    uint8_t buf[packetSize(MAX_BATCH)];
+    REQUIRE(encode(in, MAX_BATCH, buf, sizeof(buf)) == sizeof(buf));
+    REQUIRE(decode(buf, sizeof(buf), out, MAX_BATCH) == MAX_BATCH);
+    for (size_t i = 0; i < MAX_BATCH; i++) {
+        CHECK_EQ(out[i].timestamp, in[i].timestamp);   // ages are whole microseconds here
+        CHECK(rotationErrorDeg(in[i].quat, out[i].quat) < 0.01);
+        for (int j = 0; j < 3; j++)
+            CHECK_NEAR(out[i].acc[j], in[i].acc[j], abs(in[i].acc[j]) / 2048 + 1e-6);
+    }
+    CHECK_EQ(packetSize(1), 24u);
+
+    // ages saturate at 65 ms
+    in[0].timestamp = in[MAX_BATCH - 1].timestamp - 100000000;
+    encode(in, MAX_BATCH, buf, sizeof(buf));
+    decode(buf, sizeof(buf), out, MAX_BATCH);
+    CHECK_EQ(out[0].timestamp, in[MAX_BATCH - 1].timestamp - 65535000);
+}
+
+TEST(PoseCodec, RejectsWhatIsNotAPacket) {
+    Sample out[MAX_BATCH];
+    uint8_t buf[packetSize(2)] = {};
+    CHECK_EQ(decode(buf, sizeof(buf), out, MAX_BATCH), 0u);   // no magic
+    buf[0] = PACKET_MAGIC;
+    buf[1] = 3;   // more samples than the packet holds
+    CHECK_EQ(decode(buf, sizeof(buf), out, MAX_BATCH), 0u);
+    buf[1] = 2;
+    CHECK_EQ(decode(buf, sizeof(buf), out, 1), 0u);   // more than the caller takes
+    CHECK_EQ(decode(buf, sizeof(buf), out, 2), 2u);
+}
+
+// what a phone paired with a PC that doesn't announce the codec sends
+TEST(PoseCodec, LegacyLayout) {
+    mt19937 rng(3);
+    auto in = randomSample(rng, 123456789012LL);
+    uint8_t buf[LEGACY_SIZE];
+    REQUIRE(encodeLegacy(in, buf, sizeof(buf)) == 36);
+    float w;
+    memcpy(&w, buf, 4);   // plain floats in the order they were given
+    CHECK_EQ(w, in.quat[0]);
+
+    Sample out;
+    REQUIRE(decodeAny(buf, sizeof(buf), &out, 1) == 1);
+    CHECK_EQ(out.timestamp, in.timestamp);
+    for (int i = 0; i < 4; i++)
+        CHECK_EQ(out.quat[i], in.quat[i]);
+    for (int i = 0; i < 3; i++)
+        CHECK_EQ(out.acc[i], in.acc[i]);
+
+    // the magic as the first byte of a float doesn't make it a codec packet
+    buf[0] = PACKET_MAGIC;
+    buf[1] = 1;
+    CHECK_EQ(decodeAny(buf, sizeof(buf), &out, 1), 1u);
+    CHECK_EQ(out.timestamp, in.timestamp);
+
+    uint8_t codec[packetSize(1)];
+    encode(&in, 1, codec, sizeof(codec));
+    CHECK_EQ(decodeAny(codec, sizeof(codec), &out, 1), 1u);
+    CHECK_EQ(encodeLegacy(in, buf, 35), 0u);
+}
+
+// Samples per second through encode() and decode() for single samples and full batches, best of 5
+// runs, and what a sample costs on the wire against the legacy datagram.
+TEST(PoseCodec, ThroughputAndBytesPerSample) {
+    const size_t SAMPLES = 1 << 20;
+    mt19937 rng(4);
+    vector<Sample> in(SAMPLES), out(MAX_BATCH);
+    for (size_t i = 0; i < SAMPLES; i++)
+        in[i] = randomSample(rng, (int64_t) i * 2000000);
+    uint8_t buf[packetSize(MAX_BATCH)];
+    int64_t checksum = 0;
+
+    for (size_t batch : {(size_t) 1, MAX_BATCH}) {
+        double encodeNs = 1e9, decodeNs = 1e9;
+        for (int run = 0; run < 5; run++) {
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i + batch <= SAMPLES; i += batch)
+                checksum += encode(&in[i], batch, buf, sizeof(buf));
+            auto encoded = chrono::steady_clock::now();
+            for (size_t i = 0; i + batch <= SAMPLES; i += batch) {
+                decode(buf, packetSize(batch), out.data(), MAX_BATCH);
+                checksum += out[0].timestamp;
+            }
+            auto decoded = chrono::steady_clock::now();
+            encodeNs = (min)(encodeNs, chrono::duration<double, nano>(encoded - start).count());
+            decodeNs = (min)(decodeNs, chrono::duration<double, nano>(decoded - encoded).count());
+        }
+        double bytes = (double) packetSize(batch) / batch;
+        printf("batch %2zu: encode %.1f M samples/s, decode %.1f M samples/s, %.1f bytes per "
+               "sample (legacy %zu)\n",
+               batch,
+               SAMPLES / encodeNs * 1e3,
+               SAMPLES / decodeNs * 1e3,
+               bytes,
+               LEGACY_SIZE);
+
+        // millions per second where a 500 Hz sensor needs 500, and a third less on the wire
+        CHECK(SAMPLES / encodeNs * 1e3 > 2);
+        CHECK(SAMPLES / decodeNs * 1e3 > 2);
+        CHECK(bytes < (batch == 1 ? 25 : 15));
+    }
+    CHECK(checksum != 0);
+}
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include "Check.h"
+#include "Utils/PoseIngest.h"
+
+using namespace std;
+using namespace PoseIngest;
+
+namespace {
+    const double PI = 3.14159265358979;
+    const int64_t PHONE_CLOCK_NS = -7300000000LL;   // phone clock - PC clock
+    const double HORIZON_S = 0.035;                 // SteamVR renders about this far ahead
+
+    Quat axisAngle(double x, double y, double z, double angle) {
+        double s = sin(angle / 2);
+        return {cos(angle / 2), x * s, y * s, z * s};
+    }
+
+    Quat yawPitch(double yaw, double pitch) {
+        return mul(axisAngle(0, 1, 0, yaw), axisAngle(1, 0, 0, pitch));
+    }
+
+    double minimumJerk(double u) {
+        u = clamp(u, 0.0, 1.0);
+        return u * u * u * (10 - 15 * u + 6 * u * u);
+    }
+
+    // head orientations over time, in seconds
+    using Trace = function<Quat(double)>;
+
+    const Trace lookAround = [](double t) {
+        return yawPitch(0.6 * sin(2 * PI * 0.3 * t) + 0.2 * sin(2 * PI * 1.1 * t),
+                        0.3 * sin(2 * PI * 0.5 * t + 1));
+    };
+    const Trace quickTurns = [](double t) {   // 90 degrees in 350 ms every 1.5 s, with tremor
+        double turn = floor(t / 1.5);
+        double u = minimumJerk((t - turn * 1.5) / 0.35);
+        return yawPitch((fmod(turn, 2) == 0 ? u : 1 - u) * PI / 2, 0.02 * sin(2 * PI * 7 * t));
+    };
+    const Trace walking = [](double t) {
+        return yawPitch(0.3 * sin(2 * PI * 0.15 * t), 0.06 * sin(2 * PI * 1.8 * t));
+    };
+
+    struct Result {
+        double meanDeg, p99Deg;
+        double clockErrorMs;   // mean
+    };
+
+    // Samples the trace at 120 Hz with jittered timing and sensor noise, delivers them 2.5 ms
+    // plus exponential queuing later (1% of them 30 ms late) and renders at 90 Hz. Each frame
+    // predicts the newest pose HORIZON_S ahead like SteamVR does, the error is against the trace.
+    // Without velocities the pose is held as it is, as before PoseIngest.
+    Result replay(const Trace &trace, bool useVelocities, unsigned seed = 1) {
+        mt19937 rng(seed);
+        normal_distribution<double> noise(0, 0.0008);
+        exponential_distribution<double> queuing(1 / 2.0);
+        uniform_real_distribution<double> uniform(0, 1);
+
+        struct Packet {
+            double sampleS, arrivalS;
+            Quat quat;
+        };
+        vector<Packet> packets;
+        double lastArrival = 0;
+        for (double t = 0.5; t < 60; t += 1 / 120.0 + (uniform(rng) - 0.5) * 0.002) {
+            double n[3] = {noise(rng), noise(rng), noise(rng)};
+            double delay = 0.0025 + queuing(rng) / 1000 + (uniform(rng) < 0.01 ? 0.03 : 0);
+            lastArrival = (max)(lastArrival, t + delay);   // TCP or not, they arrive in order
+            packets.push_back({t, lastArrival, normalized(mul(fromRotVec(n), trace(t)))});
+        }
+
+        Ingest ingest;
+        State state;
+        double stateAtS = 0, clockError = 0;
+        int clockSamples = 0;
+        vector<double> errors;
+        size_t next = 0;
+        for (double now = 2; now < 59; now += 1 / 90.0) {
+            for (; next < packets.size() && packets[next].arrivalS <= now; next++) {
+                auto &p = packets[next];
+                float quat[4] = {(float) p.quat.w, (float) p.quat.x, (float) p.quat.y,
+                                 (float) p.quat.z};
+                auto arrivalNs = (int64_t) (p.arrivalS * 1e9);
+                ingest.add(quat, (int64_t) (p.sampleS * 1e9) + PHONE_CLOCK_NS, arrivalNs, 5);
+                state = ingest.state(arrivalNs);
+                stateAtS = p.arrivalS;
+                clockError += abs((ingest.clockOffsetNs() + PHONE_CLOCK_NS) / 1e6);
+                clockSamples++;
+                if (!useVelocities)
+                    state = {state.quat, {}, {}, state.poseTimeOffsetS};
+            }
+            if (clockSamples == 0)
+                continue;
+            double target = now + HORIZON_S;
+            double poseS = stateAtS + state.poseTimeOffsetS;
+            auto predicted = predict(
+                state.quat, state.angularVelocity, state.angularAcceleration, target - poseS);
+            errors.push_back(angleBetween(predicted, trace(target)) * 180 / PI);
+        }
+
+        sort(errors.begin(), errors.end());
+        double sum = 0;
+        for (double e : errors)
+            sum += e;
+        return {sum / errors.size(), errors[errors.size() * 99 / 100], clockError / clockSamples};
+    }
+}   // namespace
+
+TEST(PoseIngest, RotationVectorsRoundTrip) {
+    mt19937 rng(1);
+    uniform_real_distribution<double> component(-3, 3);
+    for (int i = 0; i < 1000; i++) {
+        double v[3] = {component(rng), component(rng), component(rng)}, back[3];
+        if (sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) >= PI)
+            continue;   // the shorter rotation is the other way round
+        toRotVec(fromRotVec(v), back);
+        for (int k = 0; k < 3; k++)
+            CHECK_NEAR(back[k], v[k], 1e-9);
+    }
+    double zero[3] = {}, back[3];
+    toRotVec(fromRotVec(zero), back);
+    CHECK_EQ(back[0], 0.0);
+}
+
+TEST(PoseIngest, ConstantRotationIsPredictedExactly) {
+    Ingest ingest;
+    Quat start = axisAngle(0, 0, 1, 0.3);
+    const double rate = 2;   // rad/s around y
+    for (int i = 0; i <= 24; i++) {
+        auto q = mul(axisAngle(0, 1, 0, rate * i / 120.0), start);
+        float quat[4] = {(float) q.w, (float) q.x, (float) q.y, (float) q.z};
+        auto sampleNs = (int64_t) (i / 120.0 * 1e9);
+        ingest.add(quat, sampleNs + PHONE_CLOCK_NS, sampleNs + 2000000, 4);
+    }
+    auto lastNs = (int64_t) (24 / 120.0 * 1e9);
+    auto state = ingest.state(lastNs + 2000000);
+    CHECK_NEAR(state.angularVelocity[0], 0, 1e-3);
+    CHECK_NEAR(state.angularVelocity[1], rate, 1e-3);
+    CHECK_NEAR(state.angularVelocity[2], 0, 1e-3);
+    CHECK_NEAR(state.angularAcceleration[1], 0, 1e-2);
+    // half the 4 ms RTT is the 2 ms the samples took: the pose is exactly that old
+    CHECK_NEAR(state.poseTimeOffsetS, -0.002, 1e-6);
+
+    auto predicted = predict(state.quat, state.angularVelocity, state.angularAcceleration, 0.05);
+    auto truth = mul(axisAngle(0, 1, 0, rate * (24 / 120.0 + 0.05)), start);
+    CHECK(angleBetween(predicted, truth) < 1e-3);
+}
+
+TEST(PoseIngest, OldSamplesAreIgnored) {
+    Ingest ingest;
+    float a[4] = {1, 0, 0, 0}, b[4] = {0, 1, 0, 0};
+    ingest.add(a, 2000, 5000, 0);
+    ingest.add(b, 1000, 6000, 0);   // older than the last one
+    ingest.add(b, 2000, 6000, 0);   // the same
+    CHECK_EQ(ingest.state(6000).quat.w, 1.0);
+}
+
+TEST(PoseIngest, ClockOffsetFromTheLeastQueuedSample) {
+    for (auto *trace : {&lookAround, &quickTurns, &walking})
+        CHECK(replay(*trace, true).clockErrorMs < 0.5);
+}
+
+// at SteamVR's render time, against holding the last pose as the driver did before
+TEST(PoseIngest, PredictionErrorOnTraces) {
+    struct Expected {
+        const Trace *trace;
+        double meanDeg, p99Deg;
+    };
+    for (auto &e : {Expected{&lookAround, 1, 2}, Expected{&quickTurns, 4, 10},
+                    Expected{&walking, 1, 2}}) {
+        auto held = replay(*e.trace, false);
+        auto predicted = replay(*e.trace, true);
+        CHECK(predicted.meanDeg < e.meanDeg);
+        CHECK(predicted.p99Deg < e.p99Deg);
+        CHECK(predicted.meanDeg < held.meanDeg);
+        CHECK(predicted.p99Deg < held.p99Deg);
+    }
+}
@@ -0,0 +1,162 @@
+#include <map>
+#include <set>
+#include <vector>
+
+#include "Check.h"
+#include "Utils/ReadbackRing.h"
+
+using namespace std;
+
+namespace {
+    // stands in for the GPU: every read stamps its buffer with a frame number and gets a fence,
+    // the test decides which fences have signaled
+    class MockBackend : public ReadbackBackend {
+      public:
+        int frame = 0;
+        bool failReads = false, failCopies = false;
+        uintptr_t nextFence = 1;
+        set<void *> live, done;
+        vector<size_t> readSlots;
+        map<size_t, int> contents;   // slot -> frame
+        int deleted = 0;
+
+        void *read(size_t slot) override {
+            if (failReads)
+                return nullptr;
+            readSlots.push_back(slot);
+            contents[slot] = frame;
+            auto fence = (void *) nextFence++;
+            live.insert(fence);
+            return fence;
+        }
+
+        bool signaled(void *fence) override {
+            CHECK(live.count(fence) == 1);
+            return done.count(fence) == 1;
+        }
+
+        void deleteFence(void *fence) override {
+            deleted++;
+            CHECK_EQ(live.erase(fence), 1u);
+        }
+
+        bool copy(size_t slot, void *cpuBuf) override {
+            *(int *) cpuBuf = contents[slot];
+            return !failCopies;
+        }
+
+        // everything queued so far is finished
+        void finish() { done.insert(live.begin(), live.end()); }
+    };
+}   // namespace
+
+// the GPU is two frames behind: a ring of three never drops and hands every frame back in order
+TEST(ReadbackRing, KeepsUpWithALaggingGpu) {
+    MockBackend gpu;
+    ReadbackRing ring(3);
+    vector<void *> fences;
+    int expected = 0;
+    for (gpu.frame = 0; gpu.frame < 30; gpu.frame++) {
+        CHECK(ring.download(gpu, gpu.frame * 10));
+        fences.push_back((void *) (gpu.nextFence - 1));
+        if (gpu.frame >= 2)
+            gpu.done.insert(fences[gpu.frame - 2]);
+        int pixels;
+        int64_t tag;
+        while (ring.collect(gpu, &pixels, &tag)) {
+            CHECK_EQ(pixels, expected);
+            CHECK_EQ(tag, expected * 10);
+            expected++;
+        }
+        CHECK(ring.inFlight() <= 2);
+    }
+    CHECK_EQ(expected, 28);
+    CHECK_EQ(ring.droppedFrames(), 0u);
+    for (size_t i = 0; i < gpu.readSlots.size(); i++)
+        CHECK_EQ(gpu.readSlots[i], i % 3);
+    CHECK_EQ(gpu.deleted, 28);
+    CHECK_EQ(gpu.live.size(), 2u);
+}
+
+TEST(ReadbackRing, DropsWhenEveryBufferIsInFlight) {
+    MockBackend gpu;
+    ReadbackRing ring(2);
+    CHECK(ring.download(gpu, 1));
+    CHECK(ring.download(gpu, 2));
+    CHECK(!ring.download(gpu, 3));
+    CHECK(!ring.download(gpu, 4));
+    CHECK_EQ(ring.droppedFrames(), 2u);
+    CHECK_EQ(gpu.readSlots.size(), 2u);
+
+    int pixels;
+    int64_t tag;
+    CHECK(!ring.collect(gpu, &pixels, &tag));   // not finished yet
+    CHECK_EQ(gpu.deleted, 0);
+    gpu.finish();
+    CHECK(ring.collect(gpu, &pixels, &tag));
+    CHECK_EQ(tag, 1);
+    // the freed buffer takes the next readback, the other one is still waiting to be collected
+    gpu.frame = 5;
+    CHECK(ring.download(gpu, 5));
+    CHECK_EQ(gpu.readSlots.back(), 0u);
+    CHECK(ring.collect(gpu, &pixels, &tag));
+    CHECK_EQ(tag, 2);
+    CHECK(!ring.collect(gpu, &pixels, &tag));
+    gpu.finish();
+    CHECK(ring.collect(gpu, &pixels, &tag));
+    CHECK_EQ(tag, 5);
+    CHECK_EQ(pixels, 5);
+    CHECK_EQ(ring.inFlight(), 0u);
+}
+
+TEST(ReadbackRing, FailedReadsAndCopies) {
+    MockBackend gpu;
+    ReadbackRing ring(3);
+    gpu.failReads = true;
+    CHECK(!ring.download(gpu, 1));
+    CHECK_EQ(ring.inFlight(), 0u);
+    CHECK_EQ(ring.droppedFrames(), 0u);
+
+    gpu.failReads = false;
+    CHECK(ring.download(gpu, 2));
+    CHECK_EQ(gpu.readSlots.back(), 0u);   // the failed read didn't use up a buffer
+
+    // a buffer that can't be mapped is still handed back to the ring
+    gpu.failCopies = true;
+    gpu.finish();
+    int pixels;
+    int64_t tag = 0;
+    CHECK(!ring.collect(gpu, &pixels, &tag));
+    CHECK_EQ(tag, 2);
+    CHECK_EQ(ring.inFlight(), 0u);
+    CHECK(gpu.live.empty());
+}
+
+TEST(ReadbackRing, ClearAndMoveReleaseFencesOnce) {
+    MockBackend gpu;
+    ReadbackRing ring(4);
+    for (int i = 0; i < 3; i++)
+        ring.download(gpu, i);
+    gpu.finish();
+    int pixels;
+    CHECK(ring.collect(gpu, &pixels, nullptr));
+
+    ReadbackRing moved(std::move(ring));
+    CHECK_EQ(moved.inFlight(), 2u);
+    CHECK_EQ(ring.inFlight(), 0u);
+    CHECK(!ring.download(gpu, 9));
+    CHECK(!ring.collect(gpu, &pixels, nullptr));
+    ring.clear(gpu);
+    CHECK_EQ(gpu.deleted, 1);
+
+    moved.clear(gpu);
+    CHECK_EQ(gpu.deleted, 3);
+    CHECK(gpu.live.empty());
+    moved.clear(gpu);
+    CHECK_EQ(gpu.deleted, 3);
+    // reads continue where they were
+    CHECK(moved.download(gpu, 10));
+    CHECK_EQ(gpu.readSlots.back(), 3u);
+
+    CHECK_EQ(ReadbackRing(1).size(), 2u);
+}
@@ -0,0 +1,48 @@
+#include "Check.h"
+#include "PVRMessages.h"
+
+using namespace std;
+
+TEST(SharedBuffer, TakesOverTheVector) {
+    vector<uint8_t> data(1000, 7);
+    auto *bytes = data.data();
+    SharedBuffer buf(move(data));
+    CHECK(buf.data() == bytes);
+    CHECK_EQ(buf.size(), 1000u);
+}
+
+TEST(SharedBuffer, CopiesAndSlicesShareTheStorage) {
+    SharedBuffer buf = vector<uint8_t>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    SharedBuffer copy = buf;
+    auto slice = buf.slice(2, 5);
+    auto nested = slice.slice(1, 2);
+    auto encoded = PVRMsg::encode(buf);   // raw payloads go to the talker as they are
+
+    // same bytes, not copies of them
+    CHECK(copy.data() == buf.data());
+    CHECK(encoded.data() == buf.data());
+    CHECK(slice.data() == buf.data() + 2);
+    CHECK_EQ(slice.size(), 5u);
+    CHECK_EQ(slice[0], 2);
+    CHECK_EQ(nested.size(), 2u);
+    CHECK_EQ(nested[0], 3);
+    CHECK_EQ(nested[1], 4);
+}
+
+TEST(SharedBuffer, SlicesAreClampedToTheEnd) {
+    SharedBuffer buf = vector<uint8_t>(10, 1);
+    CHECK_EQ(buf.slice(8).size(), 2u);
+    CHECK_EQ(buf.slice(8, 5).size(), 2u);
+    CHECK(buf.slice(20).empty());
+    CHECK(buf.slice(3, 4).slice(2, 10).size() == 2);
+    CHECK(SharedBuffer().slice(1, 1).empty());
+}
+
+TEST(SharedBuffer, StorageLivesAsLongAsAnySlice) {
+    SharedBuffer slice;
+    {
+        SharedBuffer buf = vector<uint8_t>{9, 8, 7, 6};
+        slice = buf.slice(1, 2);
+    }
+    CHECK_EQ(slice.toVector(), (vector<uint8_t>{8, 7}));
+}
@@ -0,0 +1,181 @@
+#include <random>
+
+#include "Check.h"
+#include "Utils/Simulcast.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace Simulcast;
+
+TEST(Simulcast, TiersKeepAspectAndAlignment) {
+    auto tiers = makeTiers(1920, 1080, 3);
+    REQUIRE(tiers.size() == 3);
+    CHECK_EQ(tiers[0].width, 1920);
+    CHECK_EQ(tiers[0].height, 1080);
+    CHECK_EQ(tiers[1].width, 1440);
+    CHECK_EQ(tiers[1].height, 808);   // 810 down to a multiple of 8
+    CHECK_EQ(tiers[2].width, 960);
+    CHECK_EQ(tiers[2].height, 536);
+    CHECK_NEAR(tiers[0].rateShare, 1, 1e-9);
+    CHECK_NEAR(tiers[1].rateShare, 0.6495, 1e-4);
+    CHECK_NEAR(tiers[2].rateShare, 0.3536, 1e-4);
+
+    CHECK_EQ(makeTiers(1920, 1080, 0).size(), 1u);
+    CHECK_EQ(makeTiers(1920, 1080, 7).size(), (size_t) MAX_TIERS);
+    auto tiny = makeTiers(12, 12, 3);
+    CHECK_EQ(tiny[2].width, 8);   // never below a block
+    CHECK_EQ(tiny[2].height, 8);
+}
+
+TEST(Simulcast, ScalingKeepsFlatAndLinearContent) {
+    const int SW = 64, SH = 48, DW = 48, DH = 36;
+    vector<uint8_t> src(SW * SH), dst(DW * DH);
+    fill(src.begin(), src.end(), 77);
+    scalePlane(src.data(), SW, SW, SH, dst.data(), DW, DW, DH);
+    for (auto v : dst)
+        CHECK_EQ(v, 77);
+
+    // a horizontal ramp stays a ramp, sampled at the destination pixel centers
+    for (int y = 0; y < SH; y++)
+        for (int x = 0; x < SW; x++)
+            src[y * SW + x] = (uint8_t) (x * 4);
+    scalePlane(src.data(), SW, SW, SH, dst.data(), DW, DW, DH);
+    for (int y = 0; y < DH; y++)
+        for (int x = 0; x < DW; x++) {
+            double sx = (x + 0.5) * SW / DW - 0.5;
+            CHECK_NEAR(dst[y * DW + x], sx * 4, 1);
+        }
+}
+
+// same size is a copy, and strides wider than the picture are neither read nor written past
+TEST(Simulcast, ScalingHonorsStrides) {
+    const int W = 40, H = 24, STRIDE = 64;
+    vector<uint8_t> src(STRIDE * H, 255), dst(STRIDE * H, 1);
+    mt19937 rng(1);
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++)
+            src[y * STRIDE + x] = (uint8_t) rng();
+    scalePlane(src.data(), STRIDE, W, H, dst.data(), STRIDE, W, H);
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < STRIDE; x++)
+            CHECK_EQ(dst[y * STRIDE + x], x < W ? src[y * STRIDE + x] : 1);
+}
+
+namespace {
+    const double FRAME_MS = 1000.0 / 60;
+
+    // half a second of a phone at 60 fps that decodes a frame in decodeMs
+    Report report(double decodeMs) {
+        Report r;
+        r.framesReceived = r.framesDecoded = 30;
+        r.decodeMs = decodeMs;
+        return r;
+    }
+
+    Clk::time_point at(double s) {
+        return Clk::time_point() + hours(1) + duration_cast<Clk::duration>(duration<double>(s));
+    }
+}   // namespace
+
+TEST(Simulcast, DownOnAnyOverload) {
+    auto tiers = makeTiers(1920, 1080, 3);
+    auto overloaded = [&](Report r) {
+        TierSelector sel(tiers, FRAME_MS);
+        return sel.onReport(r, at(0)) == 1;
+    };
+    CHECK(!overloaded(report(10)));
+    CHECK(overloaded(report(14)));   // above 80% of the interval
+
+    auto backlog = report(5);
+    backlog.framesDecoded = 26;
+    CHECK(overloaded(backlog));
+
+    auto lossy = report(5);
+    lossy.framesReceived = lossy.framesDecoded = 98;
+    lossy.framesLost = 2;
+    CHECK(!overloaded(lossy));   // 2%
+    lossy.framesLost = 3;
+    CHECK(overloaded(lossy));
+
+    auto queuing = report(5);
+    queuing.queuingMs = 31;
+    CHECK(overloaded(queuing));
+
+    // no further down than the last tier
+    TierSelector sel(tiers, FRAME_MS);
+    for (int i = 0; i < 5; i++)
+        sel.onReport(report(20), at(i * 0.5));
+    CHECK_EQ(sel.current(), 2);
+}
+
+TEST(Simulcast, UpOnlyWhenTheBiggerPictureFits) {
+    auto tiers = makeTiers(1920, 1080, 3);
+    TierSelector sel(tiers, FRAME_MS);
+    sel.onReport(report(20), at(0));
+    REQUIRE(sel.current() == 1);
+
+    // 6 ms here is 10.7 ms at tier 0, above 60% of the interval
+    for (int i = 1; i < 60; i++)
+        sel.onReport(report(6), at(i * 0.5));
+    CHECK_EQ(sel.current(), 1);
+
+    // 5 ms is 8.9 ms: up after six reports in a row, and after the hold
+    for (int i = 60; i < 65; i++)
+        CHECK_EQ(sel.onReport(report(5), at(i * 0.5)), 1);
+    CHECK_EQ(sel.onReport(report(5), at(32.5)), 0);
+
+    // reports of a stalled decoder say nothing either way
+    TierSelector idle(tiers, FRAME_MS);
+    idle.onReport(report(20), at(0));
+    Report none;
+    for (int i = 1; i < 100; i++)
+        CHECK_EQ(idle.onReport(none, at(i * 0.5)), 1);
+}
+
+TEST(Simulcast, HoldDoublesWhenAStepUpFails) {
+    auto tiers = makeTiers(1920, 1080, 2);
+    TierSelector sel(tiers, FRAME_MS);
+    // down at 0, then the time until the step up after each failure
+    double t = 0;
+    vector<double> holds;
+    sel.onReport(report(20), at(t));
+    for (int attempt = 0; attempt < 4; attempt++) {
+        double downAt = t;
+        while (sel.current() == 1) {
+            t += 0.5;
+            sel.onReport(report(5), at(t));
+        }
+        holds.push_back(t - downAt);
+        t += 0.5;
+        sel.onReport(report(20), at(t));   // right back down
+    }
+    CHECK_NEAR(holds[0], 10, 0.01);
+    CHECK_NEAR(holds[1], 20, 0.51);
+    CHECK_NEAR(holds[2], 40, 0.51);
+    CHECK_NEAR(holds[3], 80, 0.51);
+}
+
+// Ten minutes of a phone whose decode time goes with the picture size, 8 ms at full size, twice
+// that while it is throttled from minute 2 to 4. It drops one tier when throttling starts and
+// comes back shortly after it ends, without trying in between.
+TEST(Simulcast, FollowsAThrottledDecoder) {
+    auto tiers = makeTiers(1920, 1080, 3);
+    TierSelector sel(tiers, FRAME_MS);
+    mt19937 rng(2);
+    uniform_real_distribution<double> jitter(0.9, 1.1);
+    vector<pair<double, int>> switches;
+    int tier = 0;
+    for (double t = 0; t < 600; t += 0.5) {
+        double msPerPixel = 8.0 / (1920 * 1080) * (t >= 120 && t < 240 ? 2 : 1);
+        double decodeMs = msPerPixel * tiers[tier].width * tiers[tier].height * jitter(rng);
+        int wanted = sel.onReport(report(decodeMs), at(t));
+        if (wanted != tier)
+            switches.push_back({t, wanted});
+        tier = wanted;
+    }
+    REQUIRE(switches.size() == 2);
+    CHECK_EQ(switches[0].second, 1);
+    CHECK_NEAR(switches[0].first, 120, 0.01);
+    CHECK_EQ(switches[1].second, 0);
+    CHECK_NEAR(switches[1].first, 242.5, 0.01);   // the sixth good report
+}
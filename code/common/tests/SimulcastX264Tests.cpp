@@ -0,0 +1,107 @@
+#include <chrono>
+
+#include "Check.h"
+#include "Utils/Simulcast.h"
+#include "X264Scene.h"
+
+using namespace std;
+using namespace Simulcast;
+
+// What a lower tier costs per frame on top of the shared stage (rendering and color conversion,
+// done once at full size): scaling the converted frame down, then its own encode. Encoder settings
+// as in PVRStartStreamer, one thread.
+namespace {
+    const int W = 1920, H = 1080, FPS = 60, FRAMES = 60;
+
+    struct Cost {
+        double scaleMs = 0;
+        double encodeMs = 0;
+        double kbps = 0;
+    };
+
+    double ms(chrono::steady_clock::duration d) {
+        return chrono::duration<double, milli>(d).count();
+    }
+
+    Cost tierCost(const Tier &tier) {
+        x264_param_t par;
+        REQUIRE(x264_param_default_preset(&par, "ultrafast", "zerolatency") == 0);
+        par.i_log_level = X264_LOG_ERROR;
+        par.i_width = tier.width;
+        par.i_height = tier.height;
+        par.i_fps_num = FPS;
+        par.i_fps_den = 1;
+        par.i_threads = 1;
+        par.b_vfr_input = 0;
+        REQUIRE(x264_param_apply_profile(&par, "baseline") == 0);
+        par.rc.i_rc_method = X264_RC_ABR;
+        par.rc.i_bitrate = (int) (20000 * tier.rateShare);
+        x264_t *enc = x264_encoder_open(&par);
+        REQUIRE(enc);
+
+        x264_picture_t full, pic, out;
+        REQUIRE(x264_picture_alloc(&full, X264_CSP_I420, W, H) == 0);
+        REQUIRE(x264_picture_alloc(&pic, X264_CSP_I420, tier.width, tier.height) == 0);
+        X264Scene scene(W, H);
+        Cost cost;
+        double bytes = 0;
+        for (int n = 0; n < FRAMES; n++) {
+            scene.render(n, full);   // the converted frame
+            auto start = chrono::steady_clock::now();
+            x264_picture_t *src = &full;
+            if (tier.width != W) {
+                for (int p = 0; p < 3; p++) {
+                    int div = p == 0 ? 1 : 2;
+                    scalePlane(full.img.plane[p],
+                               full.img.i_stride[p],
+                               W / div,
+                               H / div,
+                               pic.img.plane[p],
+                               pic.img.i_stride[p],
+                               tier.width / div,
+                               tier.height / div);
+                }
+                src = &pic;
+            }
+            auto scaled = chrono::steady_clock::now();
+            src->i_pts = n;
+            x264_nal_t *nals;
+            int nalCount;
+            int size = x264_encoder_encode(enc, &nals, &nalCount, src, &out);
+            auto encoded = chrono::steady_clock::now();
+            REQUIRE(size > 0);
+            bytes += size;
+            cost.scaleMs += ms(scaled - start) / FRAMES;
+            cost.encodeMs += ms(encoded - scaled) / FRAMES;
+        }
+        x264_picture_clean(&full);
+        x264_picture_clean(&pic);
+        x264_encoder_close(enc);
+        cost.kbps = bytes * 8 / 1000 / ((double) FRAMES / FPS);
+        return cost;
+    }
+}   // namespace
+
+// Scaling is a small part of a tier's cost and each tier encodes faster than the one above. The
+// middle tier, scaling included, costs about as much as the full size stream, the lowest one
+// clearly less.
+TEST(SimulcastX264, LowerTiersCostLess) {
+    auto tiers = makeTiers(W, H, MAX_TIERS);
+    vector<Cost> costs;
+    for (size_t i = 0; i < tiers.size(); i++) {
+        costs.push_back(tierCost(tiers[i]));
+        printf("tier %zu %4dx%4d: scale %5.2f ms, encode %5.2f ms, %5.0f kbps\n",
+               i,
+               tiers[i].width,
+               tiers[i].height,
+               costs[i].scaleMs,
+               costs[i].encodeMs,
+               costs[i].kbps);
+    }
+    for (size_t i = 1; i < costs.size(); i++) {
+        CHECK(costs[i].scaleMs < costs[i].encodeMs / 2);
+        CHECK(costs[i].encodeMs < costs[i - 1].encodeMs);
+        CHECK(costs[i].kbps < costs[i - 1].kbps);
+    }
+    CHECK(costs.back().scaleMs + costs.back().encodeMs < costs[0].encodeMs * 0.75);
+}
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Check.h"
+#include "PVRSocketUtils.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// heap traffic of every thread, counted while allocations.counting is set
+namespace {
+    struct {
+        atomic<bool> counting{false};
+        atomic<size_t> calls{0}, bytes{0};
+    } allocations;
+}   // namespace
+
+void *operator new(size_t size) {
+    if (allocations.counting) {
+        allocations.calls++;
+        allocations.bytes += size;
+    }
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+// out of line, or GCC sees the free() of what operator new returned and warns
+[[gnu::noinline]] void operator delete(void *p) noexcept { free(p); }
+
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+    // both ends of a talker connection over loopback, the server receives
+    struct TalkerPair {
+        static uint16_t nextPort() {
+            static atomic<uint16_t> port{34600};
+            return port++;
+        }
+
+        mutex mtx;
+        condition_variable cv;
+        vector<pair<PVR_MSG, SharedBuffer>> received;
+        vector<Clk::time_point> arrivals;   // of each received message
+        unique_ptr<TCPTalker> server, client;
+
+        TalkerPair() {
+            auto port = nextPort();
+            server = make_unique<TCPTalker>(
+                port,
+                [this](PVR_MSG type, SharedBuffer data) {
+                    lock_guard<mutex> lock(mtx);
+                    received.push_back({type, data});
+                    arrivals.push_back(Clk::now());
+                    cv.notify_all();
+                },
+                [](error_code) {},
+                true);
+            client = make_unique<TCPTalker>(
+                port, [](PVR_MSG, SharedBuffer) {}, [](error_code) {}, false, "127.0.0.1");
+        }
+
+        ~TalkerPair() {
+            client.reset();
+            server.reset();
+        }
+
+        bool waitFor(size_t count, milliseconds timeout = 5s) {
+            unique_lock<mutex> lock(mtx);
+            return cv.wait_for(lock, timeout, [&] { return received.size() >= count; });
+        }
+    };
+
+    SharedBuffer pattern(size_t size, uint8_t seed) {
+        vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; i++)
+            data[i] = uint8_t(i * 7 + seed);
+        return data;
+    }
+
+    bool sameBytes(const SharedBuffer &a, const SharedBuffer &b) {
+        return a.size() == b.size() && equal(a.begin(), a.end(), b.begin());
+    }
+}   // namespace
+
+TEST(Talker, SmallMessageArrivesAsSent) {
+    TalkerPair talkers;
+    auto data = pattern(100, 1);
+    REQUIRE(talkers.client->send(PVR_MSG::DISCONNECT, data));
+    REQUIRE(talkers.waitFor(1));
+    CHECK_EQ(talkers.received[0].first, PVR_MSG::DISCONNECT);
+    CHECK(sameBytes(talkers.received[0].second, data));
+}
+
+TEST(Talker, MessagesOverTheLengthFieldArriveWhole) {
+    TalkerPair talkers;
+    // one chunk plus a byte, many chunks, and more than the 16 bit length field
+    vector<SharedBuffer> sent = {
+        pattern(TALKER_CHUNK_SIZE + 1, 2), pattern(300 * 1000, 3), pattern(4 << 20, 4)};
+    for (auto &data : sent)
+        REQUIRE(talkers.client->send(PVR_MSG::HEADER_NALS, data));
+    REQUIRE(talkers.waitFor(sent.size()));
+    for (size_t i = 0; i < sent.size(); i++) {
+        CHECK_EQ(talkers.received[i].first, PVR_MSG::HEADER_NALS);
+        CHECK(sameBytes(talkers.received[i].second, sent[i]));
+    }
+}
+
+TEST(Talker, SmallMessagesOvertakeAChunkedOne) {
+    TalkerPair talkers;
+    auto big = pattern(32 << 20, 5);
+    thread bigSender([&] { talkers.client->send(PVR_MSG::HEADER_NALS, big); });
+    this_thread::sleep_for(2ms);   // the big message is being written
+    for (uint8_t i = 0; i < 20; i++)
+        talkers.client->send(PVR_MSG::DISCONNECT, vector<uint8_t>{i});
+    bigSender.join();
+    REQUIRE(talkers.waitFor(21));
+
+    // the small ones went between chunks, in their own order, and the big one arrived whole
+    size_t bigAt = 0;
+    uint8_t next = 0;
+    for (size_t i = 0; i < talkers.received.size(); i++) {
+        auto &msg = talkers.received[i];
+        if (msg.first == PVR_MSG::HEADER_NALS) {
+            bigAt = i;
+            CHECK(sameBytes(msg.second, big));
+        } else {
+            REQUIRE(msg.second.size() == 1u);
+            CHECK_EQ(msg.second[0], next++);
+        }
+    }
+    CHECK(bigAt > 0);
+}
+
+// The payload is shared from the sender's buffer down to the socket, and the receiver assembles
+// it in one buffer of the announced size: a session costs about the payload once, plus a few
+// small allocations per chunk on the wire (header, dispatch, delivery).
+TEST(Talker, SessionAllocatesThePayloadOnce) {
+    TalkerPair talkers;
+    REQUIRE(talkers.client->send(PVR_MSG::DISCONNECT));   // connected, buffers warmed up
+    REQUIRE(talkers.waitFor(1));
+    talkers.received.reserve(100);
+    talkers.arrivals.reserve(100);
+    vector<SharedBuffer> frames = {pattern(4 << 20, 8), pattern(4 << 20, 9), pattern(4 << 20, 10)};
+    auto small = pattern(200, 11);
+
+    allocations.calls = allocations.bytes = 0;
+    allocations.counting = true;
+    for (auto &frame : frames)
+        talkers.client->send(PVR_MSG::HEADER_NALS, frame);
+    for (int i = 0; i < 50; i++)
+        talkers.client->send(PVR_MSG::DISCONNECT, small);
+    bool arrived = talkers.waitFor(1 + frames.size() + 50);
+    allocations.counting = false;
+    REQUIRE(arrived);
+
+    size_t payload = 3 * (4 << 20) + 50 * 200;
+    size_t chunks = 3 * (4 << 20) / TALKER_CHUNK_SIZE + 50;
+    printf("%zu allocations for %zu chunks, %.1f MB for %.1f MB of payload\n",
+           allocations.calls.load(),
+           chunks,
+           allocations.bytes / 1e6,
+           payload / 1e6);
+    CHECK(allocations.bytes >= payload);   // the receiver's copies
+    CHECK(allocations.bytes < payload * 1.1);
+    CHECK(allocations.calls < chunks * 8);
+    for (size_t i = 0; i < frames.size(); i++)
+        CHECK(sameBytes(talkers.received[1 + i].second, frames[i]));
+}
+
+TEST(Talker, OversizedMessageIsRefused) {
+    TalkerPair talkers;
+    CHECK(!talkers.client->send(PVR_MSG::HEADER_NALS, vector<uint8_t>(TALKER_MAX_MSG_SIZE + 1)));
+    // the connection is still usable
+    REQUIRE(talkers.client->send(PVR_MSG::DISCONNECT));
+    REQUIRE(talkers.waitFor(1));
+    CHECK_EQ(talkers.received[0].first, PVR_MSG::DISCONNECT);
+}
+
+// multiplexed mode: poses share the connection with video and must not queue behind keyframes
+TEST(Talker, PoseLatencyStaysFlatDuringKeyframes) {
+    TalkerPair talkers;
+    const int posesPerPhase = 300;
+    auto sendPoses = [&] {
+        for (int i = 0; i < posesPerPhase; i++) {
+            auto sent = Clk::now().time_since_epoch().count();
+            talkers.client->send<PVR_MSG::POSE_DATA>(
+                SharedBuffer::copyOf(reinterpret_cast<uint8_t *>(&sent), sizeof(sent)));
+            this_thread::sleep_for(1ms);
+        }
+    };
+    sendPoses();
+
+    // keyframes back to back for as long as the second half of the poses is sent
+    SharedBuffer keyframe = pattern(8 << 20, 6);
+    atomic<bool> posesDone{false};
+    int keyframes = 0;
+    thread video([&] {
+        while (!posesDone) {
+            talkers.client->send<PVR_MSG::VIDEO_FRAME>(keyframe);
+            keyframes++;
+        }
+    });
+    this_thread::sleep_for(5ms);
+    sendPoses();
+    posesDone = true;
+    video.join();
+    REQUIRE(talkers.waitFor(2 * posesPerPhase + keyframes, 30s));
+
+    vector<double> idleMs, loadedMs;
+    Clk::time_point lastVideo, lastPose;
+    int videoFrames = 0;
+    {
+        lock_guard<mutex> lock(talkers.mtx);
+        for (size_t i = 0; i < talkers.received.size(); i++) {
+            auto &msg = talkers.received[i];
+            if (msg.first == PVR_MSG::VIDEO_FRAME) {
+                CHECK(sameBytes(msg.second, keyframe));
+                lastVideo = talkers.arrivals[i];
+                videoFrames++;
+                continue;
+            }
+            REQUIRE(msg.first == PVR_MSG::POSE_DATA && msg.second.size() == 8u);
+            Clk::rep sent;
+            memcpy(&sent, msg.second.data(), sizeof(sent));
+            auto latency = talkers.arrivals[i] - Clk::time_point(Clk::duration(sent));
+            lastPose = talkers.arrivals[i];
+            (idleMs.size() < posesPerPhase ? idleMs : loadedMs)
+                .push_back(duration<double, milli>(latency).count());
+        }
+    }
+    CHECK_EQ(videoFrames, keyframes);
+    CHECK(lastVideo > lastPose);   // the poses really were sent under load
+    REQUIRE(loadedMs.size() == posesPerPhase);
+
+    auto p99 = [](vector<double> ms) {
+        sort(ms.begin(), ms.end());
+        return ms[ms.size() * 99 / 100];
+    };
+    // a pose waits for at most the video chunk being written, not for the keyframe
+    CHECK(p99(loadedMs) < (max)(10 * p99(idleMs), 20.0));
+}
+
+TEST(Talker, HeartbeatMeasuresTheRoundTrip) {
+    TalkerPair talkers;
+    atomic<int> pongs{0};
+    atomic<bool> dead{false};
+    talkers.client->startHeartbeat(
+        20ms, [&](double, double) { pongs++; }, [&] { dead = true; });
+    this_thread::sleep_for(500ms);
+    CHECK(pongs >= 10);
+    CHECK(!dead);
+    CHECK(talkers.client->rttMs() > 0 && talkers.client->rttMs() < 50);
+}
+
+// A peer that answers pings until told to stop reading, then leaves the connection open. The
+// talker's sends then block once the socket buffers are full.
+namespace {
+    struct StallingPeer {
+        int listener = -1, conn = -1;
+        atomic<bool> stalled{false}, stop{false};
+        thread thr;
+
+        explicit StallingPeer(uint16_t port) {
+            listener = socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listener, (sockaddr *) &addr, sizeof(addr));
+            listen(listener, 1);
+            thr = thread([this] { serve(); });
+        }
+
+        void serve() {
+            conn = accept(listener, nullptr, nullptr);
+            vector<uint8_t> stream;
+            uint8_t buf[4096];
+            while (!stalled) {
+                pollfd fd = {conn, POLLIN, 0};
+                if (poll(&fd, 1, 10) <= 0)
+                    continue;
+                auto len = recv(conn, buf, sizeof(buf), 0);
+                if (len <= 0)
+                    return;
+                stream.insert(stream.end(), buf, buf + len);
+                while (stream.size() >= 6) {
+                    size_t msgLen = stream[4] + stream[5] * 0x100;
+                    if (stream.size() < 6 + msgLen)
+                        break;
+                    if (stream[3] == PVR_MSG::PING) {
+                        stream[3] = PVR_MSG::PONG;
+                        send(conn, stream.data(), 6 + msgLen, 0);
+                    }
+                    stream.erase(stream.begin(), stream.begin() + 6 + msgLen);
+                }
+            }
+            while (!stop)
+                this_thread::sleep_for(10ms);
+        }
+
+        // tears the connection down with a reset, which fails the talker's blocked write
+        void reset() {
+            linger abort = {1, 0};
+            setsockopt(conn, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+            close(conn);
+            conn = -1;
+        }
+
+        ~StallingPeer() {
+            stop = true;
+            stalled = true;
+            thr.join();
+            if (conn >= 0)
+                close(conn);
+            close(listener);
+        }
+    };
+}   // namespace
+
+TEST(Talker, HeartbeatNoticesAPeerThatStopsReadingDuringASend) {
+    auto port = TalkerPair::nextPort();
+    StallingPeer peer(port);
+    TCPTalker talker(
+        port, [](PVR_MSG, SharedBuffer) {}, [](error_code) {}, false, "127.0.0.1");
+    atomic<bool> dead{false};
+    Clk::time_point deadAt;
+    talker.startHeartbeat(
+        50ms, [](double, double) {}, [&] {
+            deadAt = Clk::now();
+            dead = true;
+        });
+    this_thread::sleep_for(300ms);
+    REQUIRE(talker.rttMs() > 0);
+
+    peer.stalled = true;
+    auto stalledAt = Clk::now();
+    // blocks on the full socket buffers until the connection is torn down
+    thread sender([&] { talker.send(PVR_MSG::VIDEO_FRAME, pattern(64 << 20, 7)); });
+    while (!dead && Clk::now() - stalledAt < 3s)
+        this_thread::sleep_for(5ms);
+    CHECK(dead);
+    if (dead)
+        CHECK(deadAt - stalledAt < 1s);
+
+    peer.reset();
+    sender.join();
+}
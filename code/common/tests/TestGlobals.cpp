@@ -0,0 +1,26 @@
+#include "PVRGlobals.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// what the PC and the phone define in their own logging code, printed with PVR_TEST_LOG=1
+PVR_STATE pvrState = PVR_STATE_IDLE;
+
+namespace {
+    bool logging() {
+        static bool enabled = std::getenv("PVR_TEST_LOG") != nullptr;
+        return enabled;
+    }
+}   // namespace
+
+void pvrdebug(std::string msg) {
+    if (logging())
+        fprintf(stderr, "D %s\n", msg.c_str());
+}
+
+void pvrInfo(std::string msg) {
+    if (logging())
+        fprintf(stderr, "I %s\n", msg.c_str());
+}
+
+void pvrdebugClear() {}
@@ -0,0 +1,27 @@
+#include <cstring>
+#include <exception>
+
+#include "Check.h"
+
+int main(int argc, char **argv) {
+    int run = 0;
+    for (auto &test : Tests::all()) {
+        if (argc > 1 && strcmp(argv[1], test.name.c_str()) != 0)
+            continue;
+        int before = Tests::failures();
+        try {
+            test.body();
+        } catch (Tests::Abort &) {
+        } catch (std::exception &e) {
+            Tests::fail(__FILE__, __LINE__, test.name + " threw " + e.what());
+        }
+        std::cout << (Tests::failures() == before ? "[ ok ] " : "[FAIL] ") << test.name
+                  << std::endl;
+        run++;
+    }
+    if (run == 0) {
+        std::cerr << "no test named " << (argc > 1 ? argv[1] : "") << std::endl;
+        return 1;
+    }
+    return Tests::failures() ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include <set>
+#include <vector>
+
+#include "Check.h"
+#include "texture_pool.h"
+
+using namespace std;
+
+namespace {
+    const uint32_t RGB = 0x1907;   // GL_RGB
+    const TextureKey LOBBY = {960, 1080, RGB}, STREAM = {1440, 1600, RGB};
+
+    // stands in for the GL calls: numbers textures and records which ones are alive
+    class MockAllocator : public TextureAllocator {
+      public:
+        uint32_t next = 1;
+        int created = 0, destroyed = 0;
+        set<uint32_t> alive;
+
+        uint32_t create(const TextureKey &) override {
+            created++;
+            alive.insert(next);
+            return next++;
+        }
+
+        void destroy(uint32_t texture) override {
+            destroyed++;
+            CHECK_EQ(alive.erase(texture), 1u);
+        }
+    };
+
+    // the render loop around a stream: lobby textures are released when streaming starts and
+    // acquired again when it stops, both per eye
+    void streamSession(TexturePool &pool, uint32_t lobby[2], const TextureKey &stream) {
+        uint32_t streamTextures[2];
+        for (int eye = 0; eye < 2; eye++)
+            pool.release(lobby[eye]);
+        for (auto &texture : streamTextures)
+            texture = pool.acquire(stream);
+        for (auto texture : streamTextures)
+            pool.release(texture);
+        for (int eye = 0; eye < 2; eye++)
+            lobby[eye] = pool.acquire(LOBBY);
+    }
+}   // namespace
+
+TEST(TexturePool, ReconnectsAllocateNothing) {
+    MockAllocator gl;
+    TexturePool pool(&gl);
+    uint32_t lobby[2] = {pool.acquire(LOBBY), pool.acquire(LOBBY)};
+    streamSession(pool, lobby, STREAM);
+    CHECK_EQ(gl.created, 4);
+    CHECK_EQ(pool.allocationCount(), 4u);
+
+    for (int i = 0; i < 50; i++)
+        streamSession(pool, lobby, STREAM);
+    CHECK_EQ(gl.created, 4);
+    CHECK_EQ(gl.destroyed, 0);
+    CHECK(lobby[0] != lobby[1]);
+}
+
+TEST(TexturePool, OnlyMatchingTexturesAreReused) {
+    MockAllocator gl;
+    TexturePool pool(&gl);
+    auto a = pool.acquire(STREAM);
+    pool.release(a);
+    CHECK(pool.acquire({1440, 1600, 0x1908}) != a);   // GL_RGBA
+    CHECK(pool.acquire({1440, 1601, RGB}) != a);
+    CHECK_EQ(pool.acquire(STREAM), a);
+    CHECK_EQ(gl.created, 3);
+}
+
+TEST(TexturePool, NewResolutionEvictsTheOldest) {
+    MockAllocator gl;
+    TexturePool pool(&gl, 4);
+    uint32_t lobby[2] = {pool.acquire(LOBBY), pool.acquire(LOBBY)};
+    streamSession(pool, lobby, STREAM);
+    // the server changes resolution: four free textures fit the lobby's and one stream's, so
+    // the old stream textures are pushed out
+    streamSession(pool, lobby, {1920, 1080, RGB});
+    CHECK_EQ(gl.created, 6);
+    CHECK_EQ(gl.destroyed, 2);
+    CHECK_EQ(gl.alive.size(), 4u);
+    // the latest resolution is still there
+    streamSession(pool, lobby, {1920, 1080, RGB});
+    CHECK_EQ(gl.created, 6);
+    streamSession(pool, lobby, STREAM);
+    CHECK_EQ(gl.created, 8);
+    CHECK_EQ(gl.destroyed, 4);
+}
+
+TEST(TexturePool, ContextLossForgetsWithoutDeleting) {
+    MockAllocator gl;
+    TexturePool pool(&gl);
+    uint32_t lobby[2] = {pool.acquire(LOBBY), pool.acquire(LOBBY)};
+    streamSession(pool, lobby, STREAM);
+    pool.onContextLost();
+    CHECK_EQ(gl.destroyed, 0);
+    // what was in use when the context went is unknown to the pool now
+    pool.release(lobby[0]);
+    CHECK(pool.acquire(LOBBY) != lobby[0]);
+    CHECK_EQ(gl.created, 5);
+    CHECK_EQ(gl.destroyed, 0);
+}
@@ -0,0 +1,152 @@
+#include <random>
+#include <vector>
+
+#include "Check.h"
+#include "tracking_scheduler.h"
+
+using namespace std;
+
+namespace {
+    const int64_t MS = 1000000, VSYNC = 1000 * MS;
+
+    // the pose predicted for a timestamp is a yaw of that many milliseconds, the queries are kept
+    class MockTracker : public HeadTracker {
+      public:
+        vector<int64_t> queries;
+
+        HeadPose getPose(int64_t timestampNs) override {
+            queries.push_back(timestampNs);
+            HeadPose pose;
+            pose.orientation[1] = (float) timestampNs / MS;
+            return pose;
+        }
+    };
+
+    int64_t mod(int64_t a, int64_t b) { return (a % b + b) % b; }
+
+    // The input thread of alvr_main.cpp on a fake clock: sample, send, sleep until the next send
+    // time and wake up late by up to maxLateNs. Returns the send times.
+    vector<int64_t> runInputLoop(TrackingScheduler &sched,
+                                 MockTracker &tracker,
+                                 int64_t startNs,
+                                 int64_t durationNs,
+                                 int64_t predictionOffsetNs,
+                                 int64_t maxLateNs) {
+        mt19937 rng(3);
+        uniform_int_distribution<int64_t> late(0, maxLateNs);
+        vector<int64_t> sends;
+        auto nowNs = startNs;
+        auto sendNs = nowNs;
+        while (nowNs < startNs + durationNs) {
+            TrackingScheduler::sample(tracker, sendNs, predictionOffsetNs);
+            sends.push_back(sendNs);
+            nowNs += MS / 4;   // updateViewConfigs and alvr_send_tracking
+            sendNs = sched.nextSendTime(nowNs, predictionOffsetNs);
+            nowNs = sendNs + late(rng);
+        }
+        return sends;
+    }
+}   // namespace
+
+TEST(TrackingScheduler, SamplesPerFrameFollowThePredictionHorizon) {
+    TrackingScheduler sched;
+    sched.configure(60);
+    CHECK_EQ(sched.getFrameIntervalNs(), 16666666);
+    CHECK_EQ(sched.samplesPerFrame(0), 1);
+    CHECK_EQ(sched.samplesPerFrame(-5 * MS), 1);
+    CHECK_EQ(sched.samplesPerFrame(10 * MS), 2);
+    CHECK_EQ(sched.samplesPerFrame(30 * MS), 3);
+    CHECK_EQ(sched.samplesPerFrame(100 * MS), 3);   // capped
+    CHECK_EQ(sched.sendIntervalNs(30 * MS), 16666666 / 3);
+
+    sched.configure(90, 5);
+    CHECK_EQ(sched.samplesPerFrame(30 * MS), 4);
+    sched.configure(0, 0);   // no refresh rate yet: keeps the last one, one sample at least
+    CHECK_EQ(sched.getFrameIntervalNs(), 11111111);
+    CHECK_EQ(sched.samplesPerFrame(30 * MS), 1);
+}
+
+TEST(TrackingScheduler, NextSendIsAlignedAndAfterNow) {
+    TrackingScheduler sched;
+    sched.configure(60);
+    sched.onVsync(VSYNC);
+    auto pred = 30 * MS, interval = sched.sendIntervalNs(pred);
+    for (int64_t now : {VSYNC - 50 * MS, VSYNC - pred, VSYNC, VSYNC + 1234567, VSYNC + 7 * MS}) {
+        auto send = sched.nextSendTime(now, pred);
+        CHECK(send > now);
+        CHECK(send <= now + interval);
+        CHECK_EQ(mod(TrackingScheduler::targetTimestamp(send, pred) - VSYNC, interval), 0);
+    }
+    // exactly on the grid: the next slot, not this one
+    CHECK_EQ(sched.nextSendTime(VSYNC - pred, pred), VSYNC - pred + interval);
+}
+
+// the tracker is queried for the target of each send, all of which land on the vsync grid: one
+// per slot, however late the thread wakes up
+TEST(TrackingScheduler, TrackerIsQueriedOnTheVsyncGrid) {
+    TrackingScheduler sched;
+    sched.configure(60);
+    sched.onVsync(VSYNC);
+    MockTracker tracker;
+    auto pred = 30 * MS, interval = sched.sendIntervalNs(pred);
+    auto sends = runInputLoop(sched, tracker, VSYNC + 3 * MS, 1000 * MS, pred, 2 * MS);
+
+    REQUIRE(tracker.queries.size() == sends.size());
+    for (size_t i = 0; i < sends.size(); i++)
+        CHECK_EQ(tracker.queries[i], sends[i] + pred);
+    // the first send is right away, off the grid
+    for (size_t i = 1; i < tracker.queries.size(); i++)
+        CHECK_EQ(mod(tracker.queries[i] - VSYNC, interval), 0);
+    for (size_t i = 2; i < tracker.queries.size(); i++)
+        CHECK_EQ(tracker.queries[i] - tracker.queries[i - 1], interval);
+    // three a frame for a second
+    CHECK(sends.size() >= 179 && sends.size() <= 181);
+}
+
+// a new vsync phase and a new prediction offset move the grid, the targets follow on the next send
+TEST(TrackingScheduler, FollowsTheVsyncAndThePredictionOffset) {
+    TrackingScheduler sched;
+    sched.configure(60);
+    sched.onVsync(VSYNC);
+    MockTracker tracker;
+    runInputLoop(sched, tracker, VSYNC, 100 * MS, 30 * MS, MS);
+
+    auto vsync = VSYNC + 203 * MS + 1234;   // the display drifted
+    sched.onVsync(vsync);
+    tracker.queries.clear();
+    runInputLoop(sched, tracker, VSYNC + 205 * MS, 100 * MS, 30 * MS, MS);
+    auto interval = sched.sendIntervalNs(30 * MS);
+    for (size_t i = 1; i < tracker.queries.size(); i++)
+        CHECK_EQ(mod(tracker.queries[i] - vsync, interval), 0);
+
+    // the server predicts less far: one sample a frame, its target on a vsync
+    tracker.queries.clear();
+    runInputLoop(sched, tracker, VSYNC + 400 * MS, 100 * MS, 0, MS);
+    REQUIRE(tracker.queries.size() > 2);
+    for (size_t i = 1; i < tracker.queries.size(); i++)
+        CHECK_EQ(mod(tracker.queries[i] - vsync, sched.getFrameIntervalNs()), 0);
+}
+
+TEST(TrackingScheduler, SampleReturnsThePoseOfTheTarget) {
+    MockTracker tracker;
+    auto pose = TrackingScheduler::sample(tracker, VSYNC, 25 * MS);
+    REQUIRE(tracker.queries.size() == 1u);
+    CHECK_EQ(tracker.queries[0], VSYNC + 25 * MS);
+    CHECK_NEAR(pose.orientation[1], 1025, 1e-3);
+}
+
+TEST(SnapshotSlot, ReaderGetsTheLatestOnce) {
+    SnapshotSlot<int> slot;
+    int value = -1;
+    CHECK(!slot.read(value));
+    CHECK_EQ(value, 0);   // nothing published yet
+    slot.publish(3);
+    slot.publish(4);
+    CHECK(slot.read(value));
+    CHECK_EQ(value, 4);
+    CHECK(!slot.read(value));   // not again, the value stays
+    CHECK_EQ(value, 4);
+    slot.publish(5);
+    CHECK(slot.read(value));
+    CHECK_EQ(value, 5);
+}
@@ -0,0 +1,256 @@
+#include <random>
+
+#include "Check.h"
+#include "Utils/VideoTransport.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace VideoTransport;
+
+namespace {
+    vector<uint8_t> randomFrame(mt19937 &rng, size_t size) {
+        vector<uint8_t> frame(size);
+        for (auto &b : frame)
+            b = (uint8_t) rng();
+        return frame;
+    }
+
+    // feeds the datagrams of a frame to the assembler, skipping those drop() picks
+    template <typename Drop>
+    int deliver(FrameAssembler &assembler,
+                const vector<uint8_t> &wire,
+                size_t count,
+                Drop drop,
+                vector<uint8_t> &out) {
+        int completed = 0;
+        for (size_t i = 0; i < count; i++)
+            if (!drop(i) && assembler.add(&wire[i * DATAGRAM_SIZE], DATAGRAM_SIZE, out))
+                completed++;
+        return completed;
+    }
+}   // namespace
+
+TEST(VideoTransport, FramesArriveWhole) {
+    mt19937 rng(1);
+    for (size_t size : {1, 1200, 1201, 50000}) {
+        for (int groupSize : {0, 8}) {
+            FrameAssembler assembler;
+            uint32_t seq = 0;
+            vector<uint8_t> wire, out;
+            auto frame = randomFrame(rng, size);
+            size_t count = packetize(7, frame.data(), frame.size(), groupSize, seq, wire);
+            size_t dataCount = (size + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE;
+            CHECK_EQ(count, dataCount + parityCount(dataCount, groupSize));
+            CHECK_EQ(wire.size(), count * DATAGRAM_SIZE);
+            CHECK_EQ(seq, count);
+            CHECK_EQ(deliver(assembler, wire, count, [](size_t) { return false; }, out), 1);
+            CHECK(out == frame);
+        }
+    }
+}
+
+TEST(VideoTransport, ParityRepairsOneLossPerGroup) {
+    mt19937 rng(2);
+    FrameAssembler assembler;
+    uint32_t seq = 0;
+    int completed = 0;
+    for (int64_t pts = 0; pts < 100; pts++) {
+        auto frame = randomFrame(rng, 20000 + rng() % 40000);
+        vector<uint8_t> wire, out;
+        size_t count = packetize(pts, frame.data(), frame.size(), 8, seq, wire);
+        size_t dataCount = (frame.size() + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE;
+        // one data fragment of every group, a different one each frame
+        auto lost = [&](size_t i) { return i < dataCount && i % 8 == size_t(pts % 8); };
+        if (deliver(assembler, wire, count, lost, out) == 1 && out == frame)
+            completed++;
+    }
+    CHECK_EQ(completed, 100);
+    auto fb = assembler.feedback(99);
+    CHECK_EQ(fb.framesLost, 0u);
+    CHECK(fb.received < fb.expected);
+}
+
+TEST(VideoTransport, TwoLossesInAGroupLoseTheFrame) {
+    mt19937 rng(3);
+    FrameAssembler assembler;
+    uint32_t seq = 0;
+    vector<uint8_t> out;
+    for (int64_t pts = 0; pts < 3; pts++) {
+        auto frame = randomFrame(rng, 12000);
+        vector<uint8_t> wire;
+        size_t count = packetize(pts, frame.data(), frame.size(), 8, seq, wire);
+        auto lost = [&](size_t i) { return pts == 1 && (i == 0 || i == 1); };
+        CHECK_EQ(deliver(assembler, wire, count, lost, out), pts == 1 ? 0 : 1);
+    }
+    auto fb = assembler.feedback(2);
+    CHECK_EQ(fb.ackPts, 2);
+    CHECK_EQ(fb.framesLost, 1u);
+    CHECK_EQ(fb.expected, seq);
+    CHECK_EQ(fb.received, seq - 2);
+}
+
+TEST(VideoTransport, FramesWithNothingReceivedCountAsLost) {
+    mt19937 rng(4);
+    FrameAssembler assembler;
+    uint32_t seq = 0;
+    vector<uint8_t> out;
+    for (int64_t pts = 0; pts < 5; pts++) {
+        auto frame = randomFrame(rng, 3000);
+        vector<uint8_t> wire;
+        size_t count = packetize(pts, frame.data(), frame.size(), 0, seq, wire);
+        deliver(assembler, wire, count, [&](size_t) { return pts == 2; }, out);
+    }
+    CHECK_EQ(assembler.feedback(4).framesLost, 1u);
+}
+
+TEST(VideoTransport, RejectsWhatIsNotAFragment) {
+    FrameAssembler assembler;
+    vector<uint8_t> out, wire;
+    uint32_t seq = 0;
+    uint8_t byte = 1;
+    packetize(0, &byte, 1, 0, seq, wire);
+    CHECK(!assembler.add(wire.data(), DATAGRAM_SIZE - 1, out));
+
+    FragmentHeader hdr;
+    memcpy(&hdr, wire.data(), sizeof(hdr));
+    hdr.index = 5;   // beyond the fragments of the frame
+    memcpy(wire.data(), &hdr, sizeof(hdr));
+    CHECK(!assembler.add(wire.data(), DATAGRAM_SIZE, out));
+    CHECK_EQ(assembler.feedback(-1).received, 0u);
+}
+
+TEST(VideoTransport, LateFragmentsAreIgnored) {
+    FrameAssembler assembler;
+    vector<uint8_t> out, older, newer;
+    uint32_t seq = 0;
+    vector<uint8_t> frame(3000, 9);
+    size_t olderCount = packetize(1, frame.data(), frame.size(), 0, seq, older);
+    size_t newerCount = packetize(2, frame.data(), frame.size(), 0, seq, newer);
+    CHECK_EQ(deliver(assembler, newer, newerCount, [](size_t) { return false; }, out), 1);
+    CHECK_EQ(deliver(assembler, older, olderCount, [](size_t) { return false; }, out), 0);
+}
+
+namespace {
+    enum Policy { TCP_ONLY, UDP_ONLY, ADAPTIVE };
+
+    struct Outcome {
+        double stallMs = 0;   // display time lost to late or lost frames
+        vector<pair<double, Mode>> switches;
+    };
+
+    // 60 fps for a minute: clean for 10 s, then 20 s of trouble, then clean again. In trouble
+    // every 10th TCP frame is acked 130 ms late instead of 10 ms (retransmissions), and 2.5% of
+    // the UDP datagrams are lost, FEC repairing what it can. A late frame stalls the display by
+    // how much it is later than a frame interval, a lost one for a frame interval.
+    Outcome streamScenario(Policy policy) {
+        const double FRAME_MS = 16.7;
+        TransportSelector selector(policy == UDP_ONLY ? UDP : TCP, {}, FRAME_MS);
+        FrameAssembler assembler;
+        mt19937 rng(5);
+        bernoulli_distribution drop(0.025);
+        vector<uint8_t> frame(30000, 1), wire, out;
+        uint32_t seq = 0, lost = 0;
+        auto start = Clk::now();
+        Outcome res;
+        for (int f = 0; f < 60 * 60; f++) {
+            auto now = start + microseconds(int64_t(f) * 16667);
+            double t = f / 60.0;
+            bool trouble = t >= 10 && t < 30;
+            if (selector.current() == TCP) {
+                double latencyMs = trouble && f % 10 == 0 ? 130 : 10;
+                res.stallMs += (std::max)(0.0, latencyMs - 10 - FRAME_MS);
+                selector.onAck(TCP, latencyMs, now);
+            } else {
+                wire.clear();
+                size_t count = packetize(f, frame.data(), frame.size(), 8, seq, wire);
+                deliver(assembler, wire, count, [&](size_t) { return trouble && drop(rng); }, out);
+                auto fb = assembler.feedback(f);
+                res.stallMs += (fb.framesLost - lost) * FRAME_MS;
+                lost = fb.framesLost;
+                selector.onFeedback(fb, now);
+                selector.onAck(UDP, 10, now);
+            }
+            if (policy != ADAPTIVE)
+                continue;
+            auto wanted = selector.wanted(now);
+            if (wanted != selector.current()) {
+                selector.switched(wanted, now);
+                res.switches.push_back({t, wanted});
+            }
+        }
+        return res;
+    }
+}   // namespace
+
+// switches to UDP shortly into the trouble and back shortly after, which stalls far less than
+// staying on TCP
+TEST(VideoTransport, SelectorSwitchesOnceEachWay) {
+    auto tcp = streamScenario(TCP_ONLY), udp = streamScenario(UDP_ONLY),
+         adaptive = streamScenario(ADAPTIVE);
+    printf("stalled: TCP only %.0f ms, UDP only %.0f ms, adaptive %.0f ms\n",
+           tcp.stallMs,
+           udp.stallMs,
+           adaptive.stallMs);
+
+    auto &switches = adaptive.switches;
+    REQUIRE(switches.size() == 2);
+    CHECK_EQ(switches[0].second, UDP);
+    CHECK(switches[0].first >= 10 && switches[0].first < 13);
+    CHECK_EQ(switches[1].second, TCP);
+    CHECK(switches[1].first >= 30 && switches[1].first < 33);
+
+    CHECK(udp.stallMs < tcp.stallMs);
+    CHECK(adaptive.stallMs < tcp.stallMs / 2);
+}
+
+// a firewall drops the feedback datagrams: UDP gives up after a window without any and the next
+// attempt is held back twice as long each time
+TEST(VideoTransport, SelectorGivesUpOnUdpWithoutFeedback) {
+    TransportSelector selector(TCP, {}, 16.7);
+    auto start = Clk::now() + seconds(30);   // long after the selector started
+    vector<pair<double, Mode>> switches;
+    for (int f = 0; f < 60 * 60; f++) {
+        auto now = start + microseconds(int64_t(f) * 16667);
+        if (selector.current() == TCP)
+            selector.onAck(TCP, f % 10 == 0 ? 130 : 10, now);   // stalls all along
+        auto wanted = selector.wanted(now);
+        if (wanted != selector.current()) {
+            selector.switched(wanted, now);
+            switches.push_back({f / 60.0, wanted});
+        }
+    }
+    REQUIRE(switches.size() >= 5);
+    for (size_t i = 0; i < switches.size(); i++)
+        CHECK_EQ(switches[i].second, i % 2 ? TCP : UDP);
+    // back to TCP one window after each attempt
+    for (size_t i = 1; i < switches.size(); i += 2)
+        CHECK_NEAR(switches[i].first - switches[i - 1].first, 2, 0.05);
+    // 10 s on TCP after the first failure, then at least twice as long each time
+    CHECK_NEAR(switches[2].first - switches[1].first, 10, 0.05);
+    CHECK(switches[4].first - switches[3].first >= 20);
+}
+
+TEST(VideoTransport, SelectorHoldsLongerAfterFlapping) {
+    // seconds until the selector wants UDP under constant stalls
+    auto untilUdp = [](TransportSelector &selector, Clk::time_point from) {
+        for (int f = 0; f < 60 * 30; f++) {
+            auto now = from + microseconds(int64_t(f) * 16667);
+            selector.onAck(TCP, f % 2 ? 150 : 10, now);
+            if (selector.wanted(now) == UDP)
+                return f / 60.0;
+        }
+        return -1.0;
+    };
+    auto start = Clk::now() + seconds(30);   // long after the selectors started
+
+    TransportSelector steady(TCP, {}, 16.7);
+    steady.switched(UDP, start);
+    steady.switched(TCP, start + seconds(20));
+    CHECK_NEAR(untilUdp(steady, start + seconds(20)), 5, 0.1);
+
+    // the switch back came right after the hold: the next one is held twice as long
+    TransportSelector flapping(TCP, {}, 16.7);
+    flapping.switched(UDP, start);
+    flapping.switched(TCP, start + seconds(6));
+    CHECK_NEAR(untilUdp(flapping, start + seconds(6)), 10, 0.1);
+}
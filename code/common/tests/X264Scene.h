@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "x264.h"
+
+// Game-like frames for the encoder tests: a textured landscape panned and bobbed like a turning
+// head, an object moving across it and, optionally, a cut to another part of the landscape every
+// cutPeriod frames.
+class X264Scene {
+    static const int TW = 4096, TH = 1024;   // wraps around
+    std::vector<uint8_t> texture;
+    int width, height, cutPeriod;
+
+  public:
+    X264Scene(int width, int height, int cutPeriod = 0)
+        : texture((size_t) TW * TH), width(width), height(height), cutPeriod(cutPeriod) {
+        // smooth waves and 2x2 noise, both cost bits like a rendered scene
+        for (int y = 0; y < TH; y++)
+            for (int x = 0; x < TW; x++) {
+                uint32_t h = (uint32_t) ((x >> 1) * 73856093) ^ (uint32_t) ((y >> 1) * 19349663);
+                h ^= h >> 13;
+                h *= 0x5bd1e995;
+                h ^= h >> 15;
+                double v =
+                    110 + 50 * std::sin(x * 0.011) * std::cos(y * 0.017) + (int) (h % 70) - 35;
+                texture[(size_t) y * TW + x] = (uint8_t) (v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+    }
+
+    void render(int n, x264_picture_t &pic) const {
+        int px = (int) (width / 2 * std::sin(n * 0.01)) + 1000;
+        int py = (int) (height / 24 * std::sin(n * 0.05)) + 300;
+        if (cutPeriod > 0)
+            px += n / cutPeriod * 1500;
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                pic.img.plane[0][y * pic.img.i_stride[0] + x] =
+                    texture[(size_t) ((y + py) & (TH - 1)) * TW + ((x + px) & (TW - 1))];
+        for (int p = 1; p < 3; p++)
+            for (int y = 0; y < height / 2; y++)
+                for (int x = 0; x < width / 2; x++)
+                    pic.img.plane[p][y * pic.img.i_stride[p] + x] =
+                        (uint8_t) (128 + 20 * std::sin((x + px / 2) * 0.02 * p));
+        int size = height / 7, ox = (n * 4) % (width - size), oy = height / 2 - size / 2;
+        for (int y = oy; y < oy + size; y++)
+            memset(&pic.img.plane[0][y * pic.img.i_stride[0] + ox], 230, size);
+    }
+};
@@ -11,6 +11,7 @@
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
 #include <android/log.h>
+#include <deque>
 #include <queue>
 #include <sys/stat.h>
 
@@ -33,7 +34,7 @@ namespace {
     uint16_t vPort = 0;
 
     int maxWidth, maxHeight;
-    vector<uint8_t> vHeader;
+    SharedBuffer vHeader;
 
     array<float, 16> GetMat3(float m[4][4]) {
         array<float, 16> arr;
@@ -311,9 +312,7 @@ SUB(startAnnouncer)(JNIEnv *env, jclass, jstring jIP, jint port) {
             ip,
             port,
             [] { callJavaMethod("segueToGame"); },
-            [](uint8_t *headerBuf, size_t len) {
-                vHeader = vector<uint8_t>(headerBuf, headerBuf + len);
-            },
+            [](SharedBuffer header) { vHeader = header; },
             [] { callJavaMethod("unwindToMain"); });
         env->ReleaseStringUTFChars(jIP, ip);
     } catch (exception e) {
@@ -437,7 +436,7 @@ SUB(startMediaCodec)(JNIEnv *env, jclass, jobject surface) {
         AMediaFormat_setInt32(fmt, AMEDIAFORMAT_KEY_MAX_HEIGHT, maxHeight);
         // AMediaFormat_setInt32(fmt, AMEDIAFORMAT_KEY_FRAME_RATE, 62);
         // AMediaFormat_setInt32(fmt, AMEDIAFORMAT_KEY_MAX_INPUT_SIZE, 1000000);
-        AMediaFormat_setBuffer(fmt, "csd-0", &vHeader[0], vHeader.size());
+        AMediaFormat_setBuffer(fmt, "csd-0", vHeader.data(), vHeader.size());
 
         codec = AMediaCodec_createDecoderByType("video/avc");
         auto m = AMediaCodec_configure(codec, fmt, window, nullptr, 0);
@@ -449,6 +448,8 @@ SUB(startMediaCodec)(JNIEnv *env, jclass, jobject surface) {
 
         mediaThr = new std::thread([] {
             try {
+                // frames in the decoder and when they went in, it keeps their order
+                std::deque<std::pair<int64_t, Clk::time_point>> inDecoder;
                 while (pvrState != PVR_STATE_SHUTDOWN) {
                     if (PVRIsVidBufNeeded())   // emptyVBufs.size() < 3
                     {
@@ -472,6 +473,7 @@ SUB(startMediaCodec)(JNIEnv *env, jclass, jobject surface) {
                                                      fBuf.pktSz,
                                                      fBuf.pts,
                                                      0);   // AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM
+                        inDecoder.push_back({(int64_t) fBuf.pts, Clk::now()});
                         PVR_DB("[MediaCodec th] Getting filledVBuf Buf[ " + to_string(fBuf.pktSz) +
                                "] @ idx:" + to_string(fBuf.idx) + ", pts:" + to_string(fBuf.pts) +
                                ". into MCqInputBuf");
@@ -507,6 +509,16 @@ SUB(startMediaCodec)(JNIEnv *env, jclass, jobject surface) {
                             AMediaCodec_releaseOutputBuffer(codec, (size_t) outIdx, render);
                         if (render)
                             vOutPts = info.presentationTimeUs;
+                        while (!inDecoder.empty() &&
+                               inDecoder.front().first < info.presentationTimeUs)
+                            inDecoder.pop_front();   // dropped by the decoder
+                        if (!inDecoder.empty() &&
+                            inDecoder.front().first == info.presentationTimeUs) {
+                            PVRFrameDecoded(duration_cast<microseconds>(
+                                                Clk::now() - inDecoder.front().second)
+                                                .count());
+                            inDecoder.pop_front();
+                        }
 
                         fpsStreamDecoder = (1000000000.0 / (Clk::now() - oldtime).count());
                         oldtime = Clk::now();
@@ -1,7 +1,13 @@
 #include "alvr_client_core.h"
 #include "cardboard.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+// clang-format off
 #include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+// clang-format on
 #include <algorithm>
+#include <android/hardware_buffer.h>
 #include <android/log.h>
 #include <deque>
 #include <jni.h>
@@ -10,7 +16,12 @@
 #include <unistd.h>
 #include <vector>
 
+#include "distortion_mesh.h"
+#include "foveation_config.h"
+#include "hardware_buffer_importer.h"
 #include "nlohmann/json.hpp"
+#include "texture_pool.h"
+#include "tracking_scheduler.h"
 #include "utils.h"
 
 using namespace nlohmann;
@@ -22,13 +33,114 @@ const uint64_t VSYNC_QUEUE_INTERVAL_NS = 50e6;
 const float FLOOR_HEIGHT = 1.5;
 const int MAXIMUM_TRACKING_FRAMES = 360;
 
+class GlTextureAllocator : public TextureAllocator {
+  public:
+    uint32_t create(const TextureKey &key) override {
+        GLuint texture = 0;
+        GL(glGenTextures(1, &texture));
+        GL(glBindTexture(GL_TEXTURE_2D, texture));
+        GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL(glTexImage2D(GL_TEXTURE_2D,
+                        0,
+                        key.format,
+                        key.width,
+                        key.height,
+                        0,
+                        key.format,
+                        GL_UNSIGNED_BYTE,
+                        nullptr));
+        return texture;
+    }
+
+    void destroy(uint32_t texture) override {
+        GLuint glTexture = texture;
+        GL(glDeleteTextures(1, &glTexture));
+    }
+};
+
+class EglImageBackend : public ExternalImageBackend {
+    PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC getNativeClientBuffer = nullptr;
+    PFNEGLCREATEIMAGEKHRPROC createImageKHR = nullptr;
+    PFNEGLDESTROYIMAGEKHRPROC destroyImageKHR = nullptr;
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC imageTargetTexture2DOES = nullptr;
+
+  public:
+    bool load() override {
+        if (!getNativeClientBuffer) {
+            getNativeClientBuffer = (PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC) eglGetProcAddress(
+                "eglGetNativeClientBufferANDROID");
+            createImageKHR = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+            destroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+            imageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress(
+                "glEGLImageTargetTexture2DOES");
+        }
+        return getNativeClientBuffer && createImageKHR && destroyImageKHR &&
+               imageTargetTexture2DOES;
+    }
+
+    uint32_t createExternalTexture() override {
+        GLuint texture = 0;
+        GL(glGenTextures(1, &texture));
+        GL(glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture));
+        GL(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        return texture;
+    }
+
+    void *createImage(void *hardwareBuffer) override {
+        EGLClientBuffer clientBuffer =
+            getNativeClientBuffer(reinterpret_cast<AHardwareBuffer *>(hardwareBuffer));
+        if (!clientBuffer)
+            return nullptr;
+        const EGLint attrs[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+        EGLImageKHR image = createImageKHR(eglGetCurrentDisplay(),
+                                           EGL_NO_CONTEXT,
+                                           EGL_NATIVE_BUFFER_ANDROID,
+                                           clientBuffer,
+                                           attrs);
+        return image == EGL_NO_IMAGE_KHR ? nullptr : image;
+    }
+
+    void destroyImage(void *image) override { destroyImageKHR(eglGetCurrentDisplay(), image); }
+
+    void bindImage(uint32_t externalTexture, void *image) override {
+        GL(glBindTexture(GL_TEXTURE_EXTERNAL_OES, externalTexture));
+        GL(imageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, (GLeglImageOES) image));
+    }
+};
+
+class CardboardTracker : public HeadTracker {
+  public:
+    CardboardHeadTracker *handle = nullptr;
+
+    HeadPose getPose(int64_t timestampNs) override {
+        HeadPose pose;
+        CardboardHeadTracker_getPose(
+            handle, timestampNs, kLandscapeLeft, pose.position, pose.orientation);
+        return pose;
+    }
+};
+
+// Per-eye parameters owned by the render thread and read by the input thread.
+struct ViewConfig {
+    AlvrFov fov[2] = {};
+    float eyeOffsets[2] = {0.0, 0.0};
+};
+
 struct NativeContext {
     JavaVM *javaVm = nullptr;
     jobject javaContext = nullptr;
 
-    CardboardHeadTracker *headTracker = nullptr;
+    CardboardTracker headTracker;
     CardboardLensDistortion *lensDistortion = nullptr;
     CardboardDistortionRenderer *distortionRenderer = nullptr;
+    // samples the decoder output directly, only created when zeroCopyImport is set
+    CardboardDistortionRenderer *externalDistortionRenderer = nullptr;
 
     int screenWidth = 0;
     int screenHeight = 0;
@@ -44,20 +156,60 @@ struct NativeContext {
     GLuint lobbyTextures[2] = {0, 0};
     GLuint streamTextures[2] = {0, 0};
 
+    GlTextureAllocator textureAllocator;
+    TexturePool texturePool{&textureAllocator};
+    FoveationConfigCache foveationConfig;
+
+    // Zero-copy: skip alvr_render_stream_opengl and let the distortion pass sample the decoded
+    // buffer. Not possible with foveated encoding, which needs ALVR's decompression pass.
+    bool zeroCopyImport = false;
+    bool zeroCopyStream = false;
+    EglImageBackend eglImageBackend;
+    HardwareBufferImporter bufferImporter{&eglImageBackend};
+
     float eyeOffsets[2] = {0.0, 0.0};
     AlvrFov fovArr[2] = {};
-    AlvrViewParams viewParams[2] = {};
-    AlvrDeviceMotion deviceMotion = {};
 
-    NativeContext() {
-        memset(&fovArr, 0, (sizeof(fovArr)) / sizeof(int));
-        memset(&viewParams, 0, (sizeof(viewParams)) / sizeof(int));
-        memset(&deviceMotion, 0, (sizeof(deviceMotion)) / sizeof(int));
-    }
+    // Distortion meshes for the current viewer profile, also persisted in meshCacheDir so that
+    // resumes and restarts don't have to re-tessellate the lens model.
+    std::string meshCacheDir;
+    int meshDensity = 40;
+    DistortionMeshKey meshKey;
+    DistortionMeshData meshes[2];
+
+    TrackingScheduler trackingScheduler;
+    SnapshotSlot<ViewConfig> viewConfig;   // render thread -> input thread
+
+    NativeContext() { memset(&fovArr, 0, (sizeof(fovArr)) / sizeof(int)); }
 };
 
 NativeContext CTX = {};
 
+void updateDistortionMeshes(const DistortionMeshKey &key) {
+    if (key == CTX.meshKey)
+        return;
+
+    auto path = CTX.meshCacheDir + "/" + distortionMeshCacheName(key);
+    if (!CTX.meshCacheDir.empty() && loadDistortionMeshes(path, key, CTX.meshes)) {
+        info("Loaded distortion meshes from %s", path.c_str());
+    } else {
+        for (int eye = 0; eye < 2; eye++) {
+            CTX.meshes[eye] =
+                buildDistortionMesh(key.density, [eye](float u, float v, float *x, float *y) {
+                    CardboardUv undistorted = {u, v};
+                    auto distorted = CardboardLensDistortion_distortedUvForUndistortedUv(
+                        CTX.lensDistortion, &undistorted, (CardboardEye) eye);
+                    *x = distorted.u;
+                    *y = distorted.v;
+                });
+        }
+        info("Built distortion meshes with density %d", key.density);
+        if (!CTX.meshCacheDir.empty() && !saveDistortionMeshes(path, key, CTX.meshes))
+            error("Failed to save distortion meshes to %s", path.c_str());
+    }
+    CTX.meshKey = key;
+}
+
 int64_t GetBootTimeNano() {
     struct timespec res = {};
     clock_gettime(CLOCK_BOOTTIME, &res);
@@ -105,54 +257,63 @@ AlvrFov getFov(CardboardEye eye) {
     return fov;
 }
 
-AlvrPose getPose(uint64_t timestampNs) {
+AlvrPose toAlvrPose(const HeadPose &head) {
     AlvrPose pose = {};
 
-    float pos[3];
-    float q[4];
-    CardboardHeadTracker_getPose(CTX.headTracker, (int64_t) timestampNs, kLandscapeLeft, pos, q);
-
+    auto &q = head.orientation;
     auto inverseOrientation = AlvrQuat{q[0], q[1], q[2], q[3]};
     pose.orientation = inverseQuat(inverseOrientation);
 
     return pose;
 }
 
-void updateViewConfigs(uint64_t targetTimestampNs = 0) {
-    if (!targetTimestampNs)
-        targetTimestampNs = GetBootTimeNano() + alvr_get_head_prediction_offset_ns();
-
-    AlvrPose headPose = getPose(targetTimestampNs);
+void publishViewConfig() {
+    ViewConfig config;
+    for (int eye = 0; eye < 2; eye++) {
+        config.fov[eye] = CTX.fovArr[eye];
+        config.eyeOffsets[eye] = CTX.eyeOffsets[eye];
+    }
+    CTX.viewConfig.publish(config);
+}
 
-    CTX.deviceMotion.device_id = HEAD_ID;
-    CTX.deviceMotion.pose = headPose;
+void updateViewConfigs(const ViewConfig &config,
+                       const HeadPose &head,
+                       AlvrViewParams viewParams[2],
+                       AlvrDeviceMotion &deviceMotion) {
+    AlvrPose headPose = toAlvrPose(head);
 
-    float headToEye[3] = {CTX.eyeOffsets[kLeft], 0.0, 0.0};
+    deviceMotion.device_id = HEAD_ID;
+    deviceMotion.pose = headPose;
 
-    CTX.viewParams[kLeft].pose = headPose;
-    offsetPosWithQuat(headPose.orientation, headToEye, CTX.viewParams[kLeft].pose.position);
-    CTX.viewParams[kLeft].fov = CTX.fovArr[kLeft];
+    for (int eye = 0; eye < 2; eye++) {
+        float headToEye[3] = {config.eyeOffsets[eye], 0.0, 0.0};
 
-    headToEye[0] = CTX.eyeOffsets[kRight];
-    CTX.viewParams[kRight].pose = headPose;
-    offsetPosWithQuat(headPose.orientation, headToEye, CTX.viewParams[kRight].pose.position);
-    CTX.viewParams[kRight].fov = CTX.fovArr[kRight];
+        viewParams[eye].pose = headPose;
+        offsetPosWithQuat(headPose.orientation, headToEye, viewParams[eye].pose.position);
+        viewParams[eye].fov = config.fov[eye];
+    }
 }
 
 void inputThread() {
-    auto deadline = std::chrono::steady_clock::now();
+    ViewConfig config;
+    AlvrViewParams viewParams[2] = {};
+    AlvrDeviceMotion deviceMotion = {};
 
     info("inputThread: thread staring...");
+    int64_t sendNs = GetBootTimeNano();
     while (CTX.streaming) {
+        CTX.viewConfig.read(config);
 
-        auto targetTimestampNs = GetBootTimeNano() + alvr_get_head_prediction_offset_ns();
-        updateViewConfigs(targetTimestampNs);
+        auto predictionOffsetNs = (int64_t) alvr_get_head_prediction_offset_ns();
+        auto targetTimestampNs = TrackingScheduler::targetTimestamp(sendNs, predictionOffsetNs);
+        auto head = TrackingScheduler::sample(CTX.headTracker, sendNs, predictionOffsetNs);
+        updateViewConfigs(config, head, viewParams, deviceMotion);
 
-        alvr_send_tracking(
-            targetTimestampNs, CTX.viewParams, &CTX.deviceMotion, 1, nullptr, nullptr);
+        alvr_send_tracking(targetTimestampNs, viewParams, &deviceMotion, 1, nullptr, nullptr);
 
-        deadline += std::chrono::nanoseconds((uint64_t) (1e9 / 60.f / 3));
-        std::this_thread::sleep_until(deadline);
+        // scheduled send time, not wake-up time, so target timestamps stay on the vsync grid
+        sendNs = CTX.trackingScheduler.nextSendTime(GetBootTimeNano(), predictionOffsetNs);
+        std::this_thread::sleep_for(std::chrono::nanoseconds(sendNs - GetBootTimeNano()));
     }
 }
 
@@ -161,9 +322,15 @@ extern "C" JNIEXPORT jint JNI_OnLoad(JavaVM *vm, void *) {
     return JNI_VERSION_1_6;
 }
 
-extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_initializeNative(
-    JNIEnv *env, jobject obj, jint screenWidth, jint screenHeight, jfloat refreshRate) {
+extern "C" JNIEXPORT void JNICALL
+Java_viritualisres_phonevr_ALVRActivity_initializeNative(JNIEnv *env,
+                                                         jobject obj,
+                                                         jint screenWidth,
+                                                         jint screenHeight,
+                                                         jfloat refreshRate,
+                                                         jboolean zeroCopyImport) {
     CTX.javaContext = env->NewGlobalRef(obj);
+    CTX.zeroCopyImport = zeroCopyImport;
 
     uint32_t viewWidth = std::max(screenWidth, screenHeight) / 2;
     uint32_t viewHeight = std::min(screenWidth, screenHeight);
@@ -186,8 +353,21 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_initia
 
     alvr_initialize(caps);
 
+    CTX.trackingScheduler.configure(refreshRate);
+
     Cardboard_initializeAndroid(CTX.javaVm, CTX.javaContext);
-    CTX.headTracker = CardboardHeadTracker_create();
+    CTX.headTracker.handle = CardboardHeadTracker_create();
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_viritualisres_phonevr_ALVRActivity_setDistortionMeshCacheNative(JNIEnv *env,
+                                                                     jobject,
+                                                                     jstring cacheDir,
+                                                                     jint density) {
+    auto dir = env->GetStringUTFChars(cacheDir, nullptr);
+    CTX.meshCacheDir = dir;
+    env->ReleaseStringUTFChars(cacheDir, dir);
+    CTX.meshDensity = std::max((int) density, 2);
 }
 
 extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_destroyNative(JNIEnv *,
@@ -195,17 +375,21 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_destro
     alvr_destroy_opengl();
     alvr_destroy();
 
-    CardboardHeadTracker_destroy(CTX.headTracker);
-    CTX.headTracker = nullptr;
+    CardboardHeadTracker_destroy(CTX.headTracker.handle);
+    CTX.headTracker.handle = nullptr;
     CardboardLensDistortion_destroy(CTX.lensDistortion);
     CTX.lensDistortion = nullptr;
     CardboardDistortionRenderer_destroy(CTX.distortionRenderer);
     CTX.distortionRenderer = nullptr;
+    if (CTX.externalDistortionRenderer) {
+        CardboardDistortionRenderer_destroy(CTX.externalDistortionRenderer);
+        CTX.externalDistortionRenderer = nullptr;
+    }
 }
 
 extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_resumeNative(JNIEnv *,
                                                                                        jobject) {
-    CardboardHeadTracker_resume(CTX.headTracker);
+    CardboardHeadTracker_resume(CTX.headTracker.handle);
 
     CTX.renderingParamsChanged = true;
 
@@ -230,7 +414,7 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_pauseN
         CTX.running = false;
     }
 
-    CardboardHeadTracker_pause(CTX.headTracker);
+    CardboardHeadTracker_pause(CTX.headTracker.handle);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -256,6 +440,8 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_sendBa
 extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_renderNative(JNIEnv *,
                                                                                        jobject) {
     try {
+        CTX.trackingScheduler.onVsync(GetBootTimeNano());
+
         if (CTX.renderingParamsChanged) {
             info("renderingParamsChanged, processing new params");
             uint8_t *buffer;
@@ -274,23 +460,50 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
             info("renderingParamsChanged, destroyed distortion");
             CTX.lensDistortion =
                 CardboardLensDistortion_create(buffer, size, CTX.screenWidth, CTX.screenHeight);
+            DistortionMeshKey meshKey = {hashViewerProfile(buffer, size),
+                                         CTX.screenWidth,
+                                         CTX.screenHeight,
+                                         CTX.meshDensity};
 
             CardboardQrCode_destroy(buffer);
             *buffer = 0;
 
-            if (CTX.distortionRenderer) {
+            // the renderers only hold GL objects, keep them unless the context changed
+            if (CTX.distortionRenderer && CTX.glContextRecreated) {
                 CardboardDistortionRenderer_destroy(CTX.distortionRenderer);
                 CTX.distortionRenderer = nullptr;
             }
-            const CardboardOpenGlEsDistortionRendererConfig config{kGlTexture2D};
-            CTX.distortionRenderer = CardboardOpenGlEs2DistortionRenderer_create(&config);
+            if (!CTX.distortionRenderer) {
+                const CardboardOpenGlEsDistortionRendererConfig config{kGlTexture2D};
+                CTX.distortionRenderer = CardboardOpenGlEs2DistortionRenderer_create(&config);
+            }
+
+            if (CTX.externalDistortionRenderer && CTX.glContextRecreated) {
+                CardboardDistortionRenderer_destroy(CTX.externalDistortionRenderer);
+                CTX.externalDistortionRenderer = nullptr;
+            }
+            if (CTX.zeroCopyImport && !CTX.externalDistortionRenderer) {
+                const CardboardOpenGlEsDistortionRendererConfig externalConfig{
+                    kGlTextureExternalOes};
+                CTX.externalDistortionRenderer =
+                    CardboardOpenGlEs2DistortionRenderer_create(&externalConfig);
+            }
+
+            updateDistortionMeshes(meshKey);
 
             for (int eye = 0; eye < 2; eye++) {
+                auto &meshData = CTX.meshes[eye];
                 CardboardMesh mesh;
-                CardboardLensDistortion_getDistortionMesh(
-                    CTX.lensDistortion, (CardboardEye) eye, &mesh);
+                mesh.indices = meshData.indices.data();
+                mesh.n_indices = (int) meshData.indices.size();
+                mesh.vertices = meshData.vertices.data();
+                mesh.uvs = meshData.uvs.data();
+                mesh.n_vertices = (int) meshData.vertices.size() / 2;
                 CardboardDistortionRenderer_setMesh(
                     CTX.distortionRenderer, &mesh, (CardboardEye) eye);
+                if (CTX.externalDistortionRenderer)
+                    CardboardDistortionRenderer_setMesh(
+                        CTX.externalDistortionRenderer, &mesh, (CardboardEye) eye);
 
                 float matrix[16] = {};
                 CardboardLensDistortion_getEyeFromHeadMatrix(
@@ -300,17 +513,22 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
 
             CTX.fovArr[kLeft] = getFov(kLeft);
             CTX.fovArr[kRight] = getFov(kRight);
+            publishViewConfig();
 
             info("renderingParamsChanged, updating new view configs (FOV) to alvr");
             // alvr_send_views_config(fovArr, CTX.eyeOffsets[0] - CTX.eyeOffsets[1]);
         }
 
         // Note: if GL context is recreated, old resources are already freed.
-        if (CTX.renderingParamsChanged && !CTX.glContextRecreated) {
-            info("Pausing ALVR since glContext is not recreated, deleting textures");
+        if (CTX.glContextRecreated) {
+            CTX.texturePool.onContextLost();
+            CTX.bufferImporter.onContextLost();
+        } else if (CTX.renderingParamsChanged) {
+            info("Pausing ALVR since glContext is not recreated, releasing textures");
             alvr_pause_opengl();
 
-            GL(glDeleteTextures(2, CTX.lobbyTextures));
+            for (auto &lobbyTexture : CTX.lobbyTextures)
+                CTX.texturePool.release(lobbyTexture);
         }
 
         if (CTX.renderingParamsChanged || CTX.glContextRecreated) {
@@ -318,24 +536,10 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
                  "renderingParamsChanged %b",
                  CTX.renderingParamsChanged,
                  CTX.glContextRecreated);
-            GL(glGenTextures(2, CTX.lobbyTextures));
-
-            for (auto &lobbyTexture : CTX.lobbyTextures) {
-                GL(glBindTexture(GL_TEXTURE_2D, lobbyTexture));
-                GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-                GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-                GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-                GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-                GL(glTexImage2D(GL_TEXTURE_2D,
-                                0,
-                                GL_RGB,
-                                CTX.screenWidth / 2,
-                                CTX.screenHeight,
-                                0,
-                                GL_RGB,
-                                GL_UNSIGNED_BYTE,
-                                nullptr));
-            }
+
+            for (auto &lobbyTexture : CTX.lobbyTextures)
+                lobbyTexture =
+                    CTX.texturePool.acquire({CTX.screenWidth / 2, CTX.screenHeight, GL_RGB});
 
             const uint32_t *targetViews[2] = {(uint32_t *) &CTX.lobbyTextures[0],
                                               (uint32_t *) &CTX.lobbyTextures[1]};
@@ -366,32 +570,38 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
                 auto settings_buffer = std::vector<char>(settings_len);
                 alvr_get_settings_json(&settings_buffer[0]);
 
-                info("Got settings from ALVR Server - %s", &settings_buffer[0]);
-                if (settings_len > 900)   // to workthough logcat buffer limit
-                    info("Got settings from ALVR Server - %s", &settings_buffer[900]);
-                json settings_json = json::parse(&settings_buffer[0]);
-
-                GL(glGenTextures(2, CTX.streamTextures));
-
-                for (auto &streamTexture : CTX.streamTextures) {
-                    GL(glBindTexture(GL_TEXTURE_2D, streamTexture));
-                    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-                    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-                    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-                    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-                    GL(glTexImage2D(GL_TEXTURE_2D,
-                                    0,
-                                    GL_RGB,
-                                    config.view_width,
-                                    config.view_height,
-                                    0,
-                                    GL_RGB,
-                                    GL_UNSIGNED_BYTE,
-                                    nullptr));
+                bool settingsParsed = false;
+                auto foveation =
+                    CTX.foveationConfig.get(std::string(&settings_buffer[0]), &settingsParsed);
+                if (settingsParsed) {
+                    info("Got settings from ALVR Server - %s", &settings_buffer[0]);
+                    if (settings_len > 900)   // to workthough logcat buffer limit
+                        info("Got settings from ALVR Server - %s", &settings_buffer[900]);
                 }
+                if (foveation.missingKey)
+                    error("settings_json doesn't have a %s key", foveation.missingKey);
+                else if (!foveation.enabled)
+                    info("foveated_encoding is Disabled");
+                else
+                    info("settings_json.video.foveated_encoding is %s",
+                         foveation.encoding.c_str());
+
+                auto allocations = CTX.texturePool.allocationCount();
+                for (auto &streamTexture : CTX.streamTextures)
+                    streamTexture = CTX.texturePool.acquire(
+                        {(int) config.view_width, (int) config.view_height, GL_RGB});
+                info("Stream textures ready, %d new allocations",
+                     (int) (CTX.texturePool.allocationCount() - allocations));
+
+                CTX.zeroCopyStream = CTX.zeroCopyImport && !foveation.enabled &&
+                                     CTX.externalDistortionRenderer &&
+                                     CTX.bufferImporter.available();
+                info("Zero-copy decoder import %s",
+                     CTX.zeroCopyStream ? "enabled" : "disabled");
 
                 CTX.fovArr[0] = getFov((CardboardEye) 0);
                 CTX.fovArr[1] = getFov((CardboardEye) 1);
+                publishViewConfig();
 
                 info("ALVR Poll Event: ALVR_EVENT_STREAMING_STARTED, View configs updated...");
 
@@ -405,39 +615,13 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
                 render_config.swapchain_textures = textureHandles;
                 render_config.swapchain_length = 1;
 
-                render_config.enable_foveation = false;
-                if (!settings_json["video"].is_null()) {
-                    if (!settings_json["video"]["foveated_encoding"].is_null()) {
-                        info("settings_json.video.foveated_encoding is %s",
-                             settings_json["video"]["foveated_encoding"].dump().c_str());
-
-                        // Foveated encoding would be a "Enabled": {Array} or "Disabled" String
-                        if (!settings_json["video"]["foveated_encoding"].is_string()) {
-                            render_config.enable_foveation = true;
-                            render_config.foveation_center_size_x =
-                                settings_json["video"]["foveated_encoding"]["Enabled"]
-                                             ["center_size_x"];
-                            render_config.foveation_center_size_y =
-                                settings_json["video"]["foveated_encoding"]["Enabled"]
-                                             ["center_size_y"];
-                            render_config.foveation_center_shift_x =
-                                settings_json["video"]["foveated_encoding"]["Enabled"]
-                                             ["center_shift_x"];
-                            render_config.foveation_center_shift_y =
-                                settings_json["video"]["foveated_encoding"]["Enabled"]
-                                             ["center_shift_y"];
-                            render_config.foveation_edge_ratio_x =
-                                settings_json["video"]["foveated_encoding"]["Enabled"]
-                                             ["edge_ratio_x"];
-                            render_config.foveation_edge_ratio_y =
-                                settings_json["video"]["foveated_encoding"]["Enabled"]
-                                             ["edge_ratio_y"];
-                        } else
-                            info("foveated_encoding is Disabled");
-                    } else
-                        error("settings_json doesn't have a video.foveated_encoding key");
-                } else
-                    error("settings_json doesn't have a video key");
+                render_config.enable_foveation = foveation.enabled;
+                render_config.foveation_center_size_x = foveation.centerSizeX;
+                render_config.foveation_center_size_y = foveation.centerSizeY;
+                render_config.foveation_center_shift_x = foveation.centerShiftX;
+                render_config.foveation_center_shift_y = foveation.centerShiftY;
+                render_config.foveation_edge_ratio_x = foveation.edgeRatioX;
+                render_config.foveation_edge_ratio_y = foveation.edgeRatioY;
 
                 info("Settings for foveation:");
                 info("render_config.enable_foveation: %b", render_config.enable_foveation);
@@ -468,9 +652,12 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
                 CTX.streaming = false;
                 CTX.inputThread.join();
 
-                GL(glDeleteTextures(2, CTX.streamTextures));
-                info("ALVR Poll Event: ALVR_EVENT_STREAMING_STOPPED, Stream stopped deleted "
-                     "textures.");
+                for (auto &streamTexture : CTX.streamTextures)
+                    CTX.texturePool.release(streamTexture);
+                CTX.bufferImporter.clear();
+                CTX.zeroCopyStream = false;
+                info("ALVR Poll Event: ALVR_EVENT_STREAMING_STOPPED, Stream stopped released "
+                     "textures to pool.");
             }
         }
 
@@ -482,6 +669,7 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
             viewsDesc.bottom_v = 0.0;
         }
 
+        auto distortionRenderer = CTX.distortionRenderer;
         if (CTX.streaming) {
             void *streamHardwareBuffer = nullptr;
 
@@ -492,15 +680,28 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
                 return;
             }
 
-            uint32_t swapchainIndices[2] = {0, 0};
-            alvr_render_stream_opengl(streamHardwareBuffer, swapchainIndices);
+            if (CTX.zeroCopyStream && CTX.bufferImporter.import(streamHardwareBuffer)) {
+                // Both eyes side by side in the decoded frame, rows stored top-down
+                for (int eye = 0; eye < 2; eye++) {
+                    viewsDescs[eye].texture = CTX.bufferImporter.texture();
+                    viewsDescs[eye].left_u = eye * 0.5f;
+                    viewsDescs[eye].right_u = eye * 0.5f + 0.5f;
+                    viewsDescs[eye].top_v = 0.0;
+                    viewsDescs[eye].bottom_v = 1.0;
+                }
+                distortionRenderer = CTX.externalDistortionRenderer;
+            } else {
+                uint32_t swapchainIndices[2] = {0, 0};
+                alvr_render_stream_opengl(streamHardwareBuffer, swapchainIndices);
 
-            alvr_report_submit(timestampNs, 0);
+                viewsDescs[0].texture = CTX.streamTextures[0];
+                viewsDescs[1].texture = CTX.streamTextures[1];
+            }
 
-            viewsDescs[0].texture = CTX.streamTextures[0];
-            viewsDescs[1].texture = CTX.streamTextures[1];
+            alvr_report_submit(timestampNs, 0);
         } else {
-            AlvrPose pose = getPose(GetBootTimeNano() + VSYNC_QUEUE_INTERVAL_NS);
+            AlvrPose pose =
+                toAlvrPose(CTX.headTracker.getPose(GetBootTimeNano() + VSYNC_QUEUE_INTERVAL_NS));
 
             AlvrViewInput viewInputs[2] = {};
             for (int eye = 0; eye < 2; eye++) {
@@ -522,7 +723,7 @@ extern "C" JNIEXPORT void JNICALL Java_viritualisres_phonevr_ALVRActivity_render
         // todo: manually implement it?
 
         // info("nativeRendered: Rendering to Display...");
-        CardboardDistortionRenderer_renderEyeToDisplay(CTX.distortionRenderer,
+        CardboardDistortionRenderer_renderEyeToDisplay(distortionRenderer,
                                                        0,
                                                        0,
                                                        0,
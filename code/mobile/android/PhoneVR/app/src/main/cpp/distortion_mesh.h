@@ -0,0 +1,177 @@
+#ifndef PHONEVR_DISTORTION_MESH_H
+#define PHONEVR_DISTORTION_MESH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Identifies a set of distortion meshes: viewer profile (hash of the saved Cardboard device
+// params), screen size and mesh density.
+struct DistortionMeshKey {
+    uint64_t profileHash = 0;
+    int32_t screenWidth = 0;
+    int32_t screenHeight = 0;
+    int32_t density = 0;
+
+    bool operator==(const DistortionMeshKey &other) const {
+        return profileHash == other.profileHash && screenWidth == other.screenWidth &&
+               screenHeight == other.screenHeight && density == other.density;
+    }
+};
+
+// FNV-1a, only used to tell viewer profiles apart
+inline uint64_t hashViewerProfile(const uint8_t *data, int size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Same layout as CardboardMesh: density x density vertices on a regular grid in texture space,
+// positions in the eye viewport's NDC, indices forming one serpentine triangle strip.
+struct DistortionMeshData {
+    int density = 0;
+    std::vector<float> vertices;   // x, y
+    std::vector<float> uvs;        // u, v
+    std::vector<int> indices;
+};
+
+// undistortedToScreen: texture uv -> distorted screen uv in [0, 1] of the eye viewport
+inline DistortionMeshData
+buildDistortionMesh(int density,
+                    const std::function<void(float u, float v, float *screenU, float *screenV)>
+                        &undistortedToScreen) {
+    DistortionMeshData mesh;
+    mesh.density = density = std::max(density, 2);
+    mesh.vertices.resize(density * density * 2);
+    mesh.uvs.resize(density * density * 2);
+
+    for (int row = 0; row < density; row++) {
+        for (int col = 0; col < density; col++) {
+            int i = (row * density + col) * 2;
+            float u = (float) col / (density - 1);
+            float v = (float) row / (density - 1);
+            float screenU, screenV;
+            undistortedToScreen(u, v, &screenU, &screenV);
+            mesh.uvs[i] = u;
+            mesh.uvs[i + 1] = v;
+            mesh.vertices[i] = 2 * screenU - 1;
+            mesh.vertices[i + 1] = 2 * screenV - 1;
+        }
+    }
+
+    int vertex = 0;
+    for (int row = 0; row < density - 1; row++) {
+        if (row > 0)   // degenerate triangle to join strip rows
+            mesh.indices.push_back(mesh.indices.back());
+        for (int col = 0; col < density; col++) {
+            if (col > 0)
+                vertex += row % 2 == 0 ? 1 : -1;
+            mesh.indices.push_back(vertex);
+            mesh.indices.push_back(vertex + density);
+        }
+        vertex += density;
+    }
+    return mesh;
+}
+
+// One cache file per key, so switching between viewers or screen sizes doesn't evict the other's
+// meshes.
+inline std::string distortionMeshCacheName(const DistortionMeshKey &key) {
+    char name[80];
+    snprintf(name,
+             sizeof(name),
+             "distortion_mesh_%016llx_%dx%d_%d.bin",
+             (unsigned long long) key.profileHash,
+             key.screenWidth,
+             key.screenHeight,
+             key.density);
+    return name;
+}
+
+// binary cache file: magic / version / key / per eye: counts, vertices, uvs, indices
+namespace distortion_mesh_cache {
+    const char MAGIC[4] = {'P', 'V', 'R', 'D'};
+    const uint32_t VERSION = 1;
+
+    template <typename T> bool write(FILE *file, const T *data, size_t count) {
+        return fwrite(data, sizeof(T), count, file) == count;
+    }
+
+    template <typename T> bool read(FILE *file, T *data, size_t count) {
+        return fread(data, sizeof(T), count, file) == count;
+    }
+}   // namespace distortion_mesh_cache
+
+inline bool saveDistortionMeshes(const std::string &path,
+                                 const DistortionMeshKey &key,
+                                 const DistortionMeshData meshes[2]) {
+    using namespace distortion_mesh_cache;
+    auto tmpPath = path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = write(file, MAGIC, 4) && write(file, &VERSION, 1) && write(file, &key, 1);
+    for (int eye = 0; eye < 2 && ok; eye++) {
+        int32_t counts[3] = {meshes[eye].density,
+                             (int32_t) meshes[eye].vertices.size(),
+                             (int32_t) meshes[eye].indices.size()};
+        ok = write(file, counts, 3) &&
+             write(file, meshes[eye].vertices.data(), meshes[eye].vertices.size()) &&
+             write(file, meshes[eye].uvs.data(), meshes[eye].uvs.size()) &&
+             write(file, meshes[eye].indices.data(), meshes[eye].indices.size());
+    }
+    ok = fclose(file) == 0 && ok;
+
+    // rename so a reader never sees a half-written cache
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// returns false if the file is missing, corrupt or was built for a different key
+inline bool loadDistortionMeshes(const std::string &path,
+                                 const DistortionMeshKey &key,
+                                 DistortionMeshData meshes[2]) {
+    using namespace distortion_mesh_cache;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    char magic[4];
+    uint32_t version = 0;
+    DistortionMeshKey fileKey;
+    bool ok = read(file, magic, 4) && std::equal(magic, magic + 4, MAGIC) &&
+              read(file, &version, 1) && version == VERSION && read(file, &fileKey, 1) &&
+              fileKey == key;
+
+    for (int eye = 0; eye < 2 && ok; eye++) {
+        int32_t counts[3];
+        ok = read(file, counts, 3) && counts[0] >= 2 &&
+             counts[1] == counts[0] * counts[0] * 2 && counts[2] >= 0;
+        if (!ok)
+            break;
+        meshes[eye].density = counts[0];
+        meshes[eye].vertices.resize(counts[1]);
+        meshes[eye].uvs.resize(counts[1]);
+        meshes[eye].indices.resize(counts[2]);
+        ok = read(file, meshes[eye].vertices.data(), counts[1]) &&
+             read(file, meshes[eye].uvs.data(), counts[1]) &&
+             read(file, meshes[eye].indices.data(), counts[2]) &&
+             std::all_of(meshes[eye].indices.begin(), meshes[eye].indices.end(), [&](int i) {
+                 return i >= 0 && i < counts[1] / 2;
+             });
+    }
+    fclose(file);
+    return ok;
+}
+
+#endif   // PHONEVR_DISTORTION_MESH_H
@@ -0,0 +1,71 @@
+#ifndef PHONEVR_FOVEATION_CONFIG_H
+#define PHONEVR_FOVEATION_CONFIG_H
+
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+struct FoveationConfig {
+    bool enabled = false;
+    float centerSizeX = 0;
+    float centerSizeY = 0;
+    float centerShiftX = 0;
+    float centerShiftY = 0;
+    float edgeRatioX = 0;
+    float edgeRatioY = 0;
+
+    const char *missingKey = nullptr;   // "video" or "video.foveated_encoding" when absent
+    std::string encoding;               // video.foveated_encoding as found in the settings
+};
+
+// Foveated encoding is either "Disabled" (a string) or {"Enabled": {...}} in the ALVR settings.
+// Throws nlohmann::json::exception on malformed settings.
+inline FoveationConfig parseFoveationConfig(const std::string &settings) {
+    FoveationConfig config;
+    auto json = nlohmann::json::parse(settings);
+    if (json["video"].is_null()) {
+        config.missingKey = "video";
+        return config;
+    }
+    if (json["video"]["foveated_encoding"].is_null()) {
+        config.missingKey = "video.foveated_encoding";
+        return config;
+    }
+    config.encoding = json["video"]["foveated_encoding"].dump();
+    if (json["video"]["foveated_encoding"].is_string())
+        return config;
+
+    auto &enabled = json["video"]["foveated_encoding"]["Enabled"];
+    config.enabled = true;
+    config.centerSizeX = enabled["center_size_x"];
+    config.centerSizeY = enabled["center_size_y"];
+    config.centerShiftX = enabled["center_shift_x"];
+    config.centerShiftY = enabled["center_shift_y"];
+    config.edgeRatioX = enabled["edge_ratio_x"];
+    config.edgeRatioY = enabled["edge_ratio_y"];
+    return config;
+}
+
+// Settings rarely change between reconnects: only re-parse when the settings string differs.
+class FoveationConfigCache {
+    std::string lastSettings;
+    FoveationConfig config;
+    bool valid = false;
+
+  public:
+    // sets `parsed` to true when the settings had to be parsed
+    const FoveationConfig &get(const std::string &settings, bool *parsed = nullptr) {
+        bool miss = !valid || settings != lastSettings;
+        if (miss) {
+            valid = false;
+            config = parseFoveationConfig(settings);
+            lastSettings = settings;
+            valid = true;
+        }
+        if (parsed)
+            *parsed = miss;
+        return config;
+    }
+};
+
+#endif   // PHONEVR_FOVEATION_CONFIG_H
@@ -0,0 +1,120 @@
+#ifndef PHONEVR_HARDWARE_BUFFER_IMPORTER_H
+#define PHONEVR_HARDWARE_BUFFER_IMPORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// EGL and GL side of the import, implemented with EGL_ANDROID_get_native_client_buffer and
+// GL_OES_EGL_image_external in alvr_main.cpp.
+class ExternalImageBackend {
+  public:
+    virtual ~ExternalImageBackend() = default;
+    // false if the extensions are missing
+    virtual bool load() = 0;
+    virtual uint32_t createExternalTexture() = 0;
+    // returns nullptr on failure
+    virtual void *createImage(void *hardwareBuffer) = 0;
+    virtual void destroyImage(void *image) = 0;
+    virtual void bindImage(uint32_t externalTexture, void *image) = 0;
+};
+
+// Wraps decoder output buffers into EGLImages bound to a single external-OES texture.
+// The decoder cycles through a small fixed set of buffers, so images are cached per buffer and
+// only the least recently used one is destroyed when a new buffer shows up and the cache is full.
+class HardwareBufferImporter {
+    struct Entry {
+        void *buffer;
+        void *image;
+        uint64_t lastUse;
+    };
+
+    ExternalImageBackend *backend;
+    size_t capacity;
+    std::vector<Entry> entries;
+    uint32_t externalTexture = 0;
+    void *boundImage = nullptr;
+    uint64_t frame = 0;
+    size_t imagesCreated = 0;
+
+  public:
+    explicit HardwareBufferImporter(ExternalImageBackend *backend, size_t capacity = 8)
+        : backend(backend), capacity(capacity) {}
+
+    ~HardwareBufferImporter() { clear(); }
+
+    bool available() { return backend->load(); }
+
+    // Makes `hardwareBuffer` the content of texture(). Returns false if it can't be imported, in
+    // which case the caller should fall back to the copy path.
+    bool import(void *hardwareBuffer) {
+        if (!hardwareBuffer)
+            return false;
+        if (!externalTexture)
+            externalTexture = backend->createExternalTexture();
+        frame++;
+
+        Entry *entry = nullptr;
+        for (auto &e : entries) {
+            if (e.buffer == hardwareBuffer) {
+                entry = &e;
+                break;
+            }
+        }
+
+        if (!entry) {
+            void *image = backend->createImage(hardwareBuffer);
+            if (!image)
+                return false;
+            imagesCreated++;
+
+            if (entries.size() >= capacity) {
+                auto lru = entries.begin();
+                for (auto it = entries.begin(); it != entries.end(); ++it)
+                    if (it->lastUse < lru->lastUse)
+                        lru = it;
+                if (lru->image == boundImage)
+                    boundImage = nullptr;
+                backend->destroyImage(lru->image);
+                *lru = {hardwareBuffer, image, frame};
+                entry = &*lru;
+            } else {
+                entries.push_back({hardwareBuffer, image, frame});
+                entry = &entries.back();
+            }
+        }
+
+        entry->lastUse = frame;
+        if (entry->image != boundImage) {
+            backend->bindImage(externalTexture, entry->image);
+            boundImage = entry->image;
+        }
+        return true;
+    }
+
+    // Destroys all images. Call when the stream stops, since buffer addresses can be reused by
+    // the next decoder instance.
+    void clear() {
+        for (auto &e : entries)
+            backend->destroyImage(e.image);
+        entries.clear();
+        boundImage = nullptr;
+    }
+
+    // Forget images and the texture without destroying them, for when the EGL context is
+    // already gone.
+    void onContextLost() {
+        entries.clear();
+        externalTexture = 0;
+        boundImage = nullptr;
+    }
+
+    // the external-OES texture the last imported buffer is bound to
+    uint32_t texture() const { return externalTexture; }
+
+    size_t cachedImages() const { return entries.size(); }
+
+    size_t createdImages() const { return imagesCreated; }
+};
+
+#endif   // PHONEVR_HARDWARE_BUFFER_IMPORTER_H
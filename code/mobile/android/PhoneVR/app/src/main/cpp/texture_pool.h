@@ -0,0 +1,86 @@
+#ifndef PHONEVR_TEXTURE_POOL_H
+#define PHONEVR_TEXTURE_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <unordered_map>
+
+struct TextureKey {
+    int width = 0;
+    int height = 0;
+    uint32_t format = 0;   // GL internal format
+
+    bool operator==(const TextureKey &other) const {
+        return width == other.width && height == other.height && format == other.format;
+    }
+};
+
+// Creates and destroys the actual textures, implemented with GL calls in alvr_main.cpp.
+class TextureAllocator {
+  public:
+    virtual ~TextureAllocator() = default;
+    virtual uint32_t create(const TextureKey &key) = 0;
+    virtual void destroy(uint32_t texture) = 0;
+};
+
+// Keeps released textures around so stream restarts and lobby/stream transitions at the same
+// resolution reuse the existing allocations instead of going through glTexImage2D again.
+class TexturePool {
+    struct Entry {
+        TextureKey key;
+        uint32_t texture;
+    };
+
+    TextureAllocator *allocator;
+    size_t maxFree;
+    std::deque<Entry> freeList;                       // oldest first
+    std::unordered_map<uint32_t, TextureKey> inUse;   // texture -> key
+    size_t allocations = 0;
+
+  public:
+    explicit TexturePool(TextureAllocator *allocator, size_t maxFree = 4)
+        : allocator(allocator), maxFree(maxFree) {}
+
+    uint32_t acquire(const TextureKey &key) {
+        uint32_t texture = 0;
+        for (auto it = freeList.rbegin(); it != freeList.rend(); ++it) {
+            if (it->key == key) {
+                texture = it->texture;
+                freeList.erase(std::next(it).base());
+                break;
+            }
+        }
+        if (!texture) {
+            texture = allocator->create(key);
+            allocations++;
+        }
+        inUse[texture] = key;
+        return texture;
+    }
+
+    void release(uint32_t texture) {
+        auto it = inUse.find(texture);
+        if (it == inUse.end())
+            return;
+        freeList.push_back({it->second, texture});
+        inUse.erase(it);
+
+        while (freeList.size() > maxFree) {
+            allocator->destroy(freeList.front().texture);
+            freeList.pop_front();
+        }
+    }
+
+    // The GL context is gone together with all its textures: forget them without deleting.
+    void onContextLost() {
+        freeList.clear();
+        inUse.clear();
+    }
+
+    // number of textures created through the allocator since construction
+    size_t allocationCount() const { return allocations; }
+};
+
+#endif   // PHONEVR_TEXTURE_POOL_H
@@ -0,0 +1,105 @@
+#ifndef PHONEVR_TRACKING_SCHEDULER_H
+#define PHONEVR_TRACKING_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// Single producer / single consumer "latest value" slot (triple buffer).
+// The writer never blocks the reader and vice versa; the reader always gets the most recently
+// published complete value.
+template <typename T> class SnapshotSlot {
+    static const uint8_t DIRTY = 0x4;
+    static const uint8_t INDEX = 0x3;
+
+    T slots[3] = {};
+    uint8_t writeIdx = 0;   // owned by the writer
+    uint8_t readIdx = 2;    // owned by the reader
+    std::atomic<uint8_t> middle{1};
+
+  public:
+    void publish(const T &value) {
+        slots[writeIdx] = value;
+        writeIdx = middle.exchange(writeIdx | DIRTY, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // returns false if nothing new has been published since the last read
+    bool read(T &out) {
+        bool fresh = (middle.load(std::memory_order_acquire) & DIRTY) != 0;
+        if (fresh)
+            readIdx = middle.exchange(readIdx, std::memory_order_acq_rel) & INDEX;
+        out = slots[readIdx];
+        return fresh;
+    }
+};
+
+// The head orientation and position at a time, as the tracker reports them: orientation x, y, z,
+// w. The input thread reads it through this, implemented with the Cardboard SDK in alvr_main.cpp.
+struct HeadPose {
+    float position[3] = {};
+    float orientation[4] = {0, 0, 0, 1};
+};
+
+class HeadTracker {
+  public:
+    virtual ~HeadTracker() = default;
+    virtual HeadPose getPose(int64_t timestampNs) = 0;
+};
+
+// Decides when the input thread sends tracking and for which timestamp.
+// Sends are spaced as a fraction of the display refresh interval and phased so that each target
+// timestamp (send time + server prediction offset) lands on a predicted vsync or on an even
+// subdivision of the frame interval.
+class TrackingScheduler {
+    std::atomic<int64_t> frameIntervalNs{(int64_t) (1e9 / 60.f)};
+    std::atomic<int64_t> vsyncNs{0};
+    int maxSamplesPerFrame = 3;
+
+  public:
+    void configure(float refreshRate, int maxSamplesPerFrame = 3) {
+        if (refreshRate > 0)
+            frameIntervalNs = (int64_t) (1e9 / refreshRate);
+        this->maxSamplesPerFrame = std::max(1, maxSamplesPerFrame);
+    }
+
+    // Called by the render thread once per displayed frame, used as vsync phase reference.
+    void onVsync(int64_t timestampNs) { vsyncNs.store(timestampNs, std::memory_order_relaxed); }
+
+    int64_t getFrameIntervalNs() const { return frameIntervalNs.load(std::memory_order_relaxed); }
+
+    // One sample per frame, plus one per frame of prediction horizon: the further the server
+    // extrapolates, the more a stale sample costs.
+    int samplesPerFrame(int64_t predictionOffsetNs) const {
+        auto frameNs = getFrameIntervalNs();
+        auto horizonFrames = (int) std::ceil((double) std::max<int64_t>(predictionOffsetNs, 0) /
+                                             (double) frameNs);
+        return std::clamp(1 + horizonFrames, 1, maxSamplesPerFrame);
+    }
+
+    int64_t sendIntervalNs(int64_t predictionOffsetNs) const {
+        return getFrameIntervalNs() / samplesPerFrame(predictionOffsetNs);
+    }
+
+    // Next send time strictly after nowNs such that (send + predictionOffsetNs) is aligned to the
+    // vsync grid with the current send interval.
+    int64_t nextSendTime(int64_t nowNs, int64_t predictionOffsetNs) const {
+        auto intervalNs = sendIntervalNs(predictionOffsetNs);
+        auto phaseNs = vsyncNs.load(std::memory_order_relaxed) - predictionOffsetNs;
+        auto offsetNs = (nowNs - phaseNs) % intervalNs;
+        if (offsetNs < 0)
+            offsetNs += intervalNs;
+        return nowNs - offsetNs + intervalNs;
+    }
+
+    static int64_t targetTimestamp(int64_t sendNs, int64_t predictionOffsetNs) {
+        return sendNs + predictionOffsetNs;
+    }
+
+    // the pose the send scheduled at sendNs reports, the tracker's prediction for its target
+    static HeadPose sample(HeadTracker &tracker, int64_t sendNs, int64_t predictionOffsetNs) {
+        return tracker.getPose(targetTimestamp(sendNs, predictionOffsetNs));
+    }
+};
+
+#endif   // PHONEVR_TRACKING_SCHEDULER_H
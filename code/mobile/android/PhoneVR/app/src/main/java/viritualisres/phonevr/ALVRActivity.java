@@ -105,7 +105,13 @@ public class ALVRActivity extends AppCompatActivity
         float refreshRate = display.getRefreshRate();
         Log.i(TAG, "Refresh rate: " + refreshRate);
 
-        initializeNative(width, height, refreshRate);
+        // Lets the distortion pass sample decoder output directly (skips one render pass)
+        SharedPreferences settings = getSharedPreferences("settings", MODE_PRIVATE);
+        boolean zeroCopyImport = settings.getBoolean("zero_copy_import", false);
+
+        initializeNative(width, height, refreshRate, zeroCopyImport);
+        setDistortionMeshCacheNative(
+                getCacheDir().getAbsolutePath(), settings.getInt("distortion_mesh_density", 40));
 
         setContentView(R.layout.activity_vr);
         glView = findViewById(R.id.surface_view);
@@ -285,7 +291,9 @@ public class ALVRActivity extends AppCompatActivity
     }
 
     private native void initializeNative(
-            int screenWidth, int screenHeight, float screenRefreshRate);
+            int screenWidth, int screenHeight, float screenRefreshRate, boolean zeroCopyImport);
+
+    private native void setDistortionMeshCacheNative(String cacheDir, int density);
 
     private native void destroyNative();
 
@@ -0,0 +1,281 @@
+#include "PVRAudio.h"
+
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include <media/NdkMediaCodec.h>
+
+#include <memory>
+
+#include "PVRSocketUtils.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace asio;
+using namespace asio::ip;
+
+namespace {
+    const int BLOCK_FRAMES = 240;              // 5 ms, two of them are queued to the device
+    const double OUTPUT_LATENCY_MS = 20;       // mixer and DAC after the buffer queue, typical
+    const seconds STATS_PERIOD = seconds(10);
+
+    Audio::JitterBuffer jitter;
+
+    std::thread *recvThr = nullptr;
+    io_service *recvSvc = nullptr;
+    mutex svcMtx;
+
+    SLObjectItf engineObj = nullptr, mixObj = nullptr, playerObj = nullptr;
+    SLAndroidSimpleBufferQueueItf bufQueue = nullptr;
+    int16_t blocks[2][BLOCK_FRAMES * Audio::CHANNELS];
+    int nextBlock = 0;
+
+    void CheckSl(SLresult res, const char *what) {
+        if (res != SL_RESULT_SUCCESS)
+            throw runtime_error(string(what) + " failed: " + to_string(res));
+    }
+
+    // Opus through the platform decoder, for builds without libopus. Decoding a packet takes well
+    // under a millisecond, its output is waited for so that it keeps the packet's position.
+    class MediaCodecOpusDecoder : public Audio::Decoder {
+        AMediaCodec *codec = nullptr;
+        int64_t inputPts = 0;
+
+      public:
+        MediaCodecOpusDecoder() {
+            // OpusHead: version 1, no pre-skip, gain 0, mapping family 0. The encoder's 2.5 ms of
+            // lookahead is left in, it doesn't matter for sync.
+            uint8_t head[19] = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, Audio::CHANNELS};
+            uint32_t rate = Audio::SAMPLE_RATE;
+            memcpy(&head[12], &rate, 4);
+            int64_t codecDelayNs = 0, seekPrerollNs = 80'000'000;
+
+            auto *fmt = AMediaFormat_new();
+            AMediaFormat_setString(fmt, AMEDIAFORMAT_KEY_MIME, "audio/opus");
+            AMediaFormat_setInt32(fmt, AMEDIAFORMAT_KEY_SAMPLE_RATE, Audio::SAMPLE_RATE);
+            AMediaFormat_setInt32(fmt, AMEDIAFORMAT_KEY_CHANNEL_COUNT, Audio::CHANNELS);
+            AMediaFormat_setBuffer(fmt, "csd-0", head, sizeof(head));
+            AMediaFormat_setBuffer(fmt, "csd-1", &codecDelayNs, sizeof(codecDelayNs));
+            AMediaFormat_setBuffer(fmt, "csd-2", &seekPrerollNs, sizeof(seekPrerollNs));
+
+            codec = AMediaCodec_createDecoderByType("audio/opus");
+            auto status = codec ? AMediaCodec_configure(codec, fmt, nullptr, nullptr, 0)
+                                : AMEDIA_ERROR_UNSUPPORTED;
+            AMediaFormat_delete(fmt);
+            if (status == AMEDIA_OK)
+                status = AMediaCodec_start(codec);
+            if (status != AMEDIA_OK) {
+                if (codec)
+                    AMediaCodec_delete(codec);
+                throw runtime_error("no Opus decoder: " + to_string(status));
+            }
+        }
+
+        ~MediaCodecOpusDecoder() override {
+            AMediaCodec_stop(codec);
+            AMediaCodec_delete(codec);
+        }
+
+        int decode(const uint8_t *data, size_t size, int16_t *pcm, int maxFrames) override {
+            auto idx = AMediaCodec_dequeueInputBuffer(codec, 2000);   // 2ms timeout
+            if (idx < 0)
+                return 0;
+            size_t bufSz;
+            uint8_t *buf = AMediaCodec_getInputBuffer(codec, (size_t) idx, &bufSz);
+            size = (std::min)(size, bufSz);
+            memcpy(buf, data, size);
+            AMediaCodec_queueInputBuffer(codec, (size_t) idx, 0, size, (uint64_t) inputPts++, 0);
+
+            for (int tries = 0; tries < 10; tries++) {
+                AMediaCodecBufferInfo info;
+                auto outIdx = AMediaCodec_dequeueOutputBuffer(codec, &info, 1000);
+                if (outIdx < 0)   // no output yet, or format / buffers changed
+                    continue;
+                size_t outSz;
+                uint8_t *out = AMediaCodec_getOutputBuffer(codec, (size_t) outIdx, &outSz);
+                int frames = (std::min)((int) (info.size / (Audio::CHANNELS * 2)), maxFrames);
+                memcpy(pcm, out + info.offset, (size_t) frames * Audio::CHANNELS * 2);
+                AMediaCodec_releaseOutputBuffer(codec, (size_t) outIdx, false);
+                return frames;
+            }
+            return 0;
+        }
+    };
+
+    // Called on OpenSL's thread each time a block has played. The other block is still queued in
+    // front of this one.
+    void EnqueueBlock() {
+        auto now = Clk::now().time_since_epoch().count();
+        auto playNs =
+            now + Audio::framesToNs(BLOCK_FRAMES) + (int64_t) (OUTPUT_LATENCY_MS * 1'000'000);
+        jitter.pull(blocks[nextBlock], BLOCK_FRAMES, playNs, now);
+        (*bufQueue)->Enqueue(bufQueue, blocks[nextBlock], sizeof(blocks[0]));
+        nextBlock ^= 1;
+    }
+
+    void OnBlockPlayed(SLAndroidSimpleBufferQueueItf, void *) { EnqueueBlock(); }
+
+    void StopPlayer() {
+        if (playerObj)
+            (*playerObj)->Destroy(playerObj);
+        if (mixObj)
+            (*mixObj)->Destroy(mixObj);
+        if (engineObj)
+            (*engineObj)->Destroy(engineObj);
+        playerObj = mixObj = engineObj = nullptr;
+        bufQueue = nullptr;
+    }
+
+    void StartPlayer() {
+        CheckSl(slCreateEngine(&engineObj, 0, nullptr, 0, nullptr, nullptr), "slCreateEngine");
+        CheckSl((*engineObj)->Realize(engineObj, SL_BOOLEAN_FALSE), "engine Realize");
+        SLEngineItf engine;
+        CheckSl((*engineObj)->GetInterface(engineObj, SL_IID_ENGINE, &engine), "SL_IID_ENGINE");
+        CheckSl((*engine)->CreateOutputMix(engine, &mixObj, 0, nullptr, nullptr),
+                "CreateOutputMix");
+        CheckSl((*mixObj)->Realize(mixObj, SL_BOOLEAN_FALSE), "output mix Realize");
+
+        SLDataLocator_AndroidSimpleBufferQueue queueLoc = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE,
+                                                           2};
+        SLDataFormat_PCM format = {SL_DATAFORMAT_PCM,
+                                   Audio::CHANNELS,
+                                   SL_SAMPLINGRATE_48,
+                                   SL_PCMSAMPLEFORMAT_FIXED_16,
+                                   SL_PCMSAMPLEFORMAT_FIXED_16,
+                                   SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT,
+                                   SL_BYTEORDER_LITTLEENDIAN};
+        SLDataSource source = {&queueLoc, &format};
+        SLDataLocator_OutputMix mixLoc = {SL_DATALOCATOR_OUTPUTMIX, mixObj};
+        SLDataSink sink = {&mixLoc, nullptr};
+        const SLInterfaceID ids[] = {SL_IID_BUFFERQUEUE};
+        const SLboolean required[] = {SL_BOOLEAN_TRUE};
+        CheckSl((*engine)->CreateAudioPlayer(engine, &playerObj, &source, &sink, 1, ids, required),
+                "CreateAudioPlayer");
+        CheckSl((*playerObj)->Realize(playerObj, SL_BOOLEAN_FALSE), "player Realize");
+        CheckSl((*playerObj)->GetInterface(playerObj, SL_IID_BUFFERQUEUE, &bufQueue),
+                "SL_IID_BUFFERQUEUE");
+        CheckSl((*bufQueue)->RegisterCallback(bufQueue, OnBlockPlayed, nullptr),
+                "RegisterCallback");
+
+        SLPlayItf play;
+        CheckSl((*playerObj)->GetInterface(playerObj, SL_IID_PLAY, &play), "SL_IID_PLAY");
+        EnqueueBlock();
+        EnqueueBlock();
+        CheckSl((*play)->SetPlayState(play, SL_PLAYSTATE_PLAYING), "SetPlayState");
+    }
+
+    void ReceiveAudio(udp::socket &skt, io_service &svc, Audio::Decoder &decoder) {
+        asio::error_code ec;
+        size_t len = 0;
+        function<void(const asio::error_code &, size_t)> handler =
+            [&](const asio::error_code &err, size_t n) {
+                ec = err;
+                len = n;
+            };
+        uint8_t dgram[sizeof(Audio::PacketHeader) + Audio::MAX_PAYLOAD];
+        int16_t pcm[Audio::MAX_PACKET_FRAMES * Audio::CHANNELS];
+        auto lastStats = Clk::now();
+
+        while (pvrState != PVR_STATE_SHUTDOWN) {
+            ec = error::interrupted;   // stays set if the service is stopped
+            skt.async_receive(buffer(dgram), handler);
+            svc.run();
+            svc.reset();
+            if (ec.value() != 0)
+                break;
+            auto arrivalNs = Clk::now().time_since_epoch().count();
+            if (len < sizeof(Audio::PacketHeader))
+                continue;
+
+            Audio::PacketHeader hdr;
+            memcpy(&hdr, dgram, sizeof(hdr));
+            int frames = decoder.decode(
+                &dgram[sizeof(hdr)], len - sizeof(hdr), pcm, Audio::MAX_PACKET_FRAMES);
+            jitter.push(hdr, pcm, frames, arrivalNs);
+
+            if (Clk::now() - lastStats > STATS_PERIOD) {
+                auto s = jitter.stats(Clk::now().time_since_epoch().count());
+                PVR_DB_I(str_fmt("[PVRAudio] received %llu, late %llu, lost %llu, underruns %llu, "
+                                 "resyncs %llu, buffered %.1f ms, jitter %.1f ms, "
+                                 "behind video %.1f ms",
+                                 (unsigned long long) s.received,
+                                 (unsigned long long) s.late,
+                                 (unsigned long long) s.lost,
+                                 (unsigned long long) s.underruns,
+                                 (unsigned long long) s.resyncs,
+                                 s.bufferedMs,
+                                 s.jitterMs,
+                                 s.avOffsetMs));
+                lastStats = Clk::now();
+            }
+        }
+    }
+}   // namespace
+
+void PVRStartAudio(const PVRMsg::AudioConfig &config) {
+    try {
+        if (config.sampleRate != Audio::SAMPLE_RATE || config.channels != Audio::CHANNELS) {
+            PVR_DB_I("[PVRAudio] unsupported format, " + to_string(config.channels) +
+                     " channels at " + to_string(config.sampleRate) + " Hz");
+            return;
+        }
+        auto decoder = Audio::makeDecoder((Audio::Codec) config.codec);
+        if (!decoder && config.codec == Audio::OPUS)
+            decoder.reset(new MediaCodecOpusDecoder());
+        if (!decoder) {
+            PVR_DB_I("[PVRAudio] unsupported codec " + to_string(config.codec));
+            return;
+        }
+
+        jitter.reset();
+        StartPlayer();
+        recvThr = new std::thread([=, dec = decoder.release()] {
+            unique_ptr<Audio::Decoder> decoder(dec);
+            try {
+                io_service svc;
+                udp::socket skt(svc, {udp::v4(), config.port});
+                svcMtx.lock();
+                recvSvc = &svc;
+                svcMtx.unlock();
+                PVR_DB_I("[PVRAudio th] receiving on UDP port " + to_string(config.port));
+
+                ReceiveAudio(skt, svc, *decoder);
+
+                svcMtx.lock();
+                recvSvc = nullptr;
+                svcMtx.unlock();
+            } catch (exception &e) {
+                PVR_DB_I("[PVRAudio th] caught Exception: " + string(e.what()));
+            }
+        });
+    } catch (exception &e) {
+        PVR_DB_I("PVRAudio_PVRStartAudio:: Caught Exception: " + string(e.what()));
+        StopPlayer();
+    }
+}
+
+void PVRStopAudio() {
+    try {
+        svcMtx.lock();
+        if (recvSvc)
+            recvSvc->stop();
+        svcMtx.unlock();
+
+        if (recvThr) {
+            recvThr->join();
+            delete recvThr;
+            recvThr = nullptr;
+        }
+        StopPlayer();
+        jitter.reset();
+    } catch (exception &e) {
+        PVR_DB_I("PVRAudio_PVRStopAudio:: Caught Exception: " + string(e.what()));
+    }
+}
+
+void PVRAudioSyncToVideo(int64_t pts, Clk::time_point photonTime) {
+    jitter.onVideoPresented(pts, photonTime.time_since_epoch().count());
+}
+
+Audio::JitterBuffer::Stats PVRGetAudioStats() {
+    return jitter.stats(Clk::now().time_since_epoch().count());
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "PVRGlobals.h"
+#include "PVRMessages.h"
+#include "Utils/JitterBuffer.h"
+
+// Receives the PC's audio on config.port and plays it through OpenSL ES, in sync with the video
+// frames reported by PVRAudioSyncToVideo.
+void PVRStartAudio(const PVRMsg::AudioConfig &config);
+void PVRStopAudio();
+
+// the frame with this pts is expected to reach the screen at photonTime
+void PVRAudioSyncToVideo(int64_t pts, Clk::time_point photonTime);
+
+Audio::JitterBuffer::Stats PVRGetAudioStats();
@@ -3,7 +3,9 @@
 #include "Geometry"
 #include <unistd.h>
 
+#include "PVRAudio.h"
 #include "PVRSockets.h"
+#include "Utils/Extrapolation.h"
 #include "Utils/RenderUtils.h"
 
 using namespace std;
@@ -31,6 +33,30 @@ namespace {
     Matrix4f rotInv = Matrix4f::Identity();
     unique_ptr<Renderer> videoRdr[2];
 
+    // refreshes without a new frame show the last one, rotated to the head when reprojecting
+    bool frameShown = false;
+    Extrapolation::Quat frameQuat;   // the pose the last frame was rendered with
+    Extrapolation::FrameStats frameStats;
+    const uint32_t FRAME_STATS_INTERVAL = 600;   // displayed frames per log line
+
+    // debug mode: a checksum of each new frame as shown, read back a few refreshes later
+    unique_ptr<PBO> capture;
+    vector<uint8_t> captureBuf;
+
+    uint32_t checksum(const vector<uint8_t> &data) {
+        uint32_t hash = 2166136261u;   // FNV-1a
+        for (auto b : data)
+            hash = (hash ^ b) * 16777619u;
+        return hash;
+    }
+
+    void LogCaptures() {
+        int64_t pts;
+        while (capture->collect(captureBuf.data(), &pts))
+            PVR_DB_I("[PVRRender] frame " + to_string(pts) + " checksum " +
+                     to_string(checksum(captureBuf)));
+    }
+
     Matrix4f gvrToEigenMat(Mat4f gvrMat) {
         Matrix4f eMat;
         try {
@@ -75,6 +101,7 @@ namespace {
     struct EyeData {
         int vpLeft, vpBottom, vpWidth, vpHeight;
         Matrix4f quadModel, proj;
+        LensMask::EyeTangents display, frame;   // the eye's FOV, and with the offFov margin
     } eyes[2];
 
     vector<float> leftQuad;
@@ -89,6 +116,10 @@ namespace {
                 int rdrWidth = specs[0].GetSize().width;
                 int rdrHeight = specs[0].GetSize().height;
                 swapChain.reset(new SwapChain(gvrApi->CreateSwapChain(specs)));
+                if (debugMode) {
+                    capture.reset(new PBO(rdrWidth, rdrHeight, rdrWidth * rdrHeight * 4));
+                    captureBuf.resize((size_t) rdrWidth * rdrHeight * 4);
+                }
                 vps.reset(new BufferViewportList(gvrApi->CreateEmptyBufferViewportList()));
                 vps->SetToRecommendedBufferViewports();
 
@@ -115,6 +146,11 @@ namespace {
                     if (i == GVR_LEFT_EYE) {
                         leftQuad = {quad.left, quad.top, quad.right, quad.bottom};
                     }
+                    e.display = {-tan(fov.left * deg2rad),
+                                 tan(fov.right * deg2rad),
+                                 -tan(fov.top * deg2rad),
+                                 tan(fov.bottom * deg2rad)};
+                    e.frame = {quad.left, quad.right, -quad.top, -quad.bottom};
                     e.quadModel = Affine3f(Translation3f((quad.right + quad.left) / 2.f,
                                                          (quad.top + quad.bottom) / 2.f,
                                                          -1.f))
@@ -176,9 +212,12 @@ void PVRRender(int64_t pts) {
 
             if (pts > 0) {
                 vector<float> v = DequeueQuatAtPts(pts);
-                if (v.size() == 4)
+                PVRAudioSyncToVideo(pts, Clk::now() + 20ms);   // the target time below
+                if (v.size() == 4) {
                     rotInv.block(0, 0, 3, 3) =
                         Matrix3f(Quaternionf(v[0], v[1], v[2], v[3]));   // todo: simplify
+                    frameQuat = {v[0], v[1], v[2], v[3]};
+                }
                 // rotInv = rotMat;//.inverse(); ?
             }
 
@@ -196,7 +235,27 @@ void PVRRender(int64_t pts) {
             ClockTimePoint tgt_time = GvrApi::GetTimePointNow();
             tgt_time.monotonic_system_time_nanos += 20000000;   // 0.020 s
             Mat4f gvrHeadMat = gvrApi->GetHeadSpaceFromStartSpaceRotation(tgt_time);
-            Matrix4f deltaRot = gvrToEigenMat(gvrHeadMat) * rotInv;
+            Matrix4f headMat = gvrToEigenMat(gvrHeadMat);
+            Matrix4f deltaRot = headMat * rotInv;
+
+            // at half rate every other refresh has no new frame, it must follow the head
+            bool warp = reproj || PVRIsHalfRate();
+            if (pts > 0) {
+                frameShown = true;
+                frameStats.addReal();
+            } else if (frameShown) {
+                Quaternionf head(Matrix3f(headMat.block<3, 3>(0, 0).transpose()));
+                auto delta =
+                    Extrapolation::delta(frameQuat, {head.w(), head.x(), head.y(), head.z()});
+                bool covered = !warp ||
+                               (Extrapolation::covers(delta, eyes[0].frame, eyes[0].display) &&
+                                Extrapolation::covers(delta, eyes[1].frame, eyes[1].display));
+                frameStats.addSynthesized(delta, covered);
+            }
+            if (frameStats.displayed() >= FRAME_STATS_INTERVAL) {
+                PVR_DB_I("[PVRRender] " + frameStats.summary());
+                frameStats = {};
+            }
 
             for (int i = 0; i < 2; ++i) {
                 auto e = eyes[i];
@@ -205,7 +264,7 @@ void PVRRender(int64_t pts) {
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
                 Matrix4f mvp;
-                if (reproj)
+                if (warp)
                     mvp = e.proj * deltaRot * e.quadModel;   // order sensitive!!
                 else
                     mvp = e.proj * e.quadModel;
@@ -213,8 +272,12 @@ void PVRRender(int64_t pts) {
                 videoRdr[i]->render(mvp);
             }
 
+            if (capture && pts > 0)
+                capture->download(pts);
             frame.Unbind();
             frame.Submit(*vps, gvrHeadMat);
+            if (capture)
+                LogCaptures();
 
             fpsRenderer = (1000000000.0 / (Clk::now() - oldtime).count());
             oldtime = Clk::now();
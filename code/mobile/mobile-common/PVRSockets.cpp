@@ -1,30 +1,72 @@
 #include "PVRSockets.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <memory>
+
+#include "PVRAudio.h"
+#include "Utils/BandwidthProbe.h"
+#include "Utils/LatencyHistogram.h"
+#include "Utils/Multipath.h"
+#include "Utils/PoseCodec.h"
+#include "Utils/VideoTransport.h"
+
 // using namespace PVR;
 
 namespace {
     TCPTalker *talker = nullptr;
-    io_service *videoSvc = nullptr;
+    vector<io_service *> videoSvcs;   // one per video path
     std::thread *strThr = nullptr;
     io_service *annSvc = nullptr;
     string pcIP;
     mutex delMtx;
 
     bool announcing = false;
+    bool multiplexed = false;    // poses and video over the talker, see STREAM_CONFIG
+    bool muxReceiving = false;   // multiplexed frames are taken between start and stop of streams
+    bool halfRate = false;       // we synthesize every other displayed frame, see STREAM_CONFIG
+    bool poseCodec = false;      // the PC takes PoseCodec packets, older ones only legacy ones
+    bool multipath = false;      // the PC accepts extra video paths, see STREAM_CONFIG
+    bool duplicatePoses = false;   // and wants pose samples through them too
+    PVRMsg::AudioConfig audioConfig = {};   // packetFrames 0: the PC sends no audio
 
     TimeBomb headerBomb(seconds(5), [] {
         pvrState = PVR_STATE_SHUTDOWN;
     });   // todo: error handling instead of shutdown
 
-    //           pts       buf
-    queue<pair<int64_t, vector<float>>> quatQueue;
+    struct QueuedFrame {
+        int64_t pts;
+        vector<float> quat;
+        int64_t poseId;   // timestamp of the pose sample the PC rendered it with, 0 if unknown
+    };
+    deque<QueuedFrame> quatQueue;   // in pts order, under vBufMtx
+
+    mutex m2pMtx;
+    LatencyHistogram motionToPhoton;   // pose sample to frame render, this stream only
 
     queue<EmptyVidBuf> emptyVBufs;
     queue<FilledVidBuf> filledVBufs;
+    mutex vBufMtx;                 // video paths -> buffer queues
+    condition_variable vBufCond;   // an empty buffer was queued
+    MonotonicFilter framesSeen;    // pts of frames handed to the decoder
+
+    mutex pathsMtx;
+    vector<address_v4> extraPathAddrs;   // local addresses with a connected extra video path
+
+    // PVRMsg::ClientStats of the current interval, the PC picks our simulcast tier from them
+    mutex statsMtx;
+    Clk::time_point statsStart;
+    uint32_t statsReceived = 0, statsDecoded = 0;
+    int64_t statsDecodeUs = 0;
+    atomic<uint32_t> udpFramesLost{0};   // cumulative, from the frame assembler
+    uint32_t statsLostBase = 0;
 
     float fpsStreamRecver = 0.0;
 }   // namespace
 
+void ReceiveFrameMessage(const SharedBuffer &frame);
+
 extern float fpsStreamDecoder = 0.0;
 extern float fpsRenderer = 0.0;
 
@@ -32,9 +74,19 @@ vector<float> DequeueQuatAtPts(int64_t pts) {
 
     vector<float> quat;
     try {
-        while (quatQueue.size() > 0 && quatQueue.front().first <= pts) {
-            quat = quatQueue.front().second;
-            quatQueue.pop();
+        lock_guard<mutex> queueLock(vBufMtx);
+        while (quatQueue.size() > 0 && quatQueue.front().pts <= pts) {
+            auto &frame = quatQueue.front();
+            quat = frame.quat;
+            if (frame.pts == pts && frame.poseId > 0) {
+                // same clock on both ends, the id is the sensor thread's timestamp
+                lock_guard<mutex> lock(m2pMtx);
+                motionToPhoton.add((Clk::now().time_since_epoch().count() - frame.poseId) /
+                                   1'000'000.0);
+                if (motionToPhoton.size() % 600 == 0)
+                    PVR_DB_I("[PVRSockets] motion to photon: " + motionToPhoton.summary());
+            }
+            quatQueue.pop_front();
         }
 
     } catch (exception e) {
@@ -47,11 +99,9 @@ vector<float> DequeueQuatAtPts(int64_t pts) {
 void SendAdditionalData(vector<uint16_t> maxSize, vector<float> fov, float ipd) {
     try {
         if (talker) {
-            vector<uint8_t> v(2 * 2 + 4 * 4 + 4);
-            memcpy(&v[0], &maxSize[0], 2 * 2);
-            memcpy(&v[2 * 2], &fov[0], 4 * 4);
-            memcpy(&v[2 * 2 + 4 * 4], &ipd, 4);
-            if (!talker->send(PVR_MSG::ADDITIONAL_DATA, v))
+            PVRMsg::AdditionalData addData = {maxSize[0], maxSize[1], {}, ipd};
+            copy(fov.begin(), fov.begin() + 4, addData.projRect);
+            if (!talker->send<PVR_MSG::ADDITIONAL_DATA>(addData))
                 PVR_DB_I("[PVRSockets::SendAdditionalData] Failed to send AddData");
 
             headerBomb.ignite(false);
@@ -64,10 +114,16 @@ void SendAdditionalData(vector<uint16_t> maxSize, vector<float> fov, float ipd)
 void PVRStartAnnouncer(const char *ip,
                        uint16_t port,
                        void (*segueCb)(),
-                       void (*headerCb)(uint8_t *, size_t),
+                       void (*headerCb)(SharedBuffer),
                        void (*unwindSegue)()) {
     try {
         pcIP = ip;   // ip will become invalid afterwards, so I capture a string copy
+        multiplexed = false;
+        halfRate = false;
+        poseCodec = false;
+        multipath = false;
+        duplicatePoses = false;
+        audioConfig = {};
         std::thread([=] {
             try {
                 if (talker) {
@@ -76,26 +132,47 @@ void PVRStartAnnouncer(const char *ip,
                 }
                 talker = new TCPTalker(
                     port,
-                    [=](PVR_MSG msgType, vector<uint8_t> data) {
-                        if (msgType == PVR_MSG::PAIR_ACCEPT) {
-                            PVRStopAnnouncer();
-                            if (pcIP.length() == 0) {
-                                pcIP =
-                                    talker->getIP();   // Set pcIP from addr only if pcIP is empty
-                                                       // (override not set in android app settings)
-                            } else {
-                                PVR_DB_I("[PVRSockets::PVRStartAnnouncer] TCPTalker, got pcIP from "
-                                         "network as " +
-                                         to_string(talker->getIP()) +
-                                         " but using override ip from settings(" + pcIP + ")");
-                            }
-                            segueCb();
-                        } else if (msgType == PVR_MSG::HEADER_NALS) {
-                            headerCb(&data[0], data.size());
-                            headerBomb.defuse();
-                        } else if (msgType == PVR_MSG::DISCONNECT) {
-                            unwindSegue();
-                        }
+                    [handlers = PVRMsg::Handlers{
+                         [](const PVRMsg::Message<PVR_MSG::STREAM_CONFIG> &msg) {
+                             multiplexed = msg.data.multiplexed != 0;
+                             halfRate = msg.data.halfRate != 0;
+                             poseCodec = msg.data.poseCodec != 0;
+                             multipath = msg.data.multipath != 0;
+                             duplicatePoses = msg.data.duplicatePoses != 0;
+                             PVR_DB_I(string("[PVRSockets::PVRStartAnnouncer] streams ") +
+                                      (multiplexed ? "multiplexed" : "on their own ports") +
+                                      (halfRate ? ", video at half rate" : "") +
+                                      (multipath ? ", over every interface" : ""));
+                         },
+                         [](const PVRMsg::Message<PVR_MSG::AUDIO_CONFIG> &msg) {
+                             audioConfig = msg.data;
+                         },
+                         [=](const PVRMsg::Message<PVR_MSG::PAIR_ACCEPT> &) {
+                             PVRStopAnnouncer();
+                             if (pcIP.length() == 0) {
+                                 pcIP = talker->getIP();   // Set pcIP from addr only if pcIP is
+                                                           // empty (override not set in android
+                                                           // app settings)
+                             } else {
+                                 PVR_DB_I("[PVRSockets::PVRStartAnnouncer] TCPTalker, got pcIP "
+                                          "from network as " +
+                                          to_string(talker->getIP()) +
+                                          " but using override ip from settings(" + pcIP + ")");
+                             }
+                             segueCb();
+                         },
+                         [=](const PVRMsg::Message<PVR_MSG::HEADER_NALS> &msg) {
+                             headerCb(msg.data);
+                             headerBomb.defuse();
+                         },
+                         [](const PVRMsg::Message<PVR_MSG::VIDEO_FRAME> &msg) {
+                             ReceiveFrameMessage(msg.data);
+                         },
+                         [=](const PVRMsg::Message<PVR_MSG::DISCONNECT> &) { unwindSegue(); }}](
+                        PVR_MSG msgType, SharedBuffer data) mutable {
+                        if (!PVRMsg::dispatch(handlers, msgType, data))
+                            PVR_DB_I("[PVRSockets::PVRStartAnnouncer] malformed message with ID: " +
+                                     to_string(msgType));
                     },
                     [](std::error_code err) {
                         PVR_DB_I("[PVRSockets::PVRStartAnnouncer] TCPTalker error: " +
@@ -261,16 +338,40 @@ void PVRStartSendSensorData(uint16_t port, bool (*getSensorData)(float *, float
                 udp::endpoint ep(address::from_string(pcIP), port);
                 skt.open(udp::v4());
 
+                // with duplicatePoses copies of every sample go out through the extra video paths
+                // too, the PC keeps whichever arrives first
+                map<address_v4, unique_ptr<udp::socket>> pathSkts;
+
                 RefWhistle ref(microseconds(8333));   // this scans loops of exactly 120 fps
 
-                uint8_t buf[36];
-                auto orQuat = reinterpret_cast<float *>(&buf[0]);
-                auto acc = reinterpret_cast<float *>(&buf[4 * 4]);
-                auto tm = reinterpret_cast<long long *>(&buf[4 * 4 + 3 * 4]);
+                PoseCodec::Sample sample;
+                uint8_t buf[(std::max)(PoseCodec::packetSize(1), PoseCodec::LEGACY_SIZE)];
                 while (pvrState != PVR_STATE_SHUTDOWN) {
-                    if (getSensorData(orQuat, acc)) {
-                        *tm = Clk::now().time_since_epoch().count();
-                        skt.send_to(buffer(buf, 36), ep);
+                    if (getSensorData(sample.quat, sample.acc)) {
+                        sample.timestamp = Clk::now().time_since_epoch().count();
+                        auto size = poseCodec ? PoseCodec::encode(&sample, 1, buf, sizeof(buf))
+                                              : PoseCodec::encodeLegacy(sample, buf, sizeof(buf));
+                        if (multiplexed) {
+                            // goes ahead of any video chunks queued on the talker
+                            if (talker)
+                                talker->send<PVR_MSG::POSE_DATA>(SharedBuffer::copyOf(buf, size));
+                        } else {
+                            skt.send_to(buffer(buf, size), ep);
+
+                            pathsMtx.lock();
+                            auto addrs = duplicatePoses ? extraPathAddrs : vector<address_v4>();
+                            pathsMtx.unlock();
+                            for (auto &addr : addrs) {
+                                auto &pathSkt = pathSkts[addr];
+                                asio::error_code ec;
+                                if (!pathSkt) {
+                                    pathSkt.reset(new udp::socket(svc));
+                                    pathSkt->open(udp::v4(), ec);
+                                    pathSkt->bind({addr, 0}, ec);
+                                }
+                                pathSkt->send_to(buffer(buf, size), ep, 0, ec);
+                            }
+                        }
                     }
                     ref.wait();
                 }
@@ -284,11 +385,16 @@ void PVRStartSendSensorData(uint16_t port, bool (*getSensorData)(float *, float
     }
 }
 
-bool PVRIsVidBufNeeded() { return emptyVBufs.size() < 3; }
+bool PVRIsVidBufNeeded() {
+    lock_guard<mutex> lock(vBufMtx);
+    return emptyVBufs.size() < 3;
+}
 
 void PVREnqueueVideoBuf(EmptyVidBuf eBuf) {
     try {
+        lock_guard<mutex> lock(vBufMtx);
         emptyVBufs.push(eBuf);
+        vBufCond.notify_one();
     } catch (exception e) {
         PVR_DB_I("PVRSockets_PVREnqueueVideoBuf:: Caught Exception: " + string(e.what()));
     }
@@ -296,6 +402,7 @@ void PVREnqueueVideoBuf(EmptyVidBuf eBuf) {
 
 FilledVidBuf PVRPopVideoBuf() {
     try {
+        lock_guard<mutex> lock(vBufMtx);
         if (!filledVBufs.empty()) {
             auto fbuf = filledVBufs.front();
             filledVBufs.pop();
@@ -307,15 +414,340 @@ FilledVidBuf PVRPopVideoBuf() {
     return {-1, 0, 0};   // idx == -1 -> no buffers available
 }
 
+void ResetClientStats() {
+    lock_guard<mutex> lock(statsMtx);
+    statsStart = Clk::now();
+    statsReceived = statsDecoded = 0;
+    statsDecodeUs = 0;
+    udpFramesLost = 0;
+    statsLostBase = 0;
+}
+
+// The stats of the interval once it is over and a new one started, called with statsMtx held.
+// They are sent after it is released, a send can wait on the talker.
+bool TakeClientStatsIfDue(PVRMsg::ClientStats &stats) {
+    if (Clk::now() - statsStart < milliseconds(PVRMsg::CLIENT_STATS_MS))
+        return false;
+    uint32_t lost = udpFramesLost;
+    stats = {statsReceived,
+             statsDecoded,
+             lost - statsLostBase,
+             (uint32_t) (statsDecoded ? statsDecodeUs / statsDecoded : 0)};
+    statsStart = Clk::now();
+    statsReceived = statsDecoded = 0;
+    statsDecodeUs = 0;
+    statsLostBase = lost;
+    return true;
+}
+
+void PVRFrameDecoded(int64_t decodeUs) {
+    PVRMsg::ClientStats stats;
+    {
+        lock_guard<mutex> lock(statsMtx);
+        statsDecoded++;
+        statsDecodeUs += decodeUs;
+        if (!TakeClientStatsIfDue(stats))
+            return;
+    }
+    if (talker)
+        talker->send<PVR_MSG::CLIENT_STATS>(stats);
+}
+
+bool PVRIsHalfRate() { return halfRate; }
+
+LatencyHistogram PVRGetMotionToPhoton() {
+    lock_guard<mutex> lock(m2pMtx);
+    return motionToPhoton;
+}
+
+// Waits for a free decoder buffer and queues the frame's orientation with it, false on shutdown.
+bool AcquireVBuf(int64_t pts, const float *quat, int64_t poseId, EmptyVidBuf &eBuf) {
+    unique_lock<mutex> lock(vBufMtx);
+    // shutdown is not notified, so look at it every few ms
+    while (emptyVBufs.empty() && pvrState != PVR_STATE_SHUTDOWN)
+        vBufCond.wait_for(lock, milliseconds(2));
+    if (emptyVBufs.empty())
+        return false;
+
+    // paths race each other to here, but the renderer dequeues in pts order
+    auto pos = upper_bound(quatQueue.begin(),
+                           quatQueue.end(),
+                           pts,
+                           [](int64_t at, const QueuedFrame &frame) { return at < frame.pts; });
+    quatQueue.insert(pos, {pts, vector<float>(quat, quat + 4), poseId});
+    eBuf = emptyVBufs.front();
+    emptyVBufs.pop();
+    return true;
+}
+
+// Hands a filled buffer to the decoder, or puts it back if the frame could not be read.
+void ReleaseVBuf(const EmptyVidBuf &eBuf, uint32_t size, int64_t pts, bool filled) {
+    {
+        lock_guard<mutex> lock(vBufMtx);
+        if (filled) {
+            filledVBufs.push({eBuf.idx, size, (uint64_t) pts});
+            PVR_DB("[StreamReceiver th] pushing onto filledVBufs idx: " + to_string(eBuf.idx) +
+                   ", size: " + to_string(size) + ", pts:" + to_string(pts) + "...pop eVbuf ");
+        } else {
+            emptyVBufs.push(eBuf);
+            vBufCond.notify_one();
+        }
+    }
+    // also here, a decoder that stopped putting out frames has to show up in the stats
+    PVRMsg::ClientStats stats;
+    {
+        lock_guard<mutex> lock(statsMtx);
+        statsReceived += filled;
+        if (!TakeClientStatsIfDue(stats))
+            return;
+    }
+    if (talker)
+        talker->send<PVR_MSG::CLIENT_STATS>(stats);
+}
+
+// Reads frames from one video path until it fails or streaming stops. With multipath the same
+// frame can arrive on several paths, only the first copy is handed to the decoder.
+void ReceiveVideoPath(tcp::socket &skt, io_service &svc, bool primary) {
+    asio::error_code ec;
+    function<void(const asio::error_code &, size_t)> handler =
+        [&](const asio::error_code &err, size_t) { ec = err; };
+
+    uint8_t extraBuf[sizeof(PVRMsg::FrameHeader)];
+    // these values are automatically updated when extraBuf is updated
+    auto pts = reinterpret_cast<int64_t *>(extraBuf);
+    auto quatBuf = reinterpret_cast<float *>(extraBuf + offsetof(PVRMsg::FrameHeader, quat));
+    auto pktSz = reinterpret_cast<uint32_t *>(extraBuf + offsetof(PVRMsg::FrameHeader, size));
+    auto fpsBuf = reinterpret_cast<float *>(extraBuf + offsetof(PVRMsg::FrameHeader, fps));
+    auto ctdBuf = reinterpret_cast<float *>(extraBuf + offsetof(PVRMsg::FrameHeader, delaysMs));
+    auto timestamp = reinterpret_cast<int64_t *>(extraBuf + offsetof(PVRMsg::FrameHeader, sentUs));
+    auto poseId = reinterpret_cast<int64_t *>(extraBuf + offsetof(PVRMsg::FrameHeader, poseId));
+
+    vector<uint8_t> probeBuf, dropBuf;
+
+    auto oldtime = Clk::now();   // of the last frame on this path
+    while (pvrState != PVR_STATE_SHUTDOWN) {
+
+        async_read(skt, buffer(extraBuf, sizeof(extraBuf)), handler);
+        svc.run();
+        svc.reset();
+
+        auto networkDelay =
+            (int) ((duration_cast<microseconds>(system_clock::now().time_since_epoch()).count() -
+                    *timestamp) /
+                   1000);
+
+        PVR_DB("[StreamReceiver th] recvd 28maxBs with Error: " + to_string(ec.value()) +
+               ", pts: " + to_string(*pts) + ", pktSz" + to_string(*pktSz));
+
+        if (ec.value() == 0 && *pts == BandwidthProbe::PROBE_PTS) {
+            // startup link probe: read the train and report how long it took
+            auto start = Clk::now();
+            probeBuf.resize(*pktSz);
+            async_read(skt, buffer(probeBuf), handler);
+            svc.run();
+            svc.reset();
+            if (ec.value() != 0)
+                break;
+
+            BandwidthProbe::ProbeReply reply = {
+                *pktSz, (uint32_t) duration_cast<microseconds>(Clk::now() - start).count()};
+            async_write(skt, buffer(&reply, sizeof(reply)), handler);
+            svc.run();
+            svc.reset();
+            if (ec.value() != 0)
+                break;
+            continue;
+        }
+
+        if (ec.value() != 0)
+            break;
+
+        if (!framesSeen.accept(*pts)) {
+            // already delivered through another path
+            dropBuf.resize(*pktSz);
+            async_read(skt, buffer(dropBuf), handler);
+            svc.run();
+            svc.reset();
+        } else {
+            EmptyVidBuf eBuf;
+            if (!AcquireVBuf(*pts, quatBuf, *poseId, eBuf))
+                break;
+
+            PVR_DB("[StreamReceiver th] emptyVBufs.size: " + to_string(emptyVBufs.size()) +
+                   ", Reading sock for " + to_string(*pktSz) + "Bs");
+            async_read(skt, buffer(eBuf.buf, *pktSz), handler);
+            svc.run();
+            svc.reset();
+
+            ReleaseVBuf(eBuf, *pktSz, *pts, ec.value() == 0);
+        }
+        if (ec.value() != 0)
+            break;
+
+        // ack every frame, the PC schedules paths by these round trips
+        async_write(skt, buffer(pts, sizeof(*pts)), handler);
+        svc.run();
+        svc.reset();
+        if (ec.value() != 0)
+            break;
+
+        if (!primary)
+            continue;
+
+        // PVR_DB_I("Time: "+ to_string(
+        // (duration_cast<microseconds>(system_clock::now().time_since_epoch()).count()
+        // - *timestamp) ));
+        fpsStreamRecver = (1000000000.0 / (Clk::now() - oldtime).count());
+        PVR_DB("[StreamReceiver th] ------------------- Stream Receiving @ FPS: " +
+               to_string(fpsStreamRecver) + " De-coding @ FPS : " + to_string(fpsStreamDecoder) +
+               " Rendering @ FPS : " + to_string(fpsRenderer));
+        oldtime = Clk::now();
+
+        updateJavaTextViewFPS(
+            fpsStreamRecver,
+            fpsStreamDecoder,
+            fpsRenderer,
+            fpsBuf[0],
+            fpsBuf[1],
+            fpsBuf[2],
+            fpsBuf[3],
+            fpsBuf[4],
+            ctdBuf[0],
+            ctdBuf[1],
+            networkDelay,
+            (int) ((duration_cast<microseconds>(system_clock::now().time_since_epoch()).count() -
+                    *timestamp) /
+                   1000));
+    }
+    if (ec.value() != 0 && pvrState != PVR_STATE_SHUTDOWN)
+        PVR_DB_I("[StreamReceiver th] video path closed: " + ec.message());
+}
+
+// Copies a complete frame (header + NALs) to a decoder buffer unless a copy of it was already
+// delivered. False on shutdown.
+bool DeliverFrame(const uint8_t *frame, int64_t pts, uint32_t pktSz) {
+    const size_t headerSize = sizeof(PVRMsg::FrameHeader);
+    if (!framesSeen.accept(pts))
+        return true;
+
+    float quat[4];
+    int64_t poseId;
+    memcpy(quat, &frame[offsetof(PVRMsg::FrameHeader, quat)], sizeof(quat));
+    memcpy(&poseId, &frame[offsetof(PVRMsg::FrameHeader, poseId)], 8);
+    EmptyVidBuf eBuf;
+    if (!AcquireVBuf(pts, quat, poseId, eBuf))
+        return false;
+    bool fits = pktSz <= eBuf.bufSz;
+    if (fits)
+        memcpy(eBuf.buf, &frame[headerSize], pktSz);
+    ReleaseVBuf(eBuf, pktSz, pts, fits);
+    return true;
+}
+
+// UDP mode of the video channel (see VideoTransport): rebuilds frames from datagrams and answers
+// each one with a feedback datagram. Idle while the PC streams over TCP, frames that also came
+// over TCP around a transport switch are dropped by pts.
+void ReceiveVideoDatagrams(udp::socket &skt, io_service &svc, udp::endpoint pcEp) {
+    asio::error_code ec;
+    size_t len = 0;
+    function<void(const asio::error_code &, size_t)> handler =
+        [&](const asio::error_code &err, size_t n) {
+            ec = err;
+            len = n;
+        };
+    const size_t headerSize = sizeof(PVRMsg::FrameHeader);
+
+    VideoTransport::FrameAssembler assembler;
+    vector<uint8_t> dgram(VideoTransport::DATAGRAM_SIZE), frame;
+
+    // lets the PC know our address and port before the first frame
+    auto fb = assembler.feedback(-1);
+    skt.send_to(buffer(&fb, sizeof(fb)), pcEp, 0, ec);
+
+    while (pvrState != PVR_STATE_SHUTDOWN) {
+        ec = error::interrupted;   // stays set if the service is stopped
+        skt.async_receive(buffer(dgram), handler);
+        svc.run();
+        svc.reset();
+        if (ec.value() != 0)
+            break;
+        if (!assembler.add(dgram.data(), len, frame) || frame.size() < headerSize)
+            continue;
+
+        int64_t pts;
+        uint32_t pktSz;
+        memcpy(&pts, &frame[0], 8);
+        memcpy(&pktSz, &frame[offsetof(PVRMsg::FrameHeader, size)], 4);
+        if (pktSz != frame.size() - headerSize)
+            continue;
+
+        if (!DeliverFrame(frame.data(), pts, pktSz))
+            break;
+        fb = assembler.feedback(pts);
+        udpFramesLost = fb.framesLost;
+        skt.send_to(buffer(&fb, sizeof(fb)), pcEp, 0, ec);
+    }
+}
+
+// Multiplexed mode: VIDEO_FRAME messages on the talker's receive thread. Waiting for a decoder
+// buffer holds up the talker like it holds up the video connection otherwise.
+void ReceiveFrameMessage(const SharedBuffer &frame) {
+    const size_t headerSize = sizeof(PVRMsg::FrameHeader);
+    if (!muxReceiving || frame.size() < headerSize)
+        return;
+
+    int64_t pts;
+    uint32_t pktSz;
+    memcpy(&pts, &frame[0], 8);
+    memcpy(&pktSz, &frame[offsetof(PVRMsg::FrameHeader, size)], 4);
+    if (pktSz == frame.size() - headerSize)
+        DeliverFrame(frame.data(), pts, pktSz);
+}
+
+// Local IPv4 addresses other than loopback and `except`, one per extra path to the PC.
+vector<address_v4> OtherLocalAddresses(const address &except) {
+    vector<address_v4> addrs;
+    struct ifaddrs *ifap;
+    if (getifaddrs(&ifap) == 0) {
+        for (auto p = ifap; p; p = p->ifa_next) {
+            auto ifaAddr = SockAddrToUint32(p->ifa_addr);
+            if (ifaAddr == 0)
+                continue;
+            address_v4 addr(ifaAddr);
+            if (!addr.is_loopback() && addr != except)
+                addrs.push_back(addr);
+        }
+        freeifaddrs(ifap);
+    }
+    return addrs;
+}
+
 void PVRStartReceiveStreams(uint16_t port) {
     try {
         while (pvrState == PVR_STATE_SHUTDOWN)
             usleep(10000);
         PVR_DB_I("[PVRSockets::PVRStartReceiveStreams] th started.. @p:" + to_string(port));
+        if (audioConfig.packetFrames)
+            PVRStartAudio(audioConfig);
+        if (multiplexed) {
+            // frames come in on the talker, no connections to make
+            quatQueue.clear();
+            emptyVBufs = queue<EmptyVidBuf>();
+            filledVBufs = queue<FilledVidBuf>();
+            framesSeen.reset();
+            m2pMtx.lock();
+            motionToPhoton.clear();
+            m2pMtx.unlock();
+            ResetClientStats();
+            muxReceiving = true;
+            return;
+        }
         strThr = new std::thread([=] {
             try {
                 io_service svc;
-                videoSvc = &svc;
+                delMtx.lock();
+                videoSvcs.push_back(&svc);
+                delMtx.unlock();
                 // udp::socket skt(svc, {udp::v4(), port});
                 tcp::socket skt(svc);
                 asio::error_code ec = error::fault;
@@ -326,99 +758,99 @@ void PVRStartReceiveStreams(uint16_t port) {
 
                 PVR_DB_I("[StreamReceiver th] socket connected pcIP " + pcIP + ":" +
                          to_string(port));
-
-                function<void(const asio::error_code &, size_t)> handler =
-                    [&](const asio::error_code &err, size_t) { ec = err; };
-
-                uint8_t extraBuf[8 + 16 + 4 + 20 + 8 + 8];
-                auto pts = reinterpret_cast<int64_t *>(
-                    extraBuf);   // these values are automatically updated
-                auto quatBuf =
-                    reinterpret_cast<float *>(extraBuf + 8);   // when extraBuf is updated
-                auto pktSz = reinterpret_cast<uint32_t *>(extraBuf + 8 + 16);
-                auto fpsBuf = reinterpret_cast<float *>(extraBuf + 8 + 16 + 4);
-                auto ctdBuf = reinterpret_cast<float *>(extraBuf + 8 + 16 + 4 + 20);
-                auto timestamp = reinterpret_cast<int64_t *>(extraBuf + 8 + 16 + 4 + 20 + 8);
+                skt.set_option(tcp::no_delay(true), ec);   // acks go out right away
 
                 // reinit queues
-                quatQueue = queue<pair<int64_t, vector<float>>>();
+                quatQueue.clear();
                 emptyVBufs = queue<EmptyVidBuf>();
                 filledVBufs = queue<FilledVidBuf>();
-
-                while (pvrState != PVR_STATE_SHUTDOWN) {
-
-                    static Clk::time_point oldtime = Clk::now();
-
-                    async_read(skt, buffer(extraBuf, sizeof(extraBuf)), handler);
-                    svc.run();
-                    svc.reset();
-
-                    auto networkDelay =
-                        (int) ((duration_cast<microseconds>(system_clock::now().time_since_epoch())
-                                    .count() -
-                                *timestamp) /
-                               1000);
-
-                    PVR_DB(
-                        "[StreamReceiver th] recvd 28maxBs with Error: " + to_string(ec.value()) +
-                        ", pts: " + to_string(*pts) + ", pktSz" + to_string(*pktSz));
-
-                    if (ec.value() == 0) {
-                        quatQueue.push({*pts, vector<float>(quatBuf, quatBuf + 4)});
-
-                        while (emptyVBufs.empty() && pvrState != PVR_STATE_SHUTDOWN)
-                            usleep(2000);   // 1ms
-
-                        if (!emptyVBufs.empty()) {
-                            auto eBuf = emptyVBufs.front();
-                            async_read(skt, buffer(eBuf.buf, *pktSz), handler);
-                            svc.run();
-                            svc.reset();
-
-                            PVR_DB("[StreamReceiver th] emptyVBufs.size: " +
-                                   to_string(emptyVBufs.size()) + ", Reading sock for " +
-                                   to_string(*pktSz) + "Bs");
-                            if (ec.value() == 0) {
-                                filledVBufs.push({eBuf.idx, *pktSz, (uint64_t) *pts});
-                                PVR_DB("[StreamReceiver th] pushing onto filledVBufs idx: " +
-                                       to_string(eBuf.idx) + ", size: " + to_string(*pktSz) +
-                                       ", pts:" + to_string(*pts) + "...pop eVbuf ");
-                                emptyVBufs.pop();
-                            } else
-                                break;
+                framesSeen.reset();
+                m2pMtx.lock();
+                motionToPhoton.clear();
+                m2pMtx.unlock();
+                ResetClientStats();
+
+                // Extra paths through the other interfaces (USB tethering, second WiFi band), only
+                // when the PC announced multipath: it doesn't accept them otherwise.
+                vector<std::thread> extraPaths;
+                auto locals = multipath ? OtherLocalAddresses(skt.local_endpoint(ec).address())
+                                        : vector<address_v4>();
+                for (auto local : locals) {
+                    extraPaths.emplace_back([=] {
+                        try {
+                            io_service pathSvc;
+                            delMtx.lock();
+                            videoSvcs.push_back(&pathSvc);
+                            delMtx.unlock();
+
+                            // async so that PVRStopStreams can cancel an unreachable path
+                            tcp::socket pathSkt(pathSvc);
+                            asio::error_code pathEc = error::fault;
+                            pathSkt.open(tcp::v4());
+                            pathSkt.bind({local, 0});
+                            pathSkt.async_connect(
+                                {address::from_string(pcIP), port},
+                                [&](const asio::error_code &err) { pathEc = err; });
+                            pathSvc.run();
+                            pathSvc.reset();
+
+                            if (pathEc.value() == 0) {
+                                pathSkt.set_option(tcp::no_delay(true), pathEc);
+                                PVR_DB_I("[StreamReceiver th] extra path from " +
+                                         local.to_string());
+                                pathsMtx.lock();
+                                extraPathAddrs.push_back(local);
+                                pathsMtx.unlock();
+
+                                ReceiveVideoPath(pathSkt, pathSvc, false);
+
+                                pathsMtx.lock();
+                                extraPathAddrs.erase(
+                                    find(extraPathAddrs.begin(), extraPathAddrs.end(), local));
+                                pathsMtx.unlock();
+                            }
+                            delMtx.lock();
+                            videoSvcs.erase(find(videoSvcs.begin(), videoSvcs.end(), &pathSvc));
+                            delMtx.unlock();
+                        } catch (exception &e) {
+                            PVR_DB_I("[StreamReceiver path th] caught Exception: " +
+                                     to_string(e.what()));
                         }
-                    } else
-                        break;
-
-                    // PVR_DB_I("Time: "+ to_string(
-                    // (duration_cast<microseconds>(system_clock::now().time_since_epoch()).count()
-                    // - *timestamp) ));
-                    fpsStreamRecver = (1000000000.0 / (Clk::now() - oldtime).count());
-                    PVR_DB("[StreamReceiver th] ------------------- Stream Receiving @ FPS: " +
-                           to_string(fpsStreamRecver) +
-                           " De-coding @ FPS : " + to_string(fpsStreamDecoder) +
-                           " Rendering @ FPS : " + to_string(fpsRenderer));
-                    oldtime = Clk::now();
-
-                    updateJavaTextViewFPS(
-                        fpsStreamRecver,
-                        fpsStreamDecoder,
-                        fpsRenderer,
-                        fpsBuf[0],
-                        fpsBuf[1],
-                        fpsBuf[2],
-                        fpsBuf[3],
-                        fpsBuf[4],
-                        ctdBuf[0],
-                        ctdBuf[1],
-                        networkDelay,
-                        (int) ((duration_cast<microseconds>(system_clock::now().time_since_epoch())
-                                    .count() -
-                                *timestamp) /
-                               1000));
+                    });
                 }
+
+                std::thread datagramThr([=] {
+                    try {
+                        io_service udpSvc;
+                        udp::socket udpSkt(udpSvc);
+                        asio::error_code bindEc;
+                        udpSkt.open(udp::v4());
+                        udpSkt.bind({udp::v4(), port}, bindEc);
+                        if (bindEc.value() != 0)
+                            udpSkt.bind({udp::v4(), 0});   // the first feedback tells the PC
+
+                        delMtx.lock();
+                        videoSvcs.push_back(&udpSvc);
+                        delMtx.unlock();
+                        ReceiveVideoDatagrams(udpSkt, udpSvc, {address::from_string(pcIP), port});
+                        delMtx.lock();
+                        videoSvcs.erase(find(videoSvcs.begin(), videoSvcs.end(), &udpSvc));
+                        delMtx.unlock();
+                    } catch (exception &e) {
+                        PVR_DB_I("[StreamReceiver udp th] caught Exception: " +
+                                 to_string(e.what()));
+                    }
+                });
+
+                ReceiveVideoPath(skt, svc, true);
+
+                // the session survives the primary path as long as another one is up
+                for (auto &thr : extraPaths)
+                    thr.join();
+                datagramThr.join();
+
                 delMtx.lock();
-                videoSvc = nullptr;
+                videoSvcs.erase(find(videoSvcs.begin(), videoSvcs.end(), &svc));
                 delMtx.unlock();
             } catch (exception &e) {
                 PVR_DB_I("[PVRStartReceiveStreams th] caught Exception: " + to_string(e.what()));
@@ -432,9 +864,11 @@ void PVRStartReceiveStreams(uint16_t port) {
 void PVRStopStreams() {
     try {
         // talker sends disconnects at segue
+        muxReceiving = false;
+        PVRStopAudio();
         delMtx.lock();
-        if (videoSvc)
-            videoSvc->stop();   // todo: use mutex
+        for (auto svc : videoSvcs)
+            svc->stop();   // todo: use mutex
         delMtx.unlock();
 
         if (strThr) {
@@ -10,6 +10,7 @@
 #include "PVRRenderer.h"
 
 #include "PVRSocketUtils.h"
+#include "Utils/LatencyHistogram.h"
 #include "Utils/ThreadUtils.h"
 #include <iostream>
 #include <queue>
@@ -20,6 +21,12 @@ using namespace asio::ip;
 using namespace std::chrono;
 
 std::vector<float> DequeueQuatAtPts(int64_t pts);
+// pose sample to render time of the frames of the current stream, needs a PC that echoes pose ids
+LatencyHistogram PVRGetMotionToPhoton();
+// the PC streams at half the display rate, the renderer synthesizes the frames in between
+bool PVRIsHalfRate();
+// time a frame spent in the decoder, goes to the PC with the other client stats
+void PVRFrameDecoded(int64_t decodeUs);
 void SendAdditionalData(std::vector<uint16_t> maxSize, std::vector<float> fov, float ipd);
 
 struct EmptyVidBuf {
@@ -44,7 +51,7 @@ FilledVidBuf PVRPopVideoBuf();
 void PVRStartAnnouncer(const char *ip,
                        uint16_t port,
                        void (*segueCb)(),
-                       void (*headerCb)(uint8_t *, size_t),
+                       void (*headerCb)(SharedBuffer),
                        void (*unwindSegueCb)());
 void PVRStopAnnouncer();
 
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// GL side of an asynchronous readback, implemented with pixel pack buffers and fences by PBO in
+// RenderUtils.cpp. Buffers are addressed by their slot in the ring.
+class ReadbackBackend {
+  public:
+    virtual ~ReadbackBackend() = default;
+    // Queues a readback of the current frame into buffer `slot`. Returns its fence, nullptr on
+    // failure.
+    virtual void *read(size_t slot) = 0;
+    // polls, never waits
+    virtual bool signaled(void *fence) = 0;
+    virtual void deleteFence(void *fence) = 0;
+    // copies buffer `slot` to cpuBuf, false if it can't be mapped
+    virtual bool copy(size_t slot, void *cpuBuf) = 0;
+};
+
+// Which buffer the next readback goes to, which ones are in flight, their fences and tags.
+// Readbacks are collected in the order they were queued.
+class ReadbackRing {
+    struct Slot {
+        void *fence = nullptr;
+        int64_t tag = 0;
+    };
+
+    std::vector<Slot> slots;
+    size_t head = 0;   // next slot to read into
+    size_t pending = 0;
+    size_t dropped = 0;
+
+  public:
+    explicit ReadbackRing(size_t size) : slots((std::max)(size, (size_t) 2)) {}
+
+    // the fences belong to the backend: moved, never copied, and the source is left empty
+    ReadbackRing(const ReadbackRing &) = delete;
+    ReadbackRing &operator=(const ReadbackRing &) = delete;
+    ReadbackRing(ReadbackRing &&other) noexcept { *this = std::move(other); }
+    ReadbackRing &operator=(ReadbackRing &&other) noexcept {
+        if (this != &other) {
+            slots = std::move(other.slots);
+            head = other.head;
+            pending = other.pending;
+            dropped = other.dropped;
+            other.slots.clear();
+            other.head = other.pending = 0;
+        }
+        return *this;
+    }
+
+    size_t size() const { return slots.size(); }
+
+    // Returns false without reading if every buffer is still in flight (the frame is dropped)
+    // or the backend failed.
+    bool download(ReadbackBackend &backend, int64_t tag) {
+        if (slots.empty())
+            return false;
+        if (pending == slots.size()) {
+            dropped++;
+            return false;
+        }
+        auto &slot = slots[head];
+        slot.fence = backend.read(head);
+        if (!slot.fence)
+            return false;
+        slot.tag = tag;
+        head = (head + 1) % slots.size();
+        pending++;
+        return true;
+    }
+
+    // Copies the oldest readback out once its fence has signaled. Returns false if there is none
+    // or the GPU is not done with it yet.
+    bool collect(ReadbackBackend &backend, void *cpuBuf, int64_t *tag) {
+        if (pending == 0)
+            return false;
+        size_t index = (head + slots.size() - pending) % slots.size();
+        auto &slot = slots[index];
+        if (!backend.signaled(slot.fence))
+            return false;
+        backend.deleteFence(slot.fence);
+        slot.fence = nullptr;
+        pending--;
+
+        if (tag)
+            *tag = slot.tag;
+        return backend.copy(index, cpuBuf);
+    }
+
+    // deletes the fences of the readbacks in flight, before the buffers go
+    void clear(ReadbackBackend &backend) {
+        for (auto &slot : slots) {
+            if (slot.fence)
+                backend.deleteFence(slot.fence);
+            slot.fence = nullptr;
+        }
+        pending = 0;
+    }
+
+    size_t inFlight() const { return pending; }
+    size_t droppedFrames() const { return dropped; }
+};
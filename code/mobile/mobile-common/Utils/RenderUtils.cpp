@@ -2,6 +2,8 @@
 #include "PVRGlobals.h"
 #include "Utils/StrUtils.h"
 
+#include <algorithm>
+
 using namespace std;
 
 void glCheckError(string glFuncName);
@@ -273,38 +275,105 @@ void Renderer::render(Eigen::Matrix4f mat) {
     }
 }
 
-PBO::PBO(void *cpuBuf, int w, int h, int sz, GLenum fmt, GLenum type)
-    : cpuBuf(cpuBuf), w(w), h(h), sz(sz), fmt(fmt), type(type) {
+PBO::PBO(int w, int h, int sz, GLenum fmt, GLenum type, int ringSize)
+    : w(w), h(h), sz(sz), fmt(fmt), type(type), ring(max(ringSize, 2)) {
     try {
-        glGenBuffers(1, &pbo);
+        bufs.resize(ring.size());
+        glGenBuffers((GLsizei) bufs.size(), bufs.data());
         glCheckError("PBO::PBO::glGenBuffers");
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
-        glCheckError("PBO::PBO::glBindBuffer");
-        glBufferData(GL_PIXEL_PACK_BUFFER, sz, nullptr, GL_DYNAMIC_READ);
-        glCheckError("PBO::PBO::glBufferData");
+        for (auto buf : bufs) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buf);
+            glCheckError("PBO::PBO::glBindBuffer");
+            glBufferData(GL_PIXEL_PACK_BUFFER, sz, nullptr, GL_STREAM_READ);
+            glCheckError("PBO::PBO::glBufferData");
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     } catch (exception e) {
         PVR_DB_I("RenderUtils::PBO::PBO:: Caught Exception: " + string(e.what()));
     }
 }
 
-void PBO::download() {
+PBO::~PBO() { release(); }
+
+PBO::PBO(PBO &&other) noexcept
+    : w(other.w), h(other.h), sz(other.sz), fmt(other.fmt), type(other.type),
+      bufs(move(other.bufs)), ring(move(other.ring)) {
+    other.bufs.clear();
+}
+
+PBO &PBO::operator=(PBO &&other) noexcept {
+    if (this != &other) {
+        release();
+        w = other.w;
+        h = other.h;
+        sz = other.sz;
+        fmt = other.fmt;
+        type = other.type;
+        bufs = move(other.bufs);
+        ring = move(other.ring);
+        other.bufs.clear();
+    }
+    return *this;
+}
+
+void PBO::release() {
+    ring.clear(*this);
+    if (!bufs.empty())
+        glDeleteBuffers((GLsizei) bufs.size(), bufs.data());
+    bufs.clear();
+}
+
+bool PBO::download(int64_t tag) {
     try {
-        glReadBuffer(GL_COLOR_ATTACHMENT0);
-        glCheckError("PBO::download::glReadBuffer");
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
-        glCheckError("PBO::download::glBindBuffer");
-        glReadPixels(0, 0, w, h, fmt, type, nullptr);
-        glCheckError("PBO::download::glReadPixels");
-        void *gBuf = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sz, GL_MAP_READ_BIT);
-        glCheckError("PBO::download::glMapBufferRange");
-        memcpy(cpuBuf, gBuf, sz);
-        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
-        glCheckError("PBO::download::glUnmapBuffer");
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-        glCheckError("PBO::download::glBindBuffer");
+        return ring.download(*this, tag);
     } catch (exception e) {
         PVR_DB_I("RenderUtils::PBO::download:: Caught Exception: " + string(e.what()));
     }
+    return false;
+}
+
+bool PBO::collect(void *cpuBuf, int64_t *tag) {
+    try {
+        return ring.collect(*this, cpuBuf, tag);
+    } catch (exception e) {
+        PVR_DB_I("RenderUtils::PBO::collect:: Caught Exception: " + string(e.what()));
+    }
+    return false;
+}
+
+void *PBO::read(size_t slot) {
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glCheckError("PBO::read::glReadBuffer");
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, bufs[slot]);
+    glCheckError("PBO::read::glBindBuffer");
+    glReadPixels(0, 0, w, h, fmt, type, nullptr);
+    glCheckError("PBO::read::glReadPixels");
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glCheckError("PBO::read::glFenceSync");
+    return fence;
+}
+
+bool PBO::signaled(void *fence) {
+    // zero timeout: only polls, the flush makes sure the fence eventually signals
+    auto status = glClientWaitSync((GLsync) fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    glCheckError("PBO::signaled::glClientWaitSync");
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void PBO::deleteFence(void *fence) { glDeleteSync((GLsync) fence); }
+
+bool PBO::copy(size_t slot, void *cpuBuf) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, bufs[slot]);
+    glCheckError("PBO::copy::glBindBuffer");
+    void *gBuf = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sz, GL_MAP_READ_BIT);
+    glCheckError("PBO::copy::glMapBufferRange");
+    if (gBuf)
+        memcpy(cpuBuf, gBuf, sz);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glCheckError("PBO::copy::glUnmapBuffer");
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return gBuf != nullptr;
 }
 
 void glCheckError(string glFuncName) {
@@ -1,11 +1,13 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <string>
 #include <vector>
 
 #include "Geometry"
+#include "ReadbackRing.h"
 
 #ifdef __ANDROID__
 // clang-format off
@@ -67,20 +69,46 @@ class Renderer {
     void PVRPrintGLDesc();
 };
 
-class PBO {
-    void *cpuBuf;
+// Asynchronous readback through a ring of pixel pack buffers.
+// download() only queues glReadPixels into the next free buffer and inserts a fence; collect()
+// copies out the oldest readback once its fence has signaled, typically a few frames later.
+// Neither call waits on the GPU.
+class PBO : ReadbackBackend {
     int w, h, sz;
     GLenum fmt, type;
-    GLuint pbo;
+    std::vector<GLuint> bufs;
+    ReadbackRing ring;
+
+    void release();
+
+    void *read(size_t slot) override;
+    bool signaled(void *fence) override;
+    void deleteFence(void *fence) override;
+    bool copy(size_t slot, void *cpuBuf) override;
 
   public:
-    PBO(void *cpuBuf,
-        int width,
+    PBO(int width,
         int height,
         int byteSize,
         GLenum fmt = GL_RGBA,
-        GLenum glType = GL_UNSIGNED_SHORT);
+        GLenum glType = GL_UNSIGNED_BYTE,
+        int ringSize = 3);
+    ~PBO();
+
+    // owns its buffers and fences: moved, never copied
+    PBO(const PBO &) = delete;
+    PBO &operator=(const PBO &) = delete;
+    PBO(PBO &&other) noexcept;
+    PBO &operator=(PBO &&other) noexcept;
 
-    // I should always memcpy all the data to the cpu before processing
-    void download();
-};
\ No newline at end of file
+    // Queues a readback of the current read framebuffer. tag is handed back by collect() (frame
+    // index, pts...). Returns false and drops the frame if every buffer is still in flight.
+    bool download(int64_t tag = 0);
+
+    // Copies the oldest finished readback to cpuBuf (byteSize bytes). Returns false if there is
+    // none or the GPU is not done with it yet.
+    bool collect(void *cpuBuf, int64_t *tag = nullptr);
+
+    size_t inFlight() { return ring.inFlight(); }
+    size_t droppedFrames() { return ring.droppedFrames(); }
+};
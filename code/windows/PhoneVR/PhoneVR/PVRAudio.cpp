@@ -0,0 +1,232 @@
+#include "PVRAudio.h"
+
+#include <Audioclient.h>
+#include <mmdeviceapi.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+#include "PVRFileManager.h"
+#include "PVRSocketUtils.h"
+#include "PVRSockets.h"
+#include "Utils/AudioCodec.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace asio;
+using namespace asio::ip;
+
+namespace {
+    std::thread *audioThr = nullptr;
+    atomic<bool> audioRunning{false};
+
+    void CheckHr(HRESULT hr, const char *what) {
+        if (FAILED(hr))
+            throw runtime_error(string(what) + " failed: " + str_fmt("0x%08x", (unsigned) hr));
+    }
+
+    // What the PC plays: loopback capture of the default output device. Shared mode delivers the
+    // mixer's format, usually 32 bit float at 48 kHz, converted here to 16 bit stereo at
+    // SAMPLE_RATE. Nothing at all comes while nothing plays, the phone plays the gap as silence.
+    class LoopbackSource : public Audio::Source {
+        IMMDevice *device = nullptr;
+        IAudioClient *client = nullptr;
+        IAudioCaptureClient *capture = nullptr;
+        WAVEFORMATEX *mix = nullptr;
+        bool isFloat = false;
+
+        deque<int16_t> fifo;        // converted frames not handed out yet
+        int64_t fifoStartNs = -1;   // Clk time of the first one
+        double phase = 0;           // resampler position between prev and the next input frame
+        float prev[Audio::CHANNELS] = {};
+
+        void convert(const uint8_t *data, UINT32 frames, bool silent) {
+            double step = (double) mix->nSamplesPerSec / Audio::SAMPLE_RATE;
+            for (UINT32 i = 0; i < frames; i++) {
+                float cur[Audio::CHANNELS];
+                for (int c = 0; c < Audio::CHANNELS; c++) {
+                    int ch = (std::min)(c, mix->nChannels - 1);   // mono to both sides
+                    size_t idx = (size_t) i * mix->nChannels + ch;
+                    if (silent)
+                        cur[c] = 0;
+                    else if (isFloat)
+                        cur[c] = reinterpret_cast<const float *>(data)[idx];
+                    else
+                        cur[c] = reinterpret_cast<const int16_t *>(data)[idx] / 32768.0f;
+                }
+                for (; phase < 1; phase += step)
+                    for (int c = 0; c < Audio::CHANNELS; c++) {
+                        float v = prev[c] + (cur[c] - prev[c]) * (float) phase;
+                        fifo.push_back((int16_t) (std::clamp(v, -1.0f, 1.0f) * 32767));
+                    }
+                phase -= 1;
+                copy(cur, cur + Audio::CHANNELS, prev);
+            }
+        }
+
+      public:
+        LoopbackSource() {
+            IMMDeviceEnumerator *enumerator = nullptr;
+            CheckHr(CoCreateInstance(__uuidof(MMDeviceEnumerator),
+                                     nullptr,
+                                     CLSCTX_ALL,
+                                     __uuidof(IMMDeviceEnumerator),
+                                     (void **) &enumerator),
+                    "CoCreateInstance(MMDeviceEnumerator)");
+            auto hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+            enumerator->Release();
+            CheckHr(hr, "GetDefaultAudioEndpoint");
+            CheckHr(
+                device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void **) &client),
+                "IMMDevice::Activate");
+            CheckHr(client->GetMixFormat(&mix), "GetMixFormat");
+
+            isFloat = mix->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+            if (mix->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+                isFloat = reinterpret_cast<WAVEFORMATEXTENSIBLE *>(mix)->SubFormat ==
+                          KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
+            if (isFloat ? mix->wBitsPerSample != 32 : mix->wBitsPerSample != 16)
+                throw runtime_error("unsupported mix format, " + to_string(mix->wBitsPerSample) +
+                                    " bits");
+
+            // 20 ms, in 100 ns units
+            CheckHr(client->Initialize(AUDCLNT_SHAREMODE_SHARED,
+                                       AUDCLNT_STREAMFLAGS_LOOPBACK,
+                                       200000,
+                                       0,
+                                       mix,
+                                       nullptr),
+                    "IAudioClient::Initialize");
+            CheckHr(client->GetService(__uuidof(IAudioCaptureClient), (void **) &capture),
+                    "GetService(IAudioCaptureClient)");
+            CheckHr(client->Start(), "IAudioClient::Start");
+            PVR_DB_I("[PVRAudio] capturing " + to_string(mix->nChannels) + " channels at " +
+                     to_string(mix->nSamplesPerSec) + " Hz");
+        }
+
+        ~LoopbackSource() override {
+            if (client)
+                client->Stop();
+            if (capture)
+                capture->Release();
+            if (client)
+                client->Release();
+            if (device)
+                device->Release();
+            CoTaskMemFree(mix);
+        }
+
+        bool read(int16_t *pcm, int frames, Clk::time_point &captureTime) override {
+            size_t wanted = (size_t) frames * Audio::CHANNELS;
+            while (fifo.size() < wanted && audioRunning) {
+                UINT32 packetFrames = 0;
+                CheckHr(capture->GetNextPacketSize(&packetFrames), "GetNextPacketSize");
+                if (packetFrames == 0) {
+                    sleep_for(1ms);
+                    continue;
+                }
+
+                BYTE *data;
+                DWORD flags;
+                UINT64 qpcPosition;
+                CheckHr(capture->GetBuffer(&data, &packetFrames, &flags, nullptr, &qpcPosition),
+                        "GetBuffer");
+                // qpcPosition is in 100 ns units, steady_clock (Clk) counts QPC ticks in ns
+                if (fifo.empty())
+                    fifoStartNs = (int64_t) qpcPosition * 100;
+                convert(data, packetFrames, (flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0);
+                CheckHr(capture->ReleaseBuffer(packetFrames), "ReleaseBuffer");
+            }
+            if (fifo.size() < wanted)
+                return false;
+
+            copy_n(fifo.begin(), wanted, pcm);
+            fifo.erase(fifo.begin(), fifo.begin() + wanted);
+            captureTime = Clk::time_point(nanoseconds(fifoStartNs));
+            fifoStartNs += Audio::framesToNs(frames);
+            return true;
+        }
+    };
+
+    unique_ptr<Audio::Source> MakeSource(const string &name) {
+        if (name == "tone")
+            return unique_ptr<Audio::Source>(new Audio::SyntheticSource(440, Audio::SAMPLE_RATE));
+        if (name != "loopback")
+            return unique_ptr<Audio::Source>(new Audio::WavSource(name));
+        return unique_ptr<Audio::Source>(new LoopbackSource());
+    }
+}   // namespace
+
+PVRMsg::AudioConfig PVRAudioConfig() {
+    PVRMsg::AudioConfig config = {};
+    if (!PVRProp<bool>({AUDIO_KEY}))
+        return config;
+#ifdef PVR_OPUS
+    config.codec = Audio::OPUS;
+#else
+    config.codec = Audio::PCM16;
+#endif
+    config.channels = Audio::CHANNELS;
+    config.packetFrames = (uint16_t) Audio::packetFrames((Audio::Codec) config.codec,
+                                                         PVRProp<double>({AUDIO_PACKET_MS_KEY}));
+    config.sampleRate = Audio::SAMPLE_RATE;
+    config.port = PVRProp<uint16_t>({AUDIO_PORT_KEY});
+    return config;
+}
+
+void PVRStartAudioStreamer(string ip, const PVRMsg::AudioConfig &config) {
+    audioRunning = true;
+    audioThr = new std::thread([=] {
+        CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+        try {
+            auto source = MakeSource(PVRProp<string>({AUDIO_SOURCE_KEY}));
+            auto encoder =
+                Audio::makeEncoder((Audio::Codec) config.codec, PVRProp<int>({AUDIO_BITRATE_KEY}));
+
+            io_service svc;
+            udp::socket skt(svc);
+            skt.open(udp::v4());
+            udp::endpoint ep(address::from_string(ip), config.port);
+            PVR_DB_I("[PVRAudio th] streaming " +
+                     string(config.codec == Audio::OPUS ? "Opus" : "PCM") + " in packets of " +
+                     to_string(config.packetFrames) + " frames to UDP port " +
+                     to_string(config.port));
+
+            vector<int16_t> pcm((size_t) config.packetFrames * Audio::CHANNELS);
+            uint8_t dgram[sizeof(Audio::PacketHeader) + Audio::MAX_PAYLOAD];
+            Audio::PacketHeader hdr = {};
+            hdr.frames = config.packetFrames;
+            hdr.codec = config.codec;
+            int64_t next = -1;
+            Clk::time_point captureTime;
+            asio::error_code ec;
+
+            while (audioRunning && source->read(pcm.data(), config.packetFrames, captureTime)) {
+                // packets of one run line up exactly, unless capture skipped or paused
+                auto position = Audio::ptsToPosition(PVRStreamClockUs(captureTime));
+                if (next < 0 || abs(position - next) > Audio::nsToFrames(20'000'000))
+                    next = position;
+                hdr.position = next;
+                next += config.packetFrames;
+
+                auto size = encoder->encode(
+                    pcm.data(), config.packetFrames, &dgram[sizeof(hdr)], Audio::MAX_PAYLOAD);
+                if (size == 0)
+                    continue;
+                memcpy(dgram, &hdr, sizeof(hdr));
+                hdr.seq++;
+                skt.send_to(buffer(dgram, sizeof(hdr) + size), ep, 0, ec);
+            }
+            PVR_DB_I("[PVRAudio th] audio stopped");
+        } catch (const exception &err) {
+            PVR_DB_I("[PVRAudio th] caught exception: " + string(err.what()));
+        }
+        CoUninitialize();
+    });
+}
+
+void PVRStopAudioStreamer() {
+    audioRunning = false;
+    EndThread(audioThr);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+#include "PVRGlobals.h"
+#include "PVRMessages.h"
+
+// what goes to the phone in AUDIO_CONFIG, packetFrames is 0 with audio disabled
+PVRMsg::AudioConfig PVRAudioConfig();
+void PVRStartAudioStreamer(std::string ip, const PVRMsg::AudioConfig &config);
+void PVRStopAudioStreamer();
@@ -1,5 +1,6 @@
 #pragma once
 #include "nlohmann/json.hpp"   //awesome lib!
+#include <algorithm>
 #include <fstream>
 #include <optional>
 #include <string>
@@ -29,7 +30,30 @@ ccc KEYINT_MAX_KEY = "keyint_max";
 ccc I_REFRESH_KEY = "intra_refresh";
 ccc BITRATE_KEY = "bitrate";
 ccc PROFILE_KEY = "profile";
+ccc LOSS_RECOVERY_KEY = "loss_recovery";               // "reference" (acknowledged frame) or "idr"
+ccc DPB_SIZE_KEY = "dpb_size";                         // frames a recovery frame can reach back
+ccc CONSTANT_FRAME_SIZE_KEY = "constant_frame_size";   // intra refresh and a one frame VBV
+ccc SLICE_MAX_SIZE_KEY = "slice_max_size";             // bytes, about one UDP datagram
+ccc SIMULCAST_TIERS_KEY = "simulcast_tiers";           // quality tiers to pick from, 1 to 3
+ccc LENS_MASK_KEY = "lens_mask";                       // flat and cheapest outside the lens
 ccc CONN_TIMEOUT = "connection_timeout";
+ccc PACING_FRACTION_KEY = "pacing_frame_fraction";   // <= 0 disables video pacing
+ccc LINK_RATE_KEY = "link_rate_mbps";                 // initial link estimate, 0 if unknown
+ccc LINK_PROBE_KEY = "startup_link_probe";            // measure the link before the first frame
+ccc MULTIPATH_KEY = "multipath";                      // accept video paths from more interfaces
+ccc DUPLICATE_KEYFRAMES_KEY = "multipath_duplicate_keyframes";
+ccc DUPLICATE_POSES_KEY = "multipath_duplicate_poses";
+ccc VIDEO_TRANSPORT_KEY = "video_transport";           // "tcp" or "udp", the one to start with
+ccc TRANSPORT_SWITCHING_KEY = "transport_switching";   // switch by measured stalls and loss
+ccc FEC_GROUP_KEY = "fec_group_size";                  // UDP datagrams per parity one, 0: no FEC
+ccc MULTIPLEX_KEY = "multiplex";                       // video and poses on the connection port
+ccc HALF_RATE_KEY = "half_rate";                       // stream game_fps / 2, the phone fills in
+ccc HEARTBEAT_KEY = "heartbeat_ms";                    // RTT and liveness pings, 0 disables
+ccc AUDIO_KEY = "audio";                               // stream what the PC plays to the phone
+ccc AUDIO_PORT_KEY = "audio_stream_port";
+ccc AUDIO_PACKET_MS_KEY = "audio_packet_ms";           // 2.5, 5 or 10
+ccc AUDIO_BITRATE_KEY = "audio_bitrate_kbps";          // Opus only
+ccc AUDIO_SOURCE_KEY = "audio_source";                 // "loopback", "tone" or a WAV file path
 
 namespace {
     const nlohmann::json defSets = {{ENABLE_KEY, true},
@@ -42,6 +66,23 @@ namespace {
                                     {POSE_PORT_KEY, 51423},
                                     {CONN_PORT_KEY, 33333},
                                     {CONN_TIMEOUT, 5},
+                                    {PACING_FRACTION_KEY, 0.0},   // frames arrive ~4 ms later paced
+                                    {LINK_RATE_KEY, 0},
+                                    {LINK_PROBE_KEY, true},
+                                    {MULTIPATH_KEY, false},
+                                    {DUPLICATE_KEYFRAMES_KEY, true},
+                                    {DUPLICATE_POSES_KEY, false},
+                                    {VIDEO_TRANSPORT_KEY, "tcp"},
+                                    {TRANSPORT_SWITCHING_KEY, true},
+                                    {FEC_GROUP_KEY, 8},
+                                    {MULTIPLEX_KEY, false},
+                                    {HALF_RATE_KEY, false},
+                                    {HEARTBEAT_KEY, 100},
+                                    {AUDIO_KEY, false},   // 1.5 Mbps of PCM without libopus
+                                    {AUDIO_PORT_KEY, 15244},
+                                    {AUDIO_PACKET_MS_KEY, 5},
+                                    {AUDIO_BITRATE_KEY, 128},
+                                    {AUDIO_SOURCE_KEY, "loopback"},
                                     {ENCODER_SECT,
                                      {
                                          {PRESET_KEY, "ultrafast"},
@@ -53,6 +94,12 @@ namespace {
                                          {I_REFRESH_KEY, false},
                                          {BITRATE_KEY, -1},
                                          {PROFILE_KEY, "baseline"},
+                                         {LOSS_RECOVERY_KEY, "reference"},
+                                         {DPB_SIZE_KEY, 8},
+                                         {CONSTANT_FRAME_SIZE_KEY, false},
+                                         {SLICE_MAX_SIZE_KEY, 1200},
+                                         {SIMULCAST_TIERS_KEY, 1},
+                                         {LENS_MASK_KEY, false},   // see LensMask.h
                                      }}};
 
     // const wchar_t *const setsFile = L"C:\\Program Files\\PhoneVR\\pvrsettings.json";
@@ -108,3 +155,9 @@ template <typename T> T PVRProp(std::vector<std::string> propPath) {
     PVR_DB_I("Using default setting value: " + fullPath + " = " + to_string(res));
     return res;
 }
+
+// frames per second SteamVR renders and the PC streams, the phone displays game_fps
+inline int PVRStreamFps() {
+    int fps = PVRProp<int>({GAME_FPS_KEY});
+    return PVRProp<bool>({HALF_RATE_KEY}) ? (std::max)(fps / 2, 1) : fps;
+}
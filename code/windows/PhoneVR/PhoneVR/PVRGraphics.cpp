@@ -3,6 +3,9 @@
 #include <d3d11.h>
 
 #include "PVRGlobals.h"
+#include "Utils/CapturePipeline.h"
+#include "Utils/HandleCache.h"
+#include "Utils/LensMask.h"
 #include <amp_graphics.h>
 #include <optional>
 
@@ -21,9 +24,6 @@ namespace {
     ID3D11Device *dxDev;
     ID3D11DeviceContext *dxDevCtx;
 
-    uint64_t curHdl = 0;
-    int whichBuf;
-
     void debugHr(HRESULT hr) {
         LPWSTR output;
         FormatMessage(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS |
@@ -36,10 +36,6 @@ namespace {
                       NULL);
         PVR_DB_I(wstring(output));
     }
-
-    mutex texMtx;
-    bool gRunning = false;
-    thread *gThr;
 }   // namespace
 
 #define RELEASE(obj)                                                                               \
@@ -85,89 +81,170 @@ void PVRInitDX() {
                                   &dxDevCtx));
 }
 
-void PVRUpdTexHdl(uint64_t texHdl, int whichBuf) {
-    if (gRunning) {
-        // wait to obtain TextureMutex lock = Wait for the Renderer to complete rendering of present
-        // frame
-        texMtx.lock();
-        ::whichBuf = whichBuf;
-        curHdl = texHdl;
-        texMtx.unlock();
-        while (curHdl != 0 && gRunning)
-            sleep_for(500us);
-    }
-}
+namespace {
+    const int STAGING_SLOTS = 2;    // frames between Present and the encoder's buffers
+    const size_t SHARED_TEXS = 8;   // swap chain textures kept open, the app cycles through a few
+    const auto ACQUIRE_TIMEOUT = 100ms;
 
-void PVRStartGraphics(vector<vector<uint8_t *>> vvbuf, uint32_t inpWidth, uint32_t inpHeight) {
-    gRunning = true;
-    gThr = new thread([=] {
-        vector<vector<array_view<uint, 2>>> yuvBufViews;   // output
+    struct SharedTex {
+        ID3D11Texture2D *tex = nullptr;
+        IDXGIKeyedMutex *mtx = nullptr;
+    };
+
+    class D3DSharedTexs : public HandleCache::Backend<SharedTex> {
+        uint64_t lastRejected = 0;
 
-        for (auto vbuf : vvbuf)   // divide width by 4: store 4 bytes in an uint
-            yuvBufViews.push_back(
-                {array_view<uint, 2>(inpHeight, inpWidth / 4, reinterpret_cast<uint *>(vbuf[0])),
-                 array_view<uint, 2>(
-                     inpHeight / 2, inpWidth / 4 / 2, reinterpret_cast<uint *>(vbuf[1])),
-                 array_view<uint, 2>(
-                     inpHeight / 2, inpWidth / 4 / 2, reinterpret_cast<uint *>(vbuf[2]))});
-
-        D3D11_TEXTURE2D_DESC texDesc = {};
-        texDesc.Width = inpWidth;
-        texDesc.Height = inpHeight;
-        texDesc.MipLevels = 1;
-        texDesc.ArraySize = 1;
-        texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-        texDesc.SampleDesc.Count = 1;
-        texDesc.Usage = D3D11_USAGE_DEFAULT;
-        texDesc.BindFlags =
-            D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
-        texDesc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
-        ID3D11Texture2D *stagingTex;
-        OK_OR_DEBUG(dxDev->CreateTexture2D(&texDesc, nullptr, &stagingTex));
-        auto accView = create_accelerator_view(dxDev);
-        auto ampTex = make_texture<unorm4, 2>(accView, stagingTex);
-
-        const int texWidth = ampTex.extent[1], texHeight = ampTex.extent[0];
-
-        while (curHdl == 0 && gRunning)
-            sleep_for(500us);
-        while (gRunning) {
-
-            // Lock texture Handle until this frame is completely rendered
-            texMtx.lock();
-
-            if (!dxDev) {
-                texMtx.unlock();
-                continue;
+      public:
+        bool open(uint64_t handle, const HandleCache::Context &context, SharedTex &res) override {
+            OK_OR_DEBUG(dxDev->OpenSharedResource(
+                (HANDLE) handle, __uuidof(ID3D11Texture2D), (void **) &res.tex));
+            if (!res.tex)
+                return false;
+            D3D11_TEXTURE2D_DESC desc;
+            res.tex->GetDesc(&desc);
+            if (desc.Width != context.width || desc.Height != context.height) {
+                // CopyResource would do nothing
+                if (handle != lastRejected)
+                    PVR_DB_I("[D3DSharedTexs] shared texture is " + to_string(desc.Width) + "x" +
+                             to_string(desc.Height) + ", not " + to_string(context.width) + "x" +
+                             to_string(context.height));
+                lastRejected = handle;
+                RELEASE(res.tex);
+                return false;
             }
+            QUERY(res.tex, res.mtx);
+            if (!res.mtx) {
+                RELEASE(res.tex);
+                return false;
+            }
+            return true;
+        }
 
-            static Clk::time_point oldtime;
-            oldtime = Clk::now();
+        void close(SharedTex &res) override {
+            RELEASE(res.mtx);
+            RELEASE(res.tex);
+        }
+    };
+
+    // outlives the streams, the app keeps its swap chain when the phone reconnects
+    HandleCache::Cache<SharedTex> sharedTexs(make_unique<D3DSharedTexs>(), SHARED_TEXS);
+
+    // Staging textures the shared ones are copied to, the AMP kernel converting them into the
+    // encoder's buffers and the futures of those buffers' readback.
+    class D3DCapture : public CapturePipeline::Backend {
+        const uint32_t width, height;
+        const int mbW, mbH;
+        vector<uint> mbMask32;   // AMP has no byte arrays, one uint per macroblock: 1 if painted
+        array_view<const uint, 2> maskView;
+        accelerator_view accView;
+        vector<ID3D11Texture2D *> stagingTexs;
+        vector<unique_ptr<texture<unorm4, 2>>> ampTexs;
+        vector<vector<array_view<uint, 2>>> yuvBufViews;   // output
+        vector<vector<completion_future>> readbacks;       // of each slot
+
+        static vector<uint> paintedMask(const vector<uint8_t> &mbMask, size_t count) {
+            vector<uint> mask(count);
+            if (mbMask.size() == count)
+                for (size_t i = 0; i < count; i++)
+                    mask[i] = mbMask[i] == LensMask::PAINTED;
+            return mask;
+        }
 
-            // PVR_DB(curHdl);
-            ID3D11Texture2D *inpTex;
-            OK_OR_DEBUG(dxDev->OpenSharedResource(
-                (HANDLE) curHdl, __uuidof(ID3D11Texture2D), (void **) &inpTex));
-            IDXGIKeyedMutex *dxMtx;
-            QUERY(inpTex, dxMtx);
-            if (SUCCEEDED(dxMtx->AcquireSync(0, 500))) {
-                dxDevCtx->CopyResource(stagingTex, inpTex);   // texAmp is automatically updated
-                dxMtx->ReleaseSync(0);
+      public:
+        D3DCapture(const vector<vector<uint8_t *>> &vvbuf,
+                   uint32_t width,
+                   uint32_t height,
+                   const vector<uint8_t> &mbMask,
+                   int slots)
+            : width(width), height(height),
+              mbW((width + LensMask::MB_SIZE - 1) / LensMask::MB_SIZE),
+              mbH((height + LensMask::MB_SIZE - 1) / LensMask::MB_SIZE),
+              mbMask32(paintedMask(mbMask, (size_t) mbW * mbH)), maskView(mbH, mbW, mbMask32),
+              accView(create_accelerator_view(dxDev)), readbacks(slots) {
+            for (auto vbuf : vvbuf)   // divide width by 4: store 4 bytes in an uint
+                yuvBufViews.push_back(
+                    {array_view<uint, 2>(height, width / 4, reinterpret_cast<uint *>(vbuf[0])),
+                     array_view<uint, 2>(
+                         height / 2, width / 4 / 2, reinterpret_cast<uint *>(vbuf[1])),
+                     array_view<uint, 2>(
+                         height / 2, width / 4 / 2, reinterpret_cast<uint *>(vbuf[2]))});
+
+            D3D11_TEXTURE2D_DESC texDesc = {};
+            texDesc.Width = width;
+            texDesc.Height = height;
+            texDesc.MipLevels = 1;
+            texDesc.ArraySize = 1;
+            texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            texDesc.SampleDesc.Count = 1;
+            texDesc.Usage = D3D11_USAGE_DEFAULT;
+            texDesc.BindFlags =
+                D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+            texDesc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
+            for (int i = 0; i < slots; i++) {
+                ID3D11Texture2D *stagingTex = nullptr;
+                OK_OR_DEBUG(dxDev->CreateTexture2D(&texDesc, nullptr, &stagingTex));
+                stagingTexs.push_back(stagingTex);
+                ampTexs.emplace_back(
+                    new texture<unorm4, 2>(make_texture<unorm4, 2>(accView, stagingTex)));
             }
-            RELEASE(dxMtx);
-            RELEASE(inpTex);
+        }
+
+        ~D3DCapture() {
+            for (auto &tex : stagingTexs)
+                RELEASE(tex);
+        }
 
-            auto outY = yuvBufViews[whichBuf][0];
-            auto outU = yuvBufViews[whichBuf][1];
-            auto outV = yuvBufViews[whichBuf][2];
+        bool copy(uint64_t handle, int slot) override {
+            HRESULT hr = S_OK;
+            bool copied = sharedTexs.use(handle, [&](SharedTex &inp) {
+                hr = inp.mtx->AcquireSync(0, 500);
+                if (hr != S_OK)   // WAIT_TIMEOUT and WAIT_ABANDONED succeed too
+                    return false;
+                {
+                    // AMP works on the same immediate context from the completion thread
+                    scoped_d3d_access_lock lock(accView);
+                    dxDevCtx->CopyResource(stagingTexs[slot], inp.tex);   // ampTex sees it
+                }
+                inp.mtx->ReleaseSync(0);
+                return true;
+            });
+            if (FAILED(hr) || hr == WAIT_ABANDONED)   // its owner is gone, open it again
+                sharedTexs.erase(handle);
+            return copied;
+        }
+
+        void convert(int slot, int out) override {
+            auto outY = yuvBufViews[out][0];
+            auto outU = yuvBufViews[out][1];
+            auto outV = yuvBufViews[out][2];
+            // written completely, the old content needn't go to the GPU first
+            outY.discard_data();
+            outU.discard_data();
+            outV.discard_data();
+            auto &ampTex = *ampTexs[slot];
+            auto maskView = this->maskView;
+            const uint maskedY = LensMask::MASKED_Y * 0x01010101u,
+                       maskedUV = LensMask::MASKED_UV * 0x01010101u;
 
             // gpu kernel:
             concurrency::parallel_for_each(
-                concurrency::extent<2>(inpHeight / 2, inpWidth / 8),
+                accView,
+                concurrency::extent<2>(height / 2, width / 8),
                 [ =, &ampTex ](index<2> idx) restrict(amp) {
                     // get texture coordinates
                     int ty = idx[0] * 2, tx = idx[1] * 8;
 
+                    // outside the lens: flat color, the texture isn't read. A 16x16 macroblock
+                    // is 8 rows and 2 columns of threads
+                    if (maskView(idx[0] / 8, idx[1] / 2)) {
+                        for (int y = 0; y < 2; y++)
+                            for (int x = 0; x < 2; x++)
+                                outY[idx * 2 + index<2>(y, x)] = maskedY;
+                        outU[idx] = maskedUV;
+                        outV[idx] = maskedUV;
+                        return;
+                    }
+
                     uint yuv[2][8][3];
                     for (int y = 0; y < 2; y++) {
                         for (int x = 0; x < 8; x++) {
@@ -213,35 +290,89 @@ void PVRStartGraphics(vector<vector<uint8_t *>> vvbuf, uint32_t inpWidth, uint32
                     outV[idx] =
                         yuv[0][0][2] | yuv[0][2][2] << 8 | yuv[0][4][2] << 16 | yuv[0][6][2] << 24;
                 });
-            outY.synchronize();
-            outU.synchronize();
-            outV.synchronize();
+            // the fence: the buffers are complete in the encoder's memory once these are
+            readbacks[slot] = {outY.synchronize_async(), outU.synchronize_async(),
+                               outV.synchronize_async()};
+        }
 
-            curHdl = 0;
-            texMtx.unlock();
+        void wait(int slot) override {
+            for (auto &readback : readbacks[slot])
+                readback.wait();
+        }
+    };
+
+    mutex captureMtx;
+    shared_ptr<CapturePipeline::Pipeline> capture;   // null while stopped
+
+    shared_ptr<CapturePipeline::Pipeline> Capture() {
+        lock_guard<mutex> lock(captureMtx);
+        return capture;
+    }
+}   // namespace
 
+void PVRStartGraphics(vector<vector<uint8_t *>> vvbuf,
+                      uint32_t inpWidth,
+                      uint32_t inpHeight,
+                      vector<uint8_t> mbMask) {
+    if (!dxDev) {
+        PVR_DB_I("[PVRStartGraphics] no D3D device");
+        return;
+    }
+    sharedTexs.bind({(uint64_t) dxDev, inpWidth, inpHeight});
+    auto pipeline = make_shared<CapturePipeline::Pipeline>(
+        make_unique<D3DCapture>(vvbuf, inpWidth, inpHeight, mbMask, STAGING_SLOTS),
+        STAGING_SLOTS,
+        (int) vvbuf.size(),
+        [](int) {
+            static Clk::time_point oldtime = Clk::now();
             fpsRenderer = (1000000000.0 / (Clk::now() - oldtime).count());
             oldtime = Clk::now();
+        });
+    lock_guard<mutex> lock(captureMtx);
+    capture = pipeline;
+}
 
-            // Wait until we receive a new SharedTextHandle Updated from
-            // PVRGraphics::PVRUpdTexHdl() <- PVRSockets::PVRProcessFrame() <- OpenVR::Present()
-            while (curHdl == 0 && gRunning)
-                sleep_for(500us);
+int PVRSubmitFrame(uint64_t texHdl, const function<void(int)> &prepare) {
+    auto pipeline = Capture();
+    if (!pipeline)
+        return -1;
+    auto ticket = pipeline->begin();
+    if (ticket.out < 0)
+        return -1;
+    if (!pipeline->commit(ticket, texHdl, prepare))
+        return -1;
+    return ticket.out;
+}
 
-            // PVR_DB("[PVRGraphics th] Rendering @ FPS: " + to_string(fpsRenderer) );
-        }
-        RELEASE(stagingTex);
-    });
+int PVRAcquireFrame(int &skipped) {
+    auto pipeline = Capture();
+    if (!pipeline) {
+        skipped = 0;
+        sleep_for(ACQUIRE_TIMEOUT);
+        return -1;
+    }
+    return pipeline->acquire(skipped, ACQUIRE_TIMEOUT);
+}
+
+void PVRReleaseFrame(int buf) {
+    if (auto pipeline = Capture())
+        pipeline->release(buf);
 }
 
 void PVRStopGraphics() {
-    gRunning = false;
-    EndThread(gThr);
+    shared_ptr<CapturePipeline::Pipeline> pipeline;
+    {
+        lock_guard<mutex> lock(captureMtx);
+        pipeline = move(capture);
+    }
+    if (pipeline) {
+        pipeline->stop();   // the frames in flight still write into the encoder's buffers
+        PVR_DB_I("[PVRStopGraphics] shared textures: " + sharedTexs.stats().summary());
+    }
 }
 
 void PVRReleaseDX() {
-    texMtx.lock();
+    sharedTexs.invalidate();
     RELEASE(dxDevCtx);
     RELEASE(dxDev);
-    texMtx.unlock();
 }
\ No newline at end of file
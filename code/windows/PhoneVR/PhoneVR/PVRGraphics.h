@@ -1,9 +1,23 @@
 #pragma once
+#include <cstdint>
+#include <functional>
 #include <vector>
 
 void PVRInitDX();
-void PVRUpdTexHdl(uint64_t texHdl, int whichBuffer);
-void PVRStartGraphics(std::vector<std::vector<uint8_t *>> vvbuf, uint32_t width, uint32_t height);
+// mbMask: LensMask::macroblocks() of the frame, the painted ones get a flat color
+void PVRStartGraphics(std::vector<std::vector<uint8_t *>> vvbuf,
+                      uint32_t width,
+                      uint32_t height,
+                      std::vector<uint8_t> mbMask = {});
+// Frames reach the vvbuf buffers through Utils/CapturePipeline.h. Blocks while every staging
+// texture is in flight, calls prepare with the buffer the frame goes to and returns once its copy
+// is queued. -1 while graphics are stopped or if the texture could not be copied, prepare isn't
+// called then.
+int PVRSubmitFrame(uint64_t texHdl, const std::function<void(int)> &prepare);
+// the buffer of the newest converted frame, -1 if none came for a while, skipped counts the
+// frames dropped for it
+int PVRAcquireFrame(int &skipped);
+void PVRReleaseFrame(int buf);
 void PVRStopGraphics();
 void PVRReleaseDX();
 
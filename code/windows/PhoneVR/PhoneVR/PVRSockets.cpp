@@ -1,13 +1,26 @@
 #include "PVRSockets.h"
 
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <fstream>
+#include <memory>
 #include <queue>
 
 #include "PVRFileManager.h"
 #include "PVRGraphics.h"
 #include "PVRMath.h"
 #include "PVRSocketUtils.h"
+#include "Utils/BandwidthProbe.h"
+#include "Utils/FlatRate.h"
+#include "Utils/LensMask.h"
+#include "Utils/LossRecovery.h"
+#include "Utils/Multipath.h"
+#include "Utils/Pacer.h"
+#include "Utils/PoseCodec.h"
+#include "Utils/PoseIngest.h"
+#include "Utils/Simulcast.h"
+#include "Utils/VideoTransport.h"
 
 extern "C" {
 #include "x264.h"
@@ -31,26 +44,325 @@ namespace {
     io_service *connSvc, *dataSvc;
     bool connRunning, videoRunning = false, dataRunning;
 
-    queue<pair<pair<int64_t /*pts*/,        // pts
-                    pair<Clk::time_point,   // tpWhenFrameRecvd from OpenVRSDK::Present
-                         float>             // Renderer Delay(ms)
-                    >,
-               Quaternionf>>
+    deque<pair<pair<int64_t /*pts*/,         // pts
+                     pair<Clk::time_point,   // tpWhenFrameRecvd from OpenVRSDK::Present
+                          float>             // Renderer Delay(ms)
+                     >,
+                pair<Quaternionf, int64_t>>>   // orientation and id of the pose it came from
         quatQueue;
 
     vector<x264_picture_t> vFrames(nVFrames);
     int64_t pts = 0;                       // in microseconds
+    Clk::time_point streamStart;           // pts 0, see PVRStreamClockUs
     int64_t vFrameDtUs;
-    int whichFrame = 0;                    // syncronize rendering and encoding
-    std::mutex whichFrameMtxs[nVFrames];   // if syncronization is out (cause lag) use as last
-                                           // resort to avoid crashing
     std::mutex
         quatQueueMutex;   // Syncronization of quatQueue among SteamVR Thread and Streamer thread.
 
+    // with multipath the phone sends each sample over every path
+    MonotonicFilter poseFilter;
+    PoseIngest::Ingest poseIngest;   // only touched by whoever receives poses
+
+    atomic<double> linkRttMs{0};   // 0 until the first heartbeat answer
+
+    // the phone's last report, picked up by the streamer thread
+    mutex clientStatsMtx;
+    PVRMsg::ClientStats clientStats;
+    bool clientStatsNew = false;
+
+    // last pose handed to SteamVR, the id is the phone's sample timestamp
+    mutex latestPoseMtx;
+    Quaternionf latestPoseQuat = Quaternionf::Identity();
+    int64_t latestPoseId = 0;
+
     float fpsSteamVRApp = 0.0;
     float fpsStreamer = 0.0;
     float fpsStreamWriter = 0.0;
     float fpsEncoder = 0.0;
+
+    // one TCP connection of the video stream, the client acks every frame on it with its pts
+    struct VideoPath {
+        tcp::socket skt;
+        deque<pair<int64_t, Clk::time_point>> unacked;   // pts, send time
+        size_t stray = 0;   // bytes of a probe reply that came too late, ahead of the acks
+
+        VideoPath(tcp::socket &&skt) : skt(move(skt)) {}
+    };
+
+    // a path that can't take a frame in this long is as good as down, it mustn't hold up the rest
+    const auto PATH_WRITE_TIMEOUT = 500ms;
+
+    // Runs start(handler), an async read or write on skt, until it completes or the deadline
+    // passes, then ec is timed_out. Returns the bytes transferred.
+    template <typename Start>
+    size_t RunUntil(io_service &svc,
+                    tcp::socket &skt,
+                    Clk::time_point deadline,
+                    asio::error_code &ec,
+                    Start start) {
+        bool done = false, timedOut = false;
+        size_t transferred = 0;
+        steady_timer timer(svc, deadline - Clk::now());
+        start([&](const asio::error_code &err, size_t n) {
+            ec = err;
+            transferred = n;
+            done = true;
+            timer.cancel();
+        });
+        timer.async_wait([&](const asio::error_code &) {
+            if (!done) {
+                timedOut = true;
+                skt.cancel();
+            }
+        });
+        svc.run();
+        svc.reset();
+        if (timedOut)
+            ec = error::timed_out;
+        return transferred;
+    }
+
+    // Writes all of data to the path unless the deadline passes first, then timed_out: the socket
+    // is left with part of a frame and has to be dropped.
+    void WritePath(io_service &svc,
+                   VideoPath &path,
+                   const void *data,
+                   size_t size,
+                   Clk::time_point deadline,
+                   asio::error_code &ec) {
+        RunUntil(svc, path.skt, deadline, ec, [&](auto handler) {
+            async_write(path.skt, buffer(data, size), handler);
+        });
+    }
+
+    // A simulcast tier below full size (see Utils/Simulcast.h), with its own encoder and picture.
+    class TierEncoder {
+        x264_t *enc;
+        x264_picture_t pic;
+        vector<float> quantOffsets;   // the lens mask at this tier's size
+
+      public:
+        const int fullWidth, fullHeight, width, height;
+
+        TierEncoder(x264_param_t par, int fullWidth, int fullHeight, vector<float> quantOffsets)
+            : enc(x264_encoder_open(&par)), quantOffsets(move(quantOffsets)), fullWidth(fullWidth),
+              fullHeight(fullHeight), width(par.i_width), height(par.i_height) {
+            x264_picture_alloc(&pic, FMT, width, height);
+            if (!this->quantOffsets.empty())
+                pic.prop.quant_offsets = this->quantOffsets.data();
+        }
+
+        ~TierEncoder() {
+            x264_picture_clean(&pic);
+            if (enc)
+                x264_encoder_close(enc);
+        }
+
+        x264_t *encoder() const { return enc; }
+
+        // scales the converted frame down, it's free for the next capture afterwards
+        void scale(const x264_picture_t &from, int type) {
+            for (int p = 0; p < 3; p++) {
+                int div = p == 0 ? 1 : 2;
+                Simulcast::scalePlane(from.img.plane[p],
+                                      from.img.i_stride[p],
+                                      fullWidth / div,
+                                      fullHeight / div,
+                                      pic.img.plane[p],
+                                      pic.img.i_stride[p],
+                                      width / div,
+                                      height / div);
+            }
+            pic.i_pts = from.i_pts;
+            pic.i_type = type;
+        }
+
+        // of the last scaled frame
+        int encode(x264_nal_t **nals, int *nNals, x264_picture_t *outPic) {
+            return x264_encoder_encode(enc, nals, nNals, &pic, outPic);
+        }
+    };
+
+    // a lower tier gets tier 0's rate control scaled down by its share
+    void ScaleRate(x264_param_t &par, const x264_param_t &tier0, double share) {
+        par.rc.i_bitrate = (std::max)((int) (tier0.rc.i_bitrate * share), 1);
+        par.rc.i_vbv_max_bitrate = (std::max)((int) (tier0.rc.i_vbv_max_bitrate * share), 1);
+        par.rc.i_vbv_buffer_size = (std::max)((int) (tier0.rc.i_vbv_buffer_size * share), 1);
+    }
+
+    bool TakeClientStats(PVRMsg::ClientStats &stats) {
+        lock_guard<mutex> lock(clientStatsMtx);
+        stats = clientStats;
+        return exchange(clientStatsNew, false);
+    }
+
+    // reads the acks that arrived so far without blocking
+    void DrainAcks(VideoPath &path,
+                   int idx,
+                   MultipathScheduler &sched,
+                   VideoTransport::TransportSelector &selector,
+                   LossRecovery::ReferenceTracker &recovery) {
+        asio::error_code ec;
+        auto avail = path.skt.available(ec);
+        while (!ec && path.stray > 0 && avail > 0) {
+            uint8_t junk[sizeof(BandwidthProbe::ProbeReply)];
+            auto n = path.skt.read_some(buffer(junk, (std::min)(avail, path.stray)), ec);
+            path.stray -= n;
+            avail -= n;
+        }
+        while (!ec && path.stray == 0 && avail >= sizeof(int64_t)) {
+            int64_t ackPts;
+            asio::read(path.skt, buffer(&ackPts, sizeof(ackPts)), ec);
+            avail -= sizeof(ackPts);
+            while (!path.unacked.empty() && path.unacked.front().first <= ackPts) {
+                if (path.unacked.front().first == ackPts) {
+                    auto rttMs = (Clk::now() - path.unacked.front().second).count() / 1000000.0;
+                    sched.onAck(idx, rttMs);
+                    selector.onAck(VideoTransport::TCP, rttMs, Clk::now());
+                    recovery.onAck(ackPts, false);   // other paths may still carry older ones
+                }
+                path.unacked.pop_front();
+            }
+        }
+        sched.setInFlight(idx, (int) path.unacked.size());
+    }
+
+    // reads the UDP mode feedback that arrived so far without blocking
+    void DrainFeedback(udp::socket &skt,
+                       udp::endpoint &clientEp,
+                       deque<pair<int64_t, Clk::time_point>> &unacked,
+                       VideoTransport::TransportSelector &selector,
+                       LossRecovery::ReferenceTracker &recovery,
+                       uint32_t &framesLost) {
+        asio::error_code ec;
+        while (!ec && skt.available(ec) >= sizeof(VideoTransport::Feedback)) {
+            VideoTransport::Feedback fb;
+            udp::endpoint from;
+            if (skt.receive_from(buffer(&fb, sizeof(fb)), from, 0, ec) != sizeof(fb) ||
+                from.address() != clientEp.address())   // only the paired phone's
+                continue;
+            clientEp = from;   // the client may not have gotten the video port
+            selector.onFeedback(fb, Clk::now());
+            // frames are completed in order, the ack covers everything before it but the losses
+            if ((int32_t) (fb.framesLost - framesLost) > 0) {
+                framesLost = fb.framesLost;
+                recovery.onLoss();
+            }
+            if (fb.ackPts >= 0)
+                recovery.onAck(fb.ackPts, true);
+            while (!unacked.empty() && unacked.front().first <= fb.ackPts) {
+                if (unacked.front().first == fb.ackPts)
+                    selector.onAck(VideoTransport::UDP,
+                                   (Clk::now() - unacked.front().second).count() / 1000000.0,
+                                   Clk::now());
+                unacked.pop_front();
+            }
+        }
+    }
+
+    // a client that doesn't answer in this long doesn't take part, the configured rate is used
+    const auto PROBE_REPLY_TIMEOUT = 1s;
+
+    // Each train follows a frame header with the probe pts and the train size.
+    // stray is set to the part of a reply that didn't arrive in time, it may still come.
+    BandwidthProbe::Result ProbeLink(io_service &svc, tcp::socket &skt, size_t &stray) {
+        BandwidthProbe::Estimator est;
+        PVRMsg::FrameHeader header = {};
+        header.pts = BandwidthProbe::PROBE_PTS;
+        vector<uint8_t> train(BandwidthProbe::MAX_TRAIN_SIZE);
+
+        for (auto size : BandwidthProbe::TRAIN_SIZES) {
+            header.size = (uint32_t) size;
+            BandwidthProbe::ProbeReply reply;
+            asio::error_code ec;
+
+            auto start = Clk::now();
+            write(skt, buffer(&header, sizeof(header)), ec);
+            if (!ec)
+                write(skt, buffer(train.data(), size), ec);
+            if (!ec) {
+                auto got = RunUntil(
+                    svc, skt, Clk::now() + PROBE_REPLY_TIMEOUT, ec, [&](auto handler) {
+                        async_read(skt, buffer(&reply, sizeof(reply)), handler);
+                    });
+                if (ec == error::timed_out)
+                    stray = sizeof(reply) - got;
+            }
+            if (ec) {
+                PVR_DB_I("[ProbeLink] probe failed: " + ec.message());
+                return {};
+            }
+            est.add(reply.bytes,
+                    reply.receiveUs,
+                    duration_cast<microseconds>(Clk::now() - start).count());
+            if (est.done())
+                break;
+        }
+        return est.result();
+    }
+
+    // see Utils/FlatRate.h
+    void SetFlatVbv(x264_param_t &par, int kbps) {
+        par.rc.i_vbv_max_bitrate = kbps;
+        par.rc.i_vbv_buffer_size = FlatRate::vbvBufferKbit(kbps, par.i_fps_num, par.i_fps_den);
+    }
+
+    // Seeds rate control from the probe, keeping headroom for retransmissions and the pose and
+    // control traffic sharing the link. VBV holds a few frames at max rate, fewer when the probe
+    // saw queues building up.
+    void ApplyLinkEstimate(x264_t *enc, const BandwidthProbe::Result &link, int fps, bool flat) {
+        x264_param_t par;
+        x264_encoder_parameters(enc, &par);
+
+        auto cap = PVRProp<int>({ENCODER_SECT, BITRATE_KEY});
+        int kbps = (int) (link.throughputBps * 8 / 1000 * 0.6);
+        kbps = (std::max)(500, (std::min)(kbps, cap > 0 ? cap : 30000));
+
+        par.rc.i_bitrate = kbps;
+        if (flat) {
+            SetFlatVbv(par, kbps);
+        } else {
+            par.rc.i_vbv_max_bitrate = kbps * 6 / 5;
+            par.rc.i_vbv_buffer_size =
+                par.rc.i_vbv_max_bitrate * (link.queuingDelayMs > 20 ? 2 : 4) / fps;
+        }
+
+        if (x264_encoder_reconfig(enc, &par) < 0)
+            PVR_DB_I("[ApplyLinkEstimate] encoder rejected probed rate");
+        else
+            PVR_DB_I("[ApplyLinkEstimate] bitrate " + to_string(kbps) + " kbps, vbv " +
+                     to_string(par.rc.i_vbv_max_bitrate) + " kbps / " +
+                     to_string(par.rc.i_vbv_buffer_size) + " kbit");
+    }
+
+    // Delay based rate control on the heartbeat RTT: RTT above the lowest one seen means frames
+    // are queuing somewhere on the link, back off before that turns into stalls. Never goes above
+    // the rate set at startup (setting or link probe).
+    void AdaptRateToRtt(x264_t *enc, double srttMs, double &minRttMs, int maxKbps, bool flat) {
+        if (srttMs <= 0)
+            return;
+        minRttMs = (std::min)(minRttMs, srttMs);
+
+        x264_param_t par;
+        x264_encoder_parameters(enc, &par);
+        int kbps = par.rc.i_bitrate;
+        double queuingMs = srttMs - minRttMs;
+        if (queuingMs > 20)
+            kbps = kbps * 85 / 100;
+        else if (queuingMs < 5)
+            kbps = kbps * 105 / 100 + 1;
+        kbps = (std::max)(500, (std::min)(kbps, maxKbps));
+        if (kbps == par.rc.i_bitrate)
+            return;
+
+        par.rc.i_bitrate = kbps;
+        if (flat)
+            SetFlatVbv(par, kbps);
+        else
+            par.rc.i_vbv_max_bitrate = kbps * 6 / 5;
+        if (x264_encoder_reconfig(enc, &par) == 0)
+            PVR_DB("[AdaptRateToRtt] srtt " + str_fmt("%.1f", srttMs) + " ms, min " +
+                   str_fmt("%.1f", minRttMs) + " ms, bitrate " + to_string(kbps) + " kbps");
+    }
 }   // namespace
 
 float fpsRenderer = 0.0;
@@ -131,13 +443,19 @@ void PVRStopConnectionListener() {
 void PVRStartStreamer(string ip,
                       uint16_t width,
                       uint16_t height,
-                      function<void(vector<uint8_t>)> headerCb,
-                      function<void()> onErrCb) {
+                      const float projRect[4],
+                      function<void(SharedBuffer)> headerCb,
+                      function<void()> onErrCb,
+                      function<bool(SharedBuffer)> frameCb) {
+    LensMask::EyeTangents eyes[2];
+    LensMask::eyesFromProjRect(projRect, eyes);
+    streamStart = Clk::now();
+    pts = 0;
     videoRunning = true;
     videoThr = new std::thread([=] {
         PVR_DB_I("[PVRStartStreamer th] Setting encoder");
         auto S = ENCODER_SECT;
-        int fps = PVRProp<int>({GAME_FPS_KEY});
+        int fps = PVRStreamFps();   // half rate: CRF keeps the bits per frame, half the bitrate
 
         // auto wait = 1'000'000us / fps / 5;
         vFrameDtUs = (1'000'000us / fps).count();
@@ -184,11 +502,25 @@ void PVRStartStreamer(string ip,
 
         par.rc.i_rc_method = 1;
 
-        par.rc.i_bitrate = 1000;
-        par.rc.i_vbv_max_bitrate = 1200;
-        par.rc.i_vbv_buffer_size = 20000;
+        // the bitrate setting caps the rate, 1 Mbps until the link probe or the RTT say otherwise
+        auto kbps = PVRProp<int>({S, BITRATE_KEY});
+        par.rc.i_bitrate = kbps > 0 ? kbps : 1000;
         par.rc.f_vbv_buffer_init = 0.9f;
 
+        // Flat mode keeps every frame about the same size, a keyframe sized frame is a latency
+        // spike. A column of intra macroblocks sweeps the picture instead of IDRs, the one frame
+        // VBV bounds each frame and slices keep the damage of a lost datagram to one slice.
+        bool flat = PVRProp<bool>({S, CONSTANT_FRAME_SIZE_KEY});
+        if (flat) {
+            par.b_intra_refresh = 1;
+            par.i_keyint_max = FlatRate::refreshPeriod(fps, PVRProp<int>({S, KEYINT_MAX_KEY}));
+            par.i_slice_max_size = (std::max)(PVRProp<int>({S, SLICE_MAX_SIZE_KEY}), 0);
+            SetFlatVbv(par, par.rc.i_bitrate);
+        } else {
+            par.rc.i_vbv_max_bitrate = par.rc.i_bitrate * 6 / 5;
+            par.rc.i_vbv_buffer_size = 20000;
+        }
+
         // par.rc.i_qp_constant = 25;
         // par.rc.i_qp_min = par.rc.i_qp_constant - 1;
         // par.rc.i_qp_max = par.rc.i_qp_constant + 1;
@@ -197,7 +529,34 @@ void PVRStartStreamer(string ip,
         // par.rc.f_rf_constant = 12;
         // par.rc.f_rf_constant_max = 13;
         par.rc.f_rf_constant = 24;
-        par.rc.f_rf_constant_max = 26;
+        par.rc.f_rf_constant_max = flat ? 0 : 26;   // a cap would let scene cuts overflow the VBV
+
+        // recovering from an acknowledged frame needs it still in the DPB, x264 can't do it with
+        // intra refresh or B-frames
+        bool refRecovery = PVRProp<string>({S, LOSS_RECOVERY_KEY}) == "reference" &&
+                           !par.b_intra_refresh && par.i_bframe == 0;
+        if (refRecovery)
+            par.i_dpb_size = PVRProp<int>({S, DPB_SIZE_KEY});
+        LossRecovery::ReferenceTracker recovery(refRecovery ? par.i_dpb_size : 1);
+
+        // what the lens can't show is painted flat by the conversion and gets the highest QP
+        vector<uint8_t> lensMask;
+        vector<float> lensQuantOffsets;
+        if (PVRProp<bool>({S, LENS_MASK_KEY})) {
+            lensMask = LensMask::macroblocks(width, height, eyes);
+            lensQuantOffsets = LensMask::quantOffsets(lensMask);
+            // x264 applies quant offsets only with AQ on, and turns AQ off at strength 0: a
+            // token strength keeps the variance AQ's own offsets at a tenth of a QP
+            if (par.rc.i_aq_mode == X264_AQ_NONE) {
+                par.rc.i_aq_mode = X264_AQ_VARIANCE;
+                par.rc.f_aq_strength = 0.01f;
+            }
+            auto painted = count(lensMask.begin(), lensMask.end(), LensMask::PAINTED);
+            auto hidden = count(lensMask.begin(), lensMask.end(), LensMask::HIDDEN) + painted;
+            PVR_DB_I("[PVRStartStreamer th] lens mask: " + to_string(hidden) + " of " +
+                     to_string(lensMask.size()) + " macroblocks hidden, " + to_string(painted) +
+                     " painted");
+        }
 
         // par.nalu_process           TODO: callback available!!!!!!!!! manage a udp thread inside
         // here, then dispatch sends
@@ -208,10 +567,12 @@ void PVRStartStreamer(string ip,
         vector<vector<uint8_t *>> vvbuf;
         for (size_t i = 0; i < nVFrames; i++) {
             x264_picture_alloc(&vFrames[i], FMT, width, height);
+            if (!lensQuantOffsets.empty())
+                vFrames[i].prop.quant_offsets = lensQuantOffsets.data();
             vvbuf.push_back(
                 {vFrames[i].img.plane[0], vFrames[i].img.plane[1], vFrames[i].img.plane[2]});
         }
-        PVRStartGraphics(vvbuf, width, height);
+        PVRStartGraphics(vvbuf, width, height, lensMask);
 
         auto *enc = x264_encoder_open(&par);
 
@@ -221,6 +582,43 @@ void PVRStartStreamer(string ip,
                  to_string(height));
         PVR_DB_I("[PVRStartStreamer th] Using encoding level: " + to_string(outPar.i_level_idc));
 
+        // simulcast: the lower tiers encode scaled down copies of the converted frames, the phone
+        // gets the one its decoder and link keep up with
+        auto tiers = Simulcast::makeTiers(width, height, PVRProp<int>({S, SIMULCAST_TIERS_KEY}));
+        vector<unique_ptr<TierEncoder>> tierEncs;
+        for (size_t i = 1; i < tiers.size(); i++) {
+            auto tierPar = par;
+            tierPar.i_width = tiers[i].width;
+            tierPar.i_height = tiers[i].height;
+            ScaleRate(tierPar, par, tiers[i].rateShare);
+            vector<float> tierOffsets;
+            if (!lensMask.empty())
+                tierOffsets = LensMask::quantOffsets(
+                    LensMask::macroblocks(tiers[i].width, tiers[i].height, eyes));
+            tierEncs.emplace_back(new TierEncoder(tierPar, width, height, move(tierOffsets)));
+            if (!tierEncs.back()->encoder()) {
+                PVR_DB_I("[PVRStartStreamer th] encoder of simulcast tier " + to_string(i) +
+                         " failed to open");
+                tierEncs.pop_back();
+                break;
+            }
+            PVR_DB_I("[PVRStartStreamer th] simulcast tier " + to_string(i) + ": " +
+                     to_string(tiers[i].width) + "x" + to_string(tiers[i].height));
+        }
+        tiers.resize(tierEncs.size() + 1);
+        Simulcast::TierSelector tierSelector(tiers, vFrameDtUs / 1000.0);
+        int tier = 0;   // the phone's
+        // after the rate of tier 0 changed
+        auto syncTierRates = [&] {
+            x264_param_t tier0, tierPar;
+            x264_encoder_parameters(enc, &tier0);
+            for (size_t i = 0; i < tierEncs.size(); i++) {
+                x264_encoder_parameters(tierEncs[i]->encoder(), &tierPar);
+                ScaleRate(tierPar, tier0, tiers[i + 1].rateShare);
+                x264_encoder_reconfig(tierEncs[i]->encoder(), &tierPar);
+            }
+        };
+
         x264_nal_t *nals;
         int nNals;
         res = x264_encoder_headers(enc, &nals, &nNals);
@@ -229,62 +627,221 @@ void PVRStartStreamer(string ip,
             vheader.insert(vheader.end(),
                            nals[i].p_payload,
                            nals[i].p_payload + nals[i].i_payload);   // WARNING: including SEI nal
-        headerCb(vheader);
+        headerCb(move(vheader));
 
+        // multiplexed: frames go through frameCb (the control connection), no video sockets
+        bool multiplexed = (bool) frameCb;
+        if (multiplexed) {
+            poseFilter.reset();   // no data thread to do it, poses come in over the talker
+            poseIngest.reset();
+        }
         io_service svc;
         tcp::socket skt(svc);
-        tcp::acceptor acc(svc, {tcp::v4(), PVRProp<uint16_t>({VIDEO_PORT_KEY})});
-        PVR_DB_I("[PVRStartStreamer th] accepting connections on TCP port " +
-                 to_string(PVRProp<uint16_t>({VIDEO_PORT_KEY})) +
-                 ", waiting for device to connect");
-        // TODO: Add max retries or timeout, accept will block until connected
-        acc.accept(skt);
-        PVR_DB_I("[PVRStartStreamer th] Client device connected on TCP port " +
-                 to_string(PVRProp<uint16_t>({VIDEO_PORT_KEY})) + ", sending stream ... ");
+        tcp::acceptor acc(svc);
+        bool multipath = !multiplexed && PVRProp<bool>({MULTIPATH_KEY});
+        bool duplicateKeyframes = PVRProp<bool>({DUPLICATE_KEYFRAMES_KEY});
+        if (!multiplexed) {
+            acc = tcp::acceptor(svc, {tcp::v4(), PVRProp<uint16_t>({VIDEO_PORT_KEY})});
+            PVR_DB_I("[PVRStartStreamer th] accepting connections on TCP port " +
+                     to_string(PVRProp<uint16_t>({VIDEO_PORT_KEY})) +
+                     ", waiting for device to connect");
+            // TODO: Add max retries or timeout, accept will block until connected
+            acc.accept(skt);
+            // a frame is several writes, Nagle would hold the last one for the phone's
+            // delayed ACK (40 ms on Android)
+            skt.set_option(tcp::no_delay(true));
+            PVR_DB_I("[PVRStartStreamer th] Client device connected on TCP port " +
+                     to_string(PVRProp<uint16_t>({VIDEO_PORT_KEY})) + ", sending stream ... ");
+        }
 
         // udp::socket skt(svc);
         // udp::endpoint remEP(address::from_string(ip), port);
         // skt.open(udp::v4());
 
-        int lastWhichFrame = 0;
+        int frameBuf = -1;   // of vFrames, from PVRAcquireFrame
+        int skipped = 0;
         // uint8_t buf[256 * 256];
-        uint8_t extraBuf[8 + 16 + 4 + 20 + 8 + 8];
+        FramePacer pacer(PVRProp<float>({PACING_FRACTION_KEY}),
+                         16 * 1024,
+                         PVRProp<float>({LINK_RATE_KEY}) * 1'000'000 / 8);
+
+        size_t probeStray = 0;
+        if (!multiplexed && PVRProp<bool>({LINK_PROBE_KEY})) {
+            auto link = ProbeLink(svc, skt, probeStray);
+            if (link.valid()) {
+                PVR_DB_I("[PVRStartStreamer th] link probe: " +
+                         str_fmt("%.1f", link.throughputBps * 8 / 1'000'000) + " Mbps, rtt " +
+                         str_fmt("%.1f", link.baseRttMs) + " ms, queuing " +
+                         str_fmt("%.1f", link.queuingDelayMs) + " ms");
+                ApplyLinkEstimate(enc, link, fps, flat);
+                syncTierRates();
+                pacer.setLinkRate(link.throughputBps);
+            }
+        }
+        x264_encoder_parameters(enc, &outPar);
+        int startKbps = outPar.rc.i_bitrate;
+        double minRttMs = (numeric_limits<double>::max)();
+        auto lastRateCheck = Clk::now();
+
+        // the first connection is the primary path, later ones (other interfaces of the same
+        // device) are picked up between frames
+        MultipathScheduler sched;
+        vector<VideoPath> paths;
+        udp::endpoint clientEp;
+        if (!multiplexed) {
+            clientEp = {skt.remote_endpoint().address(), PVRProp<uint16_t>({VIDEO_PORT_KEY})};
+            paths.emplace_back(move(skt));
+            paths[0].stray = probeStray;
+            sched.addPath();
+        }
+        if (multipath)
+            acc.non_blocking(true);
+        bool forceIdr = false;
+
+        // UDP mode of the video channel, the TCP connection stays up for the session
+        udp::socket udpSkt(svc);
+        if (!multiplexed)
+            udpSkt = udp::socket(svc, {udp::v4(), PVRProp<uint16_t>({VIDEO_PORT_KEY})});
+        VideoTransport::TransportSelector selector(
+            !multiplexed && PVRProp<string>({VIDEO_TRANSPORT_KEY}) == "udp" ? VideoTransport::UDP
+                                                                            : VideoTransport::TCP,
+            {},
+            vFrameDtUs / 1000.0);
+        bool switching = !multiplexed && PVRProp<bool>({TRANSPORT_SWITCHING_KEY});
+        int fecGroup = PVRProp<int>({FEC_GROUP_KEY});
+        FramePacer udpPacer(PVRProp<float>({PACING_FRACTION_KEY}),
+                            VideoTransport::DATAGRAM_SIZE,
+                            pacer.getLinkRate());
+        deque<pair<int64_t, Clk::time_point>> udpUnacked;
+        uint32_t udpSeq = 0, udpFramesLost = 0;
+        vector<uint8_t> udpFrame, udpWire;
+        PVR_DB_I(string("[PVRStartStreamer th] video transport: ") +
+                 (multiplexed                                 ? "multiplexed"
+                  : selector.current() == VideoTransport::UDP ? "UDP"
+                                                              : "TCP"));
+
+        uint8_t extraBuf[sizeof(PVRMsg::FrameHeader)];
         auto pbuf = reinterpret_cast<int64_t *>(&extraBuf[0]);   // pts buf ref
-        auto qbuf = reinterpret_cast<float *>(&extraBuf[8]);     // quat buf ref
-        auto nbuf = reinterpret_cast<int *>(&extraBuf[8 + 16]);
-        auto fpsbuf = reinterpret_cast<float *>(&extraBuf[8 + 16 + 4]);
-        auto tDelaysBuf = reinterpret_cast<float *>(&extraBuf[8 + 16 + 4 + 20]);
-        auto timestamp = reinterpret_cast<int64_t *>(&extraBuf[8 + 16 + 4 + 20 + 8]);
+        auto qbuf = reinterpret_cast<float *>(&extraBuf[offsetof(PVRMsg::FrameHeader, quat)]);
+        auto nbuf = reinterpret_cast<int *>(&extraBuf[offsetof(PVRMsg::FrameHeader, size)]);
+        auto fpsbuf = reinterpret_cast<float *>(&extraBuf[offsetof(PVRMsg::FrameHeader, fps)]);
+        auto tDelaysBuf =
+            reinterpret_cast<float *>(&extraBuf[offsetof(PVRMsg::FrameHeader, delaysMs)]);
+        auto timestamp =
+            reinterpret_cast<int64_t *>(&extraBuf[offsetof(PVRMsg::FrameHeader, sentUs)]);
+        auto poseIdBuf =
+            reinterpret_cast<int64_t *>(&extraBuf[offsetof(PVRMsg::FrameHeader, poseId)]);
 
         asio::error_code ec;
         // ofstream outp("C:\\Users\\narni\\mystream.h264",
         // ofstream::binary);/////////////////////////////////////////////
-        while ((whichFrame == lastWhichFrame || quatQueue.size() == 0) &&
-               videoRunning)   // for first frame
-            sleep_for(500us);
+        while (frameBuf < 0 && videoRunning)   // for first frame
+            frameBuf = PVRAcquireFrame(skipped);
         while (videoRunning) {
             // PVRUpdTexWraps();
             static Clk::time_point oldtime, oldtimeStreamer;
             oldtime = Clk::now();
             oldtimeStreamer = Clk::now();
 
-            if ((lastWhichFrame + 1) % nVFrames != whichFrame)
-                PVR_DB_I("[PVRStartStreamer th] Skipped frame! Please re-tune the encoder "
-                         "parameters lWf:" +
-                         to_string(lastWhichFrame) + ", nVfs:" + to_string(nVFrames) +
-                         ", wF:" + to_string(whichFrame));
-            lastWhichFrame = whichFrame;
-            whichFrameMtxs[lastWhichFrame].lock();     // LOCK
-            auto totSz = x264_encoder_encode(enc, &nals, &nNals, &vFrames[lastWhichFrame], &outPic);
-            whichFrameMtxs[lastWhichFrame].unlock();   // UNLOCK
+            if (skipped > 0)
+                PVR_DB_I("[PVRStartStreamer th] Skipped " + to_string(skipped) +
+                         " frame(s)! Please re-tune the encoder parameters");
+            quatQueueMutex.lock();   // LOCK
+            for (auto &queued : quatQueue) {
+                // Present to converted, the copy and conversion overlap other frames now
+                if (queued.first.first == vFrames[frameBuf].i_pts)
+                    queued.first.second.second =
+                        (Clk::now() - queued.first.second.first).count() / 1000000.0;
+            }
+            quatQueueMutex.unlock();   // UNLOCK
+            // a transport switch waits for an IDR, so the new transport starts a clean chain
+            auto mode = selector.current();
+            auto wantedMode = switching ? selector.wanted(Clk::now()) : mode;
+            forceIdr |= wantedMode != mode;
+
+            // the phone's tier, a new one starts with an IDR of that tier
+            bool tierSwitch = false;
+            PVRMsg::ClientStats stats;
+            if (tiers.size() > 1 && TakeClientStats(stats)) {
+                Simulcast::Report report;
+                report.framesReceived = (int) stats.framesReceived;
+                report.framesDecoded = (int) stats.framesDecoded;
+                report.framesLost = (int) stats.framesLost;
+                report.decodeMs = stats.decodeUs / 1000.0;
+                report.queuingMs = (std::max)(0.0, linkRttMs - minRttMs);
+                int wanted = tierSelector.onReport(report, Clk::now());
+                if (wanted != tier) {
+                    PVR_DB_I("[PVRStartStreamer th] phone to simulcast tier " +
+                             to_string(wanted) + ", decode " +
+                             str_fmt("%.1f", report.decodeMs) + " ms, " +
+                             to_string(report.framesDecoded) + "/" +
+                             to_string(report.framesReceived) + " frames decoded, " +
+                             to_string(report.framesLost) + " lost");
+                    tier = wanted;
+                    tierSwitch = true;
+                }
+            }
+            auto *tierEnc = tier == 0 ? enc : tierEncs[tier - 1]->encoder();
+
+            // after a loss the next frame predicts from the newest one the client acknowledged
+            auto action = recovery.next();
+            if (action == LossRecovery::REFERENCE &&
+                (!refRecovery ||
+                 x264_encoder_invalidate_reference(tierEnc, recovery.invalidateFrom()) < 0))
+                action = LossRecovery::IDR;
+            if (action == LossRecovery::REFERENCE)
+                PVR_DB("[PVRStartStreamer th] loss, predicting from before pts " +
+                       to_string(recovery.invalidateFrom()));
+            forceIdr |= action == LossRecovery::IDR;
+            if (forceIdr && flat) {
+                // a new refresh wave cleans the picture up without a keyframe sized frame
+                x264_encoder_intra_refresh(tierEnc);
+                forceIdr = false;
+            }
+            // a new transport or a loss without an acknowledged frame restarts the reference chain
+            auto type = forceIdr || tierSwitch ? X264_TYPE_IDR : X264_TYPE_AUTO;
+            forceIdr = false;
+
+            // only the phone's tier is encoded, the others pick up again with the IDR of a switch
+            int totSz;
+            if (tier > 0) {
+                auto &t = *tierEncs[tier - 1];
+                t.scale(vFrames[frameBuf], type);
+                PVRReleaseFrame(frameBuf);   // the capture may write into it again
+                totSz = t.encode(&nals, &nNals, &outPic);
+            } else {
+                vFrames[frameBuf].i_type = type;
+                totSz = x264_encoder_encode(enc, &nals, &nNals, &vFrames[frameBuf], &outPic);
+                PVRReleaseFrame(frameBuf);
+            }
+
+            if (multipath) {
+                tcp::socket newSkt(svc);
+                acc.accept(newSkt, ec);
+                if (!ec) {
+                    PVR_DB_I("[PVRStartStreamer th] additional path from " +
+                             newSkt.remote_endpoint().address().to_string());
+                    newSkt.non_blocking(false);
+                    newSkt.set_option(tcp::no_delay(true));
+                    paths.emplace_back(move(newSkt));
+                    sched.addPath();
+                }
+            }
+            for (int i = 0; i < (int) paths.size(); i++)
+                DrainAcks(paths[i], i, sched, selector, recovery);
+            DrainFeedback(udpSkt, clientEp, udpUnacked, selector, recovery, udpFramesLost);
+            if (Clk::now() - lastRateCheck > 1s) {
+                AdaptRateToRtt(enc, linkRttMs, minRttMs, startKbps, flat);
+                syncTierRates();
+                lastRateCheck = Clk::now();
+            }
 
             fpsEncoder = (1000000000.0 / (Clk::now() - oldtime).count());
 
             oldtime = Clk::now();
 
             if (totSz > 0) {
-                PVR_DB("[PVRStartStreamer th] Rendering lWf:" + to_string(lastWhichFrame) +
-                       ", wF:" + to_string(whichFrame));
+                PVR_DB("[PVRStartStreamer th] Rendering buf:" + to_string(frameBuf));
                 quatQueueMutex.lock();                                   // LOCK
                 while ((quatQueue.size() != 0) &&
                        (quatQueue.front().first.first < outPic.i_pts))   // handle skipped frames
@@ -292,7 +849,7 @@ void PVRStartStreamer(string ip,
                     PVR_DB("[PVRStartStreamer th] handle skipped frames qPts:" +
                            to_string(quatQueue.front().first.first) +
                            ", outpicPts:" + to_string(outPic.i_pts));
-                    quatQueue.pop();
+                    quatQueue.pop_front();
                 }
                 quatQueueMutex.unlock();   // UNLOCK
 
@@ -301,15 +858,18 @@ void PVRStartStreamer(string ip,
                     auto outPts = quatQueue.front().first.first;
                     auto time = quatQueue.front().first.second.first;
                     auto renderDur = quatQueue.front().first.second.second;
-                    auto quat = quatQueue.front().second;
-                    quatQueue.pop();
+                    auto quat = quatQueue.front().second.first;
+                    auto poseId = quatQueue.front().second.second;
+                    quatQueue.pop_front();
                     quatQueueMutex.unlock();
+                    recovery.onEncoded(outPts, outPic.i_pts, outPic.b_keyframe);
 
                     *pbuf = outPts;
                     qbuf[0] = quat.w();
                     qbuf[1] = quat.x();
                     qbuf[2] = quat.y();
                     qbuf[3] = quat.z();
+                    *poseIdBuf = poseId;   // the phone measures motion to photon with it
                     *nbuf = totSz;
                     fpsbuf[0] = fpsSteamVRApp;                               // VRApp FPS
                     fpsbuf[1] = fpsEncoder;                                  // Encoder FPS
@@ -323,23 +883,111 @@ void PVRStartStreamer(string ip,
                                      system_clock::now().time_since_epoch())
                                      .count();   // FrameSent TimeStamp
 
-                    write(skt, buffer(extraBuf), ec);
-                    write(skt, buffer(nals->p_payload, totSz), ec);
+                    if (wantedMode != mode && outPic.b_keyframe) {
+                        PVR_DB_I(string("[PVRStartStreamer th] switching video to ") +
+                                 (wantedMode == VideoTransport::UDP ? "UDP" : "TCP") +
+                                 ", stalled " +
+                                 str_fmt("%.1f", selector.stallFraction(Clk::now()) * 100) +
+                                 "%, loss " + str_fmt("%.2f", selector.lossRate() * 100) +
+                                 "%, rtt " + str_fmt("%.1f", selector.rttMs()) + " ms");
+                        selector.switched(wantedMode, Clk::now());
+                        mode = wantedMode;
+                    }
 
-                    PVR_DB("[PVRStartStreamer th] wrote render to socket: Pts:[Tenc:" +
-                           str_fmt("%.2f", tDelaysBuf[1]) +
-                           " ms, Trend:" + str_fmt("%.2f", renderDur) + " ms]" + to_string(outPts) +
-                           ", Size: " + to_string(sizeof(extraBuf)) + "," + to_string(totSz));
+                    // keyframes go out on every path so a stalled path can't hold up recovery
+                    vector<int> targets = {sched.pick()};
+                    if (duplicateKeyframes && outPic.b_keyframe)
+                        targets = sched.alivePaths();
+                    if (multiplexed) {
+                        // the talker sends it as a bulk message, poses and control go first
+                        targets.clear();
+                        vector<uint8_t> frame(extraBuf, extraBuf + sizeof(extraBuf));
+                        frame.insert(frame.end(), nals->p_payload, nals->p_payload + totSz);
+                        if (!frameCb(move(frame)))
+                            PVR_DB("[PVRStartStreamer th] multiplexed frame send failed");
+                    } else if (mode == VideoTransport::UDP) {
+                        targets.clear();
+                        udpFrame.assign(extraBuf, extraBuf + sizeof(extraBuf));
+                        udpFrame.insert(udpFrame.end(), nals->p_payload, nals->p_payload + totSz);
+                        udpWire.clear();
+                        VideoTransport::packetize(
+                            outPts, udpFrame.data(), udpFrame.size(), fecGroup, udpSeq, udpWire);
+                        // a datagram the socket can't take is as good as lost, FEC covers it
+                        udpPacer.send(udpWire.data(),
+                                      udpWire.size(),
+                                      microseconds(vFrameDtUs),
+                                      [&](const uint8_t *data, size_t size) {
+                                          for (size_t off = 0; off < size;
+                                               off += VideoTransport::DATAGRAM_SIZE)
+                                              udpSkt.send_to(
+                                                  buffer(data + off, VideoTransport::DATAGRAM_SIZE),
+                                                  clientEp,
+                                                  0,
+                                                  ec);
+                                          return true;
+                                      });
+                        udpUnacked.push_back({outPts, Clk::now()});
+                        if (udpUnacked.size() > 64)
+                            udpUnacked.pop_front();
+                    }
 
-                    if (ec.value() != 0 && videoRunning)
-                        PVR_DB("Write failed: " + ec.message() + " Code: " + to_string(ec.value()));
-                    if (ec == error::connection_aborted || ec == error::connection_reset) {
+                    // copies of a duplicated keyframe go out one after the other and share the
+                    // pacing window, so the last one is through as early as a single copy would be
+                    int64_t copies =
+                        count_if(targets.begin(), targets.end(), [](int i) { return i >= 0; });
+                    auto paceDt = microseconds(vFrameDtUs / (std::max)(copies, (int64_t) 1));
+                    for (auto i : targets) {
+                        if (i < 0)
+                            continue;
+                        auto &path = paths[i];
+                        auto deadline = Clk::now() + PATH_WRITE_TIMEOUT;
+                        ec = asio::error_code();
+                        WritePath(svc, path, extraBuf, sizeof(extraBuf), deadline, ec);
+                        if (!ec)
+                            pacer.send(nals->p_payload,
+                                       totSz,
+                                       paceDt,
+                                       [&](const uint8_t *data, size_t size) {
+                                           WritePath(svc, path, data, size, deadline, ec);
+                                           return !ec;
+                                       });
+                        if (!ec) {
+                            path.unacked.push_back({outPts, Clk::now()});
+                            if (path.unacked.size() > 64)
+                                path.unacked.pop_front();
+                            sched.setInFlight(i, (int) path.unacked.size());
+                        }
+
+                        PVR_DB("[PVRStartStreamer th] wrote render to socket " + to_string(i) +
+                               ": Pts:[Tenc:" + str_fmt("%.2f", tDelaysBuf[1]) +
+                               " ms, Trend:" + str_fmt("%.2f", renderDur) + " ms]" +
+                               to_string(outPts) + ", Size: " + to_string(sizeof(extraBuf)) + "," +
+                               to_string(totSz));
+
+                        if (ec.value() != 0 && videoRunning)
+                            PVR_DB("Write failed: " + ec.message() +
+                                   " Code: " + to_string(ec.value()));
+                        // whatever failed, the phone can't tell where the next frame starts
+                        if (ec) {
+                            PVR_DB_I("[PVRStartStreamer th] path " + to_string(i) +
+                                     " down: " + ec.message());
+                            sched.onDown(i);
+                            recovery.onLoss();
+                            asio::error_code closeEc;
+                            path.skt.close(closeEc);   // the phone's end of it fails too
+                        }
+                    }
+                    if (!multiplexed && sched.alivePaths().empty()) {
                         videoRunning = false;
                         // onErrCb();
                     }
 
                     // outp.write((char*)nals->p_payload,
                     // totSz);/////////////////////////////////////////////////////////
+                } else {
+                    // never sent, the frames predicting from it can't be decoded either
+                    recovery.onEncoded(outPic.i_pts, outPic.i_pts, outPic.b_keyframe);
+                    recovery.onLoss();
                 }
             }
             fpsStreamWriter = (1000000000.0 / (Clk::now() - oldtime).count());
@@ -348,8 +996,9 @@ void PVRStartStreamer(string ip,
                    " VRApp Running @ FPS : " + to_string(fpsSteamVRApp));
             oldtime = Clk::now();
 
-            while ((whichFrame == lastWhichFrame || quatQueue.size() == 0) && videoRunning)
-                sleep_for(500us);
+            frameBuf = -1;
+            while (frameBuf < 0 && videoRunning)   // signaled when a conversion completes
+                frameBuf = PVRAcquireFrame(skipped);
 
             fpsStreamer = (1000000000.0 / (Clk::now() - oldtimeStreamer).count());
             oldtimeStreamer = Clk::now();
@@ -365,38 +1014,27 @@ void PVRStartStreamer(string ip,
     });
 }
 
-void PVRProcessFrame(uint64_t hdl, Quaternionf quat) {
+void PVRProcessFrame(uint64_t hdl, Quaternionf quat, int64_t poseId) {
     if (videoRunning) {
 
         static Clk::time_point oldtimeVRApp = Clk::now();
 
-        int newWhichFrame = (whichFrame + 1) % nVFrames;
-        whichFrameMtxs[newWhichFrame].lock();   // LOCK
-
-        pts += vFrameDtUs;
+        // Blocks only while all staging textures are in flight, returns once the copy is queued:
+        // the conversion of this frame overlaps the rendering of the next one.
+        PVRSubmitFrame(hdl, [&](int buf) {
+            // real time rather than frame count, a game below the stream rate would slow it down
+            pts = (std::max)(pts + 1, PVRStreamClockUs(Clk::now()));
 
-        quatQueueMutex.lock();     // LOCK
-        quatQueue.push({{pts, {Clk::now(), 0}}, quat});
-        quatQueueMutex.unlock();   // UNLOCK
+            quatQueueMutex.lock();     // LOCK
+            quatQueue.push_back({{pts, {Clk::now(), 0}}, {quat, poseId}});
+            quatQueueMutex.unlock();   // UNLOCK
 
-        // PVRUpdTexHdl() -> Blocking: This will wait if there is already a handle being rendered.
-        PVRUpdTexHdl(hdl, newWhichFrame);   // Render Frame
-
-        quatQueueMutex.lock();              // LOCK
-        quatQueue.back().first.second.second =
-            (Clk::now() - quatQueue.back().first.second.first).count() / 1000000.0;
-        quatQueueMutex.unlock();   // UNLOCK
-
-        vFrames[newWhichFrame].i_pts = pts;
-
-        whichFrameMtxs[newWhichFrame].unlock();   // UNLOCK
-        whichFrame = newWhichFrame;
+            vFrames[buf].i_pts = pts;
+        });
 
         fpsSteamVRApp = (1000000000.0 / (Clk::now() - oldtimeVRApp).count());
 
-        /*PVR_DB("[PVRProcessFrame] pushed frame to que Wf: "
-                + to_string(whichFrame)
-                + ", pts(Trend:"+ str_fmt("%.2f", (Clk::now() -
+        /*PVR_DB("[PVRProcessFrame] pushed frame to que pts(Trend:"+ str_fmt("%.2f", (Clk::now() -
            quatQueue.back().first.second.first).count() / 1000000.0) + "ms): "
                 + to_string(pts));*/
         oldtimeVRApp = Clk::now();
@@ -408,11 +1046,68 @@ void PVRStopStreamer() {
     EndThread(videoThr);
 }
 
-void PVRStartReceiveData(string ip, vr::DriverPose_t *pose, uint32_t *objId) {
-    float addLatency = 0;
+void PVRSetLinkRtt(double srttMs, double) { linkRttMs = srttMs; }
+
+void PVRSetClientStats(const PVRMsg::ClientStats &stats) {
+    lock_guard<mutex> lock(clientStatsMtx);
+    clientStats = stats;
+    clientStatsNew = true;
+}
 
+int64_t PVRStreamClockUs(Clk::time_point t) {
+    return duration_cast<microseconds>(t - streamStart).count();
+}
+
+int64_t PVRLatestPose(Quaternionf &quat) {
+    lock_guard<mutex> lock(latestPoseMtx);
+    quat = latestPoseQuat;
+    return latestPoseId;
+}
+
+bool PVRProcessPosePacket(const uint8_t *data,
+                          size_t size,
+                          vr::DriverPose_t *pose,
+                          uint32_t objId) {
+    PoseCodec::Sample samples[PoseCodec::MAX_BATCH];
+
+    // older phones, and phones paired with older PCs, send the legacy layout
+    auto count = PoseCodec::decodeAny(data, size, samples, PoseCodec::MAX_BATCH);
+    if (count == 0)
+        return false;
+
+    auto &latest = samples[count - 1];
+    // if (isValidOrient(quat))// check if quat is valid
+    if (poseFilter.accept(latest.timestamp)) {
+        // the whole batch, older samples sharpen the velocity estimate
+        int64_t now = Clk::now().time_since_epoch().count();   // ns, like the timestamps
+        for (size_t i = 0; i < count; i++)
+            poseIngest.add(samples[i].quat, samples[i].timestamp, now, linkRttMs);
+        auto state = poseIngest.state(now);
+
+        pose->qRotation = {state.quat.w, state.quat.x, state.quat.y, state.quat.z};
+        for (int i = 0; i < 3; i++) {
+            pose->vecAngularVelocity[i] = state.angularVelocity[i];
+            pose->vecAngularAcceleration[i] = state.angularAcceleration[i];
+        }
+        // negative: SteamVR predicts from now - |offset| to display time
+        pose->poseTimeOffset = state.poseTimeOffsetS;
+
+        latestPoseMtx.lock();
+        latestPoseQuat =
+            Quaternionf(latest.quat[0], latest.quat[1], latest.quat[2], latest.quat[3]);
+        latestPoseId = latest.timestamp;
+        latestPoseMtx.unlock();
+        vr::VRServerDriverHost()->TrackedDevicePoseUpdated(
+            objId, *pose, sizeof(vr::DriverPose_t));
+    }
+    return true;
+}
+
+void PVRStartReceiveData(string ip, vr::DriverPose_t *pose, uint32_t *objId) {
     PVR_DB_I("[PVRStartReceiveData] UDP receive started");
 
+    poseFilter.reset();
+    poseIngest.reset();
     dataRunning = true;
     dataThr = new std::thread([=] {
         try {
@@ -421,27 +1116,13 @@ void PVRStartReceiveData(string ip, vr::DriverPose_t *pose, uint32_t *objId) {
             udp::socket skt(svc, {udp::v4(), PVRProp<uint16_t>({POSE_PORT_KEY})});
 
             uint8_t buf[256];
-            auto quatBuf = reinterpret_cast<float *>(&buf[0]);
-            // auto accBuf = reinterpret_cast<float *>(&buf[4 * 4]);
-            auto tmBuf = reinterpret_cast<long long *>(&buf[4 * 4 + 3 * 4]);
 
             while (dataRunning) {
                 function<void(const asio::error_code &, size_t)> handle = [&](auto, auto pktSz) {
                     // PVR_DB(err.message());
 
-                    if (pktSz > 24) {
-                        // if (isValidOrient(quat))// check if quat is valid
-                        pose->qRotation = {
-                            quatBuf[0], quatBuf[1], quatBuf[2], quatBuf[3]};   // w x y z
-                        pose->poseTimeOffset =
-                            float(Clk::now().time_since_epoch().count() - *tmBuf) /
-                                1'000'000'000.f +
-                            addLatency;   // Clk and tmBuf is in nanoseconds
-                        vr::VRServerDriverHost()->TrackedDevicePoseUpdated(
-                            *objId, *pose, sizeof(vr::DriverPose_t));
-
+                    if (PVRProcessPosePacket(buf, pktSz, pose, *objId))
                         skt.async_receive(buffer(buf), handle);
-                    }
                 };
                 skt.async_receive(buffer(buf), handle);
                 svc.run();
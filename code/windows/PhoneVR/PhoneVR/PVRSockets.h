@@ -9,13 +9,34 @@
 void PVRStartConnectionListener(std::function<void(std::string ip, PVR_MSG devType)> callback);
 void PVRStopConnectionListener();
 
+// projRect: the phone's left eye FOV (PVRMsg::AdditionalData), for the lens mask
 void PVRStartStreamer(std::string ip,
                       uint16_t width,
                       uint16_t height,
-                      std::function<void(std::vector<uint8_t>)> headerCb,
-                      std::function<void()> onErrCb);
-void PVRProcessFrame(uint64_t hdl, Eigen::Quaternionf quat);
+                      const float projRect[4],
+                      std::function<void(SharedBuffer)> headerCb,
+                      std::function<void()> onErrCb,
+                      std::function<bool(SharedBuffer)> frameCb = nullptr);   // multiplexed mode
+// poseId: id of the pose the frame was rendered with, echoed to the phone in the frame header
+void PVRProcessFrame(uint64_t hdl, Eigen::Quaternionf quat, int64_t poseId);
 void PVRStopStreamer();
 
+// the clock video pts are on (us since the streamer started), audio is placed on it too
+int64_t PVRStreamClockUs(Clk::time_point t);
+
+// smoothed RTT of the control connection, used for pose prediction and rate control
+void PVRSetLinkRtt(double srttMs, double rttVarMs);
+
+// the phone's decoder and network report, picks its simulcast tier
+void PVRSetClientStats(const PVRMsg::ClientStats &stats);
+
+// last pose passed to SteamVR and its id (0 before the first one)
+int64_t PVRLatestPose(Eigen::Quaternionf &quat);
+
+// applies a pose packet from the phone, false if it's not one
+bool PVRProcessPosePacket(const uint8_t *data,
+                          size_t size,
+                          vr::DriverPose_t *pose,
+                          uint32_t objId);
 void PVRStartReceiveData(std::string ip, vr::DriverPose_t *pose, uint32_t *objId);
 void PVRStopReceiveData();
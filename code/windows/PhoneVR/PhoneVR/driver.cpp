@@ -4,6 +4,7 @@
 #include <Windows.h>
 #include <set>
 
+#include "PVRAudio.h"
 #include "PVRFileManager.h"
 #include "PVRGraphics.h"
 #include "PVRMath.h"
@@ -31,12 +32,16 @@ class HMD : public ITrackedDeviceServerDriver,
     string devIP;
     uint32_t objId = k_unTrackedDeviceIndexInvalid;
 
-    Quaternionf latestQuat, newFrameQuat;
+    Quaternionf latestQuat, newFrameQuat = Quaternionf::Identity();
+    int64_t newFramePoseId = 0;
 
     Clk::time_point oldTime = Clk::now();
     uint64_t frmCount = 0;
     bool waitForPresent = false;
 
+    bool multiplexed = PVRProp<bool>({MULTIPLEX_KEY});   // declared before talker, used by it
+    bool halfRate = PVRProp<bool>({HALF_RATE_KEY});
+    PVRMsg::AudioConfig audioConfig = PVRAudioConfig();   // packetFrames 0: audio is off
     TCPTalker talker;
     unique_ptr<TimeBomb> addDataBomb;
 
@@ -58,49 +63,49 @@ class HMD : public ITrackedDeviceServerDriver,
     HMD(string ip)
         : talker(
               PVRProp<uint16_t>({CONN_PORT_KEY}),
-              [=](auto msgType, auto data) {
-                  PVR_DB_I("[HMD::talker]: recvd MSG_ID: " + to_string(msgType));
-                  if (msgType == PVR_MSG::DISCONNECT) {
-                      // TODO: send remove device event
-                      PVR_DB_I("[HMD::talker]: phone disconnected, closing server");
-                      terminate();
-                  } else if (msgType == PVR_MSG::ADDITIONAL_DATA) {
-                      PVR_DB_I("[HMD::talker]: addData msg RCV'ed....");
-
-                      // mxaddDataRcvd.lock();
-                      if (addDataRcvd) {
-                          PVR_DB_I("[HMD::talker]: addData is already Recvd and Set...skipping...");
-                          return;
-                      }
-                      // mxaddDataRcvd.unlock();
-                      // auto oldTm = Clk::now();
-                      // while (objId == k_unTrackedDeviceIndexInvalid && Clk::now() - oldTime < 3s)
-                      // // 7s - ensure propCont is set 	sleep_for(10ms);
-
-                      // PVR_DB_I("[HMD::talker]: ADD DATA MSG RCV'ed.. propCont seems to be set or
-                      // timeout"); if (objId == k_unTrackedDeviceIndexInvalid)
-                      {
-                          auto ui16Data = reinterpret_cast<uint16_t *>(&data[0]);
-                          rdrW = ui16Data[0];
-                          rdrH = ui16Data[1];
-                          memcpy(projRect, &data[2 * 2], 4 * 4);
-                          PVR_DB_I("[HMD::talker]: addData: Viewport:  left: " +
-                                   to_string(projRect[0]) + "  top: " + to_string(projRect[1]) +
-                                   "  right: " + to_string(projRect[2]) +
-                                   "  bottom: " + to_string(projRect[3]));
-                          ipd = *reinterpret_cast<float *>(&data[2 * 2 + 4 * 4]);
-
-                          // VRProperties()->SetFloatProperty(propCont, Prop_UserIpdMeters_Float,
-                          // ipd);
-                          PVR_DB_I("[HMD::talker]: IPD: " + to_string(ipd));
-
-                          // mxaddDataRcvd.lock();
-                          addDataRcvd = true;
-                          // mxaddDataRcvd.unlock();
-
-                          // addDataBomb->defuse();
-                      }
-                  }
+              [this,
+               handlers = PVRMsg::Handlers{
+                   [this](const PVRMsg::Message<PVR_MSG::DISCONNECT> &) {
+                       // TODO: send remove device event
+                       PVR_DB_I("[HMD::talker]: phone disconnected, closing server");
+                       terminate();
+                   },
+                   [this](const PVRMsg::Message<PVR_MSG::ADDITIONAL_DATA> &msg) {
+                       PVR_DB_I("[HMD::talker]: addData msg RCV'ed....");
+
+                       if (addDataRcvd) {
+                           PVR_DB_I(
+                               "[HMD::talker]: addData is already Recvd and Set...skipping...");
+                           return;
+                       }
+                       rdrW = msg.data.renderWidth;
+                       rdrH = msg.data.renderHeight;
+                       memcpy(projRect, msg.data.projRect, sizeof(msg.data.projRect));
+                       PVR_DB_I("[HMD::talker]: addData: Viewport:  left: " +
+                                to_string(projRect[0]) + "  top: " + to_string(projRect[1]) +
+                                "  right: " + to_string(projRect[2]) +
+                                "  bottom: " + to_string(projRect[3]));
+                       ipd = msg.data.ipd;
+
+                       // VRProperties()->SetFloatProperty(propCont, Prop_UserIpdMeters_Float,
+                       // ipd);
+                       PVR_DB_I("[HMD::talker]: IPD: " + to_string(ipd));
+
+                       addDataRcvd = true;
+
+                       // addDataBomb->defuse();
+                   },
+                   [this](const PVRMsg::Message<PVR_MSG::POSE_DATA> &msg) {
+                       if (objId != k_unTrackedDeviceIndexInvalid)
+                           PVRProcessPosePacket(msg.data.data(), msg.data.size(), &pose, objId);
+                   },
+                   [](const PVRMsg::Message<PVR_MSG::CLIENT_STATS> &msg) {
+                       PVRSetClientStats(msg.data);
+                   }}](auto msgType, auto data) mutable {
+                  if (!PVRMsg::isFrequent(msgType))
+                      PVR_DB_I("[HMD::talker]: recvd MSG_ID: " + to_string(msgType));
+                  if (!PVRMsg::dispatch(handlers, msgType, data))
+                      PVR_DB_I("[HMD::talker]: malformed message with ID: " + to_string(msgType));
               },
               [=](error_code err) {
                   PVR_DB_I("[HMD::talker]: TCP error: " + err.message());
@@ -124,11 +129,29 @@ class HMD : public ITrackedDeviceServerDriver,
         pose.shouldApplyHeadModel = false;
         pose.deviceIsConnected = true;
 
-        vstreamDT = 1'000'000us / PVRProp<int>({GAME_FPS_KEY});
-
+        vstreamDT = 1'000'000us / PVRStreamFps();
+        if (halfRate)
+            PVR_DB_I("HMD streaming at half rate, " + to_string(PVRStreamFps()) + " fps");
+
+        // the phone reads the mode before PAIR_ACCEPT starts its streams
+        bool multipath = !multiplexed && PVRProp<bool>({MULTIPATH_KEY});
+        bool duplicatePoses = multipath && PVRProp<bool>({DUPLICATE_POSES_KEY});
+        talker.send<PVR_MSG::STREAM_CONFIG>(
+            {multiplexed, halfRate, true, multipath, duplicatePoses});
+        if (audioConfig.packetFrames)
+            talker.send<PVR_MSG::AUDIO_CONFIG>(audioConfig);
         PVR_DB_I("HMD Sending PAIR_ACCEPT TCP msg to " + ip);
         talker.send(PVR_MSG::PAIR_ACCEPT);
 
+        // notices a dead phone long before a write fails
+        talker.startHeartbeat(
+            milliseconds(PVRProp<int>({HEARTBEAT_KEY})),
+            [](double srttMs, double rttVarMs) { PVRSetLinkRtt(srttMs, rttVarMs); },
+            [this] {
+                PVR_DB_I("[HMD::talker]: phone stopped answering heartbeats, closing server");
+                terminate();
+            });
+
         PVRInitDX();
 
         PVR_DB_I("HMD initialized");
@@ -180,8 +203,9 @@ class HMD : public ITrackedDeviceServerDriver,
         // // ??
         VRProperties()->SetBoolProperty(propCont, Prop_ReportsTimeSinceVSync_Bool, false);
         VRProperties()->SetFloatProperty(propCont, Prop_SecondsFromVsyncToPhotons_Float, 0.100f);
+        // at half rate SteamVR paces the app to the frames we stream
         VRProperties()->SetFloatProperty(
-            propCont, Prop_DisplayFrequency_Float, PVRProp<float>({GAME_FPS_KEY}));
+            propCont, Prop_DisplayFrequency_Float, (float) PVRStreamFps());
         VRProperties()->SetUint64Property(
             propCont, Prop_CurrentUniverseId_Uint64, /*P+V+R ascii = */ 0x808682);
         VRProperties()->SetBoolProperty(propCont, Prop_IsOnDesktop_Bool, false);
@@ -241,10 +265,19 @@ class HMD : public ITrackedDeviceServerDriver,
                 devIP,
                 rdrW,
                 rdrH,
-                [=](auto v) { talker.send(PVR_MSG::HEADER_NALS, v); },
-                [=] { terminate(); });
+                projRect,
+                [=](auto v) { talker.send<PVR_MSG::HEADER_NALS>(v); },
+                [=] { terminate(); },
+                multiplexed ? function<bool(SharedBuffer)>(
+                                  [=](auto f) { return talker.send<PVR_MSG::VIDEO_FRAME>(f); })
+                            : nullptr);
+
+            if (!multiplexed)   // otherwise poses come in as POSE_DATA messages
+                PVRStartReceiveData(devIP, &pose, &objId);
 
-            PVRStartReceiveData(devIP, &pose, &objId);
+            // after the streamer, which starts the clock audio positions are on
+            if (audioConfig.packetFrames)
+                PVRStartAudioStreamer(devIP, audioConfig);
 
             PVR_DB_I("[Activating HMD]: HMD activated with id: " + to_string(objectId));
 
@@ -266,6 +299,9 @@ class HMD : public ITrackedDeviceServerDriver,
         PVR_DB_I("Closing data thread");
         PVRStopReceiveData();
 
+        PVR_DB_I("Closing audio thread");
+        PVRStopAudioStreamer();
+
         PVR_DB_I("Closing video thread");
         PVRStopStreamer();
 
@@ -357,15 +393,16 @@ class HMD : public ITrackedDeviceServerDriver,
 
         auto now = Clk::now();
         // if (now - oldTime > vstreamDT) {
-        PVRProcessFrame(backBuffer, newFrameQuat);
+        PVRProcessFrame(backBuffer, newFrameQuat, newFramePoseId);
         oldTime = now;
 
         //}
         while (Clk::now() - oldTime < vstreamDT - 1ms)
             sleep_for(1ms);
 
-        // newFrameQuat = Quaternionf(latestQuat); // poll here the quaternion used in the next
-        // frame VRServerDriverHost()->TrackedDevicePoseUpdated(objId, GetPose(),
+        // the app renders its next frame with the poses it gets after this Present returns
+        newFramePoseId = PVRLatestPose(newFrameQuat);
+        // VRServerDriverHost()->TrackedDevicePoseUpdated(objId, GetPose(),
         // sizeof(DriverPose_t)); waitForPresent = false;
         // VRServerDriverHost()->VsyncEvent(0.0028);
     }